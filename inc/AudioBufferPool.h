@@ -0,0 +1,111 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CODAL_AUDIO_BUFFER_POOL_H
+#define CODAL_AUDIO_BUFFER_POOL_H
+
+#include "ManagedBuffer.h"
+
+#ifndef CONFIG_AUDIO_BUFFER_POOL_SIZE
+#define CONFIG_AUDIO_BUFFER_POOL_SIZE 8
+#endif
+
+namespace codal
+{
+
+/**
+ * A fixed size pool of equally sized ManagedBuffers, recycled once every reference to them outside the pool
+ * has been released. Used by the audio pipeline to avoid heap allocation when generating buffers in interrupt context.
+ *
+ * Requests that cannot be served from the pool (the pool is exhausted, or a different buffer size is requested)
+ * fall back to the heap.
+ */
+class AudioBufferPool
+{
+    BufferData      *buffers[CONFIG_AUDIO_BUFFER_POOL_SIZE];    // Buffers owned by the pool. NULL until first used.
+    int             bufferSize;                                 // The size of each buffer in the pool, in bytes.
+    int             next;                                       // The slot to inspect first on the next allocation.
+
+    uint32_t        hits;                                       // Number of allocations served by recycling a pooled buffer.
+    uint32_t        misses;                                     // Number of allocations that required a heap allocation.
+    int             highWaterMark;                              // The largest number of pooled buffers in use at once.
+
+    public:
+
+    /**
+     * Constructor.
+     * Creates an empty pool. Buffers are allocated on first use, or by calling fill().
+     *
+     * @param bufferSize The size of each buffer in the pool, in bytes.
+     */
+    AudioBufferPool(int bufferSize);
+
+    /**
+     * Destructor.
+     * Releases the pool's reference to each of its buffers.
+     */
+    ~AudioBufferPool();
+
+    /**
+     * Allocates every buffer in the pool that has not yet been allocated.
+     * Should be called from thread context, so that later allocations made from interrupt context do not use the heap.
+     *
+     * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the heap is exhausted.
+     */
+    int fill();
+
+    /**
+     * Provides a buffer of the given size. The buffer returns to the pool when the last reference to it is released.
+     * Safe to call from interrupt context.
+     *
+     * @param size The size of buffer required, in bytes.
+     * @return A buffer of the requested size. Its contents are undefined.
+     */
+    ManagedBuffer allocate(int size);
+
+    /**
+     * Determines the size of the buffers held in this pool.
+     * @return the size of each buffer, in bytes.
+     */
+    int getBufferSize();
+
+    /**
+     * Determines the number of allocations that were served by recycling a pooled buffer.
+     */
+    uint32_t getHits();
+
+    /**
+     * Determines the number of allocations that were served from the heap.
+     */
+    uint32_t getMisses();
+
+    /**
+     * Determines the largest number of pooled buffers that have been in use at the same time.
+     */
+    int getHighWaterMark();
+};
+
+} // namespace codal
+
+#endif
@@ -0,0 +1,190 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CODAL_AUDIO_RENDER_QUEUE_H
+#define CODAL_AUDIO_RENDER_QUEUE_H
+
+#include "CodalConfig.h"
+#include "DataStream.h"
+
+// The maximum number of buffers that may be rendered ahead of playback. Should be a power of two.
+#ifndef CONFIG_AUDIO_RENDER_QUEUE_MAX_DEPTH
+#define CONFIG_AUDIO_RENDER_QUEUE_MAX_DEPTH         8
+#endif
+
+// The default number of buffers rendered ahead of playback.
+#ifndef CONFIG_AUDIO_RENDER_QUEUE_DEPTH
+#define CONFIG_AUDIO_RENDER_QUEUE_DEPTH             4
+#endif
+
+// The interval at which the render fiber tops up the queue, in milliseconds.
+#ifndef CONFIG_AUDIO_RENDER_QUEUE_PERIOD
+#define CONFIG_AUDIO_RENDER_QUEUE_PERIOD            2
+#endif
+
+// Status flags
+#define AUDIO_RENDER_QUEUE_STATUS_STREAMING         0x01    // Connected downstream, and rendering ahead.
+#define AUDIO_RENDER_QUEUE_STATUS_FIBER             0x02    // The render fiber is running.
+#define AUDIO_RENDER_QUEUE_STATUS_PRIMED            0x04    // The queue has been filled, and playback started.
+
+namespace codal
+{
+
+/**
+ * A queue of audio buffers, rendered ahead of playback.
+ *
+ * Placed between an audio source (typically a Mixer2) and an output driver, buffers are pulled from the source
+ * by a dedicated fiber, rather than from the interrupt context of the output driver. The driver's pull() then only
+ * hands over buffers that have already been rendered, so the cost of synthesis no longer has to fit within its
+ * interrupt latency. The depth of the queue trades latency for resilience.
+ *
+ * If the queue is empty when the driver pulls, the last sample rendered is repeated for one buffer, and an
+ * underrun is recorded.
+ */
+class AudioRenderQueue : public DataSource, public DataSink
+{
+    DataSource              &upStream;                                      // The component we render from.
+    DataSink                *downStream;                                    // The component we deliver to.
+    ManagedBuffer           buffers[CONFIG_AUDIO_RENDER_QUEUE_MAX_DEPTH];   // Queue of rendered buffers.
+    ManagedBuffer           silence;                                        // Buffer delivered when the queue is empty.
+    volatile uint32_t       head;                                           // The number of buffers pulled downstream.
+    volatile uint32_t       tail;                                           // The number of buffers rendered.
+    volatile int            pullRequests;                                   // The number of buffers available from upstream.
+    int                     depth;                                          // The number of buffers to render ahead.
+    int                     bytesPerSample;                                 // The size of each sample rendered, in bytes.
+    uint32_t                lastSample;                                     // The last sample delivered downstream.
+    uint32_t                silenceSample;                                  // The sample the silence buffer is filled with.
+    volatile uint8_t        status;                                         // AUDIO_RENDER_QUEUE_STATUS_STREAMING...
+
+    uint32_t                pulls;                                          // The number of buffers pulled downstream.
+    uint32_t                underruns;                                      // The number of times the queue was found empty.
+    int                     lowWaterMark;                                   // The smallest number of buffers found queued by a pull.
+
+    public:
+
+    /**
+     * Constructor.
+     * Rendering starts when this queue is connected to a sink.
+     *
+     * @param source The component to render audio from.
+     * @param depth The number of buffers to render ahead of playback, in the range 1..CONFIG_AUDIO_RENDER_QUEUE_MAX_DEPTH.
+     */
+    AudioRenderQueue(DataSource &source, int depth = CONFIG_AUDIO_RENDER_QUEUE_DEPTH);
+
+    /**
+     * Destructor.
+     * Stops rendering, and waits for the render fiber to exit.
+     */
+    ~AudioRenderQueue();
+
+    /**
+     * Define a downstream component for data stream, and start rendering ahead for it.
+     * Playback is started once the queue has been filled.
+     *
+     * @sink The component that data will be delivered to, when it is availiable
+     */
+    virtual void connect(DataSink &sink) override;
+
+    /**
+     * Stop rendering for our downstream component.
+     */
+    virtual void disconnect() override;
+
+    /**
+     * Determine the data format of the buffers streamed out of this component.
+     */
+    virtual int getFormat() override;
+
+    /**
+     * Provide the next rendered ManagedBuffer to our downstream caller.
+     * Safe to call from interrupt context.
+     */
+    virtual ManagedBuffer pull() override;
+
+    /**
+     * Callback provided when data is ready from our upstream component.
+     */
+    virtual int pullRequest() override;
+
+    /**
+     * Defines the number of buffers rendered ahead of playback. May be changed while streaming.
+     *
+     * @param depth The number of buffers, in the range 1..CONFIG_AUDIO_RENDER_QUEUE_MAX_DEPTH.
+     * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+     */
+    int setDepth(int depth);
+
+    /**
+     * Determines the number of buffers rendered ahead of playback.
+     */
+    int getDepth();
+
+    /**
+     * Determines the number of buffers currently rendered and awaiting playback.
+     */
+    int getOccupancy();
+
+    /**
+     * Discards all buffers rendered but not yet played. If streaming, the last sample played is held
+     * until the queue is refilled.
+     */
+    void flush();
+
+    /**
+     * Determines the smallest number of buffers found awaiting playback when a buffer was pulled, since the
+     * queue was primed or statistics were last reset.
+     */
+    int getLowWaterMark();
+
+    /**
+     * Determines the number of times the queue was found empty when a buffer was pulled.
+     */
+    uint32_t getUnderrunCount();
+
+    /**
+     * Determines the number of buffers pulled since the queue was primed or statistics were last reset.
+     */
+    uint32_t getPullCount();
+
+    /**
+     * Resets the pull count, underrun count and low water mark.
+     */
+    void resetStatistics();
+
+    private:
+
+    /**
+     * Pulls buffers from upstream until the queue is full, or upstream has nothing more to offer.
+     */
+    void render();
+
+    /**
+     * Entry point of the render fiber.
+     */
+    static void renderFiber(void *queue);
+};
+
+} // namespace codal
+
+#endif
@@ -0,0 +1,131 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CODAL_AUDIO_STREAM_SPLITTER_H
+#define CODAL_AUDIO_STREAM_SPLITTER_H
+
+#include "CodalConfig.h"
+#include "DataStream.h"
+
+// The maximum number of consumers that may share one stream.
+#ifndef CONFIG_AUDIO_STREAM_SPLITTER_CHANNELS
+#define CONFIG_AUDIO_STREAM_SPLITTER_CHANNELS       4
+#endif
+
+namespace codal
+{
+
+class AudioStreamSplitter;
+
+/**
+ * One output of an AudioStreamSplitter. Behaves as an independent DataSource for a single consumer.
+ */
+class AudioSplitterChannel : public DataSource
+{
+    AudioStreamSplitter     &parent;                                        // The splitter we deliver from.
+    DataSink                *downStream;                                    // Our consumer, if any.
+    ManagedBuffer           buffer;                                         // The buffer awaiting collection by our consumer.
+
+    friend class AudioStreamSplitter;
+
+    public:
+
+    /**
+     * Constructor.
+     * @param parent The splitter this channel belongs to.
+     */
+    AudioSplitterChannel(AudioStreamSplitter &parent);
+
+    /**
+     * Provide the most recent buffer from the shared stream to our downstream caller, if it has not already been collected.
+     */
+    virtual ManagedBuffer pull() override;
+
+    /**
+     * Define a downstream component for data stream.
+     *
+     * @sink The component that data will be delivered to, when it is availiable
+     */
+    virtual void connect(DataSink &sink) override;
+
+    /**
+     * Stop delivering data to our downstream component.
+     */
+    virtual void disconnect() override;
+
+    /**
+     * Determine the data format of the buffers streamed out of this component.
+     */
+    virtual int getFormat() override;
+};
+
+/**
+ * Shares a single stream between several consumers.
+ *
+ * Most DataSources support only one downstream component, so a second consumer connecting to them silently
+ * disconnects the first. The splitter is instead the only consumer of its source, and each buffer it pulls is
+ * offered to every connected channel. Buffers are shared rather than copied, so consumers must not modify them.
+ */
+class AudioStreamSplitter : public DataSink
+{
+    DataSource              &upStream;                                      // The component we pull from.
+    AudioSplitterChannel    *channels[CONFIG_AUDIO_STREAM_SPLITTER_CHANNELS];  // Our outputs, created on demand.
+
+    public:
+
+    /**
+     * Constructor.
+     * Connects to the given source immediately.
+     *
+     * @param source The component whose stream is to be shared.
+     */
+    AudioStreamSplitter(DataSource &source);
+
+    /**
+     * Destructor.
+     * Disconnects from our source, and deletes all channels.
+     */
+    ~AudioStreamSplitter();
+
+    /**
+     * Creates a new output of the shared stream. The channel is owned by the splitter.
+     * @return the new channel, or NULL if CONFIG_AUDIO_STREAM_SPLITTER_CHANNELS are already in use.
+     */
+    AudioSplitterChannel *createChannel();
+
+    /**
+     * Callback provided when data is ready from our upstream component.
+     * Pulls the buffer once, and offers it to each connected channel.
+     */
+    virtual int pullRequest() override;
+
+    /**
+     * Determine the data format of the shared stream.
+     */
+    int getFormat();
+};
+
+} // namespace codal
+
+#endif
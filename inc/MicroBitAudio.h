@@ -26,11 +26,42 @@ DEALINGS IN THE SOFTWARE.
 #define MICROBIT_AUDIO_H
 
 #include "NRF52PWM.h"
+#include "NRF52ADC.h"
 #include "SoundEmojiSynthesizer.h"
 #include "SoundExpressions.h"
 #include "Mixer2.h"
+#include "AudioBufferPool.h"
+#include "AudioRenderQueue.h"
+#include "AudioStreamSplitter.h"
+#include "MicroBitAudioCapture.h"
 #include "SoundOutputPin.h"
 
+// The number of mixer output buffers rendered ahead of playback from fiber context, or 0 to render directly
+// from the interrupt context of the PWM driver.
+#ifndef CONFIG_MICROBIT_AUDIO_RENDER_AHEAD
+#define CONFIG_MICROBIT_AUDIO_RENDER_AHEAD 0
+#endif
+
+// The output sample rate of the audio pipeline when it is activated, and the highest rate it will negotiate.
+#ifndef CONFIG_MICROBIT_AUDIO_SAMPLE_RATE
+#define CONFIG_MICROBIT_AUDIO_SAMPLE_RATE 44100
+#endif
+
+// Enables negotiation of the lowest output sample rate acceptable to the mixer channels generating audio.
+#ifndef CONFIG_MICROBIT_AUDIO_SAMPLE_RATE_NEGOTIATION
+#define CONFIG_MICROBIT_AUDIO_SAMPLE_RATE_NEGOTIATION 1
+#endif
+
+// The time for which a lower output sample rate must be acceptable before it is adopted, in milliseconds.
+#ifndef CONFIG_MICROBIT_AUDIO_SAMPLE_RATE_HOLD
+#define CONFIG_MICROBIT_AUDIO_SAMPLE_RATE_HOLD 500
+#endif
+
+// The number of sound expressions that can play simultaneously.
+#ifndef CONFIG_MICROBIT_AUDIO_SOUND_EXPRESSION_VOICES
+#define CONFIG_MICROBIT_AUDIO_SOUND_EXPRESSION_VOICES 3
+#endif
+
 namespace codal
 {
     /**
@@ -40,6 +71,7 @@ namespace codal
     {
         public:
         static MicroBitAudio    *instance;      // Primary instance of MicroBitAudio, on demand activated.
+        AudioBufferPool         bufferPool;     // Pool of buffers shared by the audio pipeline, to avoid heap allocation in interrupt context.
         Mixer2                  mixer;          // Multi channel audio mixer
 
         private:
@@ -47,9 +79,18 @@ namespace codal
         bool pinEnabled;                        // State of on auxiliary output pin
         NRF52Pin &pin;                          // Auxiliary pin to route audio to
         NRF52Pin &speaker;                      // Primary pin for onboard speaker
+        NRF52ADC *adc;                          // ADC used to sample the microphone, or NULL if there is no microphone
+        NRF52Pin *microphone;                   // Analogue input from the microphone
+        NRF52Pin *runmic;                       // Power control for the microphone
+        AudioStreamSplitter *microphoneSplitter; // Shares the microphone stream between its consumers, created on demand
+        MicroBitAudioCapture *capture;          // Microphone capture and analysis, created on demand
         SoundEmojiSynthesizer synth;            // Synthesizer used bfor SoundExpressions
         MixerChannel *soundExpressionChannel;   // Mixer channel associated with sound expression audio
         NRF52PWM *pwm;                          // PWM driver used for sound generation (mixer output)
+        AudioRenderQueue *renderQueue;          // Queue of mixer output rendered ahead of playback, if enabled.
+        int renderAhead;                        // The number of buffers to render ahead of playback, or 0 if disabled.
+        int sampleRate;                         // The current output sample rate of the pipeline.
+        uint32_t timeOfLastRateRequirement;     // The last time the current output sample rate was required by an active channel.
 
         public:
         SoundExpressions soundExpressions;      // SoundExpression intepreter
@@ -57,9 +98,16 @@ namespace codal
 
         /**
          * Constructor.
+         * Creates an output only audio pipeline, without microphone capture.
          */
         MicroBitAudio(NRF52Pin &pin, NRF52Pin &speaker);
 
+        /**
+         * Constructor.
+         * Creates an audio pipeline that can also capture from the microphone sampled by the given ADC.
+         */
+        MicroBitAudio(NRF52Pin &pin, NRF52Pin &speaker, NRF52ADC &adc, NRF52Pin &microphone, NRF52Pin &runmic);
+
         /**
          * Destructor.
          */
@@ -117,6 +165,78 @@ namespace codal
          * @return true if enabled, false otherwise.
          */
         bool isPinEnabled();
+
+        /**
+         * Configures render-ahead mode. In this mode, the mixer is pulled from a dedicated fiber into a queue of
+         * buffers, rather than from the interrupt context of the PWM driver, so the cost of synthesis does not
+         * cause glitches in playback. Deeper queues are more robust, at the cost of latency.
+         *
+         * The mode must be chosen before the audio pipeline is activated. Once active, only the depth of the queue may be changed.
+         *
+         * @param depth The number of buffers to render ahead, in the range 1..CONFIG_AUDIO_RENDER_QUEUE_MAX_DEPTH, or 0 to disable render-ahead mode.
+         * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER, or DEVICE_NOT_SUPPORTED if the pipeline is already active in another mode.
+         */
+        int setRenderAhead(int depth);
+
+        /**
+         * Provides the queue used in render-ahead mode, for example to monitor underruns and occupancy.
+         * @return the render queue, or NULL if the pipeline is not active in render-ahead mode.
+         */
+        AudioRenderQueue *getRenderQueue();
+
+        /**
+         * Provides the splitter through which the microphone stream is shared. Consumers of the microphone should
+         * each take a channel from it, rather than connecting to the ADC channel directly, which supports only one.
+         * @return the splitter, or NULL if this pipeline has no microphone.
+         */
+        AudioStreamSplitter *getMicrophoneSplitter();
+
+        /**
+         * Provides the microphone capture pipeline, powering up the microphone on first use.
+         * The microphone is captured at the sample rate the ADC is already configured for.
+         * @return the capture component, through which the microphone level and features may be monitored,
+         * or NULL if this pipeline has no microphone.
+         */
+        MicroBitAudioCapture *getCapture();
+
+        /**
+         * Determine the current output sample rate of the audio pipeline.
+         * @return The sample rate, in samples per second.
+         */
+        int getSampleRate();
+
+        /**
+         * Periodic callback from the idle fiber, used to negotiate the output sample rate of the pipeline.
+         */
+        virtual void idleCallback() override;
+
+        private:
+
+        /**
+         * Constructor used by the public constructors. The ADC and microphone pins are NULL if there is no microphone.
+         */
+        MicroBitAudio(NRF52Pin &pin, NRF52Pin &speaker, NRF52ADC *adc, NRF52Pin *microphone, NRF52Pin *runmic);
+
+        /**
+         * Determines the lowest supported output sample rate that satisfies the given requirement.
+         * @param required The required sample rate, in samples per second.
+         * @return The supported sample rate, or the highest supported rate if none is sufficient.
+         */
+        int selectSampleRate(float required);
+
+        /**
+         * Raises the output sample rate immediately when a mixer channel requires a higher rate.
+         * @param context The MicroBitAudio instance that owns the mixer.
+         * @param sampleRate The sample rate required by the channel, in samples per second.
+         */
+        static void onRateRequired(void *context, float sampleRate);
+
+        /**
+         * Reconfigures the PWM driver and the mixer to output at the given sample rate.
+         * Any audio already rendered ahead at the previous rate is discarded.
+         * @param rate The new sample rate, in samples per second.
+         */
+        void configureSampleRate(int rate);
     };
 }
 
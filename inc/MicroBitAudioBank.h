@@ -0,0 +1,230 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MICROBIT_AUDIO_BANK_H
+#define MICROBIT_AUDIO_BANK_H
+
+#include "CodalConfig.h"
+#include "CodalComponent.h"
+#include "DataStream.h"
+#include "ManagedString.h"
+#include "ManagedBuffer.h"
+#include <stddef.h>
+
+#define MICROBIT_AUDIO_BANK_MAGIC                   0x4B4E4241      // "ABNK"
+#define MICROBIT_AUDIO_BANK_VERSION                 1
+#define MICROBIT_AUDIO_BANK_NAME_LENGTH             12
+
+// Layout of each block of samples, which matches BufferData in codal-core.
+#define MICROBIT_AUDIO_BANK_BLOCK_REFCOUNT_OFFSET   0       // uint16_t reference count, always 0xffff (read-only).
+#define MICROBIT_AUDIO_BANK_BLOCK_TAG_OFFSET        2       // uint16_t tag, always 0.
+#define MICROBIT_AUDIO_BANK_BLOCK_LENGTH_OFFSET     4       // uint16_t length of the samples, in bytes.
+#define MICROBIT_AUDIO_BANK_BLOCK_SAMPLES_OFFSET    6       // The samples, padded with zeroes to a word boundary.
+#define MICROBIT_AUDIO_BANK_BLOCK_REFCOUNT          0xffff
+
+// Status flags
+#define MICROBIT_AUDIO_BANK_STATUS_STREAMING        0x02
+
+#define DEVICE_ID_MICROBIT_AUDIO_BANK               3022
+
+// Events
+#define MICROBIT_AUDIO_BANK_EVT_DONE                1       // Raised when the whole sound has been delivered downstream.
+
+namespace codal
+{
+
+/**
+ * Describes a single sound held in a MicroBitAudioBank.
+ */
+typedef struct
+{
+    char        name[MICROBIT_AUDIO_BANK_NAME_LENGTH];      // The name of the sound, padded with NUL characters.
+    uint32_t    offset;                                     // The offset of the first block of the sound, from the start of the bank.
+    uint32_t    sampleRate;                                 // The sample rate of the sound, in samples per second.
+    uint16_t    format;                                     // The DATASTREAM_FORMAT of the samples.
+    uint16_t    blockCount;                                 // The number of blocks holding the sound.
+} MicroBitAudioBankEntry;
+
+/**
+ * Header at the start of a MicroBitAudioBank, immediately followed by its MicroBitAudioBankEntry table.
+ */
+typedef struct
+{
+    uint32_t    magic;                                      // MICROBIT_AUDIO_BANK_MAGIC.
+    uint16_t    version;                                    // MICROBIT_AUDIO_BANK_VERSION.
+    uint16_t    count;                                      // The number of entries in the bank.
+    uint32_t    length;                                     // The total length of the bank, in bytes.
+} MicroBitAudioBankHeader;
+
+static_assert(sizeof(MicroBitAudioBankEntry) == 24, "MicroBitAudioBankEntry layout");
+static_assert(sizeof(MicroBitAudioBankHeader) == 12, "MicroBitAudioBankHeader layout");
+
+// BufferData derives from RefCounted, so is not standard layout, but GCC lays it out as a plain struct.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winvalid-offsetof"
+static_assert(sizeof(BufferData) == MICROBIT_AUDIO_BANK_BLOCK_SAMPLES_OFFSET, "BufferData layout");
+static_assert(offsetof(BufferData, refCount) == MICROBIT_AUDIO_BANK_BLOCK_REFCOUNT_OFFSET, "BufferData layout");
+static_assert(offsetof(BufferData, tag) == MICROBIT_AUDIO_BANK_BLOCK_TAG_OFFSET, "BufferData layout");
+static_assert(offsetof(BufferData, length) == MICROBIT_AUDIO_BANK_BLOCK_LENGTH_OFFSET, "BufferData layout");
+static_assert(offsetof(BufferData, payload) == MICROBIT_AUDIO_BANK_BLOCK_SAMPLES_OFFSET, "BufferData layout");
+#pragma GCC diagnostic pop
+
+/**
+ * A read-only collection of sounds, held in flash memory.
+ *
+ * A bank is a word aligned, little endian image, either linked into the program as a const array or programmed
+ * into a reserved region of flash. It starts with a 12 byte MicroBitAudioBankHeader and a table of 24 byte entries.
+ * The samples of each entry are held in a sequence of word aligned blocks, each laid out as a read-only BufferData:
+ *
+ *   offset 0: uint16_t reference count, 0xffff to mark the block as read-only.
+ *   offset 2: uint16_t tag, 0.
+ *   offset 4: uint16_t length of the samples, in bytes.
+ *   offset 6: the samples, followed by zero padding to the next word boundary.
+ *
+ * Blocks can therefore be handed downstream as ManagedBuffers that refer directly to flash, without copying them
+ * into RAM. The assertions below ensure BufferData keeps this layout. Images can be built from WAVE files on the
+ * host, with the tool in tests/tools.
+ */
+class MicroBitAudioBank
+{
+    const MicroBitAudioBankHeader   *header;                // The bank, or NULL if it is not valid.
+
+    public:
+
+    /**
+     * Constructor.
+     * Validates the bank at the given address.
+     *
+     * @param bank The address of the bank in memory.
+     */
+    MicroBitAudioBank(const void *bank);
+
+    /**
+     * Determines if the bank is well formed.
+     */
+    bool isValid();
+
+    /**
+     * Determines the number of sounds in the bank.
+     */
+    int getCount();
+
+    /**
+     * Finds a sound by name.
+     *
+     * @param name The name of the sound.
+     * @return The index of the sound, or DEVICE_INVALID_PARAMETER if there is no sound with the given name.
+     */
+    int find(ManagedString name);
+
+    /**
+     * Retrieves the description of a sound.
+     *
+     * @param index The index of the sound.
+     * @return The entry describing the sound, or NULL if the index is not valid.
+     */
+    const MicroBitAudioBankEntry *getEntry(int index);
+
+    /**
+     * Determines the address of the first block of a sound.
+     *
+     * @param index The index of the sound.
+     * @return The address of the first block, or NULL if the index is not valid.
+     */
+    const uint8_t *getFirstBlock(int index);
+
+    /**
+     * Determines the address of the block following the given block.
+     */
+    static const uint8_t *getNextBlock(const uint8_t *block);
+};
+
+/**
+ * A DataSource that plays a sound from a MicroBitAudioBank, such as into a channel of a Mixer2.
+ * Each buffer delivered downstream refers directly to a block of the bank, so playback requires no RAM for samples.
+ */
+class MicroBitAudioBankSource : public DataSource, public CodalComponent
+{
+    MicroBitAudioBank       &bank;                          // The bank holding the sound.
+    DataSink                *downStream;                    // Our downstream component.
+    int                     index;                          // The index of the sound within the bank.
+    const MicroBitAudioBankEntry *entry;                    // The sound being played, or NULL if it is not valid.
+    const uint8_t           *block;                         // The next block to deliver downstream.
+    int                     blocksRemaining;                // The number of blocks yet to be delivered downstream.
+
+    public:
+
+    /**
+     * Constructor.
+     * Streaming starts when this source is connected to a sink.
+     *
+     * @param bank The bank holding the sound.
+     * @param index The index of the sound to play.
+     * @param id The id to use for the message bus when transmitting events.
+     */
+    MicroBitAudioBankSource(MicroBitAudioBank &bank, int index, uint16_t id = DEVICE_ID_MICROBIT_AUDIO_BANK);
+
+    /**
+     * Determines if the sound exists in the bank.
+     */
+    bool isValid();
+
+    /**
+     * Define a downstream component for data stream, and start streaming to it.
+     *
+     * @sink The component that data will be delivered to, when it is availiable
+     */
+    virtual void connect(DataSink &sink) override;
+
+    /**
+     * Stop streaming to our downstream component.
+     */
+    virtual void disconnect() override;
+
+    /**
+     * Determine the data format of the buffers streamed out of this component.
+     */
+    virtual int getFormat() override;
+
+    /**
+     * Provide the next available ManagedBuffer to our downstream caller, if available.
+     */
+    virtual ManagedBuffer pull() override;
+
+    /**
+     * Determine the sample rate of the sound being played.
+     * @return the sample rate, in Hz.
+     */
+    int getSampleRate();
+
+    /**
+     * Restarts streaming from the start of the sound.
+     * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the sound is not valid.
+     */
+    int rewind();
+};
+
+} // namespace codal
+
+#endif
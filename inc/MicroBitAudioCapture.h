@@ -0,0 +1,215 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MICROBIT_AUDIO_CAPTURE_H
+#define MICROBIT_AUDIO_CAPTURE_H
+
+#include "CodalConfig.h"
+#include "CodalComponent.h"
+#include "DataStream.h"
+
+// The number of captured buffers queued for our downstream component.
+#ifndef CONFIG_AUDIO_CAPTURE_QUEUE_SIZE
+#define CONFIG_AUDIO_CAPTURE_QUEUE_SIZE             4
+#endif
+
+// The number of samples analysed by the band energy extractor. Must be a power of two.
+#define MICROBIT_AUDIO_CAPTURE_FFT_BITS             6
+#define MICROBIT_AUDIO_CAPTURE_FFT_SIZE             (1 << MICROBIT_AUDIO_CAPTURE_FFT_BITS)
+
+// The number of octave bands reported by the band energy extractor. Band n covers FFT bins 2^n to 2^(n+1) - 1.
+#define MICROBIT_AUDIO_CAPTURE_BANDS                (MICROBIT_AUDIO_CAPTURE_FFT_BITS - 1)
+
+// Status flags
+#define MICROBIT_AUDIO_CAPTURE_STATUS_LOUD          0x01
+#define MICROBIT_AUDIO_CAPTURE_STATUS_ZCR_HIGH      0x02
+
+#define DEVICE_ID_MICROBIT_AUDIO_CAPTURE            3021
+
+// Events
+#define MICROBIT_AUDIO_CAPTURE_EVT_LOUD             1       // The RMS level rose above the loud threshold.
+#define MICROBIT_AUDIO_CAPTURE_EVT_QUIET            2       // The RMS level fell below the quiet threshold.
+#define MICROBIT_AUDIO_CAPTURE_EVT_ZCR_HIGH         3       // The zero crossing rate rose above its threshold.
+#define MICROBIT_AUDIO_CAPTURE_EVT_ZCR_LOW          4       // The zero crossing rate fell back below its threshold.
+#define MICROBIT_AUDIO_CAPTURE_EVT_BAND             16      // The level of band n rose above its threshold (raised with value MICROBIT_AUDIO_CAPTURE_EVT_BAND + n).
+
+namespace codal
+{
+
+/**
+ * Captures a stream of audio samples, such as from the microphone channel of the ADC, and analyses it one buffer
+ * at a time.
+ *
+ * Each buffer is measured for RMS level, zero crossing rate, and the level of a small number of octave bands
+ * (using a fixed point FFT). Events are raised only when these features cross their configured thresholds, so
+ * applications need not process individual samples. Captured buffers are also queued in a lock free ring for
+ * any downstream component, such as a recorder or an audio effect.
+ *
+ * Buffers are captured in the context in which the upstream component delivers data, which is typically an
+ * interrupt. Analysis is deferred to idleCallback(), which analyses only the most recent buffer captured.
+ */
+class MicroBitAudioCapture : public DataSink, public DataSource, public CodalComponent
+{
+    DataSource              &upStream;                                          // The component we capture from.
+    DataSink                *downStream;                                        // Our downstream component, if any.
+    ManagedBuffer           buffers[CONFIG_AUDIO_CAPTURE_QUEUE_SIZE];           // Queue of captured buffers.
+    volatile uint32_t       head;                                               // The number of buffers pulled downstream.
+    volatile uint32_t       tail;                                               // The number of buffers captured.
+    uint32_t                overruns;                                           // The number of buffers dropped because the queue was full.
+    ManagedBuffer           pending;                                            // The most recent buffer captured, awaiting analysis.
+    int                     sampleRate;                                         // The sample rate of the captured audio, in samples per second.
+
+    int                     level;                                              // RMS level of the last buffer, in sample units.
+    int                     zeroCrossingRate;                                   // Zero crossing rate of the last buffer, in crossings per second.
+    uint16_t                bandLevel[MICROBIT_AUDIO_CAPTURE_BANDS];            // RMS level of each octave band of the last buffer, in sample units.
+
+    int                     loudThreshold;                                      // Level above which MICROBIT_AUDIO_CAPTURE_EVT_LOUD is raised.
+    int                     quietThreshold;                                     // Level below which MICROBIT_AUDIO_CAPTURE_EVT_QUIET is raised.
+    int                     zeroCrossingThreshold;                              // Rate above which MICROBIT_AUDIO_CAPTURE_EVT_ZCR_HIGH is raised, or 0 if disabled.
+    uint16_t                bandThreshold[MICROBIT_AUDIO_CAPTURE_BANDS];        // Level above which each band event is raised, or 0 if disabled.
+    uint32_t                bandActive;                                         // Bitmask of bands currently above their threshold.
+
+    int16_t                 sine[MICROBIT_AUDIO_CAPTURE_FFT_SIZE];              // Q15 sine table covering one full cycle.
+    int16_t                 window[MICROBIT_AUDIO_CAPTURE_FFT_SIZE];            // Q15 Hann window.
+    int16_t                 re[MICROBIT_AUDIO_CAPTURE_FFT_SIZE];                // FFT working buffer (real part).
+    int16_t                 im[MICROBIT_AUDIO_CAPTURE_FFT_SIZE];                // FFT working buffer (imaginary part).
+
+    public:
+
+    /**
+     * Constructor.
+     * Connects to the given source, and starts capturing immediately.
+     *
+     * @param source The component to capture audio from.
+     * @param sampleRate The sample rate of the source, in samples per second.
+     * @param id The id to use for the message bus when transmitting events.
+     */
+    MicroBitAudioCapture(DataSource &source, int sampleRate, uint16_t id = DEVICE_ID_MICROBIT_AUDIO_CAPTURE);
+
+    /**
+     * Callback provided when data is ready from our upstream component.
+     * Captures the next buffer. This may be called from interrupt context, so analysis is deferred to idleCallback().
+     */
+    virtual int pullRequest() override;
+
+    /**
+     * Periodic callback from the idle fiber. Analyses the most recently captured buffer, if it has not been analysed
+     * already, and raises any events due. Buffers captured while an earlier one awaits analysis replace it.
+     */
+    virtual void idleCallback() override;
+
+    /**
+     * Provide the next captured ManagedBuffer to our downstream caller, if available.
+     */
+    virtual ManagedBuffer pull() override;
+
+    /**
+     * Define a downstream component for data stream.
+     *
+     * @sink The component that data will be delivered to, when it is availiable
+     */
+    virtual void connect(DataSink &sink) override;
+
+    /**
+     * Stop delivering data to our downstream component.
+     */
+    virtual void disconnect() override;
+
+    /**
+     * Determine the data format of the buffers streamed out of this component.
+     */
+    virtual int getFormat() override;
+
+    /**
+     * Determines the RMS level of the most recently captured buffer, after removal of any DC offset.
+     * @return the level, in sample units.
+     */
+    int getLevel();
+
+    /**
+     * Determines the zero crossing rate of the most recently captured buffer.
+     * This is approximately twice the dominant frequency of a tonal sound, and high for noisy sounds.
+     * @return the rate, in zero crossings per second.
+     */
+    int getZeroCrossingRate();
+
+    /**
+     * Determines the RMS level of one octave band of the most recently captured buffer.
+     * Band n covers frequencies from (2^n * sampleRate / MICROBIT_AUDIO_CAPTURE_FFT_SIZE) up to twice that value.
+     *
+     * @param band The band, in the range 0..MICROBIT_AUDIO_CAPTURE_BANDS-1.
+     * @return the level in sample units, or DEVICE_INVALID_PARAMETER.
+     */
+    int getBandLevel(int band);
+
+    /**
+     * Defines the levels at which MICROBIT_AUDIO_CAPTURE_EVT_LOUD and MICROBIT_AUDIO_CAPTURE_EVT_QUIET are raised.
+     *
+     * @param quiet The level below which a loud sound is deemed to have ended.
+     * @param loud The level above which a sound is deemed to be loud.
+     * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+     */
+    int setLevelThresholds(int quiet, int loud);
+
+    /**
+     * Defines the zero crossing rate above which MICROBIT_AUDIO_CAPTURE_EVT_ZCR_HIGH is raised.
+     * MICROBIT_AUDIO_CAPTURE_EVT_ZCR_LOW is raised when the rate falls back below three quarters of this value.
+     *
+     * @param rate The threshold, in zero crossings per second, or 0 to disable these events.
+     * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+     */
+    int setZeroCrossingThreshold(int rate);
+
+    /**
+     * Defines the level above which the event for a given octave band is raised.
+     *
+     * @param band The band, in the range 0..MICROBIT_AUDIO_CAPTURE_BANDS-1.
+     * @param level The threshold in sample units, or 0 to disable events for this band.
+     * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+     */
+    int setBandThreshold(int band, int level);
+
+    /**
+     * Determines the number of captured buffers dropped because our downstream component did not pull them in time.
+     */
+    uint32_t getOverrunCount();
+
+    private:
+
+    /**
+     * Measures the level, zero crossing rate and band levels of a buffer, and raises any events due.
+     * @param buffer The buffer to analyse.
+     * @param format The format of the samples in the buffer.
+     */
+    void analyse(ManagedBuffer &buffer, int format);
+
+    /**
+     * Measures the level of each octave band of the first MICROBIT_AUDIO_CAPTURE_FFT_SIZE samples in the working buffer.
+     */
+    void analyseBands();
+};
+
+} // namespace codal
+
+#endif
@@ -0,0 +1,174 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef MICROBIT_AUDIO_FILE_SOURCE_H
+#define MICROBIT_AUDIO_FILE_SOURCE_H
+
+#include "CodalConfig.h"
+#include "CodalComponent.h"
+#include "DataStream.h"
+#include "MicroBitFile.h"
+
+// The size of each block of PCM audio read ahead from the file, in bytes.
+#ifndef CONFIG_AUDIO_FILE_BLOCK_SIZE
+#define CONFIG_AUDIO_FILE_BLOCK_SIZE                512
+#endif
+
+// The number of blocks read ahead from the file.
+#ifndef CONFIG_AUDIO_FILE_READ_AHEAD
+#define CONFIG_AUDIO_FILE_READ_AHEAD                4
+#endif
+
+// Status flags
+#define MICROBIT_AUDIO_FILE_STATUS_VALID            0x01
+#define MICROBIT_AUDIO_FILE_STATUS_STREAMING        0x02
+
+// Supported WAVE encodings
+#define MICROBIT_AUDIO_FILE_ENCODING_PCM            0x0001
+#define MICROBIT_AUDIO_FILE_ENCODING_IMA_ADPCM      0x0011
+
+#define DEVICE_ID_MICROBIT_AUDIO_FILE               3020
+
+// Events
+#define MICROBIT_AUDIO_FILE_EVT_DONE                1       // Raised when the whole file has been delivered downstream.
+
+namespace codal
+{
+
+/**
+ * A DataSource that streams audio stored in a WAVE file on the MicroBitFileSystem, such as into a channel of a Mixer2.
+ *
+ * Mono 8 bit and 16 bit PCM, and mono IMA ADPCM encodings are supported. Audio is read ahead of playback in small
+ * blocks from fiber context, so the whole file is never held in RAM and no file access takes place in the interrupt
+ * context of the audio pipeline. ADPCM is decoded to 16 bit signed samples as each block is read.
+ */
+class MicroBitAudioFileSource : public DataSource, public CodalComponent
+{
+    MicroBitFile            file;                                       // The file being streamed.
+    DataSink                *downStream;                                // Our downstream component.
+    ManagedBuffer           blocks[CONFIG_AUDIO_FILE_READ_AHEAD];       // Queue of blocks read ahead of playback.
+    volatile uint32_t       head;                                       // The number of blocks pulled downstream.
+    volatile uint32_t       tail;                                       // The number of blocks read from the file.
+
+    int                     encoding;                                   // The WAVE encoding of the file.
+    int                     format;                                     // The DATASTREAM_FORMAT of the samples we output.
+    int                     sampleRate;                                 // The sample rate of the file, in samples per second.
+    int                     blockAlign;                                 // The size of an encoded block, in bytes.
+    int                     dataStart;                                  // The offset of the first sample in the file.
+    int                     dataLength;                                 // The length of the sample data in the file, in bytes.
+    int                     dataPosition;                               // The offset of the next sample to read, relative to dataStart.
+
+    uint32_t                underruns;                                  // The number of times the read ahead queue was found empty during playback.
+
+    public:
+
+    /**
+     * Constructor.
+     * Opens the given file and reads its WAVE header. Streaming starts when this source is connected to a sink.
+     *
+     * @param filename The name of the file to stream.
+     * @param id The id to use for the message bus when transmitting events.
+     */
+    MicroBitAudioFileSource(ManagedString filename, uint16_t id = DEVICE_ID_MICROBIT_AUDIO_FILE);
+
+    /**
+     * Destructor.
+     */
+    ~MicroBitAudioFileSource();
+
+    /**
+     * Determines if the file was opened successfully, and holds audio in a supported encoding.
+     */
+    bool isValid();
+
+    /**
+     * Define a downstream component for data stream, and start streaming to it.
+     *
+     * @sink The component that data will be delivered to, when it is availiable
+     */
+    virtual void connect(DataSink &sink) override;
+
+    /**
+     * Stop streaming to our downstream component.
+     */
+    virtual void disconnect() override;
+
+    /**
+     * Determine the data format of the buffers streamed out of this component.
+     */
+    virtual int getFormat() override;
+
+    /**
+     * Provide the next available ManagedBuffer to our downstream caller, if available.
+     */
+    virtual ManagedBuffer pull() override;
+
+    /**
+     * Determine the sample rate of the file being streamed.
+     * @return the sample rate, in Hz.
+     */
+    int getSampleRate();
+
+    /**
+     * Restarts streaming from the start of the file.
+     * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the file is not valid.
+     */
+    int rewind();
+
+    /**
+     * Determines the number of times playback found no audio available, because the file could not be read quickly enough.
+     */
+    uint32_t getUnderrunCount();
+
+    /**
+     * Reads ahead from the file, until the queue of blocks is full or the end of the file has been reached.
+     * Called periodically from the idle fiber.
+     */
+    virtual void idleCallback() override;
+
+    private:
+
+    /**
+     * Reads the RIFF header of the file, locating the format and data chunks.
+     * @return DEVICE_OK on success, or DEVICE_NOT_SUPPORTED if the file does not hold audio in a supported encoding.
+     */
+    int readHeader();
+
+    /**
+     * Reads the next block of samples from the file.
+     * @return A buffer of samples in our output format, or an empty buffer at the end of the file.
+     */
+    ManagedBuffer readBlock();
+
+    /**
+     * Reads and decodes the next IMA ADPCM encoded block from the file.
+     * @return A buffer of 16 bit signed samples, or an empty buffer at the end of the file.
+     */
+    ManagedBuffer readAdpcmBlock();
+};
+
+} // namespace codal
+
+#endif
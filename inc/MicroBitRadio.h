@@ -32,11 +32,16 @@ namespace codal
     struct FrameBuffer;
 }
 
+extern "C" void RADIO_IRQHandler(void);
+
 #include "CodalConfig.h"
 #include "codal-core/inc/types/Event.h"
 #include "PacketBuffer.h"
 #include "MicroBitRadioDatagram.h"
 #include "MicroBitRadioEvent.h"
+#include "MicroBitRadioFragment.h"
+#include "MicroBitRadioUnicast.h"
+#include "MicroBitRadioFlood.h"
 
 /**
  * Provides a simple broadcast radio abstraction, built upon the raw nrf51822 RADIO module.
@@ -64,6 +69,11 @@ namespace codal
 // Status Flags
 #define MICROBIT_RADIO_STATUS_INITIALISED       0x0001
 
+// Transceiver states
+#define MICROBIT_RADIO_STATE_RECEIVING          0       // Listening for packets.
+#define MICROBIT_RADIO_STATE_DISABLING          1       // Turning off the receiver, before transmitting queued packets.
+#define MICROBIT_RADIO_STATE_TRANSMITTING       2       // Transmitting the packet at the tail of the transmit queue.
+
 // Default configuration values
 #define MICROBIT_RADIO_BASE_ADDRESS             0x75626974
 #define MICROBIT_RADIO_DEFAULT_GROUP            0
@@ -74,12 +84,30 @@ namespace codal
 #define MICROBIT_RADIO_MAXIMUM_RX_BUFFERS       4
 #define MICROBIT_RADIO_POWER_LEVELS             10
 
+// The number of received frames that can be held awaiting processing, in addition to the frame being received.
+#ifndef MICROBIT_RADIO_RX_RING_SIZE
+#define MICROBIT_RADIO_RX_RING_SIZE             8
+#endif
+
+// The number of packets that can be queued for transmission.
+#ifndef MICROBIT_RADIO_TX_QUEUE_SIZE
+#define MICROBIT_RADIO_TX_QUEUE_SIZE            4
+#endif
+
 // Known Protocol Numbers
 #define MICROBIT_RADIO_PROTOCOL_DATAGRAM        1       // A simple, single frame datagram. a little like UDP but with smaller packets. :-)
 #define MICROBIT_RADIO_PROTOCOL_EVENTBUS        2       // Transparent propogation of events from one micro:bit to another.
+#define MICROBIT_RADIO_PROTOCOL_FRAGMENT        3       // Messages larger than a single frame, sent as a sequence of fragments.
+#define MICROBIT_RADIO_PROTOCOL_UNICAST         4       // Addressed packets, acknowledged and retransmitted until delivered.
+#define MICROBIT_RADIO_PROTOCOL_FLOOD           5       // Multi-hop broadcast, relayed by every device that hears it.
 
 // Events
 #define MICROBIT_RADIO_EVT_DATAGRAM             1       // Event to signal that a new datagram has been received.
+#define MICROBIT_RADIO_EVT_TX_DONE              2       // Event to signal that a queued packet has been transmitted.
+#define MICROBIT_RADIO_EVT_FRAGMENT             3       // Event to signal that a fragmented message has been reassembled.
+#define MICROBIT_RADIO_EVT_UNICAST              4       // Event to signal that a new unicast packet has been received.
+#define MICROBIT_RADIO_EVT_UNICAST_TX           5       // Event to signal that a unicast packet has been acknowledged or abandoned.
+#define MICROBIT_RADIO_EVT_FLOOD                6       // Event to signal that a new flood has been received.
 
 namespace codal
 {
@@ -99,14 +127,30 @@ namespace codal
     class MicroBitRadio : CodalComponent
     {
         uint8_t                 group;      // The radio group to which this micro:bit belongs.
-        uint8_t                 queueDepth; // The number of packets in the receiver queue.
         int                     rssi;
-        FrameBuffer             *rxQueue;   // A linear list of incoming packets, queued awaiting processing.
-        FrameBuffer             *rxBuf;     // A pointer to the buffer being actively used by the RADIO hardware.
+        volatile uint16_t       rxHead;     // The ring slot being actively used by the RADIO hardware. Written only by the ISR.
+        volatile uint16_t       rxTail;     // The ring slot holding the oldest packet awaiting processing. Written only by recv().
+        uint32_t                rxDropped;  // The number of packets dropped because the receive ring was full.
+        uint32_t                rxCrcErrors;// The number of packets dropped because they failed their CRC check.
+        FrameBuffer             rxRing[MICROBIT_RADIO_RX_RING_SIZE + 1];   // Incoming packets, queued awaiting processing.
+        volatile uint8_t        state;      // The state of the transceiver (MICROBIT_RADIO_STATE_*). Written only by the ISR once enabled.
+        volatile uint16_t       txHead;     // The ring slot to hold the next packet queued for transmission.
+        volatile uint16_t       txTail;     // The ring slot holding the packet being transmitted. Written only by the ISR, or by disable() with the ISR stopped.
+        uint32_t                txQueued;   // The number of packets queued for transmission.
+        volatile uint32_t       txCompleted;// The number of packets transmitted, or discarded when the radio was disabled.
+        uint32_t                txAbortedFrom;  // Packets queued after this count, up to txAbortedTo, were discarded by disable().
+        uint32_t                txAbortedTo;
+        FrameBuffer             txRing[MICROBIT_RADIO_TX_QUEUE_SIZE + 1];  // Outgoing packets, queued awaiting transmission.
+
+        friend void ::RADIO_IRQHandler(void);
+        friend class MicroBitRadioFlood;    // Stamps and queues a flood atomically, once the transmit queue is empty.
 
         public:
         MicroBitRadioDatagram   datagram;   // A simple datagram service.
         MicroBitRadioEvent      event;      // A simple event handling service.
+        MicroBitRadioFragment   fragment;   // Messages larger than a single frame.
+        MicroBitRadioUnicast    unicast;    // Reliable, addressed delivery.
+        MicroBitRadioFlood      flood;      // Multi-hop broadcast and network time.
         static MicroBitRadio    *instance;  // A singleton reference, used purely by the interrupt service routine.
 
         /**
@@ -149,8 +193,8 @@ namespace codal
         /**
          * Attempt to queue a buffer received by the radio hardware, if sufficient space is available.
          *
-         * @return MICROBIT_OK on success, or MICROBIT_NO_RESOURCES if a replacement receiver buffer
-         *         could not be allocated (either by policy or memory exhaustion).
+         * @return MICROBIT_OK on success, or MICROBIT_NO_RESOURCES if the receive buffer is full. In this case the
+         *         packet is dropped, and the radio hardware receives the next packet into the same buffer.
          */
         int queueRxBuf();
 
@@ -183,6 +227,7 @@ namespace codal
 
         /**
          * Disables the radio for use as a multipoint sender/receiver.
+         * Any packets still queued for transmission are discarded, and a pending send() returns MICROBIT_CANCELLED.
          *
          * @return MICROBIT_OK on success, MICROBIT_NOT_SUPPORTED if the BLE stack is running.
          */
@@ -222,15 +267,83 @@ namespace codal
          */
         FrameBuffer* recv();
 
+        /**
+         * Determines the number of packets dropped because the receive buffer was full.
+         *
+         * @return The number of packets dropped since the radio was created.
+         */
+        uint32_t getDroppedCount();
+
+        /**
+         * Determines the number of packets dropped because they were corrupted in transit.
+         *
+         * @return The number of packets that failed their CRC check since the radio was created.
+         */
+        uint32_t getCrcErrorCount();
+
+        /**
+         * Determines the number of packets queued for transmission, including any being transmitted.
+         *
+         * @return The number of packets awaiting transmission.
+         */
+        int getTxQueueLength();
+
         /**
          * Transmits the given buffer onto the broadcast radio.
          * The call will wait until the transmission of the packet has completed before returning.
+         * The calling fiber is descheduled whilst waiting, rather than occupying the processor.
          *
          * @param data The packet contents to transmit.
          *
-         * @return MICROBIT_OK on success, or MICROBIT_NOT_SUPPORTED if the BLE stack is running.
+         * The radio is enabled on demand, if necessary.
+         *
+         * @return MICROBIT_OK on success, MICROBIT_INVALID_PARAMETER if the packet is too long,
+         *         MICROBIT_CANCELLED if the radio was disabled before the packet was sent,
+         *         or MICROBIT_NOT_SUPPORTED if the BLE stack is running.
          */
         int send(FrameBuffer *buffer);
+
+        /**
+         * Queues the given buffer for transmission onto the broadcast radio, and returns immediately.
+         * The packet is copied, so the buffer may be reused as soon as this call returns. Queued packets are
+         * transmitted in order from the RADIO interrupt, and a MICROBIT_RADIO_EVT_TX_DONE event is raised as
+         * each one completes. May be called from interrupt context, so unlike send(), the radio is not enabled on demand.
+         *
+         * @param data The packet contents to transmit.
+         *
+         * @return MICROBIT_OK on success, MICROBIT_INVALID_PARAMETER if the packet is too long,
+         *         MICROBIT_NO_RESOURCES if the transmit queue is full, DEVICE_INVALID_STATE if the radio is not enabled,
+         *         or MICROBIT_NOT_SUPPORTED if the BLE stack is running.
+         */
+        int sendAsync(FrameBuffer *buffer);
+
+        private:
+
+        /**
+         * Queues the given buffer for transmission.
+         *
+         * @param buffer The packet contents to transmit.
+         * @param ticket Set to the value txCompleted will reach once the packet has been transmitted.
+         *
+         * @return MICROBIT_OK on success, or an error code as per sendAsync().
+         */
+        int queueTxBuf(FrameBuffer *buffer, uint32_t &ticket);
+
+        /**
+         * Waits until txCompleted reaches the given value.
+         *
+         * @param ticket The value to wait for.
+         */
+        void waitForTransmission(uint32_t ticket);
+
+        /**
+         * Waits until the given packet has been transmitted, or discarded by disable().
+         *
+         * @param ticket The ticket set by queueTxBuf() for the packet.
+         *
+         * @return DEVICE_OK if the packet was transmitted, or DEVICE_CANCELLED if the radio was disabled before it was sent.
+         */
+        int waitForPacket(uint32_t ticket);
     };
 }
 
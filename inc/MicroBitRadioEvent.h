@@ -48,6 +48,7 @@ namespace codal
     {
         bool            suppressForwarding;     // A private flag used to prevent event forwarding loops.
         MicroBitRadio   &radio;                 // A reference to the underlying radio module to use.
+        uint32_t        dropped;                // The number of events that could not be transmitted.
 
         public:
 
@@ -138,6 +139,14 @@ namespace codal
          * a radio packet and transmitted to any other micro:bits in the same group.
          */
         void eventReceived(Event e);
+
+        /**
+         * Determines the number of events that could not be forwarded onto the radio. Events raised from interrupt
+         * context cannot wait for the radio, so are dropped if the transmit queue is full or the radio is not enabled.
+         *
+         * @return The number of events dropped since this instance was created.
+         */
+        uint32_t getDroppedCount();
     };
 }
 #endif
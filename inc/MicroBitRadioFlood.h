@@ -0,0 +1,219 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MICROBIT_RADIO_FLOOD_H
+#define MICROBIT_RADIO_FLOOD_H
+
+#include "CodalConfig.h"
+#include "MicroBitRadio.h"
+#include "PacketBuffer.h"
+
+// The number of times a flood is relayed before it is discarded, which bounds the diameter of the network.
+#ifndef MICROBIT_RADIO_FLOOD_MAX_RELAYS
+#define MICROBIT_RADIO_FLOOD_MAX_RELAYS             8
+#endif
+
+// The number of recent floods remembered, to suppress duplicates.
+#ifndef MICROBIT_RADIO_FLOOD_CACHE_SIZE
+#define MICROBIT_RADIO_FLOOD_CACHE_SIZE             16
+#endif
+
+// The time for which a flood is remembered to suppress duplicates, in milliseconds. This must exceed the time a flood
+// takes to cross the network, but bounds how long a sequence number reused by a restarted initiator is ignored.
+#ifndef MICROBIT_RADIO_FLOOD_CACHE_LIFETIME
+#define MICROBIT_RADIO_FLOOD_CACHE_LIFETIME         1000
+#endif
+
+// The time from the end of the reception of a flood to the start of its relay, in microseconds.
+// This is dominated by the ramp up time of the transmitter.
+#ifndef MICROBIT_RADIO_FLOOD_RELAY_DELAY
+#define MICROBIT_RADIO_FLOOD_RELAY_DELAY            150
+#endif
+
+// The number of bytes sent on air in addition to the length of a frame: preamble, address, length and CRC.
+#define MICROBIT_RADIO_FLOOD_FRAME_OVERHEAD         9
+
+// Flags.
+#define MICROBIT_RADIO_FLOOD_FLAG_TIME_REFERENCE    0x01    // The initiator of the flood is the time reference for the network.
+
+// The largest payload that can be sent in a single flood: MICROBIT_RADIO_MAX_PACKET_SIZE, less the flood header.
+#define MICROBIT_RADIO_FLOOD_MAX_PAYLOAD            20
+
+namespace codal
+{
+    /**
+     * Header carried at the start of the payload of each flood.
+     */
+    typedef struct
+    {
+        uint32_t        timestamp;          // The network time at which the initiator started the flood, in microseconds.
+        uint16_t        initiator;          // Identifies the initiator of the flood, derived from its serial number.
+        uint8_t         sequence;           // Sequence number of the flood, incremented by the initiator for each flood.
+        uint8_t         relays;             // The number of times the flood has been relayed.
+        uint8_t         maxRelays;          // The number of times the flood may be relayed.
+        uint8_t         flags;              // MICROBIT_RADIO_FLOOD_FLAG_* values.
+        uint16_t        reserved;
+    } MicroBitRadioFloodHeader;
+
+    /**
+     * A flood recently seen, remembered to suppress duplicates.
+     */
+    typedef struct
+    {
+        uint32_t        time;               // The local time at which the flood was first seen, in microseconds.
+        uint16_t        initiator;          // The initiator of the flood.
+        uint8_t         sequence;           // The sequence number of the flood.
+        bool            valid;              // Set if this entry is in use.
+    } MicroBitRadioFloodCache;
+
+    /**
+     * Provides multi-hop broadcast and network time synchronisation, built upon MicroBitRadio.
+     *
+     * This follows the GLOSSY approach. A flood is relayed from the RADIO interrupt as soon as it is received, so every
+     * device that hears a given transmission relays it after the same fixed delay, and the flood spreads through the
+     * network one hop per slot. Each device relays each flood only once, as identified by its initiator and sequence
+     * number, and only up to MICROBIT_RADIO_FLOOD_MAX_RELAYS times in total.
+     *
+     * Because the slot duration is known, a device can infer when a flood was started from the number of times it has been
+     * relayed. Floods started by the time reference carry its clock, from which the other devices derive the network time.
+     *
+     * @note This API does not contain any form of encryption, authentication or authorisation. Its purpose is solely for use as a
+     * teaching aid to demonstrate how simple communications operates, and to provide a sandpit through which learning can take place.
+     * For serious applications, BLE should be considered a substantially more secure alternative.
+     */
+    class MicroBitRadioFlood
+    {
+        MicroBitRadio                   &radio;                                         // The underlying radio module used to send and receive data.
+        uint8_t                         nextSequence;                                   // The sequence number of the next flood to send.
+        bool                            sequenceValid;                                  // Set once nextSequence has been chosen.
+        bool                            reference;                                      // Set if this device is the time reference.
+        volatile bool                   synchronised;                                   // Set once the network time is known.
+        volatile int32_t                offset;                                         // The network time, less the local time, in microseconds.
+        MicroBitRadioFloodCache         cache[MICROBIT_RADIO_FLOOD_CACHE_SIZE];         // Floods recently seen.
+        int                             cacheIndex;                                     // The next cache entry to replace.
+        FrameBuffer                     *rxQueue;                                       // A linear list of incoming floods, queued awaiting processing.
+
+        public:
+
+        /**
+         * Constructor.
+         *
+         * @param r The underlying radio module used to send and receive data.
+         */
+        MicroBitRadioFlood(MicroBitRadio &r);
+
+        /**
+         * Retrieves the next flood received.
+         *
+         * @param initiator If not NULL, set to the identity of the device that started the flood.
+         * @param hops If not NULL, set to the number of hops the flood travelled to reach this device.
+         *
+         * @return the data received, or an empty PacketBuffer if no data is available.
+         */
+        PacketBuffer recv(uint16_t *initiator = NULL, uint8_t *hops = NULL);
+
+        /**
+         * Starts a flood of the given buffer through the network.
+         * This is a synchronous call that will wait until this device has transmitted the flood before returning.
+         * The flood waits for any packets already queued for transmission, so that it leaves at the time it was stamped with.
+         *
+         * @param buffer The packet contents to transmit.
+         * @param len The number of bytes to transmit.
+         *
+         * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the buffer is invalid,
+         *         or the number of bytes to transmit is greater than MICROBIT_RADIO_FLOOD_MAX_PAYLOAD,
+         *         DEVICE_CANCELLED if the radio was disabled before the flood was sent,
+         *         or DEVICE_NOT_SUPPORTED if the BLE stack is running.
+         */
+        int send(uint8_t *buffer, int len);
+
+        /**
+         * Starts a flood of the given buffer through the network.
+         * This is a synchronous call that will wait until this device has transmitted the flood before returning.
+         * The flood waits for any packets already queued for transmission, so that it leaves at the time it was stamped with.
+         *
+         * @param data The packet contents to transmit.
+         *
+         * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the number of bytes to transmit is
+         *         greater than MICROBIT_RADIO_FLOOD_MAX_PAYLOAD, DEVICE_CANCELLED if the radio was disabled before
+         *         the flood was sent, or DEVICE_NOT_SUPPORTED if the BLE stack is running.
+         */
+        int send(PacketBuffer data);
+
+        /**
+         * Determines whether this device is the time reference for the network.
+         * The network time of the time reference is its own clock, and each flood it starts synchronises the other devices.
+         *
+         * @param reference true if this device should be the time reference, false otherwise.
+         */
+        void setTimeReference(bool reference);
+
+        /**
+         * Determines if the network time is known, either because this device is the time reference, or because a flood
+         * started by the time reference has been received.
+         */
+        bool isSynchronised();
+
+        /**
+         * Retrieves the network time.
+         *
+         * @return the network time, in microseconds, or the local time if the network time is not yet known.
+         */
+        uint32_t getNetworkTime();
+
+        /**
+         * Protocol handler callback. This is called when the radio receives a packet marked as a flood.
+         *
+         * This function queues the flood for user reception. Relaying and duplicate suppression have already taken place in relay().
+         */
+        void packetReceived();
+
+        /**
+         * Interrupt handler callback. This is called by the RADIO interrupt as soon as a flood has been received.
+         *
+         * Duplicate floods are discarded. Otherwise, the network time is updated if the flood was started by the time
+         * reference, and the flood is queued for relaying unless it has already been relayed MICROBIT_RADIO_FLOOD_MAX_RELAYS times.
+         * A relay must leave at the same time as those of the other devices, so if packets are already queued for
+         * transmission, the flood is neither relayed nor used to update the network time.
+         *
+         * @param p The flood received.
+         *
+         * @return true if the flood should be passed on to packetReceived(), or false if it should be discarded.
+         */
+        bool relay(FrameBuffer *p);
+
+        private:
+
+        /**
+         * Determines if the given flood has been seen within the last MICROBIT_RADIO_FLOOD_CACHE_LIFETIME, and remembers it if not.
+         *
+         * @param initiator The initiator of the flood.
+         * @param sequence The sequence number of the flood.
+         * @param now The current local time, in microseconds.
+         */
+        bool isDuplicate(uint16_t initiator, uint8_t sequence, uint32_t now);
+    };
+}
+
+#endif
@@ -0,0 +1,190 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MICROBIT_RADIO_FRAGMENT_H
+#define MICROBIT_RADIO_FRAGMENT_H
+
+#include "CodalConfig.h"
+#include "MicroBitRadio.h"
+#include "ManagedBuffer.h"
+
+// The largest message that can be sent or reassembled, in bytes.
+#ifndef MICROBIT_RADIO_FRAGMENT_MAX_LENGTH
+#define MICROBIT_RADIO_FRAGMENT_MAX_LENGTH          2048
+#endif
+
+// The number of messages that can be reassembled concurrently.
+#ifndef MICROBIT_RADIO_FRAGMENT_SLOTS
+#define MICROBIT_RADIO_FRAGMENT_SLOTS               2
+#endif
+
+// The number of reassembled messages that can be queued awaiting recv().
+#ifndef MICROBIT_RADIO_FRAGMENT_QUEUE_SIZE
+#define MICROBIT_RADIO_FRAGMENT_QUEUE_SIZE          2
+#endif
+
+// The time after which a partially received message is abandoned, and a completed message may be received again, in milliseconds.
+#ifndef MICROBIT_RADIO_FRAGMENT_TIMEOUT
+#define MICROBIT_RADIO_FRAGMENT_TIMEOUT             1000
+#endif
+
+// The number of recently completed messages remembered, to suppress duplicates.
+#define MICROBIT_RADIO_FRAGMENT_HISTORY             4
+
+// The number of message bytes carried by each fragment: MICROBIT_RADIO_MAX_PACKET_SIZE, less the fragment header.
+#define MICROBIT_RADIO_FRAGMENT_DATA_SIZE           24
+#define MICROBIT_RADIO_FRAGMENT_MAX_COUNT           ((MICROBIT_RADIO_FRAGMENT_MAX_LENGTH + MICROBIT_RADIO_FRAGMENT_DATA_SIZE - 1) / MICROBIT_RADIO_FRAGMENT_DATA_SIZE)
+
+namespace codal
+{
+    /**
+     * Header carried at the start of the payload of each fragment.
+     */
+    typedef struct
+    {
+        uint16_t        source;             // Identifies the sender of the message, derived from its serial number.
+        uint8_t         message;            // Sequence number of the message, incremented by the sender for each message.
+        uint8_t         index;              // The index of this fragment within the message.
+        uint8_t         count;              // The number of fragments in the message.
+        uint8_t         reserved;
+        uint16_t        length;             // The length of the whole message, in bytes.
+    } MicroBitRadioFragmentHeader;
+
+    /**
+     * State of a message being reassembled.
+     */
+    typedef struct
+    {
+        bool            active;             // Set if this slot is in use.
+        uint16_t        source;             // The sender of the message.
+        uint8_t         message;            // The sequence number of the message.
+        uint8_t         remaining;          // The number of fragments yet to be received.
+        uint32_t        timestamp;          // The time the most recent fragment was received.
+        uint32_t        received[(MICROBIT_RADIO_FRAGMENT_MAX_COUNT + 31) / 32];    // Bitmap of the fragments received.
+        ManagedBuffer   data;               // The message being reassembled.
+    } MicroBitRadioFragmentSlot;
+
+    /**
+     * A message recently completed, remembered to suppress duplicates.
+     */
+    typedef struct
+    {
+        uint16_t        source;             // The sender of the message.
+        uint8_t         message;            // The sequence number of the message.
+        bool            valid;              // Set if this entry is in use.
+        uint32_t        timestamp;          // The time the message was completed.
+    } MicroBitRadioFragmentHistory;
+
+    /**
+     * Provides broadcast of messages larger than a single radio frame, built upon MicroBitRadio.
+     *
+     * Messages of up to MICROBIT_RADIO_FRAGMENT_MAX_LENGTH bytes are split into numbered fragments, each sent as a
+     * separate radio frame. Receivers reassemble them in a bounded number of slots, discarding duplicate fragments
+     * and repeated messages, and abandoning messages that have not completed within MICROBIT_RADIO_FRAGMENT_TIMEOUT.
+     * Delivery is best effort: a message is only delivered if all of its fragments are received.
+     *
+     * @note This API does not contain any form of encryption, authentication or authorisation. Its purpose is solely for use as a
+     * teaching aid to demonstrate how simple communications operates, and to provide a sandpit through which learning can take place.
+     * For serious applications, BLE should be considered a substantially more secure alternative.
+     */
+    class MicroBitRadioFragment
+    {
+        MicroBitRadio                   &radio;                                         // The underlying radio module used to send and receive data.
+        uint8_t                         nextMessage;                                    // The sequence number of the next message to send.
+        MicroBitRadioFragmentSlot       slots[MICROBIT_RADIO_FRAGMENT_SLOTS];           // Messages being reassembled.
+        MicroBitRadioFragmentHistory    history[MICROBIT_RADIO_FRAGMENT_HISTORY];       // Messages recently completed.
+        int                             historyIndex;                                   // The next history entry to replace.
+        ManagedBuffer                   rxQueue[MICROBIT_RADIO_FRAGMENT_QUEUE_SIZE];    // Completed messages, awaiting recv().
+        int                             rxQueueHead;                                    // The index of the oldest completed message.
+        int                             rxQueueLength;                                  // The number of completed messages.
+        uint32_t                        dropped;                                        // The number of messages abandoned or discarded.
+
+        public:
+
+        /**
+         * Constructor.
+         *
+         * @param r The underlying radio module used to send and receive data.
+         */
+        MicroBitRadioFragment(MicroBitRadio &r);
+
+        /**
+         * Retrieves the next reassembled message.
+         *
+         * @return the message, or an empty buffer if no message is available.
+         */
+        ManagedBuffer recv();
+
+        /**
+         * Transmits the given message onto the broadcast radio, as a sequence of fragments.
+         * This is a synchronous call that will wait until all fragments have been transmitted before returning.
+         *
+         * @param buffer The message to transmit.
+         * @param len The number of bytes to transmit.
+         *
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the buffer is invalid,
+         *         or the number of bytes to transmit is greater than MICROBIT_RADIO_FRAGMENT_MAX_LENGTH.
+         */
+        int send(uint8_t *buffer, int len);
+
+        /**
+         * Transmits the given message onto the broadcast radio, as a sequence of fragments.
+         * This is a synchronous call that will wait until all fragments have been transmitted before returning.
+         *
+         * @param data The message to transmit.
+         *
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the message is
+         *         longer than MICROBIT_RADIO_FRAGMENT_MAX_LENGTH.
+         */
+        int send(ManagedBuffer data);
+
+        /**
+         * Determines the number of messages that were partially received and abandoned, or discarded because the
+         * queue of completed messages was full.
+         */
+        uint32_t getDroppedCount();
+
+        /**
+         * Protocol handler callback. This is called when the radio receives a packet marked as a fragment.
+         *
+         * This function adds the fragment to the message it belongs to, and queues the message for user reception once complete.
+         */
+        void packetReceived();
+
+        private:
+
+        /**
+         * Finds the slot reassembling the given message, or allocates one for it.
+         * If no slot is free, the slot that has waited longest for a fragment is abandoned.
+         */
+        MicroBitRadioFragmentSlot *getSlot(MicroBitRadioFragmentHeader *header, uint32_t now);
+
+        /**
+         * Determines if the given message has recently been completed.
+         */
+        bool isDuplicate(uint16_t source, uint8_t message, uint32_t now);
+    };
+}
+
+#endif
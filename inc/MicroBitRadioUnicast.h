@@ -0,0 +1,269 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MICROBIT_RADIO_UNICAST_H
+#define MICROBIT_RADIO_UNICAST_H
+
+#include "CodalConfig.h"
+#include "MicroBitRadio.h"
+#include "PacketBuffer.h"
+
+// The number of unacknowledged packets that may be outstanding at once, across all peers.
+#ifndef MICROBIT_RADIO_UNICAST_WINDOW_SIZE
+#define MICROBIT_RADIO_UNICAST_WINDOW_SIZE          4
+#endif
+
+// The number of peers for which sequence numbers and statistics are maintained.
+#ifndef MICROBIT_RADIO_UNICAST_PEERS
+#define MICROBIT_RADIO_UNICAST_PEERS                4
+#endif
+
+// The number of times a packet is retransmitted before it is abandoned.
+#ifndef MICROBIT_RADIO_UNICAST_RETRIES
+#define MICROBIT_RADIO_UNICAST_RETRIES              5
+#endif
+
+// Bounds on the retransmission timeout, in milliseconds.
+#ifndef MICROBIT_RADIO_UNICAST_INITIAL_RTO
+#define MICROBIT_RADIO_UNICAST_INITIAL_RTO          50
+#endif
+
+#ifndef MICROBIT_RADIO_UNICAST_MIN_RTO
+#define MICROBIT_RADIO_UNICAST_MIN_RTO              10
+#endif
+
+#ifndef MICROBIT_RADIO_UNICAST_MAX_RTO
+#define MICROBIT_RADIO_UNICAST_MAX_RTO              1000
+#endif
+
+// The time a sender leaves the air free for an acknowledgement before sending its next packet, in milliseconds.
+#ifndef MICROBIT_RADIO_UNICAST_ACK_GUARD
+#define MICROBIT_RADIO_UNICAST_ACK_GUARD            2
+#endif
+
+// The time after which a silent peer's receive history is forgotten, allowing it to restart its sequence numbers, in milliseconds.
+#ifndef MICROBIT_RADIO_UNICAST_PEER_TIMEOUT
+#define MICROBIT_RADIO_UNICAST_PEER_TIMEOUT         5000
+#endif
+
+// The number of recent sequence numbers from each peer remembered, to suppress duplicates. This is the width of rxHistory.
+#define MICROBIT_RADIO_UNICAST_HISTORY              32
+
+// Packet types.
+#define MICROBIT_RADIO_UNICAST_TYPE_DATA            1
+#define MICROBIT_RADIO_UNICAST_TYPE_ACK             2
+
+// The largest payload that can be sent in a single packet: MICROBIT_RADIO_MAX_PACKET_SIZE, less the unicast header.
+#define MICROBIT_RADIO_UNICAST_MAX_PAYLOAD          26
+
+namespace codal
+{
+    /**
+     * Header carried at the start of the payload of each unicast packet.
+     */
+    typedef struct
+    {
+        uint16_t        destination;        // The address of the intended recipient.
+        uint16_t        source;             // The address of the sender.
+        uint8_t         type;               // MICROBIT_RADIO_UNICAST_TYPE_DATA or MICROBIT_RADIO_UNICAST_TYPE_ACK.
+        uint8_t         sequence;           // The sequence number of the data packet sent, or being acknowledged.
+    } MicroBitRadioUnicastHeader;
+
+    /**
+     * Sequence numbers, round trip time estimates and statistics maintained for each peer.
+     */
+    typedef struct
+    {
+        uint16_t        address;            // The address of the peer, or 0 if this entry is unused.
+        uint8_t         txSequence;         // The sequence number of the next packet sent to the peer.
+        uint8_t         rxSequence;         // The highest sequence number received from the peer.
+        uint32_t        rxHistory;          // Bitmap of the sequence numbers received, relative to rxSequence.
+        uint32_t        lastActivity;       // The time a packet was last sent to or received from the peer, in milliseconds.
+        uint32_t        rxTimestamp;        // The time a data packet was last received from the peer, in milliseconds.
+        uint32_t        srtt;               // Smoothed round trip time, in microseconds, or 0 if not yet measured.
+        uint32_t        rttvar;             // Round trip time variation, in microseconds.
+        uint32_t        rto;                // Retransmission timeout, in microseconds.
+        uint32_t        sent;               // The number of packets sent to the peer, excluding retransmissions.
+        uint32_t        retransmitted;      // The number of retransmissions sent to the peer.
+        uint32_t        delivered;          // The number of packets acknowledged by the peer.
+        uint32_t        failed;             // The number of packets abandoned after MICROBIT_RADIO_UNICAST_RETRIES retransmissions.
+        uint32_t        received;           // The number of packets received from the peer.
+        uint32_t        duplicates;         // The number of duplicate packets received from the peer.
+    } MicroBitRadioUnicastPeer;
+
+    /**
+     * A packet awaiting acknowledgement.
+     */
+    typedef struct
+    {
+        bool            active;             // Set if this entry is in use.
+        uint8_t         retries;            // The number of times the packet has been retransmitted.
+        uint32_t        timestamp;          // The time the packet was last transmitted, in microseconds.
+        uint32_t        timeout;            // The time to wait for an acknowledgement, in microseconds.
+        uint8_t         length;             // The number of bytes of data in the packet.
+        MicroBitRadioUnicastHeader header;  // The header of the packet.
+        uint8_t         data[MICROBIT_RADIO_UNICAST_MAX_PAYLOAD];   // The data in the packet.
+    } MicroBitRadioUnicastWindow;
+
+    /**
+     * Provides reliable, addressed delivery of packets to a single peer, built upon MicroBitRadio.
+     *
+     * Each device is addressed by a 16 bit value derived from its serial number. Every data packet is acknowledged
+     * by its recipient, and retransmitted with exponential backoff until it is, up to MICROBIT_RADIO_UNICAST_RETRIES times.
+     * Up to MICROBIT_RADIO_UNICAST_WINDOW_SIZE packets may be awaiting acknowledgement at once, and only those that are
+     * not acknowledged are retransmitted. The sequence numbers in flight to a peer never span more than MICROBIT_RADIO_UNICAST_HISTORY. Recipients discard duplicate packets, but packets may be delivered out of order.
+     *
+     * The retransmission timeout for each peer is derived from measurements of its round trip time, which are made
+     * available alongside loss statistics through getPeer().
+     *
+     * @note This API does not contain any form of encryption, authentication or authorisation. Its purpose is solely for use as a
+     * teaching aid to demonstrate how simple communications operates, and to provide a sandpit through which learning can take place.
+     * For serious applications, BLE should be considered a substantially more secure alternative.
+     */
+    class MicroBitRadioUnicast
+    {
+        MicroBitRadio                   &radio;                                         // The underlying radio module used to send and receive data.
+        uint16_t                        address;                                        // The address of this device.
+        MicroBitRadioUnicastPeer        peers[MICROBIT_RADIO_UNICAST_PEERS];            // Per peer state and statistics.
+        MicroBitRadioUnicastWindow      window[MICROBIT_RADIO_UNICAST_WINDOW_SIZE];     // Packets awaiting acknowledgement.
+        FrameBuffer                     *rxQueue;                                       // A linear list of incoming packets, queued awaiting processing.
+        uint32_t                        lastTransmission;                               // The time a data packet was last queued for transmission, in microseconds.
+
+        public:
+
+        /**
+         * Constructor.
+         *
+         * @param r The underlying radio module used to send and receive data.
+         */
+        MicroBitRadioUnicast(MicroBitRadio &r);
+
+        /**
+         * Retrieves the address of this device.
+         */
+        uint16_t getAddress();
+
+        /**
+         * Changes the address of this device. By default, this is derived from its serial number.
+         *
+         * @param address The new address, which must not be zero.
+         *
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the address is zero.
+         */
+        int setAddress(uint16_t address);
+
+        /**
+         * Retrieves the next packet received.
+         *
+         * @param source If not NULL, set to the address of the sender of the packet.
+         *
+         * @return the data received, or an empty PacketBuffer if no data is available.
+         */
+        PacketBuffer recv(uint16_t *source = NULL);
+
+        /**
+         * Transmits the given buffer to the given peer.
+         *
+         * This call waits until there is room in the window of packets awaiting acknowledgement, and for the packet to be
+         * transmitted once and then acknowledged or for up to MICROBIT_RADIO_UNICAST_ACK_GUARD milliseconds, before
+         * returning. As the radio is half duplex, this keeps the next packet from colliding with the acknowledgement.
+         * Acknowledgement and any retransmission take place in the background, and a
+         * MICROBIT_RADIO_EVT_UNICAST_TX event is raised when the packet is acknowledged or abandoned.
+         *
+         * @param address The address of the recipient.
+         * @param buffer The packet contents to transmit.
+         * @param len The number of bytes to transmit.
+         *
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the buffer or address is invalid,
+         *         or the number of bytes to transmit is greater than MICROBIT_RADIO_UNICAST_MAX_PAYLOAD.
+         */
+        int send(uint16_t address, uint8_t *buffer, int len);
+
+        /**
+         * Transmits the given buffer to the given peer.
+         *
+         * @param address The address of the recipient.
+         * @param data The packet contents to transmit.
+         *
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the address is invalid,
+         *         or the number of bytes to transmit is greater than MICROBIT_RADIO_UNICAST_MAX_PAYLOAD.
+         */
+        int send(uint16_t address, PacketBuffer data);
+
+        /**
+         * Retrieves the round trip time and loss statistics for the given peer.
+         *
+         * @param address The address of the peer.
+         *
+         * @return the state held for the peer, or NULL if no packets have been exchanged with it recently.
+         */
+        const MicroBitRadioUnicastPeer *getPeer(uint16_t address);
+
+        /**
+         * Protocol handler callback. This is called when the radio receives a packet marked as unicast.
+         *
+         * Data packets addressed to this device are acknowledged and queued for user reception, unless they are duplicates.
+         * Acknowledgements release the corresponding packet from the window.
+         */
+        void packetReceived();
+
+        /**
+         * Periodic callback from MicroBitRadio, used to retransmit packets whose acknowledgement is overdue.
+         */
+        void idleCallback();
+
+        private:
+
+        /**
+         * Finds the state held for the given peer, optionally creating it.
+         * If the peer table is full, the least recently active peer is forgotten. Peers with packets awaiting
+         * acknowledgement are never forgotten, as their sequence numbers and round trip times are still in use.
+         *
+         * @return the state held for the peer, or NULL if it is not known and either create is not set, or every peer is busy.
+         */
+        MicroBitRadioUnicastPeer *lookup(uint16_t address, bool create);
+
+        /**
+         * Transmits the packet held in the given entry in the window.
+         *
+         * @param w The packet to transmit.
+         * @param wait If set, wait for the packet to be transmitted. Otherwise, queue it and return immediately.
+         *
+         * @return DEVICE_OK on success, or an error code as per MicroBitRadio::send() or MicroBitRadio::sendAsync().
+         */
+        int transmit(MicroBitRadioUnicastWindow *w, bool wait);
+
+        /**
+         * Sends an acknowledgement of the given data packet.
+         */
+        void acknowledge(MicroBitRadioUnicastHeader *header);
+
+        /**
+         * Releases the given entry in the window, and notifies any fiber waiting for space.
+         */
+        void release(MicroBitRadioUnicastWindow *w);
+    };
+}
+
+#endif
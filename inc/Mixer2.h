@@ -26,6 +26,7 @@ DEALINGS IN THE SOFTWARE.
 #define CODAL_MIXER2_H
 
 #include "DataStream.h"
+#include "AudioBufferPool.h"
 
 #ifndef CONFIG_MIXER_BUFFER_SIZE
 #define CONFIG_MIXER_BUFFER_SIZE 512
@@ -39,22 +40,123 @@ DEALINGS IN THE SOFTWARE.
 #define CONFIG_MIXER_DEFAULT_SAMPLERATE 44100
 #endif
 
+//
+// Selects the integer mixing engine by default, for mixers constructed without an explicit engine.
+// See MIXER_ENGINE_FIXED.
+//
+#ifndef CONFIG_MIXER_FIXED_POINT
+#define CONFIG_MIXER_FIXED_POINT 0
+#endif
+
+//
+// Enables instrumentation of Mixer2::pull() and of the sources feeding each channel, using the DWT cycle counter.
+// When disabled, no instrumentation code or state is compiled in.
+//
+#ifndef CONFIG_MIXER_INSTRUMENTATION
+#define CONFIG_MIXER_INSTRUMENTATION 0
+#endif
+
+//
+// Default release time of the output limiter, in milliseconds. This is the time constant with which gain is
+// restored once the mixed output falls back below the limiter threshold.
+//
+#ifndef CONFIG_MIXER_LIMITER_RELEASE
+#define CONFIG_MIXER_LIMITER_RELEASE 50
+#endif
+
+//
+// Mixing engines. The floating point engine accumulates into a buffer of floats. The fixed point engine accumulates
+// into a buffer of saturating 16 bit values, half the size, using the SMLAD and SSAT instructions of the Cortex-M4
+// DSP extensions where available. Each input sample is normalised to 16 bits, and accumulated in Q13 format (a full
+// scale input on one channel maps to +/- 8192), leaving 12dB of headroom for the limiter.
+//
+#define MIXER_ENGINE_FLOAT              0
+#define MIXER_ENGINE_FIXED              1
+
+#if CONFIG_ENABLED(CONFIG_MIXER_FIXED_POINT)
+#define MIXER_ENGINE_DEFAULT            MIXER_ENGINE_FIXED
+#else
+#define MIXER_ENGINE_DEFAULT            MIXER_ENGINE_FLOAT
+#endif
+
+#define MIXER_LIMITER_UNITY             65536   // Q16 representation of unity gain in the output limiter.
+
+#define MIXER_HISTOGRAM_BUCKETS         8       // Number of buckets in the pull duration histogram. Each covers an equal fraction of the playout time of one output buffer.
+
+//
+// Resampling modes, used when a channel's sample rate differs from the output sample rate of the mixer.
+//
+#define MIXER_RESAMPLE_NEAREST          0       // Nearest (previous) sample. Cheapest, but aliases badly when upsampling.
+#define MIXER_RESAMPLE_LINEAR           1       // Linear interpolation between adjacent samples.
+#define MIXER_RESAMPLE_POLYPHASE        2       // Band limited interpolation, using a fixed point polyphase FIR filter.
+
+#define MIXER_POLYPHASE_TAPS            8       // Number of input samples contributing to each output sample in MIXER_RESAMPLE_POLYPHASE mode.
+#define MIXER_POLYPHASE_PHASES          32      // Number of fractional sample positions in the polyphase coefficient table.
+
+//
+// Status flags of a MixerChannel.
+//
+#define MIXER_CHANNEL_STATUS_MUTED      0x01    // The channel consumes its input as normal, but does not contribute to the mix.
+#define MIXER_CHANNEL_STATUS_PAUSED     0x02    // The channel does not consume its input, and does not contribute to the mix.
+#define MIXER_CHANNEL_STATUS_STARVED    0x04    // The channel's input ran out part way through the last output buffer (CONFIG_MIXER_INSTRUMENTATION only).
 
 namespace codal
 {
 
+class MixerChannel;
+
+#if CONFIG_ENABLED(CONFIG_MIXER_INSTRUMENTATION)
+/**
+ * Timing statistics gathered for a Mixer2, or for the DataSource feeding one of its channels.
+ * Durations are measured in CPU cycles, relative to the time taken to play out one output buffer of the mixer.
+ */
+typedef struct
+{
+    uint32_t        pulls;                                  // The number of pull operations measured.
+    uint32_t        lastCycles;                             // The duration of the most recent pull.
+    uint32_t        maxCycles;                              // The longest duration of any pull.
+    uint64_t        totalCycles;                            // The sum of the durations of all pulls.
+    uint32_t        overruns;                               // The number of pulls that took longer than the playout time of an output buffer.
+    uint32_t        underruns;                              // The number of times input ran out part way through an output buffer, and more arrived by the next (channels only).
+    uint32_t        maxPullRequests;                        // The largest number of buffers queued by the source at once (channels only).
+    uint32_t        histogram[MIXER_HISTOGRAM_BUCKETS];     // Distribution of pull durations. The last bucket includes any overruns.
+} MixerStatistics;
+#endif
+
+/**
+ * Inner loop used to mix samples from a channel into the accumulator.
+ * Specialised versions are selected per channel according to its input format and sample rate, and the mixing engine.
+ *
+ * @param channel The channel to read samples from, starting at its current position.
+ * @param out The position in the accumulator of the first sample to write. Accumulator samples are normalised
+ * to +/- CONFIG_MIXER_INTERNAL_RANGE / 2 (MIXER_ENGINE_FLOAT), or are Q13 values (MIXER_ENGINE_FIXED).
+ * @param len The number of output samples to generate.
+ */
+typedef void (*MixerKernel)(MixerChannel *channel, float *out, int len);
+typedef void (*MixerKernelFixed)(MixerChannel *channel, int16_t *out, int len);
+
+/**
+ * Handler invoked from fiber context when a channel may need a higher output sample rate than the mixer currently uses.
+ *
+ * @param context The context registered with the handler.
+ * @param sampleRate The sample rate required by the channel, in samples per second.
+ */
+typedef void (*MixerRateHandler)(void *context, float sampleRate);
+
 class MixerChannel : public DataSink
 {
 private:
     DataSource      *stream;                    // The DataSource feeding this mixer channel.
     ManagedBuffer   buffer;                     // The last buffer received from the DataSource.
     int             pullRequests;               // The number of buffers ready to be read from the DataSource.
+    uint8_t         status;                     // MIXER_CHANNEL_STATUS_MUTED, MIXER_CHANNEL_STATUS_PAUSED...
 
     uint8_t         *in;                        // Pointer to the next sample that should be read from the current buffer.
     uint8_t         *end;                       // Pointer to the end of the current buffer (optimisation).
 
     float           range;                      // The number of quantization levels in the input data.
     float           rate;                       // The sample rate of the input data.
+    float           requiredRate;               // The lowest output sample rate that reproduces this channel acceptably.
     float           offset;                     // Offset applied to every sample before mixing (for unsigned samples)
     float           gain;                       // Input gain to applied ot each sample to normalise (optimisation)
     float           skip;                       // Number of input samples to progress for each output sample (when sub/super sampling)
@@ -63,9 +165,26 @@ private:
     float           volume;                     // Volume leve of channel, in the range 0..CONFIG_MIXER_INTERNAL_RANGE
     int             format;                     // Format of the data recieved on this channel (e.g. DATASTREAM_FORMAT_16BIT_UNSIGNED...)
     int             bytesPerSample;             // The number of bytes used in the input stream for each sample (optimisation)
-
+    int             resampleMode;               // Interpolation used when sub/super sampling (e.g. MIXER_RESAMPLE_LINEAR...)
+    int32_t         history[MIXER_POLYPHASE_TAPS-1];    // The last samples of the previous buffer, used as interpolation context (oldest first).
+
+    int32_t         offsetFixed;                // Offset applied to every doubled sample before mixing (for unsigned samples)
+    int8_t          shiftFixed;                 // Left (or if negative, right) shift normalising a doubled, offset sample to 16 bits
+    uint32_t        gainFixed;                  // Q14 combined gain and volume (low half), packed with Q14 unity (high half) for SMLAD
+    uint32_t        skipFixed;                  // Q16.16 number of input samples to progress for each output sample
+    uint32_t        positionFixed;              // Q16.16 position within the buffer of the next sample
+
+    union
+    {
+        MixerKernel         kernel;             // Inner loop used to mix this channel, specialised for its format and sample rate.
+        MixerKernelFixed    kernelFixed;        // As above, for mixers using MIXER_ENGINE_FIXED.
+    };
     MixerChannel    *next;                      // Internal Linkage - list of all mixer channels
 
+#if CONFIG_ENABLED(CONFIG_MIXER_INSTRUMENTATION)
+    MixerStatistics statistics;                 // Timing of the DataSource feeding this channel.
+#endif
+
     friend class    Mixer2;
 
 public:
@@ -81,14 +200,33 @@ class Mixer2 : public DataSource
 {
     MixerChannel    *channels;
     DataSink        *downStream;
-    float           mix[CONFIG_MIXER_BUFFER_SIZE];
+    int             engine;                     // MIXER_ENGINE_FLOAT or MIXER_ENGINE_FIXED.
+    union
+    {
+        float       *mix;                       // Accumulator of CONFIG_MIXER_BUFFER_SIZE samples (MIXER_ENGINE_FLOAT).
+        int16_t     *mixFixed;                  // Accumulator of CONFIG_MIXER_BUFFER_SIZE samples (MIXER_ENGINE_FIXED).
+    };
     float           outputRange;
     float           outputRate;
+    float           defaultRate;                // The input rate of channels added without one: the rate the mixer was constructed with.
     int             outputFormat;
     int             bytesPerSampleOut;
     float           volume;
     uint32_t        orMask;
     float           silenceLevel;
+    AudioBufferPool *pool;
+    MixerRateHandler rateHandler;               // Notified when a channel requires a higher output rate, or NULL.
+    void            *rateHandlerContext;
+
+    uint32_t        limiterThreshold;           // Output level above which the limiter reduces gain, as a Q16 fraction of full scale, or zero if disabled.
+    uint32_t        limiterRatio;               // Compression ratio applied above the threshold, or zero to hard limit at the threshold.
+    uint32_t        limiterRelease;             // Time constant with which gain is restored, in milliseconds.
+    uint32_t        limiterReleaseCoefficient;  // Q16 fraction of the outstanding gain reduction recovered per output buffer.
+    uint32_t        limiterGain;                // Q16 gain applied at the end of the last output buffer.
+
+#if CONFIG_ENABLED(CONFIG_MIXER_INSTRUMENTATION)
+    MixerStatistics statistics;
+#endif
 
 public:
     /**
@@ -97,8 +235,9 @@ public:
      * @param sampleRate (samples per second) of the mixer output
      * @param sampleRange (quantization levels) the difference between the maximum and minimum sample level on the output channel
      * @param format The format the mixer will output (DATASTREAM_FORMAT_16BIT_UNSIGNED or DATASTREAM_FORMAT_16BIT_SIGNED)
+     * @param engine The mixing engine to use (MIXER_ENGINE_FLOAT or MIXER_ENGINE_FIXED)
      */
-    Mixer2(float sampleRate = CONFIG_MIXER_DEFAULT_SAMPLERATE, int sampleRange = CONFIG_MIXER_INTERNAL_RANGE, int format = DATASTREAM_FORMAT_16BIT_UNSIGNED);
+    Mixer2(float sampleRate = CONFIG_MIXER_DEFAULT_SAMPLERATE, int sampleRange = CONFIG_MIXER_INTERNAL_RANGE, int format = DATASTREAM_FORMAT_16BIT_UNSIGNED, int engine = MIXER_ENGINE_DEFAULT);
 
     /**
      * Destructor.
@@ -110,10 +249,73 @@ public:
      * Add a new channel to the mixer.
      * 
      * @oaram stream DataSource to connect to the new input channel
-     * @param sampleRate (samples per second) - if set to zero, defaults to the output sample rate of the Mixer
+     * @param sampleRate (samples per second) - if set to zero, defaults to the sample rate the Mixer was constructed with,
+     * regardless of any later change to its output rate
      * @param sampleRange (quantization levels) the difference between the maximum and minimum sample level on the input channel
+     * @param resampleMode The interpolation to use if sampleRate differs from the output sample rate of the mixer:
+     * MIXER_RESAMPLE_NEAREST
+     * MIXER_RESAMPLE_LINEAR
+     * MIXER_RESAMPLE_POLYPHASE
+     */
+    MixerChannel *addChannel(DataSource &stream, float sampleRate = 0, int sampleRange = CONFIG_MIXER_INTERNAL_RANGE, int resampleMode = MIXER_RESAMPLE_NEAREST);
+
+    /**
+     * Removes a channel from the mixer, disconnecting it from its DataSource.
+     * The channel is deleted, and must not be used after this call. This must not be called from within
+     * the pull() of a DataSource connected to this mixer.
+     *
+     * @param channel The channel to remove.
+     * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the channel does not belong to this mixer.
+     */
+    int removeChannel(MixerChannel *channel);
+
+    /**
+     * Mutes or unmutes a channel. A muted channel continues to consume data from its DataSource at the
+     * normal rate, so remains in time with the other channels, but does not contribute to the mix.
+     *
+     * @param channel The channel to update.
+     * @param mute true to mute the channel, false to unmute it.
+     * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+     */
+    int setMute(MixerChannel *channel, bool mute);
+
+    /**
+     * Pauses or resumes a channel. A paused channel does not consume data from its DataSource, and resumes
+     * from the same position when unpaused.
+     *
+     * @param channel The channel to update.
+     * @param pause true to pause the channel, false to resume it.
+     * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+     */
+    int setPaused(MixerChannel *channel, bool pause);
+
+    /**
+     * Defines the lowest output sample rate at which a channel is acceptably reproduced.
+     * By default, this is the sample rate of the channel's input.
+     *
+     * @param channel The channel to update.
+     * @param sampleRate The required sample rate, in samples per second.
+     * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+     */
+    int setRequiredSampleRate(MixerChannel *channel, float sampleRate);
+
+    /**
+     * Determines the lowest output sample rate that acceptably reproduces every channel currently generating audio.
+     * Channels that are muted, paused, or that have no data are ignored.
+     *
+     * @return The required sample rate in samples per second, or zero if no channel is generating audio.
+     */
+    float getRequiredSampleRate();
+
+    /**
+     * Registers a handler to be notified as soon as a channel that is added, unmuted, resumed or given a new
+     * required sample rate needs a higher output sample rate than the mixer currently uses. This allows the
+     * output rate to be raised before the channel is first mixed, rather than on the next periodic check.
+     *
+     * @param handler The handler to invoke, or NULL to remove the handler.
+     * @param context Passed to the handler on each invocation.
      */
-    MixerChannel *addChannel(DataSource &stream, float sampleRate = 0, int sampleRange = CONFIG_MIXER_INTERNAL_RANGE);
+    void setRateHandler(MixerRateHandler handler, void *context = NULL);
 
     /**
      * Provide the next available ManagedBuffer to our downstream caller, if available.
@@ -132,6 +334,12 @@ public:
      */
     virtual int getFormat();
 
+    /**
+     * Determines the mixing engine in use.
+     * @return MIXER_ENGINE_FLOAT or MIXER_ENGINE_FIXED.
+     */
+    int getEngine();
+
     /**
      * Defines the output format for the Mixer.
      * @param format The fomrat to output. Valid values are:
@@ -202,8 +410,78 @@ public:
      */
     int setSilenceLevel(float level);
 
+    /**
+     * Defines a pool from which output buffers are allocated, rather than using the heap.
+     *
+     * @param pool The pool to use, or NULL to allocate output buffers from the heap.
+     * @return DEVICE_OK on success.
+     */
+    int setBufferPool(AudioBufferPool *pool);
+
+    /**
+     * Determines the pool from which output buffers are allocated.
+     * @return the buffer pool in use, or NULL if output buffers are allocated from the heap.
+     */
+    AudioBufferPool *getBufferPool();
+
+    /**
+     * Configures a soft limiter, applied to the mixed output before it is clamped to the output range.
+     * The gain is computed once per output buffer from the peak level of the mix. Gain reduction takes effect
+     * over the course of the buffer in which it is detected, and is released gradually over subsequent buffers.
+     * Any transient faster than this is still clamped to the output range.
+     *
+     * @param threshold The output level above which gain is reduced, in the range 1..1023 (where 1023 represents full scale), or 0 to disable the limiter.
+     * @param ratio The compression ratio applied to levels above the threshold (e.g. 4 for 4:1 compression), or 0 to limit the output to the threshold.
+     * @param release The time taken to restore gain once the output falls below the threshold, in milliseconds.
+     * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+     */
+    int setLimiter(int threshold, int ratio = 0, int release = CONFIG_MIXER_LIMITER_RELEASE);
+
+    /**
+     * Determines the gain currently applied by the limiter.
+     * @return the gain in the range 0..1023, where 1023 indicates that no gain reduction is being applied.
+     */
+    int getLimiterGain();
+
+#if CONFIG_ENABLED(CONFIG_MIXER_INSTRUMENTATION)
+    /**
+     * Provides the timing statistics gathered for this mixer, or for one of its channels.
+     *
+     * @param channel The channel to report on, or NULL to report on the mixer as a whole.
+     * @return the statistics gathered since the channel was added or statistics were last reset.
+     */
+    MixerStatistics *getStatistics(MixerChannel *channel = NULL);
+
+    /**
+     * Discards the timing statistics gathered for this mixer and all of its channels.
+     */
+    void resetStatistics();
+
+    /**
+     * Writes the timing statistics gathered for this mixer, its channels and its buffer pool to DMESG.
+     */
+    void dumpStatistics();
+#endif
+
     private:
     void configureChannel(MixerChannel *c);
+    void configureKernel(MixerChannel *c);
+
+    void updateHistory(MixerChannel *c);
+    void notifyRequiredRate(MixerChannel *c);
+    void configureLimiter();
+    void applyLimiter(int len);
+
+    template <typename T> void configureKernel(MixerChannel *c, bool resample);
+    void skipSamples(MixerChannel *ch, int len);
+
+    template <typename T, bool resample> static void mixSamples(MixerChannel *ch, float *out, int len);
+    template <typename T, int mode> static void mixSamplesInterpolated(MixerChannel *ch, float *out, int len);
+    static void mixSamplesGeneric(MixerChannel *ch, float *out, int len);
+
+    template <typename T, bool resample> static void mixSamplesFixed(MixerChannel *ch, int16_t *out, int len);
+    template <typename T, int mode> static void mixSamplesInterpolatedFixed(MixerChannel *ch, int16_t *out, int len);
+    static void mixSamplesGenericFixed(MixerChannel *ch, int16_t *out, int len);
 };
 
 } // namespace codal
@@ -26,21 +26,45 @@ DEALINGS IN THE SOFTWARE.
 #define SOUND_EMOJI_SYNTHESIZER_H
 
 #include "DataStream.h"
+#include "AudioBufferPool.h"
 
 #define EMOJI_SYNTHESIZER_SAMPLE_RATE         44100
 #define EMOJI_SYNTHESIZER_TONE_WIDTH          1024
 #define EMOJI_SYNTHESIZER_TONE_WIDTH_F        1024.0f
 #define EMOJI_SYNTHESIZER_BUFFER_SIZE         512
+#define EMOJI_SYNTHESIZER_WAVETABLE_BITS      8
+#define EMOJI_SYNTHESIZER_WAVETABLE_SIZE      (1 << EMOJI_SYNTHESIZER_WAVETABLE_BITS)
+#define EMOJI_SYNTHESIZER_CONTROL_PERIOD      32
+#define EMOJI_SYNTHESIZER_MIX_BLOCK           64
+
+// Enables band limited (PolyBLEP) rendering of square and sawtooth tones, and non-repeating noise.
+#ifndef CONFIG_EMOJI_SYNTHESIZER_BAND_LIMITED
+#define CONFIG_EMOJI_SYNTHESIZER_BAND_LIMITED   1
+#endif
+
+//
+// Waveforms rendered directly rather than from the wavetable of a voice
+//
+#define EMOJI_SYNTHESIZER_WAVEFORM_TABLE                        0
+#define EMOJI_SYNTHESIZER_WAVEFORM_SQUARE                       1
+#define EMOJI_SYNTHESIZER_WAVEFORM_SAWTOOTH                     2
+#define EMOJI_SYNTHESIZER_WAVEFORM_NOISE                        3
 
 #define EMOJI_SYNTHESIZER_TONE_EFFECT_PARAMETERS        2
 #define EMOJI_SYNTHESIZER_TONE_EFFECTS                  3
 
+// The maximum number of sound effects that can be scheduled in advance on a single synthesizer.
+#ifndef CONFIG_EMOJI_SYNTHESIZER_SEQUENCE_LENGTH
+#define CONFIG_EMOJI_SYNTHESIZER_SEQUENCE_LENGTH        16
+#endif
+
 //
 // Status flags
 //
 #define EMOJI_SYNTHESIZER_STATUS_ACTIVE                         0x01
 #define EMOJI_SYNTHESIZER_STATUS_OUTPUT_SILENCE_AS_EMPTY        0x02
 #define EMOJI_SYNTHESIZER_STATUS_STOPPING                       0x04
+#define EMOJI_SYNTHESIZER_STATUS_LOCKED                         0x08    // The voice's lock is held by the fiber that started its playout.
 
 
 #define DEVICE_ID_SOUND_EMOJI_SYNTHESIZER_0 3010
@@ -55,6 +79,7 @@ DEALINGS IN THE SOFTWARE.
 #define DEVICE_ID_SOUND_EMOJI_SYNTHESIZER_9 3019
 
 #define DEVICE_SOUND_EMOJI_SYNTHESIZER_EVT_DONE 1
+#define DEVICE_SOUND_EMOJI_SYNTHESIZER_EVT_VOICE_DONE 16                    // Raised alongside EVT_DONE, offset by the index of the voice that completed.
 
 namespace codal
 {
@@ -103,6 +128,53 @@ namespace codal
         ToneEffect          effects[EMOJI_SYNTHESIZER_TONE_EFFECTS];        // Optional Effects to apply to the SoundEffect
     } SoundEffect;
 
+    /**
+     * Rendering state of a single voice within a SoundEmojiSynthesizer.
+     * Each voice plays its own sequence of SoundEffects, and is rendered by an integer phase accumulator
+     * driving a wavetable sampled from the TonePrint of the current effect. Effects are evaluated once
+     * per control block, with frequency and volume ramped linearly across each block.
+     *
+     * Square and sawtooth tones are instead generated directly from the phase with PolyBLEP corrections at
+     * each edge, taking their levels from the wavetable, so they do not alias at high frequencies. Noise is
+     * generated by a shift register clocked at the rate of the wavetable, so it does not repeat each cycle.
+     */
+    struct SoundEmojiVoice
+    {
+        FiberLock               lock;                   // Ingress queue to handle concurrent playback requests on this voice.
+        ManagedBuffer           effectBuffer;           // Current sound effect sequence being generated.
+        SoundEffect*            effect;                 // The effect within the current EffectBuffer that's being generated.
+        uint16_t                status;                 // Voice specific status flags (EMOJI_SYNTHESIZER_STATUS_STOPPING, EMOJI_SYNTHESIZER_STATUS_LOCKED).
+
+        float                   frequency;              // The instantaneous frequency currently being generated within an effect.
+        float                   volume;                 // The instantaneous volume currently being generated within an effect.
+        int                     samplesToWrite;         // The number of samples needed from the current sound effect block.
+        int                     samplesWritten;         // The number of samples written from the current sound effect block.
+        float                   samplesPerStep[EMOJI_SYNTHESIZER_TONE_EFFECTS];     // The number of samples to render per step for each effect.
+
+        int                     controlEnd;             // The sample at which the current control block ends.
+
+        uint32_t                phase;                  // Position within the waveform, where 2^32 represents one full cycle.
+        uint32_t                increment;              // The phase increment of the sample being rendered.
+        int32_t                 incrementDelta;         // The per sample change in phase increment across the current control block.
+        int32_t                 gain;                   // The gain of the sample being rendered, in 16.16 fixed point.
+        int32_t                 gainDelta;              // The per sample change in gain across the current control block.
+        TonePrint               tone;                   // The TonePrint currently sampled into the wavetable.
+        uint8_t                 waveform;               // How the tone is rendered (EMOJI_SYNTHESIZER_WAVEFORM_*).
+        uint32_t                noise;                  // State of the noise generator.
+        int16_t                 noiseSample;            // The noise sample currently being held.
+        int16_t                 wavetable[EMOJI_SYNTHESIZER_WAVETABLE_SIZE + 1];    // One cycle of the tone centred on zero, plus a guard sample for interpolation.
+    };
+
+    /**
+     * A buffer of SoundEffects scheduled to start on a given voice at a given sample time.
+     */
+    struct SoundEmojiSequencerEvent
+    {
+        uint32_t                time;                   // The sample time at which playback starts.
+        int                     voice;                  // The voice on which to play the sound effects.
+        ManagedBuffer           sound;                  // The buffer of SoundEffects to play.
+    };
+
     /**
       * Class definition for the micro:bit Sound Emoji Synthesizer.
       * Generates synthesized sound effects based on a set of parameterised inputs.
@@ -112,31 +184,41 @@ namespace codal
         public:
 
         DataSink*               downStream;             // Our downstream component.
-        FiberLock               lock;                   // Ingress queue to handle concurrent playback requests.
         ManagedBuffer           buffer;                 // Current playout buffer.
-        ManagedBuffer           effectBuffer;           // Current sound effect sequence being generated.
         ManagedBuffer           emptyBuffer;            // Zero length buffer.
-        SoundEffect*            effect;                 // The effect within the current EffectBuffer that's being generated.
+        SoundEffect*            effect;                 // The effect being evaluated by a ToneEffectFunction.
+        AudioBufferPool*        pool;                   // Optional pool from which output buffers are allocated.
+        SoundEmojiVoice*        voices;                 // The voices of this synthesizer, rendered concurrently into the same output.
+        int                     voiceCount;             // The number of voices of this synthesizer.
+        SoundEmojiSequencerEvent* sequence;             // Sound effects scheduled for playback, in order of start time. Allocated on first use.
+        int                     sequenceLength;         // The number of sound effects currently scheduled.
+        uint32_t                sampleTime;             // The number of samples generated by this synthesizer.
 
         int                     sampleRate;             // The sample rate of our output, measure in samples per second (e.g. 44000).
         float                   sampleRange;            // The maximum sample value that can be output.
         uint16_t                orMask;                 // A bitmask that is logically OR'd with each output sample.
         int                     bufferSize;             // The number of samples to create in a single buffer before scheduling it for playback
 
-        float                   frequency;              // The instantaneous frequency currently being generated within an effect.
-        float                   volume;                 // The instantaneous volume currently being generated within an effect.
-        int                     samplesToWrite;         // The number of samples needed from the current sound effect block.
-        int                     samplesWritten;         // The number of samples written from the current sound effect block.
-        float                   position;               // Position within the tonePrint.
-        float                   samplesPerStep[EMOJI_SYNTHESIZER_TONE_EFFECTS];     // The number of samples to render per step for each effect.
+        float                   frequency;              // The frequency of the voice being evaluated by a ToneEffectFunction.
+        float                   volume;                 // The volume of the voice being evaluated by a ToneEffectFunction.
+
+        // The playback state of voice 0, under the names used before voices were introduced. The position within
+        // the TonePrint is no longer held as a float; see SoundEmojiVoice::phase.
+        FiberLock&              lock;                   // Ingress queue to handle concurrent playback requests on voice 0.
+        ManagedBuffer&          effectBuffer;           // Current sound effect sequence being generated on voice 0.
+        int&                    samplesToWrite;         // The number of samples needed from the current sound effect block of voice 0.
+        int&                    samplesWritten;         // The number of samples written from the current sound effect block of voice 0.
+        float                   (&samplesPerStep)[EMOJI_SYNTHESIZER_TONE_EFFECTS];  // The number of samples to render per step for each effect of voice 0.
+
         /**
           * Default Constructor.
           * Creates an empty DataStream.
           *
           * @param id The ID of this synthesizer.
           * @param sampleRate The sample rate at which this synthesizer will produce data.
+          * @param voiceCount The number of sound effect sequences that can be played simultaneously.
           */
-        SoundEmojiSynthesizer(uint16_t id, int sampleRate = EMOJI_SYNTHESIZER_SAMPLE_RATE);
+        SoundEmojiSynthesizer(uint16_t id, int sampleRate = EMOJI_SYNTHESIZER_SAMPLE_RATE, int voiceCount = 1);
 
         /**
           * Destructor.
@@ -162,7 +244,14 @@ namespace codal
         virtual ManagedBuffer pull() override;
 
         /**
-         * Schedules the next sound effect as defined in the effectBuffer, if available.
+         * Schedules the next sound effect as defined in the effectBuffer of the given voice, if available.
+         * @param voice The voice to advance.
+         * @return true if we've just completed a buffer of effects, false otherwise.
+         */
+        bool nextSoundEffect(SoundEmojiVoice *voice);
+
+        /**
+         * Schedules the next sound effect as defined in the effectBuffer of voice 0, if available.
          * @return true if we've just completed a buffer of effects, false otherwise.
          */
         bool nextSoundEffect();
@@ -170,15 +259,84 @@ namespace codal
         /**
         * Schedules playout of the given sound effect.
         * @param sound A buffer containing an array of one or more SoundEffects.
+        * @param voice The voice on which to play the sound effect.
         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER
         */
-        int play(ManagedBuffer sound);
+        int play(ManagedBuffer sound, int voice = 0);
 
         /**
-        * Stops play of the current buffer of SoundEffects and discards it.
+        * Stops play of the current buffer of SoundEffects on all voices and discards them.
         */
         void stop();
 
+        /**
+        * Stops play of the current buffer of SoundEffects on the given voice and discards it.
+        * @param voice The voice to stop.
+        * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER
+        */
+        int stop(int voice);
+
+        /**
+         * Schedules playout of the given sound effect at an exact sample time.
+         * When the sample time is reached, any sound effect playing on the voice is replaced, starting at the
+         * first sample of that time. This allows a sequence of sounds to be queued in advance and played with
+         * sample accurate timing, without waking a fiber for each sound. Sound effects scheduled in the past
+         * start at the beginning of the next buffer generated.
+         *
+         * @param sound A buffer containing an array of one or more SoundEffects.
+         * @param time The sample time at which to start playback. See getSampleTime().
+         * @param voice The voice on which to play the sound effect.
+         * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER, or DEVICE_NO_RESOURCES if
+         * CONFIG_EMOJI_SYNTHESIZER_SEQUENCE_LENGTH sound effects are already scheduled.
+         */
+        int schedule(ManagedBuffer sound, uint32_t time, int voice = 0);
+
+        /**
+         * Starts playout of the given sound effect on the given voice at once, replacing any sound effect playing or
+         * scheduled on it. Unlike play(), this never blocks, so may be used when the schedule is full.
+         *
+         * @param sound A buffer containing an array of one or more SoundEffects.
+         * @param voice The voice on which to play the sound effect.
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER
+         */
+        int replace(ManagedBuffer sound, int voice = 0);
+
+        /**
+         * Discards all sound effects scheduled for playout that have not yet started.
+         */
+        void clearSchedule();
+
+        /**
+         * Determines the current sample time of this synthesizer.
+         * The sample time is the number of samples generated so far. It advances only while the synthesizer
+         * is generating output, and wraps around after 2^32 samples.
+         *
+         * @return the sample time of the next sample to be generated.
+         */
+        uint32_t getSampleTime();
+
+        /**
+         * Determines the sample time a given period after the next sample to be generated.
+         *
+         * @param offset The period, in milliseconds.
+         * @return the sample time at the given offset.
+         */
+        uint32_t getSampleTime(float offset);
+
+        /**
+         * Determines if the given voice is playing, or has a sound effect scheduled to play.
+         *
+         * @param voice The voice to test.
+         * @return true if the voice is in use, false otherwise.
+         */
+        bool isVoiceActive(int voice);
+
+        /**
+         * Determines the number of voices of this synthesizer.
+         * @return the number of sound effect sequences that can be played simultaneously.
+         */
+        int getVoiceCount();
+
         /**
         * Define the size of the audio buffer to hold. The larger the buffer, the lower the CPU overhead, but the longer the delay.
         * @param size The new bufer size to use.
@@ -229,6 +387,14 @@ namespace codal
          */
         void allowEmptyBuffers(bool mode);
 
+        /**
+         * Defines a pool from which output buffers are allocated, rather than using the heap.
+         *
+         * @param pool The pool to use, or NULL to allocate output buffers from the heap.
+         * @return DEVICE_OK on success.
+         */
+        int setBufferPool(AudioBufferPool *pool);
+
 
         private:
 
@@ -241,6 +407,89 @@ namespace codal
          */
         int determineSampleCount(float playoutTime);
 
+        /**
+         * Moves the given voice onto its next sound effect if the current one has completed,
+         * and signals completion of its buffer of effects.
+         *
+         * @param voice The voice to prepare.
+         * @return true if the voice has samples to render, false otherwise.
+         */
+        bool prepareVoice(SoundEmojiVoice *voice);
+
+        /**
+         * Invokes the effect functions of the given voice for all effect steps that fall due before the given sample.
+         *
+         * @param voice The voice to update.
+         * @param end The sample at which the current control block ends.
+         */
+        void evaluateEffects(SoundEmojiVoice *voice, int end);
+
+        /**
+         * Determines the phase increment per sample for the given frequency, at the current sample rate.
+         *
+         * @param frequency The frequency, in Hz.
+         * @return the phase increment, where 2^32 represents one full cycle.
+         */
+        uint32_t phaseIncrement(float frequency);
+
+        /**
+         * Determines the gain to apply to wavetable samples for the given volume, at the current sample range.
+         *
+         * @param volume The volume, in the range 0..1.
+         * @return the gain, in 16.16 fixed point.
+         */
+        int32_t fixedGain(float volume);
+
+        /**
+         * Signals completion of the playout on the given voice: raises DEVICE_SOUND_EMOJI_SYNTHESIZER_EVT_DONE and
+         * DEVICE_SOUND_EMOJI_SYNTHESIZER_EVT_VOICE_DONE, and releases the voice's lock if a call to play() holds it.
+         *
+         * @param voice The voice that has completed.
+         */
+        void completeVoice(SoundEmojiVoice *voice);
+
+        /**
+         * Starts playback of the given buffer of sound effects on the given voice, replacing any playing.
+         * The frequency and volume of a playing sound effect ramp into those of the new one.
+         *
+         * @param voice The voice to use.
+         * @param sound A buffer containing an array of one or more SoundEffects.
+         */
+        void startSoundEffect(SoundEmojiVoice *voice, ManagedBuffer sound);
+
+        /**
+         * Renders the given number of samples of all voices, starting scheduled sound effects at the sample they fall due.
+         *
+         * @param out The buffer of signed samples to add the output of the voices into.
+         * @param len The number of samples to render.
+         */
+        void render(int32_t *out, int len);
+
+        /**
+         * Renders up to the given number of samples of the given voice, evaluating its effects as they fall due.
+         *
+         * @param voice The voice to render.
+         * @param out The buffer of signed samples to add the output of the voice into.
+         * @param len The number of samples to render.
+         */
+        void renderVoice(SoundEmojiVoice *voice, int32_t *out, int len);
+
+        /**
+         * Renders a block of samples of the tone of the given voice, ramping its frequency and volume.
+         *
+         * @param voice The voice to render.
+         * @param out The buffer of signed samples to add the output of the voice into.
+         * @param len The number of samples to render.
+         */
+        void renderTone(SoundEmojiVoice *voice, int32_t *out, int len);
+
+        /**
+         * Samples the TonePrint of the current effect of the given voice into its wavetable, and selects how it is rendered.
+         *
+         * @param voice The voice to update.
+         */
+        void loadWavetable(SoundEmojiVoice *voice);
+
     };
 }
 
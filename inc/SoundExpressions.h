@@ -28,9 +28,74 @@ DEALINGS IN THE SOFTWARE.
 #include "ManagedString.h"
 #include "SoundEmojiSynthesizer.h"
 
+// The number of compiled sound expressions retained for replay.
+#ifndef CONFIG_SOUND_EXPRESSIONS_CACHE_SIZE
+#define CONFIG_SOUND_EXPRESSIONS_CACHE_SIZE     4
+#endif
+
+// Identifies files written by SoundExpressions::save(). The version changes whenever SoundExpressionEffect does.
+#define SOUND_EXPRESSIONS_FILE_MAGIC            0x58455353      // "SSEX"
+#define SOUND_EXPRESSIONS_FILE_VERSION          1
+
 namespace codal
 {
-
+    /**
+     * Compiled form of a single effect within a sound expression.
+     * Holds the decoded parameters of the effect, including its ranges of randomness,
+     * which are applied each time the effect is played.
+     */
+    typedef struct
+    {
+        uint8_t     wave;                   // 0-4 waveform
+        uint8_t     shape;                  // Frequency interpolation shape
+        uint8_t     fxChoice;               // Vibrato effect choice
+        uint8_t     reserved;
+        int16_t     steps;                  // Frequency interpolation steps
+        uint16_t    volume;                 // 0-1023 start volume
+        uint16_t    frequency;              // Start frequency, in Hz
+        uint16_t    duration;               // Duration, in milliseconds
+        uint16_t    endFrequency;           // End frequency, in Hz
+        uint16_t    endVolume;              // 0-1023 end volume
+        uint16_t    fxParam;                // Vibrato effect parameter
+        uint16_t    fxnSteps;               // Vibrato effect steps
+        uint16_t    frequencyRandom;        // Random variation applied to each of the above
+        uint16_t    endFrequencyRandom;
+        uint16_t    volumeRandom;
+        uint16_t    endVolumeRandom;
+        uint16_t    durationRandom;
+        uint16_t    fxParamRandom;
+        uint16_t    fxnStepsRandom;
+    } SoundExpressionEffect;
+
+    /**
+     * Header of a file of compiled sound expression effects, written by SoundExpressions::save().
+     * The header is followed by count SoundExpressionEffects.
+     */
+    typedef struct
+    {
+        uint32_t    magic;                  // SOUND_EXPRESSIONS_FILE_MAGIC
+        uint8_t     version;                // SOUND_EXPRESSIONS_FILE_VERSION
+        uint8_t     effectSize;             // sizeof(SoundExpressionEffect)
+        uint16_t    count;                  // The number of effects in the file.
+    } SoundExpressionFileHeader;
+
+    /**
+     * An entry in the cache of compiled sound expressions.
+     */
+    typedef struct
+    {
+        uint32_t        hash;               // Hash of the sound expression, or name of the built-in sound.
+        uint32_t        lastUsed;           // Time of last use, used to select the least recently used entry.
+        ManagedString   sound;              // The sound expression, or name of the built-in sound.
+        ManagedBuffer   compiled;           // An array of SoundExpressionEffects compiled from the sound.
+    } SoundExpressionCacheEntry;
+
+    /**
+     * Plays sound expressions on the voices of a SoundEmojiSynthesizer.
+     * Sounds played concurrently are assigned to free voices and mixed within the synthesizer, so they
+     * play simultaneously on a single mixer channel. If all voices are busy, the voice that started
+     * playing least recently is stolen.
+     */
     class SoundExpressions
     {
         public:
@@ -48,7 +113,7 @@ namespace codal
 
         /**
          * Plays a sound encoded as a series of decimal encoded effects or specified by name.
-         * Blocks until the sound is complete.
+         * Blocks until the sound is complete, or until the voice it was assigned falls silent if it is stolen.
          */
         void play(ManagedString sound);
 
@@ -59,17 +124,66 @@ namespace codal
         void playAsync(ManagedString sound);
 
         /**
-         * Stops the currently playing sound.
+         * Plays a sound previously compiled by compile() or load().
+         * Blocks until the sound is complete, or until the voice it was assigned falls silent if it is stolen.
+         */
+        void play(ManagedBuffer compiled);
+
+        /**
+         * Plays a sound previously compiled by compile() or load().
+         * Does not block.
+         */
+        void playAsync(ManagedBuffer compiled);
+
+        /**
+         * Stops all currently playing sounds.
          */
         void stop();
 
+        /**
+         * Compiles a sound encoded as a series of decimal encoded effects or specified by name.
+         * Recently compiled sounds are retained, so replaying them does not require them to be parsed again.
+         *
+         * @param sound The sound expression, or name of a built-in sound.
+         * @return A buffer containing an array of SoundExpressionEffects, or an empty buffer if the sound is invalid.
+         */
+        ManagedBuffer compile(ManagedString sound);
+
+        /**
+         * Compiles a sound and stores the result in a file, so it can be replayed later without parsing.
+         *
+         * @param sound The sound expression, or name of a built-in sound.
+         * @param filename The file to create.
+         * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the sound is invalid, or DEVICE_NO_RESOURCES if the file could not be written.
+         */
+        int save(ManagedString sound, ManagedString filename);
+
+        /**
+         * Loads a sound previously stored by save().
+         *
+         * @param filename The file to read.
+         * @return A buffer containing an array of SoundExpressionEffects, or an empty buffer if the file does not exist,
+         * was not written by save(), or was written by an incompatible version.
+         */
+        ManagedBuffer load(ManagedString filename);
+
         private:
         SoundEmojiSynthesizer &synth;
+        SoundExpressionCacheEntry cache[CONFIG_SOUND_EXPRESSIONS_CACHE_SIZE];
+        uint32_t cacheClock;
+        uint32_t *voiceStarted;             // The voiceClock at which each voice of the synthesizer was last assigned a sound.
+        uint32_t voiceClock;
+
+        int allocateVoice();
+        void start(ManagedBuffer compiled, int voice);
 
         static int parseDigits(const char *input, const int digits);
         static int applyRandom(int value, int rand);
+        static uint32_t hash(ManagedString sound);
         static ManagedString lookupBuiltIn(ManagedString sound);
-        bool parseSoundExpression(const char *soundChars, SoundEffect *fx);
+        static bool parseSoundExpression(const char *soundChars, SoundExpressionEffect *fx);
+        static bool isValid(ManagedBuffer compiled);
+        static void expandSoundExpression(const SoundExpressionEffect *fx, SoundEffect *effect);
 
     };
 }
@@ -30,17 +30,22 @@ DEALINGS IN THE SOFTWARE.
 #include "CodalComponent.h"
 #include "MicroBitCompat.h"
 #include "Mixer2.h"
-#include "SoundEmojiSynthesizer.h"
+#include "SquareWaveGenerator.h"
 
 #ifndef CONFIG_SOUND_OUTPUT_PIN_PERIOD
 #define CONFIG_SOUND_OUTPUT_PIN_PERIOD  50
 #endif
 
+// The sample rate at which square waves are synthesized. The mixer resamples these to its output rate as needed.
+#ifndef CONFIG_SOUND_OUTPUT_PIN_SAMPLE_RATE
+#define CONFIG_SOUND_OUTPUT_PIN_SAMPLE_RATE  22050
+#endif
+
 #ifndef CONFIG_SOUND_OUTPUT_PIN_SILENCE_GATE
 #define CONFIG_SOUND_OUTPUT_PIN_SILENCE_GATE  100
 #endif
 
-#define SOUND_OUTPUT_PIN_STATUS_ACTIVE        0x0001        // Synthesizer is actively generating sound
+#define SOUND_OUTPUT_PIN_STATUS_ACTIVE        0x0001        // Generator is attached to the mixer
 
 /**
   * Class definition for a SoundPin.
@@ -54,9 +59,7 @@ namespace codal
     private:
         Mixer2                  &mixer;
         MixerChannel            *channel;
-        SoundEmojiSynthesizer   synth;
-        ManagedBuffer           outputBuffer;
-        SoundEffect             *fx;
+        SquareWaveGenerator     generator;
         int                     periodUs;
         int                     value;
         uint32_t                timeOfLastUpdate;
@@ -136,7 +139,7 @@ namespace codal
 
         /**
           * Callback when the device is idling. We use this to determine long periods of silence,
-          * and disable the synthesizer.
+          * and detach the generator from the mixer.
           */
         virtual void idleCallback() override;
 
@@ -0,0 +1,148 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CODAL_SQUARE_WAVE_GENERATOR_H
+#define CODAL_SQUARE_WAVE_GENERATOR_H
+
+#include "CodalConfig.h"
+#include "DataStream.h"
+#include "AudioBufferPool.h"
+
+// The size of each buffer generated, in bytes.
+#ifndef CONFIG_SQUARE_WAVE_GENERATOR_BUFFER_SIZE
+#define CONFIG_SQUARE_WAVE_GENERATOR_BUFFER_SIZE    512
+#endif
+
+#define SQUARE_WAVE_GENERATOR_RANGE                 1023    // The sample range of the generated waveform.
+
+namespace codal
+{
+
+/**
+ * A lightweight DataSource generating a square or pulse wave of a given frequency, duty cycle and amplitude.
+ *
+ * Samples are generated as 16 bit signed values, spanning SQUARE_WAVE_GENERATOR_RANGE at full amplitude.
+ * A 32 bit phase accumulator determines how many samples remain until the next edge, so each buffer is written
+ * as a small number of runs of constant value, rather than evaluating a waveform per sample. No buffer is
+ * generated while the amplitude is zero.
+ */
+class SquareWaveGenerator : public DataSource
+{
+    DataSink                *downStream;        // Our downstream component.
+    AudioBufferPool         *pool;              // Optional pool from which output buffers are allocated.
+    int                     sampleRate;         // The sample rate of our output, in samples per second.
+    float                   frequency;          // The frequency of the waveform, in Hz.
+    volatile uint32_t       increment;          // The phase advanced per sample, as a fraction of 2^32.
+    volatile uint32_t       duty;               // The phase at which the output falls from high to low, as a fraction of 2^32.
+    volatile int16_t        amplitude;          // The peak sample value.
+    uint32_t                phase;              // The current phase, as a fraction of 2^32.
+
+    public:
+
+    /**
+     * Constructor.
+     * Creates a silent generator.
+     *
+     * @param sampleRate The sample rate at which to generate samples.
+     */
+    SquareWaveGenerator(int sampleRate);
+
+    /**
+     * Provide the next available ManagedBuffer to our downstream caller.
+     */
+    virtual ManagedBuffer pull() override;
+
+    /**
+     * Define a downstream component for data stream.
+     *
+     * @sink The component that data will be delivered to, when it is availiable
+     */
+    virtual void connect(DataSink &sink) override;
+
+    /**
+     * Stop delivering data to our downstream component.
+     */
+    virtual void disconnect() override;
+
+    /**
+     * Determine the data format of the buffers streamed out of this component.
+     */
+    virtual int getFormat() override;
+
+    /**
+     * Defines the frequency of the waveform.
+     *
+     * @param frequency The frequency, in Hz. Values above half the sample rate are clamped.
+     * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+     */
+    int setFrequency(float frequency);
+
+    /**
+     * Defines the duty cycle of the waveform.
+     *
+     * @param duty The proportion of each cycle for which the output is high, in the range 0..1023. 512 generates a square wave.
+     * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+     */
+    int setDutyCycle(int duty);
+
+    /**
+     * Defines the amplitude of the waveform.
+     *
+     * @param volume The amplitude, in the range 0..1023, where 1023 spans the full sample range.
+     * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+     */
+    int setVolume(int volume);
+
+    /**
+     * Determines the amplitude of the waveform.
+     * @return the amplitude, in the range 0..1023.
+     */
+    int getVolume();
+
+    /**
+     * Change the sample rate at which samples are generated.
+     *
+     * @param sampleRate The new sample rate, in samples per second.
+     * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+     */
+    int setSampleRate(int sampleRate);
+
+    /**
+     * Determine the sample rate at which samples are generated.
+     * @return the sample rate, in samples per second.
+     */
+    int getSampleRate();
+
+    /**
+     * Defines a pool from which output buffers are allocated, rather than using the heap.
+     *
+     * @param pool The pool to use, or NULL to allocate output buffers from the heap.
+     * @return DEVICE_OK on success.
+     */
+    int setBufferPool(AudioBufferPool *pool);
+};
+
+} // namespace codal
+
+#endif
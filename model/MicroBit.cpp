@@ -84,7 +84,7 @@ MicroBit::MicroBit() :
     accelerometer(MicroBitAccelerometer::autoDetect(_i2c)),
     compass(MicroBitCompass::autoDetect(_i2c)),
     compassCalibrator(compass, accelerometer, display, storage),
-    audio(io.P0, io.speaker)
+    audio(io.P0, io.speaker, adc, io.microphone, io.runmic)
 {
     // Clear our status
     status = 0;
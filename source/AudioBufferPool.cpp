@@ -0,0 +1,202 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "AudioBufferPool.h"
+#include "codal_target_hal.h"
+#include "ErrorNo.h"
+
+// RefCounted objects hold (2 * references) + 1. A pooled buffer referenced only by the pool is free for reuse.
+#define AUDIO_BUFFER_POOL_UNREFERENCED  3
+
+using namespace codal;
+
+/**
+ * Constructor.
+ * Creates an empty pool. Buffers are allocated on first use, or by calling fill().
+ *
+ * @param bufferSize The size of each buffer in the pool, in bytes.
+ */
+AudioBufferPool::AudioBufferPool(int bufferSize)
+{
+    this->bufferSize = bufferSize;
+    this->next = 0;
+    this->hits = 0;
+    this->misses = 0;
+    this->highWaterMark = 0;
+
+    for (int i = 0; i < CONFIG_AUDIO_BUFFER_POOL_SIZE; i++)
+        buffers[i] = NULL;
+}
+
+/**
+ * Destructor.
+ * Releases the pool's reference to each of its buffers.
+ */
+AudioBufferPool::~AudioBufferPool()
+{
+    for (int i = 0; i < CONFIG_AUDIO_BUFFER_POOL_SIZE; i++)
+        if (buffers[i])
+            buffers[i]->decr();
+}
+
+/**
+ * Allocates every buffer in the pool that has not yet been allocated.
+ * Should be called from thread context, so that later allocations made from interrupt context do not use the heap.
+ *
+ * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the heap is exhausted.
+ */
+int AudioBufferPool::fill()
+{
+    for (int i = 0; i < CONFIG_AUDIO_BUFFER_POOL_SIZE; i++)
+    {
+        if (buffers[i] == NULL)
+        {
+            ManagedBuffer b(bufferSize);
+
+            if (b.length() != bufferSize)
+                return DEVICE_NO_RESOURCES;
+
+            target_disable_irq();
+            if (buffers[i] == NULL)
+                buffers[i] = b.leakData();
+            target_enable_irq();
+        }
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Provides a buffer of the given size. The buffer returns to the pool when the last reference to it is released.
+ * Safe to call from interrupt context.
+ *
+ * @param size The size of buffer required, in bytes.
+ * @return A buffer of the requested size. Its contents are undefined.
+ */
+ManagedBuffer AudioBufferPool::allocate(int size)
+{
+    if (size != bufferSize)
+    {
+        misses++;
+        return ManagedBuffer(size);
+    }
+
+    BufferData *result = NULL;
+    int empty = -1;
+    int inUse = 0;
+
+    target_disable_irq();
+
+    // Search the ring for a buffer that nobody else holds a reference to, starting after the last one handed out.
+    // References are only ever released concurrently, so a buffer seen as free cannot be claimed by anyone else.
+    for (int i = 0; i < CONFIG_AUDIO_BUFFER_POOL_SIZE; i++)
+    {
+        int slot = (next + i) % CONFIG_AUDIO_BUFFER_POOL_SIZE;
+
+        if (buffers[slot] == NULL)
+        {
+            if (empty < 0)
+                empty = slot;
+        }
+        else if (buffers[slot]->refCount != AUDIO_BUFFER_POOL_UNREFERENCED)
+        {
+            inUse++;
+        }
+        else if (result == NULL)
+        {
+            result = buffers[slot];
+            next = (slot + 1) % CONFIG_AUDIO_BUFFER_POOL_SIZE;
+        }
+    }
+
+    if (result)
+    {
+        hits++;
+        inUse++;
+    }
+    else
+    {
+        misses++;
+    }
+
+    if (inUse > highWaterMark)
+        highWaterMark = inUse;
+
+    target_enable_irq();
+
+    if (result)
+        return ManagedBuffer(result);
+
+    // The pool is exhausted. Grow into an empty slot if there is one, otherwise hand out an unpooled buffer.
+    ManagedBuffer b(size);
+
+    if (empty >= 0 && b.length() == size)
+    {
+        target_disable_irq();
+        if (buffers[empty] == NULL)
+        {
+            buffers[empty] = b.leakData();
+            b = ManagedBuffer(buffers[empty]);
+
+            if (++inUse > highWaterMark)
+                highWaterMark = inUse;
+        }
+        target_enable_irq();
+    }
+
+    return b;
+}
+
+/**
+ * Determines the size of the buffers held in this pool.
+ * @return the size of each buffer, in bytes.
+ */
+int AudioBufferPool::getBufferSize()
+{
+    return bufferSize;
+}
+
+/**
+ * Determines the number of allocations that were served by recycling a pooled buffer.
+ */
+uint32_t AudioBufferPool::getHits()
+{
+    return hits;
+}
+
+/**
+ * Determines the number of allocations that were served from the heap.
+ */
+uint32_t AudioBufferPool::getMisses()
+{
+    return misses;
+}
+
+/**
+ * Determines the largest number of pooled buffers that have been in use at the same time.
+ */
+int AudioBufferPool::getHighWaterMark()
+{
+    return highWaterMark;
+}
@@ -0,0 +1,308 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "AudioRenderQueue.h"
+#include "CodalFiber.h"
+#include "codal_target_hal.h"
+#include "ErrorNo.h"
+
+using namespace codal;
+
+/**
+ * Constructor.
+ * Rendering starts when this queue is connected to a sink.
+ *
+ * @param source The component to render audio from.
+ * @param depth The number of buffers to render ahead of playback, in the range 1..CONFIG_AUDIO_RENDER_QUEUE_MAX_DEPTH.
+ */
+AudioRenderQueue::AudioRenderQueue(DataSource &source, int depth) : upStream(source)
+{
+    this->downStream = NULL;
+    this->head = 0;
+    this->tail = 0;
+    this->pullRequests = 0;
+    this->depth = CONFIG_AUDIO_RENDER_QUEUE_DEPTH;
+    this->bytesPerSample = 0;
+    this->lastSample = 0;
+    this->silenceSample = 0;
+    this->status = 0;
+
+    setDepth(depth);
+    resetStatistics();
+}
+
+/**
+ * Destructor.
+ * Stops rendering, and waits for the render fiber to exit.
+ */
+AudioRenderQueue::~AudioRenderQueue()
+{
+    disconnect();
+
+    while (status & AUDIO_RENDER_QUEUE_STATUS_FIBER)
+        fiber_sleep(CONFIG_AUDIO_RENDER_QUEUE_PERIOD);
+}
+
+/**
+ * Define a downstream component for data stream, and start rendering ahead for it.
+ * Playback is started once the queue has been filled.
+ *
+ * @sink The component that data will be delivered to, when it is availiable
+ */
+void AudioRenderQueue::connect(DataSink &sink)
+{
+    this->downStream = &sink;
+    status |= AUDIO_RENDER_QUEUE_STATUS_STREAMING;
+
+    upStream.connect(*this);
+
+    if (!(status & AUDIO_RENDER_QUEUE_STATUS_FIBER))
+    {
+        status |= AUDIO_RENDER_QUEUE_STATUS_FIBER;
+        create_fiber(renderFiber, this);
+    }
+}
+
+/**
+ * Stop rendering for our downstream component.
+ */
+void AudioRenderQueue::disconnect()
+{
+    target_disable_irq();
+    status &= ~(AUDIO_RENDER_QUEUE_STATUS_STREAMING | AUDIO_RENDER_QUEUE_STATUS_PRIMED);
+    this->downStream = NULL;
+    target_enable_irq();
+
+    // Don't play out stale audio if we are reconnected.
+    flush();
+}
+
+/**
+ * Determine the data format of the buffers streamed out of this component.
+ */
+int AudioRenderQueue::getFormat()
+{
+    return upStream.getFormat();
+}
+
+/**
+ * Callback provided when data is ready from our upstream component.
+ */
+int AudioRenderQueue::pullRequest()
+{
+    pullRequests++;
+    return DEVICE_OK;
+}
+
+/**
+ * Provide the next rendered ManagedBuffer to our downstream caller.
+ * Safe to call from interrupt context.
+ */
+ManagedBuffer AudioRenderQueue::pull()
+{
+    ManagedBuffer b;
+    int occupancy = (int) (tail - head);
+
+    if (!(status & AUDIO_RENDER_QUEUE_STATUS_STREAMING))
+        return b;
+
+    pulls++;
+
+    if (occupancy < lowWaterMark)
+        lowWaterMark = occupancy;
+
+    if (occupancy)
+    {
+        int slot = head % CONFIG_AUDIO_RENDER_QUEUE_MAX_DEPTH;
+        b = buffers[slot];
+        buffers[slot] = ManagedBuffer();
+        head++;
+
+        // Remember where playback left off, in case we need to hold that level through an underrun.
+        if (b.length() >= bytesPerSample)
+        {
+            lastSample = 0;
+            memcpy(&lastSample, &b[b.length() - bytesPerSample], bytesPerSample);
+        }
+    }
+    else
+    {
+        underruns++;
+
+        // Hold the last sample delivered, to avoid an audible step.
+        if (silenceSample != lastSample)
+        {
+            for (int i = 0; i + bytesPerSample <= silence.length(); i += bytesPerSample)
+                memcpy(&silence[i], &lastSample, bytesPerSample);
+
+            silenceSample = lastSample;
+        }
+
+        b = silence;
+    }
+
+    // We always have something to offer, so request that the next buffer be pulled.
+    downStream->pullRequest();
+    return b;
+}
+
+/**
+ * Defines the number of buffers rendered ahead of playback. May be changed while streaming.
+ *
+ * @param depth The number of buffers, in the range 1..CONFIG_AUDIO_RENDER_QUEUE_MAX_DEPTH.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int AudioRenderQueue::setDepth(int depth)
+{
+    if (depth < 1 || depth > CONFIG_AUDIO_RENDER_QUEUE_MAX_DEPTH)
+        return DEVICE_INVALID_PARAMETER;
+
+    this->depth = depth;
+    return DEVICE_OK;
+}
+
+/**
+ * Determines the number of buffers rendered ahead of playback.
+ */
+int AudioRenderQueue::getDepth()
+{
+    return depth;
+}
+
+/**
+ * Determines the number of buffers currently rendered and awaiting playback.
+ */
+int AudioRenderQueue::getOccupancy()
+{
+    return (int) (tail - head);
+}
+
+/**
+ * Discards all buffers rendered but not yet played. If streaming, the last sample played is held
+ * until the queue is refilled.
+ */
+void AudioRenderQueue::flush()
+{
+    target_disable_irq();
+
+    while (head != tail)
+    {
+        buffers[head % CONFIG_AUDIO_RENDER_QUEUE_MAX_DEPTH] = ManagedBuffer();
+        head++;
+    }
+
+    target_enable_irq();
+}
+
+/**
+ * Determines the smallest number of buffers found awaiting playback when a buffer was pulled, since the
+ * queue was primed or statistics were last reset.
+ */
+int AudioRenderQueue::getLowWaterMark()
+{
+    return pulls ? lowWaterMark : getOccupancy();
+}
+
+/**
+ * Determines the number of times the queue was found empty when a buffer was pulled.
+ */
+uint32_t AudioRenderQueue::getUnderrunCount()
+{
+    return underruns;
+}
+
+/**
+ * Determines the number of buffers pulled since the queue was primed or statistics were last reset.
+ */
+uint32_t AudioRenderQueue::getPullCount()
+{
+    return pulls;
+}
+
+/**
+ * Resets the pull count, underrun count and low water mark.
+ */
+void AudioRenderQueue::resetStatistics()
+{
+    target_disable_irq();
+    pulls = 0;
+    underruns = 0;
+    lowWaterMark = CONFIG_AUDIO_RENDER_QUEUE_MAX_DEPTH;
+    target_enable_irq();
+}
+
+/**
+ * Pulls buffers from upstream until the queue is full, or upstream has nothing more to offer.
+ */
+void AudioRenderQueue::render()
+{
+    while ((status & AUDIO_RENDER_QUEUE_STATUS_STREAMING) && pullRequests > 0 && (int) (tail - head) < depth)
+    {
+        target_disable_irq();
+        pullRequests--;
+        target_enable_irq();
+
+        ManagedBuffer b = upStream.pull();
+
+        if (b.length() == 0)
+            continue;
+
+        // Size our silence buffer to match what upstream generates. We're in fiber context, so can use the heap.
+        if (silence.length() != b.length())
+        {
+            bytesPerSample = DATASTREAM_FORMAT_BYTES_PER_SAMPLE(upStream.getFormat());
+            silence = ManagedBuffer(b.length());
+
+            // Ensure the new buffer is filled before its first use.
+            silenceSample = lastSample + 1;
+        }
+
+        buffers[tail % CONFIG_AUDIO_RENDER_QUEUE_MAX_DEPTH] = b;
+        tail++;
+    }
+
+    // Start playback once the queue is full.
+    if ((status & AUDIO_RENDER_QUEUE_STATUS_STREAMING) && !(status & AUDIO_RENDER_QUEUE_STATUS_PRIMED) && (int) (tail - head) >= depth)
+    {
+        status |= AUDIO_RENDER_QUEUE_STATUS_PRIMED;
+        resetStatistics();
+        downStream->pullRequest();
+    }
+}
+
+/**
+ * Entry point of the render fiber.
+ */
+void AudioRenderQueue::renderFiber(void *queue)
+{
+    AudioRenderQueue *q = (AudioRenderQueue *) queue;
+
+    while (q->status & AUDIO_RENDER_QUEUE_STATUS_STREAMING)
+    {
+        q->render();
+        fiber_sleep(CONFIG_AUDIO_RENDER_QUEUE_PERIOD);
+    }
+
+    q->status &= ~AUDIO_RENDER_QUEUE_STATUS_FIBER;
+}
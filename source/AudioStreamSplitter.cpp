@@ -0,0 +1,149 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "AudioStreamSplitter.h"
+#include "ErrorNo.h"
+
+using namespace codal;
+
+/**
+ * Constructor.
+ * @param parent The splitter this channel belongs to.
+ */
+AudioSplitterChannel::AudioSplitterChannel(AudioStreamSplitter &parent) : parent(parent)
+{
+    this->downStream = NULL;
+}
+
+/**
+ * Provide the most recent buffer from the shared stream to our downstream caller, if it has not already been collected.
+ */
+ManagedBuffer AudioSplitterChannel::pull()
+{
+    ManagedBuffer b = buffer;
+    buffer = ManagedBuffer();
+
+    return b;
+}
+
+/**
+ * Define a downstream component for data stream.
+ *
+ * @sink The component that data will be delivered to, when it is availiable
+ */
+void AudioSplitterChannel::connect(DataSink &sink)
+{
+    this->downStream = &sink;
+}
+
+/**
+ * Stop delivering data to our downstream component.
+ */
+void AudioSplitterChannel::disconnect()
+{
+    this->downStream = NULL;
+    this->buffer = ManagedBuffer();
+}
+
+/**
+ * Determine the data format of the buffers streamed out of this component.
+ */
+int AudioSplitterChannel::getFormat()
+{
+    return parent.getFormat();
+}
+
+/**
+ * Constructor.
+ * Connects to the given source immediately.
+ *
+ * @param source The component whose stream is to be shared.
+ */
+AudioStreamSplitter::AudioStreamSplitter(DataSource &source) : upStream(source)
+{
+    for (int i = 0; i < CONFIG_AUDIO_STREAM_SPLITTER_CHANNELS; i++)
+        channels[i] = NULL;
+
+    upStream.connect(*this);
+}
+
+/**
+ * Destructor.
+ * Disconnects from our source, and deletes all channels.
+ */
+AudioStreamSplitter::~AudioStreamSplitter()
+{
+    upStream.disconnect();
+
+    for (int i = 0; i < CONFIG_AUDIO_STREAM_SPLITTER_CHANNELS; i++)
+        delete channels[i];
+}
+
+/**
+ * Creates a new output of the shared stream. The channel is owned by the splitter.
+ * @return the new channel, or NULL if CONFIG_AUDIO_STREAM_SPLITTER_CHANNELS are already in use.
+ */
+AudioSplitterChannel *AudioStreamSplitter::createChannel()
+{
+    for (int i = 0; i < CONFIG_AUDIO_STREAM_SPLITTER_CHANNELS; i++)
+    {
+        if (channels[i] == NULL)
+        {
+            channels[i] = new AudioSplitterChannel(*this);
+            return channels[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Callback provided when data is ready from our upstream component.
+ * Pulls the buffer once, and offers it to each connected channel.
+ */
+int AudioStreamSplitter::pullRequest()
+{
+    ManagedBuffer b = upStream.pull();
+
+    for (int i = 0; i < CONFIG_AUDIO_STREAM_SPLITTER_CHANNELS; i++)
+    {
+        AudioSplitterChannel *c = channels[i];
+
+        if (c && c->downStream)
+        {
+            c->buffer = b;
+            c->downStream->pullRequest();
+        }
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Determine the data format of the shared stream.
+ */
+int AudioStreamSplitter::getFormat()
+{
+    return upStream.getFormat();
+}
@@ -30,22 +30,53 @@ DEALINGS IN THE SOFTWARE.
 #include "Synthesizer.h"
 #include "SoundExpressions.h"
 #include "SoundEmojiSynthesizer.h"
+#include "codal_target_hal.h"
 
 using namespace codal;
 
 MicroBitAudio* MicroBitAudio::instance = NULL;
 
+// Output sample rates that may be negotiated, in ascending order.
+static const int microbitAudioSampleRates[] = {16000, 22050, CONFIG_MICROBIT_AUDIO_SAMPLE_RATE};
+
 /**
-  * Default Constructor.
-  */
-MicroBitAudio::MicroBitAudio(NRF52Pin &pin, NRF52Pin &speaker):
+ * Constructor.
+ * Creates an output only audio pipeline, without microphone capture.
+ */
+MicroBitAudio::MicroBitAudio(NRF52Pin &pin, NRF52Pin &speaker) : MicroBitAudio(pin, speaker, NULL, NULL, NULL)
+{
+}
+
+/**
+ * Constructor.
+ * Creates an audio pipeline that can also capture from the microphone sampled by the given ADC.
+ */
+MicroBitAudio::MicroBitAudio(NRF52Pin &pin, NRF52Pin &speaker, NRF52ADC &adc, NRF52Pin &microphone, NRF52Pin &runmic) : MicroBitAudio(pin, speaker, &adc, &microphone, &runmic)
+{
+}
+
+/**
+ * Constructor used by the public constructors. The ADC and microphone pins are NULL if there is no microphone.
+ */
+MicroBitAudio::MicroBitAudio(NRF52Pin &pin, NRF52Pin &speaker, NRF52ADC *adc, NRF52Pin *microphone, NRF52Pin *runmic):
+    bufferPool(CONFIG_MIXER_BUFFER_SIZE),
+    mixer(CONFIG_MICROBIT_AUDIO_SAMPLE_RATE),
     speakerEnabled(true),
     pinEnabled(true),
     pin(pin), 
     speaker(speaker),
-    synth(DEVICE_ID_SOUND_EMOJI_SYNTHESIZER_0),
+    adc(adc),
+    microphone(microphone),
+    runmic(runmic),
+    microphoneSplitter(NULL),
+    capture(NULL),
+    synth(DEVICE_ID_SOUND_EMOJI_SYNTHESIZER_0, EMOJI_SYNTHESIZER_SAMPLE_RATE, CONFIG_MICROBIT_AUDIO_SOUND_EXPRESSION_VOICES),
     soundExpressionChannel(NULL),
     pwm(NULL),
+    renderQueue(NULL),
+    renderAhead(CONFIG_MICROBIT_AUDIO_RENDER_AHEAD),
+    sampleRate(CONFIG_MICROBIT_AUDIO_SAMPLE_RATE),
+    timeOfLastRateRequirement(0),
     soundExpressions(synth),
     virtualOutputPin(mixer)
 {
@@ -54,6 +85,10 @@ MicroBitAudio::MicroBitAudio(NRF52Pin &pin, NRF52Pin &speaker):
         MicroBitAudio::instance = this;
 
     synth.allowEmptyBuffers(true);
+
+    // Share a common pool of output buffers across the audio pipeline.
+    mixer.setBufferPool(&bufferPool);
+    synth.setBufferPool(&bufferPool);
 }
 
 /**
@@ -63,11 +98,17 @@ int MicroBitAudio::enable()
 {
     if (pwm == NULL)
     {
+        // Populate our buffer pool now, so that the pipeline does not need to use the heap from interrupt context.
+        bufferPool.fill();
+
+        // In render-ahead mode, the PWM driver plays out a queue filled from fiber context, rather than pulling the mixer directly.
+        if (renderAhead)
+            renderQueue = new AudioRenderQueue(mixer, renderAhead);
 
-        pwm = new NRF52PWM(NRF_PWM1, mixer, 44100);
+        pwm = new NRF52PWM(NRF_PWM1, renderQueue ? (DataSource &) *renderQueue : (DataSource &) mixer, sampleRate);
         pwm->setDecoderMode(PWM_DECODER_LOAD_Common);
 
-        mixer.setSampleRate(44100);
+        mixer.setSampleRate(sampleRate);
         mixer.setSampleRange(pwm->getSampleRange());
         mixer.setOrMask(0x8000);
 
@@ -75,6 +116,14 @@ int MicroBitAudio::enable()
         setPinEnabled(pinEnabled);
 
         soundExpressionChannel = mixer.addChannel(synth);
+
+#if CONFIG_ENABLED(CONFIG_MICROBIT_AUDIO_SAMPLE_RATE_NEGOTIATION)
+        // Periodically match our output sample rate to the channels generating audio.
+        // Channels that need a higher rate raise it as soon as they are added, rather than on the next idle tick.
+        timeOfLastRateRequirement = system_timer_current_time();
+        mixer.setRateHandler(onRateRequired, this);
+        status |= DEVICE_COMPONENT_STATUS_IDLE_TICK;
+#endif
     }
 
     return DEVICE_OK;
@@ -175,6 +224,174 @@ bool MicroBitAudio::isPinEnabled()
     return this->pinEnabled;
 }
 
+/**
+ * Configures render-ahead mode. In this mode, the mixer is pulled from a dedicated fiber into a queue of
+ * buffers, rather than from the interrupt context of the PWM driver, so the cost of synthesis does not
+ * cause glitches in playback. Deeper queues are more robust, at the cost of latency.
+ *
+ * The mode must be chosen before the audio pipeline is activated. Once active, only the depth of the queue may be changed.
+ *
+ * @param depth The number of buffers to render ahead, in the range 1..CONFIG_AUDIO_RENDER_QUEUE_MAX_DEPTH, or 0 to disable render-ahead mode.
+ * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER, or DEVICE_NOT_SUPPORTED if the pipeline is already active in another mode.
+ */
+int MicroBitAudio::setRenderAhead(int depth)
+{
+    if (depth < 0 || depth > CONFIG_AUDIO_RENDER_QUEUE_MAX_DEPTH)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (pwm)
+    {
+        if (renderQueue == NULL || depth == 0)
+            return DEVICE_NOT_SUPPORTED;
+
+        renderQueue->setDepth(depth);
+    }
+
+    renderAhead = depth;
+    return DEVICE_OK;
+}
+
+/**
+ * Provides the queue used in render-ahead mode, for example to monitor underruns and occupancy.
+ * @return the render queue, or NULL if the pipeline is not active in render-ahead mode.
+ */
+AudioRenderQueue *MicroBitAudio::getRenderQueue()
+{
+    return renderQueue;
+}
+
+/**
+ * Provides the splitter through which the microphone stream is shared. Consumers of the microphone should
+ * each take a channel from it, rather than connecting to the ADC channel directly, which supports only one.
+ * @return the splitter, or NULL if this pipeline has no microphone.
+ */
+AudioStreamSplitter *MicroBitAudio::getMicrophoneSplitter()
+{
+    if (microphoneSplitter == NULL && adc != NULL)
+        microphoneSplitter = new AudioStreamSplitter(adc->getChannel(*microphone)->output);
+
+    return microphoneSplitter;
+}
+
+/**
+ * Provides the microphone capture pipeline, powering up the microphone on first use.
+ * The microphone is captured at the sample rate the ADC is already configured for.
+ * @return the capture component, through which the microphone level and features may be monitored,
+ * or NULL if this pipeline has no microphone.
+ */
+MicroBitAudioCapture *MicroBitAudio::getCapture()
+{
+    if (capture == NULL && adc != NULL)
+    {
+        AudioSplitterChannel *channel = getMicrophoneSplitter()->createChannel();
+
+        if (channel == NULL)
+            return NULL;
+
+        // Power up the microphone. The ADC is shared with other channels, so its sample period is left as it is.
+        runmic->setDigitalValue(1);
+        runmic->setHighDrive(true);
+        adc->getChannel(*microphone)->setGain(7, 0);
+
+        capture = new MicroBitAudioCapture(*channel, 1000000 / adc->getSamplePeriod());
+    }
+
+    return capture;
+}
+
+/**
+ * Determine the current output sample rate of the audio pipeline.
+ * @return The sample rate, in samples per second.
+ */
+int MicroBitAudio::getSampleRate()
+{
+    return sampleRate;
+}
+
+/**
+ * Periodic callback from the idle fiber, used to negotiate the output sample rate of the pipeline.
+ */
+void MicroBitAudio::idleCallback()
+{
+    if (pwm == NULL)
+        return;
+
+    // Choose the lowest supported rate that satisfies every channel generating audio.
+    int rate = selectSampleRate(mixer.getRequiredSampleRate());
+
+    // Raise the rate immediately, but only lower it once the lower rate has been sufficient for a while.
+    // This avoids repeatedly reconfiguring the pipeline between short sounds.
+    if (rate >= sampleRate)
+    {
+        timeOfLastRateRequirement = system_timer_current_time();
+
+        if (rate > sampleRate)
+            configureSampleRate(rate);
+    }
+    else if (system_timer_current_time() - timeOfLastRateRequirement > CONFIG_MICROBIT_AUDIO_SAMPLE_RATE_HOLD)
+    {
+        configureSampleRate(rate);
+    }
+}
+
+/**
+ * Determines the lowest supported output sample rate that satisfies the given requirement.
+ * @param required The required sample rate, in samples per second.
+ * @return The supported sample rate, or the highest supported rate if none is sufficient.
+ */
+int MicroBitAudio::selectSampleRate(float required)
+{
+    int count = sizeof(microbitAudioSampleRates) / sizeof(int);
+
+    for (int i = 0; i < count; i++)
+        if (microbitAudioSampleRates[i] >= required)
+            return microbitAudioSampleRates[i];
+
+    return microbitAudioSampleRates[count - 1];
+}
+
+/**
+ * Raises the output sample rate immediately when a mixer channel requires a higher rate.
+ * @param context The MicroBitAudio instance that owns the mixer.
+ * @param sampleRate The sample rate required by the channel, in samples per second.
+ */
+void MicroBitAudio::onRateRequired(void *context, float sampleRate)
+{
+    MicroBitAudio *audio = (MicroBitAudio *) context;
+
+    if (audio->pwm == NULL)
+        return;
+
+    int rate = audio->selectSampleRate(sampleRate);
+
+    if (rate > audio->sampleRate)
+    {
+        audio->timeOfLastRateRequirement = system_timer_current_time();
+        audio->configureSampleRate(rate);
+    }
+}
+
+/**
+ * Reconfigures the PWM driver and the mixer to output at the given sample rate.
+ * Any audio already rendered ahead at the previous rate is discarded.
+ * @param rate The new sample rate, in samples per second.
+ */
+void MicroBitAudio::configureSampleRate(int rate)
+{
+    // Buffers queued ahead were rendered for the old rate, and would otherwise be replayed at the new one.
+    if (renderQueue)
+        renderQueue->flush();
+
+    // The PWM driver pulls from the mixer in interrupt context, so reconfigure both atomically.
+    target_disable_irq();
+    pwm->setSampleRate(rate);
+    mixer.setSampleRange(pwm->getSampleRange());
+    mixer.setSampleRate(rate);
+    target_enable_irq();
+
+    sampleRate = rate;
+}
+
 /**
   * Destructor.
   *
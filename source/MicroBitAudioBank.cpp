@@ -0,0 +1,264 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "MicroBitAudioBank.h"
+#include "ErrorNo.h"
+#include "Event.h"
+#include "codal_target_hal.h"
+
+using namespace codal;
+
+/**
+ * Constructor.
+ * Validates the bank at the given address.
+ *
+ * @param bank The address of the bank in memory.
+ */
+MicroBitAudioBank::MicroBitAudioBank(const void *bank)
+{
+    const MicroBitAudioBankHeader *h = (const MicroBitAudioBankHeader *) bank;
+    const uint8_t *start = (const uint8_t *) bank;
+
+    this->header = NULL;
+
+    if (h == NULL || ((uintptr_t) start & 3) || h->magic != MICROBIT_AUDIO_BANK_MAGIC || h->version != MICROBIT_AUDIO_BANK_VERSION)
+        return;
+
+    if (sizeof(MicroBitAudioBankHeader) + h->count * sizeof(MicroBitAudioBankEntry) > h->length)
+        return;
+
+    // Ensure every block of every sound lies within the bank, and is marked as read-only.
+    const MicroBitAudioBankEntry *entry = (const MicroBitAudioBankEntry *) (h + 1);
+    const uint8_t *end = start + h->length;
+
+    for (int i = 0; i < h->count; i++, entry++)
+    {
+        if ((entry->offset & 3) || entry->offset >= h->length)
+            return;
+
+        const uint8_t *block = start + entry->offset;
+
+        for (int b = 0; b < entry->blockCount; b++)
+        {
+            const BufferData *data = (const BufferData *) block;
+
+            if (block + sizeof(BufferData) > end || data->refCount != MICROBIT_AUDIO_BANK_BLOCK_REFCOUNT || block + sizeof(BufferData) + data->length > end)
+                return;
+
+            block = getNextBlock(block);
+        }
+    }
+
+    this->header = h;
+}
+
+/**
+ * Determines if the bank is well formed.
+ */
+bool MicroBitAudioBank::isValid()
+{
+    return header != NULL;
+}
+
+/**
+ * Determines the number of sounds in the bank.
+ */
+int MicroBitAudioBank::getCount()
+{
+    return header ? header->count : 0;
+}
+
+/**
+ * Finds a sound by name.
+ *
+ * @param name The name of the sound.
+ * @return The index of the sound, or DEVICE_INVALID_PARAMETER if there is no sound with the given name.
+ */
+int MicroBitAudioBank::find(ManagedString name)
+{
+    if (name.length() > MICROBIT_AUDIO_BANK_NAME_LENGTH)
+        return DEVICE_INVALID_PARAMETER;
+
+    for (int i = 0; i < getCount(); i++)
+    {
+        const MicroBitAudioBankEntry *entry = getEntry(i);
+
+        if (strncmp(entry->name, name.toCharArray(), MICROBIT_AUDIO_BANK_NAME_LENGTH) == 0)
+            return i;
+    }
+
+    return DEVICE_INVALID_PARAMETER;
+}
+
+/**
+ * Retrieves the description of a sound.
+ *
+ * @param index The index of the sound.
+ * @return The entry describing the sound, or NULL if the index is not valid.
+ */
+const MicroBitAudioBankEntry *MicroBitAudioBank::getEntry(int index)
+{
+    if (index < 0 || index >= getCount())
+        return NULL;
+
+    return ((const MicroBitAudioBankEntry *) (header + 1)) + index;
+}
+
+/**
+ * Determines the address of the first block of a sound.
+ *
+ * @param index The index of the sound.
+ * @return The address of the first block, or NULL if the index is not valid.
+ */
+const uint8_t *MicroBitAudioBank::getFirstBlock(int index)
+{
+    const MicroBitAudioBankEntry *entry = getEntry(index);
+
+    if (entry == NULL)
+        return NULL;
+
+    return ((const uint8_t *) header) + entry->offset;
+}
+
+/**
+ * Determines the address of the block following the given block.
+ */
+const uint8_t *MicroBitAudioBank::getNextBlock(const uint8_t *block)
+{
+    return block + ((sizeof(BufferData) + ((const BufferData *) block)->length + 3) & ~3);
+}
+
+/**
+ * Constructor.
+ * Streaming starts when this source is connected to a sink.
+ *
+ * @param bank The bank holding the sound.
+ * @param index The index of the sound to play.
+ * @param id The id to use for the message bus when transmitting events.
+ */
+MicroBitAudioBankSource::MicroBitAudioBankSource(MicroBitAudioBank &bank, int index, uint16_t id) : CodalComponent(id, 0), bank(bank)
+{
+    this->downStream = NULL;
+    this->index = index;
+    this->entry = bank.getEntry(index);
+    this->block = bank.getFirstBlock(index);
+    this->blocksRemaining = entry ? entry->blockCount : 0;
+}
+
+/**
+ * Determines if the sound exists in the bank.
+ */
+bool MicroBitAudioBankSource::isValid()
+{
+    return entry != NULL;
+}
+
+/**
+ * Define a downstream component for data stream, and start streaming to it.
+ *
+ * @sink The component that data will be delivered to, when it is availiable
+ */
+void MicroBitAudioBankSource::connect(DataSink &sink)
+{
+    this->downStream = &sink;
+
+    if (blocksRemaining > 0)
+    {
+        status |= MICROBIT_AUDIO_BANK_STATUS_STREAMING;
+        downStream->pullRequest();
+    }
+}
+
+/**
+ * Stop streaming to our downstream component.
+ */
+void MicroBitAudioBankSource::disconnect()
+{
+    status &= ~MICROBIT_AUDIO_BANK_STATUS_STREAMING;
+    this->downStream = NULL;
+}
+
+/**
+ * Determine the data format of the buffers streamed out of this component.
+ */
+int MicroBitAudioBankSource::getFormat()
+{
+    return entry ? entry->format : DATASTREAM_FORMAT_16BIT_SIGNED;
+}
+
+/**
+ * Determine the sample rate of the sound being played.
+ * @return the sample rate, in Hz.
+ */
+int MicroBitAudioBankSource::getSampleRate()
+{
+    return entry ? entry->sampleRate : 0;
+}
+
+/**
+ * Restarts streaming from the start of the sound.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the sound is not valid.
+ */
+int MicroBitAudioBankSource::rewind()
+{
+    if (!isValid())
+        return DEVICE_INVALID_PARAMETER;
+
+    target_disable_irq();
+    block = bank.getFirstBlock(index);
+    blocksRemaining = entry->blockCount;
+    target_enable_irq();
+
+    if (downStream)
+        connect(*downStream);
+
+    return DEVICE_OK;
+}
+
+/**
+ * Provide the next available ManagedBuffer to our downstream caller, if available.
+ */
+ManagedBuffer MicroBitAudioBankSource::pull()
+{
+    if (!(status & MICROBIT_AUDIO_BANK_STATUS_STREAMING) || blocksRemaining == 0)
+        return ManagedBuffer();
+
+    // Refer to the block in place. Its reference count marks it as read-only, so it is never freed.
+    ManagedBuffer b((BufferData *) block);
+
+    block = MicroBitAudioBank::getNextBlock(block);
+    blocksRemaining--;
+
+    if (blocksRemaining > 0)
+    {
+        downStream->pullRequest();
+    }
+    else
+    {
+        status &= ~MICROBIT_AUDIO_BANK_STATUS_STREAMING;
+        Event(id, MICROBIT_AUDIO_BANK_EVT_DONE);
+    }
+
+    return b;
+}
@@ -0,0 +1,443 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "MicroBitAudioCapture.h"
+#include "StreamNormalizer.h"
+#include "ErrorNo.h"
+#include "Event.h"
+#include "codal_target_hal.h"
+#include <math.h>
+
+using namespace codal;
+
+/**
+ * Integer square root, rounded down.
+ */
+static uint32_t isqrt(uint64_t v)
+{
+    uint64_t result = 0;
+    uint64_t bit = 1ULL << 62;
+
+    while (bit > v)
+        bit >>= 2;
+
+    while (bit)
+    {
+        if (v >= result + bit)
+        {
+            v -= result + bit;
+            result = (result >> 1) + bit;
+        }
+        else
+        {
+            result >>= 1;
+        }
+
+        bit >>= 2;
+    }
+
+    return (uint32_t) result;
+}
+
+/**
+ * Constructor.
+ * Connects to the given source, and starts capturing immediately.
+ *
+ * @param source The component to capture audio from.
+ * @param sampleRate The sample rate of the source, in samples per second.
+ * @param id The id to use for the message bus when transmitting events.
+ */
+MicroBitAudioCapture::MicroBitAudioCapture(DataSource &source, int sampleRate, uint16_t id) : CodalComponent(id, 0), upStream(source)
+{
+    this->downStream = NULL;
+    this->head = 0;
+    this->tail = 0;
+    this->overruns = 0;
+    this->sampleRate = sampleRate;
+    this->level = 0;
+    this->zeroCrossingRate = 0;
+    this->loudThreshold = 0x7fffffff;
+    this->quietThreshold = 0;
+    this->zeroCrossingThreshold = 0;
+    this->bandActive = 0;
+
+    for (int i = 0; i < MICROBIT_AUDIO_CAPTURE_BANDS; i++)
+    {
+        bandLevel[i] = 0;
+        bandThreshold[i] = 0;
+    }
+
+    // Precompute the FFT twiddle factors and analysis window.
+    for (int i = 0; i < MICROBIT_AUDIO_CAPTURE_FFT_SIZE; i++)
+    {
+        float phase = (2.0f * (float) M_PI * i) / MICROBIT_AUDIO_CAPTURE_FFT_SIZE;
+
+        sine[i] = (int16_t) (32767.0f * sinf(phase));
+        window[i] = (int16_t) (32767.0f * 0.5f * (1.0f - cosf(phase)));
+    }
+
+    // Analyse captured audio from the idle fiber, rather than the interrupt context of our source.
+    status |= DEVICE_COMPONENT_STATUS_IDLE_TICK;
+
+    upStream.connect(*this);
+}
+
+/**
+ * Callback provided when data is ready from our upstream component.
+ * Captures the next buffer. This may be called from interrupt context, so analysis is deferred to idleCallback().
+ */
+int MicroBitAudioCapture::pullRequest()
+{
+    ManagedBuffer b = upStream.pull();
+
+    pending = b;
+
+    if (downStream)
+    {
+        // Drop the buffer if our downstream component has not kept up, rather than blocking capture.
+        if (tail - head < CONFIG_AUDIO_CAPTURE_QUEUE_SIZE)
+        {
+            buffers[tail % CONFIG_AUDIO_CAPTURE_QUEUE_SIZE] = b;
+            tail++;
+            downStream->pullRequest();
+        }
+        else
+        {
+            overruns++;
+        }
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Periodic callback from the idle fiber. Analyses the most recently captured buffer, if it has not been analysed
+ * already, and raises any events due. Buffers captured while an earlier one awaits analysis replace it.
+ */
+void MicroBitAudioCapture::idleCallback()
+{
+    target_disable_irq();
+    ManagedBuffer b = pending;
+    pending = ManagedBuffer();
+    target_enable_irq();
+
+    if (b.length() > 0)
+        analyse(b, upStream.getFormat());
+}
+
+/**
+ * Provide the next captured ManagedBuffer to our downstream caller, if available.
+ */
+ManagedBuffer MicroBitAudioCapture::pull()
+{
+    if (head == tail)
+        return ManagedBuffer();
+
+    int slot = head % CONFIG_AUDIO_CAPTURE_QUEUE_SIZE;
+    ManagedBuffer b = buffers[slot];
+    buffers[slot] = ManagedBuffer();
+    head++;
+
+    return b;
+}
+
+/**
+ * Define a downstream component for data stream.
+ *
+ * @sink The component that data will be delivered to, when it is availiable
+ */
+void MicroBitAudioCapture::connect(DataSink &sink)
+{
+    this->downStream = &sink;
+}
+
+/**
+ * Stop delivering data to our downstream component.
+ */
+void MicroBitAudioCapture::disconnect()
+{
+    this->downStream = NULL;
+}
+
+/**
+ * Determine the data format of the buffers streamed out of this component.
+ */
+int MicroBitAudioCapture::getFormat()
+{
+    return upStream.getFormat();
+}
+
+/**
+ * Determines the RMS level of the most recently captured buffer, after removal of any DC offset.
+ * @return the level, in sample units.
+ */
+int MicroBitAudioCapture::getLevel()
+{
+    return level;
+}
+
+/**
+ * Determines the zero crossing rate of the most recently captured buffer.
+ * This is approximately twice the dominant frequency of a tonal sound, and high for noisy sounds.
+ * @return the rate, in zero crossings per second.
+ */
+int MicroBitAudioCapture::getZeroCrossingRate()
+{
+    return zeroCrossingRate;
+}
+
+/**
+ * Determines the RMS level of one octave band of the most recently captured buffer.
+ * Band n covers frequencies from (2^n * sampleRate / MICROBIT_AUDIO_CAPTURE_FFT_SIZE) up to twice that value.
+ *
+ * @param band The band, in the range 0..MICROBIT_AUDIO_CAPTURE_BANDS-1.
+ * @return the level in sample units, or DEVICE_INVALID_PARAMETER.
+ */
+int MicroBitAudioCapture::getBandLevel(int band)
+{
+    if (band < 0 || band >= MICROBIT_AUDIO_CAPTURE_BANDS)
+        return DEVICE_INVALID_PARAMETER;
+
+    return bandLevel[band];
+}
+
+/**
+ * Defines the levels at which MICROBIT_AUDIO_CAPTURE_EVT_LOUD and MICROBIT_AUDIO_CAPTURE_EVT_QUIET are raised.
+ *
+ * @param quiet The level below which a loud sound is deemed to have ended.
+ * @param loud The level above which a sound is deemed to be loud.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int MicroBitAudioCapture::setLevelThresholds(int quiet, int loud)
+{
+    if (quiet < 0 || loud < quiet)
+        return DEVICE_INVALID_PARAMETER;
+
+    this->quietThreshold = quiet;
+    this->loudThreshold = loud;
+
+    return DEVICE_OK;
+}
+
+/**
+ * Defines the zero crossing rate above which MICROBIT_AUDIO_CAPTURE_EVT_ZCR_HIGH is raised.
+ * MICROBIT_AUDIO_CAPTURE_EVT_ZCR_LOW is raised when the rate falls back below three quarters of this value.
+ *
+ * @param rate The threshold, in zero crossings per second, or 0 to disable these events.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int MicroBitAudioCapture::setZeroCrossingThreshold(int rate)
+{
+    if (rate < 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    this->zeroCrossingThreshold = rate;
+    status &= ~MICROBIT_AUDIO_CAPTURE_STATUS_ZCR_HIGH;
+
+    return DEVICE_OK;
+}
+
+/**
+ * Defines the level above which the event for a given octave band is raised.
+ *
+ * @param band The band, in the range 0..MICROBIT_AUDIO_CAPTURE_BANDS-1.
+ * @param level The threshold in sample units, or 0 to disable events for this band.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int MicroBitAudioCapture::setBandThreshold(int band, int level)
+{
+    if (band < 0 || band >= MICROBIT_AUDIO_CAPTURE_BANDS || level < 0 || level > 0xffff)
+        return DEVICE_INVALID_PARAMETER;
+
+    this->bandThreshold[band] = level;
+    this->bandActive &= ~(1 << band);
+
+    return DEVICE_OK;
+}
+
+/**
+ * Determines the number of captured buffers dropped because our downstream component did not pull them in time.
+ */
+uint32_t MicroBitAudioCapture::getOverrunCount()
+{
+    return overruns;
+}
+
+/**
+ * Measures the level, zero crossing rate and band levels of a buffer, and raises any events due.
+ * @param buffer The buffer to analyse.
+ * @param format The format of the samples in the buffer.
+ */
+void MicroBitAudioCapture::analyse(ManagedBuffer &buffer, int format)
+{
+    int bytesPerSample = DATASTREAM_FORMAT_BYTES_PER_SAMPLE(format);
+    int samples = bytesPerSample ? buffer.length() / bytesPerSample : 0;
+
+    if (samples == 0)
+        return;
+
+    uint8_t *data = &buffer[0];
+    int64_t sum = 0;
+
+    // Remove any DC offset (such as the bias of the microphone), so we measure only the AC component.
+    for (int i = 0; i < samples; i++)
+        sum += StreamNormalizer::readSample[format](data + i * bytesPerSample);
+
+    int mean = (int) (sum / samples);
+    uint64_t squares = 0;
+    int crossings = 0;
+    bool negative = false;
+
+    for (int i = 0; i < samples; i++)
+    {
+        int v = StreamNormalizer::readSample[format](data + i * bytesPerSample) - mean;
+
+        squares += (int64_t) v * v;
+
+        if (i > 0 && (v < 0) != negative)
+            crossings++;
+
+        negative = v < 0;
+
+        // Retain the start of the buffer for band analysis.
+        if (i < MICROBIT_AUDIO_CAPTURE_FFT_SIZE)
+            re[i] = (int16_t) (v < -32768 ? -32768 : v > 32767 ? 32767 : v);
+    }
+
+    level = (int) isqrt(squares / samples);
+    zeroCrossingRate = (int) (((int64_t) crossings * sampleRate) / samples);
+
+    if (samples >= MICROBIT_AUDIO_CAPTURE_FFT_SIZE)
+        analyseBands();
+
+    // Raise events only on transitions, so applications are not woken for every buffer.
+    if (!(status & MICROBIT_AUDIO_CAPTURE_STATUS_LOUD) && level > loudThreshold)
+    {
+        status |= MICROBIT_AUDIO_CAPTURE_STATUS_LOUD;
+        Event(id, MICROBIT_AUDIO_CAPTURE_EVT_LOUD);
+    }
+
+    if ((status & MICROBIT_AUDIO_CAPTURE_STATUS_LOUD) && level < quietThreshold)
+    {
+        status &= ~MICROBIT_AUDIO_CAPTURE_STATUS_LOUD;
+        Event(id, MICROBIT_AUDIO_CAPTURE_EVT_QUIET);
+    }
+
+    if (zeroCrossingThreshold)
+    {
+        if (!(status & MICROBIT_AUDIO_CAPTURE_STATUS_ZCR_HIGH) && zeroCrossingRate > zeroCrossingThreshold)
+        {
+            status |= MICROBIT_AUDIO_CAPTURE_STATUS_ZCR_HIGH;
+            Event(id, MICROBIT_AUDIO_CAPTURE_EVT_ZCR_HIGH);
+        }
+
+        if ((status & MICROBIT_AUDIO_CAPTURE_STATUS_ZCR_HIGH) && zeroCrossingRate < (zeroCrossingThreshold * 3) / 4)
+        {
+            status &= ~MICROBIT_AUDIO_CAPTURE_STATUS_ZCR_HIGH;
+            Event(id, MICROBIT_AUDIO_CAPTURE_EVT_ZCR_LOW);
+        }
+    }
+
+    for (int b = 0; b < MICROBIT_AUDIO_CAPTURE_BANDS; b++)
+    {
+        if (bandThreshold[b] == 0)
+            continue;
+
+        if (!(bandActive & (1 << b)) && bandLevel[b] > bandThreshold[b])
+        {
+            bandActive |= (1 << b);
+            Event(id, MICROBIT_AUDIO_CAPTURE_EVT_BAND + b);
+        }
+
+        if ((bandActive & (1 << b)) && bandLevel[b] < (bandThreshold[b] * 3) / 4)
+            bandActive &= ~(1 << b);
+    }
+}
+
+/**
+ * Measures the level of each octave band of the first MICROBIT_AUDIO_CAPTURE_FFT_SIZE samples in the working buffer.
+ */
+void MicroBitAudioCapture::analyseBands()
+{
+    const int n = MICROBIT_AUDIO_CAPTURE_FFT_SIZE;
+
+    // Apply the window, and load the working buffer in bit reversed order.
+    for (int i = 0; i < n; i++)
+        im[i] = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        int j = 0;
+        for (int b = 0; b < MICROBIT_AUDIO_CAPTURE_FFT_BITS; b++)
+            j |= ((i >> b) & 1) << (MICROBIT_AUDIO_CAPTURE_FFT_BITS - 1 - b);
+
+        if (j >= i)
+        {
+            int16_t a = (int16_t) ((re[i] * window[i]) >> 15);
+            int16_t c = (int16_t) ((re[j] * window[j]) >> 15);
+            re[i] = c;
+            re[j] = a;
+        }
+    }
+
+    // Radix 2 decimation in time, halving at each stage so that the output is scaled by 1/n and cannot overflow.
+    for (int size = 2; size <= n; size <<= 1)
+    {
+        int half = size >> 1;
+        int step = n / size;
+
+        for (int i = 0; i < n; i += size)
+        {
+            for (int j = 0; j < half; j++)
+            {
+                int k = j * step;
+                int32_t wr = sine[(k + n / 4) & (n - 1)];
+                int32_t wi = -sine[k];
+                int a = i + j;
+                int b = a + half;
+
+                int32_t tr = (wr * re[b] - wi * im[b]) >> 15;
+                int32_t ti = (wr * im[b] + wi * re[b]) >> 15;
+
+                re[b] = (int16_t) ((re[a] - tr) >> 1);
+                im[b] = (int16_t) ((im[a] - ti) >> 1);
+                re[a] = (int16_t) ((re[a] + tr) >> 1);
+                im[a] = (int16_t) ((im[a] + ti) >> 1);
+            }
+        }
+    }
+
+    // Sum the energy of the bins in each octave, counting only the positive frequency half of the spectrum (hence doubled).
+    // The Hann window retains 3/8 of the signal power, so the RMS level of the band is sqrt(2 * 8/3 * sum(|X|^2)).
+    for (int band = 0; band < MICROBIT_AUDIO_CAPTURE_BANDS; band++)
+    {
+        uint64_t energy = 0;
+
+        for (int k = 1 << band; k < (2 << band); k++)
+            energy += (int32_t) re[k] * re[k] + (int32_t) im[k] * im[k];
+
+        uint32_t l = isqrt((energy * 16) / 3);
+        bandLevel[band] = l > 0xffff ? 0xffff : l;
+    }
+}
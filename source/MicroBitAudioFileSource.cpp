@@ -0,0 +1,387 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "MicroBitAudioFileSource.h"
+#include "CodalUtil.h"
+#include "ErrorNo.h"
+#include "Event.h"
+#include "codal_target_hal.h"
+
+using namespace codal;
+
+// IMA ADPCM quantizer step sizes, and the change in step index for each encoded nibble.
+static const int16_t imaStepTable[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+    130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060,
+    1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484,
+    7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int8_t imaIndexTable[16] = { -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8 };
+
+static inline uint16_t read16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t read32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/**
+ * Decodes a single IMA ADPCM nibble, updating the predictor and step index.
+ */
+static inline int16_t imaDecode(int nibble, int &predictor, int &index)
+{
+    int step = imaStepTable[index];
+    int diff = step >> 3;
+
+    if (nibble & 1)
+        diff += step >> 2;
+    if (nibble & 2)
+        diff += step >> 1;
+    if (nibble & 4)
+        diff += step;
+
+    predictor += (nibble & 8) ? -diff : diff;
+    predictor = predictor < -32768 ? -32768 : predictor > 32767 ? 32767 : predictor;
+
+    index += imaIndexTable[nibble];
+    index = index < 0 ? 0 : index > 88 ? 88 : index;
+
+    return (int16_t) predictor;
+}
+
+/**
+ * Constructor.
+ * Opens the given file and reads its WAVE header. Streaming starts when this source is connected to a sink.
+ *
+ * @param filename The name of the file to stream.
+ * @param id The id to use for the message bus when transmitting events.
+ */
+MicroBitAudioFileSource::MicroBitAudioFileSource(ManagedString filename, uint16_t id) : CodalComponent(id, 0), file(filename, READ)
+{
+    this->downStream = NULL;
+    this->head = 0;
+    this->tail = 0;
+    this->encoding = 0;
+    this->format = DATASTREAM_FORMAT_16BIT_SIGNED;
+    this->sampleRate = 0;
+    this->blockAlign = 0;
+    this->dataStart = 0;
+    this->dataLength = 0;
+    this->dataPosition = 0;
+    this->underruns = 0;
+
+    if (file.isValid() && readHeader() == DEVICE_OK)
+    {
+        status |= MICROBIT_AUDIO_FILE_STATUS_VALID;
+        file.setPosition(dataStart);
+    }
+}
+
+/**
+ * Destructor.
+ */
+MicroBitAudioFileSource::~MicroBitAudioFileSource()
+{
+    disconnect();
+}
+
+/**
+ * Determines if the file was opened successfully, and holds audio in a supported encoding.
+ */
+bool MicroBitAudioFileSource::isValid()
+{
+    return status & MICROBIT_AUDIO_FILE_STATUS_VALID;
+}
+
+/**
+ * Reads the RIFF header of the file, locating the format and data chunks.
+ * @return DEVICE_OK on success, or DEVICE_NOT_SUPPORTED if the file does not hold audio in a supported encoding.
+ */
+int MicroBitAudioFileSource::readHeader()
+{
+    uint8_t header[16];
+    int position = 12;
+    int channels = 0;
+    int bitsPerSample = 0;
+    bool haveFormat = false;
+
+    if (file.read((char *) header, 12) != 12 || memcmp(header, "RIFF", 4) != 0 || memcmp(&header[8], "WAVE", 4) != 0)
+        return DEVICE_NOT_SUPPORTED;
+
+    // Walk the chunks of the file until we find the sample data.
+    while (true)
+    {
+        if (file.setPosition(position) < 0 || file.read((char *) header, 8) != 8)
+            return DEVICE_NOT_SUPPORTED;
+
+        uint32_t size = read32(&header[4]);
+
+        if (memcmp(header, "fmt ", 4) == 0)
+        {
+            if (size < 16 || file.read((char *) header, 16) != 16)
+                return DEVICE_NOT_SUPPORTED;
+
+            encoding = read16(&header[0]);
+            channels = read16(&header[2]);
+            sampleRate = read32(&header[4]);
+            blockAlign = read16(&header[12]);
+            bitsPerSample = read16(&header[14]);
+            haveFormat = true;
+        }
+        else if (memcmp(header, "data", 4) == 0)
+        {
+            dataStart = position + 8;
+            dataLength = size;
+            break;
+        }
+
+        // Chunks are padded to an even length. A corrupt size could wrap the position back onto this chunk, and hang us.
+        uint64_t next = (uint64_t) position + 8 + size + (size & 1);
+
+        if (next > INT32_MAX)
+            return DEVICE_NOT_SUPPORTED;
+
+        position = (int) next;
+    }
+
+    if (!haveFormat || channels != 1 || sampleRate <= 0)
+        return DEVICE_NOT_SUPPORTED;
+
+    if (encoding == MICROBIT_AUDIO_FILE_ENCODING_PCM && bitsPerSample == 8)
+        format = DATASTREAM_FORMAT_8BIT_UNSIGNED;
+
+    else if (encoding == MICROBIT_AUDIO_FILE_ENCODING_PCM && bitsPerSample == 16)
+        format = DATASTREAM_FORMAT_16BIT_SIGNED;
+
+    else if (encoding == MICROBIT_AUDIO_FILE_ENCODING_IMA_ADPCM && bitsPerSample == 4 && blockAlign > 4)
+        format = DATASTREAM_FORMAT_16BIT_SIGNED;
+
+    else
+        return DEVICE_NOT_SUPPORTED;
+
+    return DEVICE_OK;
+}
+
+/**
+ * Define a downstream component for data stream, and start streaming to it.
+ *
+ * @sink The component that data will be delivered to, when it is availiable
+ */
+void MicroBitAudioFileSource::connect(DataSink &sink)
+{
+    this->downStream = &sink;
+
+    if (isValid() && dataPosition < dataLength)
+    {
+        status |= MICROBIT_AUDIO_FILE_STATUS_STREAMING | DEVICE_COMPONENT_STATUS_IDLE_TICK;
+
+        // Prime our read ahead queue, so playback can start immediately.
+        idleCallback();
+    }
+}
+
+/**
+ * Stop streaming to our downstream component.
+ */
+void MicroBitAudioFileSource::disconnect()
+{
+    status &= ~(MICROBIT_AUDIO_FILE_STATUS_STREAMING | DEVICE_COMPONENT_STATUS_IDLE_TICK);
+    this->downStream = NULL;
+}
+
+/**
+ * Determine the data format of the buffers streamed out of this component.
+ */
+int MicroBitAudioFileSource::getFormat()
+{
+    return format;
+}
+
+/**
+ * Determine the sample rate of the file being streamed.
+ * @return the sample rate, in Hz.
+ */
+int MicroBitAudioFileSource::getSampleRate()
+{
+    return sampleRate;
+}
+
+/**
+ * Determines the number of times playback found no audio available, because the file could not be read quickly enough.
+ */
+uint32_t MicroBitAudioFileSource::getUnderrunCount()
+{
+    return underruns;
+}
+
+/**
+ * Restarts streaming from the start of the file.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the file is not valid.
+ */
+int MicroBitAudioFileSource::rewind()
+{
+    if (!isValid())
+        return DEVICE_INVALID_PARAMETER;
+
+    // Discard anything we have read ahead.
+    target_disable_irq();
+    for (int i = 0; i < CONFIG_AUDIO_FILE_READ_AHEAD; i++)
+        blocks[i] = ManagedBuffer();
+    head = tail;
+    target_enable_irq();
+
+    dataPosition = 0;
+    file.setPosition(dataStart);
+
+    if (downStream)
+        connect(*downStream);
+
+    return DEVICE_OK;
+}
+
+/**
+ * Provide the next available ManagedBuffer to our downstream caller, if available.
+ */
+ManagedBuffer MicroBitAudioFileSource::pull()
+{
+    // This is likely to be in interrupt context, so only hand over blocks that have already been read.
+    if (head == tail)
+        return ManagedBuffer();
+
+    int slot = head % CONFIG_AUDIO_FILE_READ_AHEAD;
+    ManagedBuffer b = blocks[slot];
+    blocks[slot] = ManagedBuffer();
+    head++;
+
+    return b;
+}
+
+/**
+ * Reads ahead from the file, until the queue of blocks is full or the end of the file has been reached.
+ * Called periodically from the idle fiber.
+ */
+void MicroBitAudioFileSource::idleCallback()
+{
+    if (!(status & MICROBIT_AUDIO_FILE_STATUS_STREAMING) || downStream == NULL)
+        return;
+
+    // If playback has consumed everything we read ahead part way through the file, it has been starved of data.
+    if (head == tail && dataPosition > 0 && dataPosition < dataLength)
+        underruns++;
+
+    while (tail - head < CONFIG_AUDIO_FILE_READ_AHEAD && dataPosition < dataLength)
+    {
+        ManagedBuffer b = readBlock();
+
+        // Treat a truncated or unreadable file as having ended.
+        if (b.length() == 0)
+        {
+            dataPosition = dataLength;
+            break;
+        }
+
+        blocks[tail % CONFIG_AUDIO_FILE_READ_AHEAD] = b;
+        tail++;
+
+        downStream->pullRequest();
+    }
+
+    // Once the whole file has been consumed, we're done.
+    if (head == tail && dataPosition >= dataLength)
+    {
+        status &= ~(MICROBIT_AUDIO_FILE_STATUS_STREAMING | DEVICE_COMPONENT_STATUS_IDLE_TICK);
+        Event(id, MICROBIT_AUDIO_FILE_EVT_DONE);
+    }
+}
+
+/**
+ * Reads the next block of samples from the file.
+ * @return A buffer of samples in our output format, or an empty buffer at the end of the file.
+ */
+ManagedBuffer MicroBitAudioFileSource::readBlock()
+{
+    if (encoding == MICROBIT_AUDIO_FILE_ENCODING_IMA_ADPCM)
+        return readAdpcmBlock();
+
+    int bytesPerSample = DATASTREAM_FORMAT_BYTES_PER_SAMPLE(format);
+    int length = min(CONFIG_AUDIO_FILE_BLOCK_SIZE, dataLength - dataPosition);
+    length -= length % bytesPerSample;
+
+    if (length <= 0)
+        return ManagedBuffer();
+
+    ManagedBuffer b(length);
+    if (file.read((char *) &b[0], length) != length)
+        return ManagedBuffer();
+
+    dataPosition += length;
+    return b;
+}
+
+/**
+ * Reads and decodes the next IMA ADPCM encoded block from the file.
+ * @return A buffer of 16 bit signed samples, or an empty buffer at the end of the file.
+ */
+ManagedBuffer MicroBitAudioFileSource::readAdpcmBlock()
+{
+    uint8_t raw[32];
+    int length = min(blockAlign, dataLength - dataPosition);
+
+    // Each block starts with a header holding the first sample and the initial step index,
+    // followed by two samples per byte, least significant nibble first.
+    if (length <= 4 || file.read((char *) raw, 4) != 4)
+        return ManagedBuffer();
+
+    int predictor = (int16_t) read16(&raw[0]);
+    int index = min((int) raw[2], 88);
+    int remaining = length - 4;
+
+    ManagedBuffer b((1 + remaining * 2) * sizeof(int16_t));
+    int16_t *out = (int16_t *) &b[0];
+
+    *out++ = (int16_t) predictor;
+
+    while (remaining)
+    {
+        int n = min(remaining, (int) sizeof(raw));
+        if (file.read((char *) raw, n) != n)
+            return ManagedBuffer();
+
+        for (int i = 0; i < n; i++)
+        {
+            *out++ = imaDecode(raw[i] & 0x0F, predictor, index);
+            *out++ = imaDecode(raw[i] >> 4, predictor, index);
+        }
+
+        remaining -= n;
+    }
+
+    dataPosition += length;
+    return b;
+}
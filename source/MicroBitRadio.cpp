@@ -29,6 +29,7 @@ DEALINGS IN THE SOFTWARE.
 #include "ErrorNo.h"
 #include "CodalFiber.h"
 #include "nrf.h"
+#include "codal_target_hal.h"
 
 using namespace codal;
 
@@ -61,39 +62,87 @@ MicroBitRadio* MicroBitRadio::instance = NULL;
 
 extern "C" void RADIO_IRQHandler(void)
 {
-    if(NRF_RADIO->EVENTS_READY)
-    {
-        NRF_RADIO->EVENTS_READY = 0;
-
-        // Start listening and wait for the END event
-        NRF_RADIO->TASKS_START = 1;
-    }
+    MicroBitRadio *radio = MicroBitRadio::instance;
 
     if(NRF_RADIO->EVENTS_END)
     {
         NRF_RADIO->EVENTS_END = 0;
-        if(NRF_RADIO->CRCSTATUS == 1)
-        {
-            int sample = (int)NRF_RADIO->RSSISAMPLE;
 
-            // Associate this packet's rssi value with the data just
-            // transferred by DMA receive
-            MicroBitRadio::instance->setRSSI(-sample);
+        // The end of a transmission is handled once the transceiver has been disabled, below.
+        if (radio->state == MICROBIT_RADIO_STATE_RECEIVING)
+        {
+            if(NRF_RADIO->CRCSTATUS == 1)
+            {
+                int sample = (int)NRF_RADIO->RSSISAMPLE;
+
+                // Associate this packet's rssi value with the data just
+                // transferred by DMA receive
+                radio->setRSSI(-sample);
+
+                // Floods are relayed immediately, so that every device relaying the same hop transmits together.
+                // Copies of a flood we have already seen are dropped here, without using a slot in the receive buffer.
+                FrameBuffer *p = radio->getRxBuf();
+
+                if (p->protocol != MICROBIT_RADIO_PROTOCOL_FLOOD || radio->flood.relay(p))
+                {
+                    // Now move on to the next buffer, if possible.
+                    // The queued packet will get the rssi value set above.
+                    radio->queueRxBuf();
+
+                    // Set the new buffer for DMA
+                    NRF_RADIO->PACKETPTR = (uint32_t) (uintptr_t) radio->getRxBuf();
+                }
+            }
+            else
+            {
+                radio->setRSSI(0);
+                radio->rxCrcErrors++;
+            }
+
+            // Start listening and wait for the END event
+            NRF_RADIO->TASKS_START = 1;
+        }
+    }
 
-            // Now move on to the next buffer, if possible.
-            // The queued packet will get the rssi value set above.
-            MicroBitRadio::instance->queueRxBuf();
+    if(NRF_RADIO->EVENTS_DISABLED)
+    {
+        NRF_RADIO->EVENTS_DISABLED = 0;
 
-            // Set the new buffer for DMA
-            NRF_RADIO->PACKETPTR = (uint32_t) MicroBitRadio::instance->getRxBuf();
+        // If we've just finished sending a packet, release it from the transmit queue.
+        if (radio->state == MICROBIT_RADIO_STATE_TRANSMITTING)
+        {
+            radio->txTail = radio->txTail + 1 == MICROBIT_RADIO_TX_QUEUE_SIZE + 1 ? 0 : radio->txTail + 1;
+            radio->txCompleted++;
+            Event(DEVICE_ID_RADIO, MICROBIT_RADIO_EVT_TX_DONE);
         }
-        else
+
+        if (radio->state != MICROBIT_RADIO_STATE_RECEIVING)
         {
-            MicroBitRadio::instance->setRSSI(0);
+            if (radio->txTail != radio->txHead)
+            {
+                // Send the next packet. The hardware starts transmission as soon as the transmitter is ready,
+                // and disables itself once the packet has been sent.
+                radio->state = MICROBIT_RADIO_STATE_TRANSMITTING;
+                NRF_RADIO->PACKETPTR = (uint32_t) (uintptr_t) &radio->txRing[radio->txTail];
+                NRF_RADIO->SHORTS = RADIO_SHORTS_READY_START_Msk | RADIO_SHORTS_END_DISABLE_Msk;
+                NRF_RADIO->TASKS_TXEN = 1;
+            }
+            else
+            {
+                // Nothing more to send, so start listening for the next packet.
+                radio->state = MICROBIT_RADIO_STATE_RECEIVING;
+                NRF_RADIO->PACKETPTR = (uint32_t) (uintptr_t) radio->getRxBuf();
+                NRF_RADIO->SHORTS = RADIO_SHORTS_READY_START_Msk | RADIO_SHORTS_ADDRESS_RSSISTART_Msk;
+                NRF_RADIO->TASKS_RXEN = 1;
+            }
         }
+    }
 
-        // Start listening and wait for the END event
-        NRF_RADIO->TASKS_START = 1;
+    // If packets have been queued for transmission, turn off the receiver so that we can send them.
+    if (radio->state == MICROBIT_RADIO_STATE_RECEIVING && radio->txTail != radio->txHead)
+    {
+        radio->state = MICROBIT_RADIO_STATE_DISABLING;
+        NRF_RADIO->TASKS_DISABLE = 1;
     }
 }
 
@@ -105,15 +154,23 @@ extern "C" void RADIO_IRQHandler(void)
   * @note This class is demand activated, as a result most resources are only
   *       committed if send/recv or event registrations calls are made.
   */
-MicroBitRadio::MicroBitRadio(uint16_t id) : datagram(*this), event (*this)
+MicroBitRadio::MicroBitRadio(uint16_t id) : datagram(*this), event (*this), fragment(*this), unicast(*this), flood(*this)
 {
     this->id = id;
     this->status = 0;
 	this->group = MICROBIT_RADIO_DEFAULT_GROUP;
-	this->queueDepth = 0;
     this->rssi = 0;
-    this->rxQueue = NULL;
-    this->rxBuf = NULL;
+    this->rxHead = 0;
+    this->rxTail = 0;
+    this->rxDropped = 0;
+    this->rxCrcErrors = 0;
+    this->state = MICROBIT_RADIO_STATE_RECEIVING;
+    this->txHead = 0;
+    this->txTail = 0;
+    this->txQueued = 0;
+    this->txCompleted = 0;
+    this->txAbortedFrom = 0;
+    this->txAbortedTo = 0;
 
     instance = this;
 }
@@ -164,53 +221,34 @@ int MicroBitRadio::setFrequencyBand(int band)
   */
 FrameBuffer* MicroBitRadio::getRxBuf()
 {
-    return rxBuf;
+    return &rxRing[rxHead];
 }
 
 /**
   * Attempt to queue a buffer received by the radio hardware, if sufficient space is available.
   *
-  * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if a replacement receiver buffer
-  *         could not be allocated (either by policy or memory exhaustion).
+  * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the receive buffer is full. In this case the
+  *         packet is dropped, and the radio hardware receives the next packet into the same buffer.
   */
 int MicroBitRadio::queueRxBuf()
 {
-    if (rxBuf == NULL)
-        return DEVICE_INVALID_PARAMETER;
-
-    if (queueDepth >= MICROBIT_RADIO_MAXIMUM_RX_BUFFERS)
-        return DEVICE_NO_RESOURCES;
-
-    // Store the received RSSI value in the frame
-    rxBuf->rssi = getRSSI();
-
-    // Ensure that a replacement buffer is available before queuing.
-    FrameBuffer *newRxBuf = new FrameBuffer();
-
-    if (newRxBuf == NULL)
-        return DEVICE_NO_RESOURCES;
+    // The receive buffer is a single producer, single consumer ring. Only this function (called from the ISR) advances
+    // rxHead, and only recv() advances rxTail, so neither needs to lock the other out.
+    uint16_t next = rxHead + 1 == MICROBIT_RADIO_RX_RING_SIZE + 1 ? 0 : rxHead + 1;
 
-    // We add to the tail of the queue to preserve causal ordering.
-    rxBuf->next = NULL;
-
-    if (rxQueue == NULL)
-    {
-        rxQueue = rxBuf;
-    }
-    else
+    if (next == rxTail)
     {
-        FrameBuffer *p = rxQueue;
-        while (p->next != NULL)
-            p = p->next;
-
-        p->next = rxBuf;
+        rxDropped++;
+        return DEVICE_NO_RESOURCES;
     }
 
-    // Increase our received packet count
-    queueDepth++;
+    // Store the received RSSI value in the frame
+    rxRing[rxHead].rssi = getRSSI();
 
-    // Allocate a new buffer for the receiver hardware to use. the old on will be passed on to higher layer protocols/apps.
-    rxBuf = newRxBuf;
+    // Publish the packet, and move the radio hardware on to the next free slot. The barrier ensures the packet
+    // is complete in memory before recv() can see it.
+    __DMB();
+    rxHead = next;
 
     return DEVICE_OK;
 }
@@ -264,13 +302,6 @@ int MicroBitRadio::enable()
     if (ble_running())
         return DEVICE_NOT_SUPPORTED;
 
-    // If this is the first time we've been enable, allocate out receive buffers.
-    if (rxBuf == NULL)
-        rxBuf = new FrameBuffer();
-
-    if (rxBuf == NULL)
-        return DEVICE_NO_RESOURCES;
-
     // Enable the High Frequency clock on the processor. This is a pre-requisite for
     // the RADIO module. Without this clock, no communication is possible.
     NRF_CLOCK->EVENTS_HFCLKSTARTED = 0;
@@ -320,22 +351,22 @@ int MicroBitRadio::enable()
     NRF_RADIO->DATAWHITEIV = 0x18;
 
     // Set up the RADIO module to read and write from our internal buffer.
-    NRF_RADIO->PACKETPTR = (uint32_t)rxBuf;
+    NRF_RADIO->PACKETPTR = (uint32_t) (uintptr_t) getRxBuf();
 
-    // Configure the hardware to issue an interrupt whenever a task is complete (e.g. send/receive).
-    NRF_RADIO->INTENSET = 0x00000008;
-    NVIC_ClearPendingIRQ(RADIO_IRQn);
-    NVIC_EnableIRQ(RADIO_IRQn);
-
-    NRF_RADIO->SHORTS |= RADIO_SHORTS_ADDRESS_RSSISTART_Msk;
+    // Configure the hardware to issue an interrupt whenever a packet has been sent or received, and whenever the
+    // transceiver is disabled. The latter drives transitions between receiving and transmitting.
+    NRF_RADIO->INTENSET = RADIO_INTENSET_END_Msk | RADIO_INTENSET_DISABLED_Msk;
 
-    // Start listening for the next packet
+    // Start listening for the next packet, as soon as the receiver is ready.
+    state = MICROBIT_RADIO_STATE_RECEIVING;
+    NRF_RADIO->SHORTS = RADIO_SHORTS_READY_START_Msk | RADIO_SHORTS_ADDRESS_RSSISTART_Msk;
     NRF_RADIO->EVENTS_READY = 0;
+    NRF_RADIO->EVENTS_END = 0;
+    NRF_RADIO->EVENTS_DISABLED = 0;
     NRF_RADIO->TASKS_RXEN = 1;
-    while(NRF_RADIO->EVENTS_READY == 0);
 
-    NRF_RADIO->EVENTS_END = 0;
-    NRF_RADIO->TASKS_START = 1;
+    NVIC_ClearPendingIRQ(RADIO_IRQn);
+    NVIC_EnableIRQ(RADIO_IRQn);
 
     // register ourselves for a callback event, in order to empty the receive queue.
     status |= DEVICE_COMPONENT_STATUS_IDLE_TICK;
@@ -348,6 +379,7 @@ int MicroBitRadio::enable()
 
 /**
   * Disables the radio for use as a multipoint sender/receiver.
+  * Any packets still queued for transmission are discarded, and a pending send() returns DEVICE_CANCELLED.
   *
   * @return DEVICE_OK on success, DEVICE_NOT_SUPPORTED if the BLE stack is running.
   */
@@ -363,16 +395,54 @@ int MicroBitRadio::disable()
     // Disable interrupts and STOP any ongoing packet reception.
     NVIC_DisableIRQ(RADIO_IRQn);
 
+    // A transmission may have completed without its interrupt having been handled yet. The END event remains set
+    // if the packet is sent at any point up to the transceiver being disabled, as nothing else clears it meanwhile.
+    bool transmitting = state == MICROBIT_RADIO_STATE_TRANSMITTING;
+    bool sent = transmitting && (NRF_RADIO->EVENTS_END || NRF_RADIO->EVENTS_DISABLED);
+
     NRF_RADIO->EVENTS_DISABLED = 0;
     NRF_RADIO->TASKS_DISABLE = 1;
     while(NRF_RADIO->EVENTS_DISABLED == 0);
 
-    // deregister ourselves from the callback event used to empty the receive queue.
-    status &= ~DEVICE_COMPONENT_STATUS_IDLE_TICK;
+    sent = sent || (transmitting && NRF_RADIO->EVENTS_END);
+
+    // Leave the transceiver ready to receive when next enabled, even if we stopped it mid transmission.
+    NRF_RADIO->SHORTS = 0;
+    NRF_RADIO->EVENTS_END = 0;
+    NRF_RADIO->EVENTS_DISABLED = 0;
+    NVIC_ClearPendingIRQ(RADIO_IRQn);
+    state = MICROBIT_RADIO_STATE_RECEIVING;
 
-    // record that the radio is now disabled
+    // Packets may still be queued from other interrupt handlers, so lock them out. Once we record that the radio is
+    // disabled, sendAsync() refuses any more, so none can be left behind to go out stale when the radio is next enabled.
+    target_disable_irq();
     status &= ~MICROBIT_RADIO_STATUS_INITIALISED;
 
+    // Release a packet that was sent as though its interrupt had been handled.
+    if (sent)
+    {
+        txTail = txTail + 1 == MICROBIT_RADIO_TX_QUEUE_SIZE + 1 ? 0 : txTail + 1;
+        txCompleted++;
+    }
+
+    // Discard any packets that can now no longer be sent, including any in flight, and release the fibers waiting for them.
+    uint32_t dropped = getTxQueueLength();
+    txTail = txHead;
+
+    if (dropped)
+    {
+        txAbortedFrom = txCompleted;
+        txAbortedTo = txCompleted + dropped;
+        txCompleted = txAbortedTo;
+    }
+    target_enable_irq();
+
+    if (sent || dropped)
+        Event(DEVICE_ID_RADIO, MICROBIT_RADIO_EVT_TX_DONE);
+
+    // deregister ourselves from the callback event used to empty the receive queue.
+    status &= ~DEVICE_COMPONENT_STATUS_IDLE_TICK;
+
     return DEVICE_OK;
 }
 
@@ -404,9 +474,12 @@ int MicroBitRadio::setGroup(uint8_t group)
 void MicroBitRadio::idleCallback()
 {
     // Walk the list of packets and process each one.
-    while(rxQueue)
+    while(rxTail != rxHead)
     {
-        FrameBuffer *p = rxQueue;
+        FrameBuffer *p = &rxRing[rxTail];
+        uint16_t tail = rxTail;
+
+        __DMB();
 
         switch (p->protocol)
         {
@@ -418,18 +491,33 @@ void MicroBitRadio::idleCallback()
                 event.packetReceived();
                 break;
 
+            case MICROBIT_RADIO_PROTOCOL_FRAGMENT:
+                fragment.packetReceived();
+                break;
+
+            case MICROBIT_RADIO_PROTOCOL_UNICAST:
+                unicast.packetReceived();
+                break;
+
+            case MICROBIT_RADIO_PROTOCOL_FLOOD:
+                flood.packetReceived();
+                break;
+
             default:
                 Event(DEVICE_ID_RADIO_DATA_READY, p->protocol);
         }
 
         // If the packet was processed, it will have been recv'd, and taken from the queue.
-        // If this was a packet for an unknown protocol, it will still be there, so simply free it.
-        if (p == rxQueue)
+        // If this was a packet for an unknown protocol, it will still be there, so simply discard it.
+        if (rxTail == tail)
         {
-            recv();
-            delete p;
+            __DMB();
+            rxTail = tail + 1 == MICROBIT_RADIO_RX_RING_SIZE + 1 ? 0 : tail + 1;
         }
     }
+
+    // Retransmit any unicast packets whose acknowledgement is overdue.
+    unicast.idleCallback();
 }
 
 /**
@@ -439,7 +527,9 @@ void MicroBitRadio::idleCallback()
   */
 int MicroBitRadio::dataReady()
 {
-    return queueDepth;
+    int depth = rxHead - rxTail;
+
+    return depth < 0 ? depth + MICROBIT_RADIO_RX_RING_SIZE + 1 : depth;
 }
 
 /**
@@ -454,32 +544,120 @@ int MicroBitRadio::dataReady()
   */
 FrameBuffer* MicroBitRadio::recv()
 {
-    FrameBuffer *p = rxQueue;
+    if (rxTail == rxHead)
+        return NULL;
+
+    // Copy the packet out of the ring. We do this here, rather than in the ISR, so that the
+    // ISR never touches the heap. The slot is only released to the ISR once the copy is complete.
+    // The barriers ensure the slot is read only after rxHead shows it to be full, and released only once read.
+    FrameBuffer *p = new FrameBuffer();
+
+    __DMB();
 
     if (p)
-    {
-         // Protect shared resource from ISR activity
-        NVIC_DisableIRQ(RADIO_IRQn);
+        memcpy(p, &rxRing[rxTail], sizeof(FrameBuffer));
 
-        rxQueue = rxQueue->next;
-        queueDepth--;
+    __DMB();
 
-        // Allow ISR access to shared resource
-        NVIC_EnableIRQ(RADIO_IRQn);
-    }
+    rxTail = rxTail + 1 == MICROBIT_RADIO_RX_RING_SIZE + 1 ? 0 : rxTail + 1;
 
     return p;
 }
 
+/**
+  * Determines the number of packets dropped because the receive buffer was full.
+  *
+  * @return The number of packets dropped since the radio was created.
+  */
+uint32_t MicroBitRadio::getDroppedCount()
+{
+    return rxDropped;
+}
+
+/**
+  * Determines the number of packets dropped because they were corrupted in transit.
+  *
+  * @return The number of packets that failed their CRC check since the radio was created.
+  */
+uint32_t MicroBitRadio::getCrcErrorCount()
+{
+    return rxCrcErrors;
+}
+
+/**
+  * Determines the number of packets queued for transmission, including any being transmitted.
+  *
+  * @return The number of packets awaiting transmission.
+  */
+int MicroBitRadio::getTxQueueLength()
+{
+    return (txHead + MICROBIT_RADIO_TX_QUEUE_SIZE + 1 - txTail) % (MICROBIT_RADIO_TX_QUEUE_SIZE + 1);
+}
+
 /**
   * Transmits the given buffer onto the broadcast radio.
   * The call will wait until the transmission of the packet has completed before returning.
+  * The calling fiber is descheduled whilst waiting, rather than occupying the processor.
+  * The radio is enabled on demand, if necessary.
   *
   * @param data The packet contents to transmit.
   *
-  * @return DEVICE_OK on success, or DEVICE_NOT_SUPPORTED if the BLE stack is running.
+  * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the packet is too long,
+  *         DEVICE_CANCELLED if the radio was disabled before the packet was sent,
+  *         or DEVICE_NOT_SUPPORTED if the BLE stack is running.
   */
 int MicroBitRadio::send(FrameBuffer *buffer)
+{
+    uint32_t ticket;
+    int result;
+
+    // Bring up the radio on demand. This is done only here, as enable() busy waits for the high frequency clock.
+    if (!(status & MICROBIT_RADIO_STATUS_INITIALISED))
+    {
+        result = enable();
+
+        if (result != DEVICE_OK)
+            return result;
+    }
+
+    // If the transmit queue is full, wait for space to become available.
+    while ((result = queueTxBuf(buffer, ticket)) == DEVICE_NO_RESOURCES)
+        waitForTransmission(txCompleted + 1);
+
+    if (result != DEVICE_OK)
+        return result;
+
+    return waitForPacket(ticket);
+}
+
+/**
+  * Queues the given buffer for transmission onto the broadcast radio, and returns immediately.
+  * The packet is copied, so the buffer may be reused as soon as this call returns. Queued packets are
+  * transmitted in order from the RADIO interrupt, and a MICROBIT_RADIO_EVT_TX_DONE event is raised as
+  * each one completes. May be called from interrupt context, so unlike send(), the radio is not enabled on demand.
+  *
+  * @param data The packet contents to transmit.
+  *
+  * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the packet is too long,
+  *         DEVICE_NO_RESOURCES if the transmit queue is full, DEVICE_INVALID_STATE if the radio is not enabled,
+  *         or DEVICE_NOT_SUPPORTED if the BLE stack is running.
+  */
+int MicroBitRadio::sendAsync(FrameBuffer *buffer)
+{
+    uint32_t ticket;
+
+    return queueTxBuf(buffer, ticket);
+}
+
+/**
+  * Queues the given buffer for transmission.
+  *
+  * @param buffer The packet contents to transmit.
+  * @param ticket Set to the value txCompleted will reach once the packet has been transmitted.
+  *
+  * @return DEVICE_OK on success, or an error code as per sendAsync().
+  */
+int MicroBitRadio::queueTxBuf(FrameBuffer *buffer, uint32_t &ticket)
 {
     if (ble_running())
         return DEVICE_NOT_SUPPORTED;
@@ -490,46 +668,77 @@ int MicroBitRadio::send(FrameBuffer *buffer)
     if (buffer->length > MICROBIT_RADIO_MAX_PACKET_SIZE + MICROBIT_RADIO_HEADER_SIZE - 1)
         return DEVICE_INVALID_PARAMETER;
 
-    // Firstly, disable the Radio interrupt. We want to wait until the trasmission completes.
-    NVIC_DisableIRQ(RADIO_IRQn);
+    // Packets may be queued from both fiber and interrupt context, so briefly lock out other producers.
+    // The radio may not be enabled from here, so packets can only be queued once it is running.
+    target_disable_irq();
 
-    // Turn off the transceiver.
-    NRF_RADIO->EVENTS_DISABLED = 0;
-    NRF_RADIO->TASKS_DISABLE = 1;
-    while(NRF_RADIO->EVENTS_DISABLED == 0);
+    if (!(status & MICROBIT_RADIO_STATUS_INITIALISED))
+    {
+        target_enable_irq();
+        return DEVICE_INVALID_STATE;
+    }
 
-    // Configure the radio to send the buffer provided.
-    NRF_RADIO->PACKETPTR = (uint32_t) buffer;
+    uint16_t next = txHead + 1 == MICROBIT_RADIO_TX_QUEUE_SIZE + 1 ? 0 : txHead + 1;
 
-    // Turn on the transmitter, and wait for it to signal that it's ready to use.
-    NRF_RADIO->EVENTS_READY = 0;
-    NRF_RADIO->TASKS_TXEN = 1;
-    while (NRF_RADIO->EVENTS_READY == 0);
+    if (next == txTail)
+    {
+        target_enable_irq();
+        return DEVICE_NO_RESOURCES;
+    }
 
-    // Start transmission and wait for end of packet.
-    NRF_RADIO->TASKS_START = 1;
-    NRF_RADIO->EVENTS_END = 0;
-    while(NRF_RADIO->EVENTS_END == 0);
+    memcpy(&txRing[txHead], buffer, sizeof(FrameBuffer));
+    txHead = next;
+    ticket = ++txQueued;
 
-    // Return the radio to using the default receive buffer
-    NRF_RADIO->PACKETPTR = (uint32_t) rxBuf;
+    target_enable_irq();
 
-    // Turn off the transmitter.
-    NRF_RADIO->EVENTS_DISABLED = 0;
-    NRF_RADIO->TASKS_DISABLE = 1;
-    while(NRF_RADIO->EVENTS_DISABLED == 0);
+    // Have the RADIO interrupt start the transmission, if it is not already sending.
+    NVIC_SetPendingIRQ(RADIO_IRQn);
 
-    // Start listening for the next packet
-    NRF_RADIO->EVENTS_READY = 0;
-    NRF_RADIO->TASKS_RXEN = 1;
-    while(NRF_RADIO->EVENTS_READY == 0);
+    return DEVICE_OK;
+}
 
-    NRF_RADIO->EVENTS_END = 0;
-    NRF_RADIO->TASKS_START = 1;
+/**
+  * Waits until txCompleted reaches the given value.
+  *
+  * @param ticket The value to wait for.
+  */
+void MicroBitRadio::waitForTransmission(uint32_t ticket)
+{
+    while ((int32_t) (txCompleted - ticket) < 0)
+    {
+        // Without a scheduler, simply wait for the RADIO interrupt to complete the transmission.
+        if (!fiber_scheduler_running())
+            continue;
 
-    // Re-enable the Radio interrupt.
-    NVIC_ClearPendingIRQ(RADIO_IRQn);
-    NVIC_EnableIRQ(RADIO_IRQn);
+        // Register for the completion event before testing again, so that a completion cannot be missed.
+        NVIC_DisableIRQ(RADIO_IRQn);
+
+        bool pending = (int32_t) (txCompleted - ticket) < 0;
+        if (pending)
+            fiber_wake_on_event(DEVICE_ID_RADIO, MICROBIT_RADIO_EVT_TX_DONE);
+
+        NVIC_EnableIRQ(RADIO_IRQn);
+
+        if (pending)
+            schedule();
+    }
+}
+
+/**
+  * Waits until the given packet has been transmitted, or discarded by disable().
+  *
+  * @param ticket The ticket set by queueTxBuf() for the packet.
+  *
+  * @return DEVICE_OK if the packet was transmitted, or DEVICE_CANCELLED if the radio was disabled before it was sent.
+  */
+int MicroBitRadio::waitForPacket(uint32_t ticket)
+{
+    waitForTransmission(ticket);
+
+    // Determine if our packet was discarded by disable(), rather than sent.
+    if ((int32_t) (ticket - txAbortedFrom) > 0 && (int32_t) (ticket - txAbortedTo) <= 0)
+        return DEVICE_CANCELLED;
 
     return DEVICE_OK;
 }
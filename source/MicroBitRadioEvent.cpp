@@ -24,6 +24,7 @@ DEALINGS IN THE SOFTWARE.
 */
 
 #include "MicroBitRadio.h"
+#include "nrf.h"
 
 using namespace codal;
 
@@ -52,6 +53,7 @@ using namespace codal;
 MicroBitRadioEvent::MicroBitRadioEvent(MicroBitRadio &r) : radio(r)
 {
     this->suppressForwarding = false;
+    this->dropped = 0;
 }
 
 /**
@@ -172,5 +174,24 @@ void MicroBitRadioEvent::eventReceived(Event e)
     buf.protocol = MICROBIT_RADIO_PROTOCOL_EVENTBUS;
     memcpy(buf.payload, (const uint8_t *)&e, sizeof(Event));
 
-    radio.send(&buf);
+    // We listen immediately, so may be running in interrupt context, where we must not block.
+    // Otherwise, if the packet cannot be queued, wait for it to be sent (enabling the radio if need be).
+    int result = radio.sendAsync(&buf);
+
+    if (result != DEVICE_OK && __get_IPSR() == 0)
+        result = radio.send(&buf);
+
+    if (result != DEVICE_OK)
+        dropped++;
+}
+
+/**
+  * Determines the number of events that could not be forwarded onto the radio. Events raised from interrupt
+  * context cannot wait for the radio, so are dropped if the transmit queue is full or the radio is not enabled.
+  *
+  * @return The number of events dropped since this instance was created.
+  */
+uint32_t MicroBitRadioEvent::getDroppedCount()
+{
+    return dropped;
 }
@@ -0,0 +1,336 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "MicroBitRadio.h"
+#include "MicroBitDevice.h"
+#include "codal_target_hal.h"
+
+using namespace codal;
+
+/**
+  * Provides multi-hop broadcast and network time synchronisation, built upon MicroBitRadio.
+  *
+  * This follows the GLOSSY approach. A flood is relayed from the RADIO interrupt as soon as it is received, so every
+  * device that hears a given transmission relays it after the same fixed delay, and the flood spreads through the
+  * network one hop per slot. Each device relays each flood only once, as identified by its initiator and sequence
+  * number, and only up to MICROBIT_RADIO_FLOOD_MAX_RELAYS times in total.
+  *
+  * Because the slot duration is known, a device can infer when a flood was started from the number of times it has been
+  * relayed. Floods started by the time reference carry its clock, from which the other devices derive the network time.
+  *
+  * @note This API does not contain any form of encryption, authentication or authorisation. Its purpose is solely for use as a
+  * teaching aid to demonstrate how simple communications operates, and to provide a sandpit through which learning can take place.
+  * For serious applications, BLE should be considered a substantially more secure alternative.
+  */
+
+/**
+  * Constructor.
+  *
+  * @param r The underlying radio module used to send and receive data.
+  */
+MicroBitRadioFlood::MicroBitRadioFlood(MicroBitRadio &r) : radio(r)
+{
+    this->nextSequence = 0;
+    this->sequenceValid = false;
+    this->reference = false;
+    this->synchronised = false;
+    this->offset = 0;
+    this->cacheIndex = 0;
+    this->rxQueue = NULL;
+
+    for (int i = 0; i < MICROBIT_RADIO_FLOOD_CACHE_SIZE; i++)
+        cache[i].valid = false;
+}
+
+/**
+  * Retrieves the next flood received.
+  *
+  * @param initiator If not NULL, set to the identity of the device that started the flood.
+  * @param hops If not NULL, set to the number of hops the flood travelled to reach this device.
+  *
+  * @return the data received, or an empty PacketBuffer if no data is available.
+  */
+PacketBuffer MicroBitRadioFlood::recv(uint16_t *initiator, uint8_t *hops)
+{
+    if (rxQueue == NULL)
+        return PacketBuffer::EmptyPacket;
+
+    FrameBuffer *p = rxQueue;
+    rxQueue = rxQueue->next;
+
+    MicroBitRadioFloodHeader *header = (MicroBitRadioFloodHeader *) p->payload;
+
+    if (initiator)
+        *initiator = header->initiator;
+
+    if (hops)
+        *hops = header->relays + 1;
+
+    PacketBuffer packet(p->payload + sizeof(MicroBitRadioFloodHeader), p->length - (MICROBIT_RADIO_HEADER_SIZE - 1) - sizeof(MicroBitRadioFloodHeader), p->rssi);
+
+    delete p;
+    return packet;
+}
+
+/**
+  * Starts a flood of the given buffer through the network.
+  * This is a synchronous call that will wait until this device has transmitted the flood before returning.
+  * The flood waits for any packets already queued for transmission, so that it leaves at the time it was stamped with.
+  *
+  * @param buffer The packet contents to transmit.
+  * @param len The number of bytes to transmit.
+  *
+  * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the buffer is invalid,
+  *         or the number of bytes to transmit is greater than MICROBIT_RADIO_FLOOD_MAX_PAYLOAD,
+  *         DEVICE_CANCELLED if the radio was disabled before the flood was sent,
+  *         or DEVICE_NOT_SUPPORTED if the BLE stack is running.
+  */
+int MicroBitRadioFlood::send(uint8_t *buffer, int len)
+{
+    if (buffer == NULL || len < 0 || len > MICROBIT_RADIO_FLOOD_MAX_PAYLOAD)
+        return DEVICE_INVALID_PARAMETER;
+
+    FrameBuffer buf;
+    MicroBitRadioFloodHeader *header = (MicroBitRadioFloodHeader *) buf.payload;
+
+    buf.length = len + sizeof(MicroBitRadioFloodHeader) + MICROBIT_RADIO_HEADER_SIZE - 1;
+    buf.version = 1;
+    buf.group = 0;
+    buf.protocol = MICROBIT_RADIO_PROTOCOL_FLOOD;
+
+    // Start from a random sequence number, so a restarted device is unlikely to reuse one its neighbours remember.
+    // This is chosen here rather than on construction, as the random number generator is seeded only once the device is initialised.
+    if (!sequenceValid)
+    {
+        nextSequence = microbit_random(256);
+        sequenceValid = true;
+    }
+
+    header->initiator = (uint16_t) microbit_serial_number();
+    header->sequence = nextSequence++;
+    header->relays = 0;
+    header->maxRelays = MICROBIT_RADIO_FLOOD_MAX_RELAYS;
+    header->flags = reference ? MICROBIT_RADIO_FLOOD_FLAG_TIME_REFERENCE : 0;
+    header->reserved = 0;
+    memcpy(buf.payload + sizeof(MicroBitRadioFloodHeader), buffer, len);
+
+    // Remember our own flood, so that we don't relay it when it comes back to us.
+    target_disable_irq();
+    isDuplicate(header->initiator, header->sequence, (uint32_t) system_timer_current_time_us());
+    target_enable_irq();
+
+    // Bring up the radio before stamping the flood, as enable() busy waits for the high frequency clock.
+    int result = radio.enable();
+
+    if (result != DEVICE_OK)
+        return result;
+
+    // Receivers assume the flood leaves us MICROBIT_RADIO_FLOOD_RELAY_DELAY after it was stamped, so like a relay, it must
+    // not be queued behind other packets. Wait for the transmit queue to drain, then stamp and queue the flood atomically.
+    uint32_t ticket;
+
+    while (true)
+    {
+        target_disable_irq();
+
+        if (radio.getTxQueueLength() == 0)
+        {
+            header->timestamp = getNetworkTime();
+            result = radio.queueTxBuf(&buf, ticket);
+            target_enable_irq();
+            break;
+        }
+
+        ticket = radio.txCompleted + 1;
+        target_enable_irq();
+
+        radio.waitForTransmission(ticket);
+    }
+
+    if (result != DEVICE_OK)
+        return result;
+
+    return radio.waitForPacket(ticket);
+}
+
+/**
+  * Starts a flood of the given buffer through the network.
+  * This is a synchronous call that will wait until this device has transmitted the flood before returning.
+  * The flood waits for any packets already queued for transmission, so that it leaves at the time it was stamped with.
+  *
+  * @param data The packet contents to transmit.
+  *
+  * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the number of bytes to transmit is
+  *         greater than MICROBIT_RADIO_FLOOD_MAX_PAYLOAD, DEVICE_CANCELLED if the radio was disabled before
+  *         the flood was sent, or DEVICE_NOT_SUPPORTED if the BLE stack is running.
+  */
+int MicroBitRadioFlood::send(PacketBuffer data)
+{
+    return send(data.getBytes(), data.length());
+}
+
+/**
+  * Determines whether this device is the time reference for the network.
+  * The network time of the time reference is its own clock, and each flood it starts synchronises the other devices.
+  *
+  * @param reference true if this device should be the time reference, false otherwise.
+  */
+void MicroBitRadioFlood::setTimeReference(bool reference)
+{
+    this->reference = reference;
+    this->offset = 0;
+    this->synchronised = reference;
+}
+
+/**
+  * Determines if the network time is known, either because this device is the time reference, or because a flood
+  * started by the time reference has been received.
+  */
+bool MicroBitRadioFlood::isSynchronised()
+{
+    return synchronised;
+}
+
+/**
+  * Retrieves the network time.
+  *
+  * @return the network time, in microseconds, or the local time if the network time is not yet known.
+  */
+uint32_t MicroBitRadioFlood::getNetworkTime()
+{
+    return (uint32_t) system_timer_current_time_us() + offset;
+}
+
+/**
+  * Determines if the given flood has been seen within the last MICROBIT_RADIO_FLOOD_CACHE_LIFETIME, and remembers it if not.
+  *
+  * @param initiator The initiator of the flood.
+  * @param sequence The sequence number of the flood.
+  * @param now The current local time, in microseconds.
+  */
+bool MicroBitRadioFlood::isDuplicate(uint16_t initiator, uint8_t sequence, uint32_t now)
+{
+    for (int i = 0; i < MICROBIT_RADIO_FLOOD_CACHE_SIZE; i++)
+    {
+        if (cache[i].valid && now - cache[i].time > MICROBIT_RADIO_FLOOD_CACHE_LIFETIME * 1000)
+            cache[i].valid = false;
+
+        if (cache[i].valid && cache[i].initiator == initiator && cache[i].sequence == sequence)
+            return true;
+    }
+
+    cache[cacheIndex].valid = true;
+    cache[cacheIndex].time = now;
+    cache[cacheIndex].initiator = initiator;
+    cache[cacheIndex].sequence = sequence;
+    cacheIndex = (cacheIndex + 1) % MICROBIT_RADIO_FLOOD_CACHE_SIZE;
+
+    return false;
+}
+
+/**
+  * Interrupt handler callback. This is called by the RADIO interrupt as soon as a flood has been received.
+  *
+  * Duplicate floods are discarded. Otherwise, the network time is updated if the flood was started by the time
+  * reference, and the flood is queued for relaying unless it has already been relayed MICROBIT_RADIO_FLOOD_MAX_RELAYS times.
+  * A relay must leave at the same time as those of the other devices, so if packets are already queued for
+  * transmission, the flood is neither relayed nor used to update the network time.
+  *
+  * @param p The flood received.
+  *
+  * @return true if the flood should be passed on to packetReceived(), or false if it should be discarded.
+  */
+bool MicroBitRadioFlood::relay(FrameBuffer *p)
+{
+    uint32_t now = (uint32_t) system_timer_current_time_us();
+    MicroBitRadioFloodHeader *header = (MicroBitRadioFloodHeader *) p->payload;
+
+    if (p->length < sizeof(MicroBitRadioFloodHeader) + MICROBIT_RADIO_HEADER_SIZE - 1 || isDuplicate(header->initiator, header->sequence, now))
+        return false;
+
+    // A relay queued behind other packets would leave late, and corrupt the timing of every device downstream.
+    // The flood is still delivered locally, and typically reaches our neighbours through the other devices relaying it.
+    if (radio.getTxQueueLength() > 0)
+        return true;
+
+    // Each hop takes one slot: the relay delay, plus the time on air of the frame at 1Mbit/s.
+    // The initiator's transmission ended one slot after it stamped the flood, and each relay adds another.
+    if ((header->flags & MICROBIT_RADIO_FLOOD_FLAG_TIME_REFERENCE) && !reference)
+    {
+        uint32_t slot = MICROBIT_RADIO_FLOOD_RELAY_DELAY + (p->length + MICROBIT_RADIO_FLOOD_FRAME_OVERHEAD) * 8;
+
+        offset = (int32_t)(header->timestamp + (header->relays + 1) * slot - now);
+        synchronised = true;
+    }
+
+    // Queue the relay. The RADIO interrupt switches to transmit as soon as we return.
+    if (header->relays < header->maxRelays)
+    {
+        header->relays++;
+        radio.sendAsync(p);
+        header->relays--;
+    }
+
+    return true;
+}
+
+/**
+  * Protocol handler callback. This is called when the radio receives a packet marked as a flood.
+  *
+  * This function queues the flood for user reception. Relaying and duplicate suppression have already taken place in relay().
+  */
+void MicroBitRadioFlood::packetReceived()
+{
+    FrameBuffer *packet = radio.recv();
+    int queueDepth = 0;
+
+    // We add to the tail of the queue to preserve causal ordering.
+    packet->next = NULL;
+
+    if (rxQueue == NULL)
+    {
+        rxQueue = packet;
+    }
+    else
+    {
+        FrameBuffer *p = rxQueue;
+        queueDepth++;
+
+        while (p->next != NULL)
+        {
+            p = p->next;
+            queueDepth++;
+        }
+
+        if (queueDepth >= MICROBIT_RADIO_MAXIMUM_RX_BUFFERS)
+        {
+            delete packet;
+            return;
+        }
+
+        p->next = packet;
+    }
+
+    Event(DEVICE_ID_RADIO, MICROBIT_RADIO_EVT_FLOOD);
+}
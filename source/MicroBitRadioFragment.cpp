@@ -0,0 +1,285 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "MicroBitRadio.h"
+#include "MicroBitDevice.h"
+
+using namespace codal;
+
+/**
+  * Provides broadcast of messages larger than a single radio frame, built upon MicroBitRadio.
+  *
+  * Messages of up to MICROBIT_RADIO_FRAGMENT_MAX_LENGTH bytes are split into numbered fragments, each sent as a
+  * separate radio frame. Receivers reassemble them in a bounded number of slots, discarding duplicate fragments
+  * and repeated messages, and abandoning messages that have not completed within MICROBIT_RADIO_FRAGMENT_TIMEOUT.
+  * Delivery is best effort: a message is only delivered if all of its fragments are received.
+  *
+  * @note This API does not contain any form of encryption, authentication or authorisation. Its purpose is solely for use as a
+  * teaching aid to demonstrate how simple communications operates, and to provide a sandpit through which learning can take place.
+  * For serious applications, BLE should be considered a substantially more secure alternative.
+  */
+
+/**
+  * Constructor.
+  *
+  * @param r The underlying radio module used to send and receive data.
+  */
+MicroBitRadioFragment::MicroBitRadioFragment(MicroBitRadio &r) : radio(r)
+{
+    this->nextMessage = 0;
+    this->historyIndex = 0;
+    this->rxQueueHead = 0;
+    this->rxQueueLength = 0;
+    this->dropped = 0;
+
+    for (int i = 0; i < MICROBIT_RADIO_FRAGMENT_SLOTS; i++)
+        slots[i].active = false;
+
+    for (int i = 0; i < MICROBIT_RADIO_FRAGMENT_HISTORY; i++)
+        history[i].valid = false;
+}
+
+/**
+  * Retrieves the next reassembled message.
+  *
+  * @return the message, or an empty buffer if no message is available.
+  */
+ManagedBuffer MicroBitRadioFragment::recv()
+{
+    if (rxQueueLength == 0)
+        return ManagedBuffer();
+
+    ManagedBuffer data = rxQueue[rxQueueHead];
+    rxQueue[rxQueueHead] = ManagedBuffer();
+
+    rxQueueHead = (rxQueueHead + 1) % MICROBIT_RADIO_FRAGMENT_QUEUE_SIZE;
+    rxQueueLength--;
+
+    return data;
+}
+
+/**
+  * Transmits the given message onto the broadcast radio, as a sequence of fragments.
+  * This is a synchronous call that will wait until all fragments have been transmitted before returning.
+  *
+  * @param buffer The message to transmit.
+  * @param len The number of bytes to transmit.
+  *
+  * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the buffer is invalid,
+  *         or the number of bytes to transmit is greater than MICROBIT_RADIO_FRAGMENT_MAX_LENGTH.
+  */
+int MicroBitRadioFragment::send(uint8_t *buffer, int len)
+{
+    if (buffer == NULL || len < 0 || len > MICROBIT_RADIO_FRAGMENT_MAX_LENGTH)
+        return DEVICE_INVALID_PARAMETER;
+
+    FrameBuffer buf;
+    MicroBitRadioFragmentHeader *header = (MicroBitRadioFragmentHeader *) buf.payload;
+    int count = max(1, (int)((len + MICROBIT_RADIO_FRAGMENT_DATA_SIZE - 1) / MICROBIT_RADIO_FRAGMENT_DATA_SIZE));
+
+    buf.version = 1;
+    buf.group = 0;
+    buf.protocol = MICROBIT_RADIO_PROTOCOL_FRAGMENT;
+
+    header->source = (uint16_t) microbit_serial_number();
+    header->message = nextMessage++;
+    header->count = count;
+    header->reserved = 0;
+    header->length = len;
+
+    for (int i = 0; i < count; i++)
+    {
+        int offset = i * MICROBIT_RADIO_FRAGMENT_DATA_SIZE;
+        int l = min(len - offset, (int)MICROBIT_RADIO_FRAGMENT_DATA_SIZE);
+
+        header->index = i;
+        memcpy(buf.payload + sizeof(MicroBitRadioFragmentHeader), buffer + offset, l);
+        buf.length = l + sizeof(MicroBitRadioFragmentHeader) + MICROBIT_RADIO_HEADER_SIZE - 1;
+
+        int result = radio.send(&buf);
+        if (result != DEVICE_OK)
+            return result;
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+  * Transmits the given message onto the broadcast radio, as a sequence of fragments.
+  * This is a synchronous call that will wait until all fragments have been transmitted before returning.
+  *
+  * @param data The message to transmit.
+  *
+  * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the message is
+  *         longer than MICROBIT_RADIO_FRAGMENT_MAX_LENGTH.
+  */
+int MicroBitRadioFragment::send(ManagedBuffer data)
+{
+    return send(data.getBytes(), data.length());
+}
+
+/**
+  * Determines the number of messages that were partially received and abandoned, or discarded because the
+  * queue of completed messages was full.
+  */
+uint32_t MicroBitRadioFragment::getDroppedCount()
+{
+    return dropped;
+}
+
+/**
+  * Determines if the given message has recently been completed.
+  */
+bool MicroBitRadioFragment::isDuplicate(uint16_t source, uint8_t message, uint32_t now)
+{
+    for (int i = 0; i < MICROBIT_RADIO_FRAGMENT_HISTORY; i++)
+    {
+        MicroBitRadioFragmentHistory *h = &history[i];
+
+        if (h->valid && now - h->timestamp > MICROBIT_RADIO_FRAGMENT_TIMEOUT)
+            h->valid = false;
+
+        if (h->valid && h->source == source && h->message == message)
+            return true;
+    }
+
+    return false;
+}
+
+/**
+  * Finds the slot reassembling the given message, or allocates one for it.
+  * If no slot is free, the slot that has waited longest for a fragment is abandoned.
+  */
+MicroBitRadioFragmentSlot *MicroBitRadioFragment::getSlot(MicroBitRadioFragmentHeader *header, uint32_t now)
+{
+    MicroBitRadioFragmentSlot *slot = NULL;
+
+    for (int i = 0; i < MICROBIT_RADIO_FRAGMENT_SLOTS; i++)
+    {
+        MicroBitRadioFragmentSlot *s = &slots[i];
+
+        // Abandon any message that has stalled.
+        if (s->active && now - s->timestamp > MICROBIT_RADIO_FRAGMENT_TIMEOUT)
+        {
+            s->active = false;
+            s->data = ManagedBuffer();
+            dropped++;
+        }
+
+        if (s->active && s->source == header->source && s->message == header->message)
+        {
+            // A sender that has reused a sequence number with a different message restarts reassembly.
+            if (s->data.length() == header->length)
+                return s;
+
+            slot = s;
+            break;
+        }
+
+        if (slot == NULL || (slot->active && (!s->active || s->timestamp < slot->timestamp)))
+            slot = s;
+    }
+
+    if (slot->active)
+        dropped++;
+
+    slot->active = true;
+    slot->source = header->source;
+    slot->message = header->message;
+    slot->remaining = header->count;
+    slot->data = ManagedBuffer(header->length);
+    memset(slot->received, 0, sizeof(slot->received));
+
+    return slot;
+}
+
+/**
+  * Protocol handler callback. This is called when the radio receives a packet marked as a fragment.
+  *
+  * This function adds the fragment to the message it belongs to, and queues the message for user reception once complete.
+  */
+void MicroBitRadioFragment::packetReceived()
+{
+    FrameBuffer *packet = radio.recv();
+    MicroBitRadioFragmentHeader *header = (MicroBitRadioFragmentHeader *) packet->payload;
+    int len = packet->length - (MICROBIT_RADIO_HEADER_SIZE - 1) - (int) sizeof(MicroBitRadioFragmentHeader);
+    uint32_t now = system_timer_current_time();
+
+    // Discard anything malformed, or that we could never reassemble.
+    if (len < 0 || header->length > MICROBIT_RADIO_FRAGMENT_MAX_LENGTH || header->index >= header->count ||
+        header->count != max(1, (int)((header->length + MICROBIT_RADIO_FRAGMENT_DATA_SIZE - 1) / MICROBIT_RADIO_FRAGMENT_DATA_SIZE)))
+    {
+        delete packet;
+        return;
+    }
+
+    int offset = header->index * MICROBIT_RADIO_FRAGMENT_DATA_SIZE;
+
+    if (len != min(header->length - offset, (int)MICROBIT_RADIO_FRAGMENT_DATA_SIZE) || isDuplicate(header->source, header->message, now))
+    {
+        delete packet;
+        return;
+    }
+
+    MicroBitRadioFragmentSlot *slot = getSlot(header, now);
+    uint32_t bit = 1UL << (header->index % 32);
+
+    slot->timestamp = now;
+
+    if ((slot->received[header->index / 32] & bit) == 0)
+    {
+        memcpy(slot->data.getBytes() + offset, packet->payload + sizeof(MicroBitRadioFragmentHeader), len);
+        slot->received[header->index / 32] |= bit;
+        slot->remaining--;
+    }
+
+    delete packet;
+
+    if (slot->remaining)
+        return;
+
+    // The message is complete. Remember it, so that retransmissions are not delivered twice.
+    MicroBitRadioFragmentHistory *h = &history[historyIndex];
+    historyIndex = (historyIndex + 1) % MICROBIT_RADIO_FRAGMENT_HISTORY;
+
+    h->valid = true;
+    h->source = slot->source;
+    h->message = slot->message;
+    h->timestamp = now;
+
+    if (rxQueueLength < MICROBIT_RADIO_FRAGMENT_QUEUE_SIZE)
+    {
+        rxQueue[(rxQueueHead + rxQueueLength) % MICROBIT_RADIO_FRAGMENT_QUEUE_SIZE] = slot->data;
+        rxQueueLength++;
+
+        Event(DEVICE_ID_RADIO, MICROBIT_RADIO_EVT_FRAGMENT);
+    }
+    else
+    {
+        dropped++;
+    }
+
+    slot->active = false;
+    slot->data = ManagedBuffer();
+}
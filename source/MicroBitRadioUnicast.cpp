@@ -0,0 +1,515 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "MicroBitRadio.h"
+#include "MicroBitDevice.h"
+
+using namespace codal;
+
+/**
+  * Provides reliable, addressed delivery of packets to a single peer, built upon MicroBitRadio.
+  *
+  * Each device is addressed by a 16 bit value derived from its serial number. Every data packet is acknowledged
+  * by its recipient, and retransmitted with exponential backoff until it is, up to MICROBIT_RADIO_UNICAST_RETRIES times.
+  * Up to MICROBIT_RADIO_UNICAST_WINDOW_SIZE packets may be awaiting acknowledgement at once, and only those that are
+  * not acknowledged are retransmitted. The sequence numbers in flight to a peer never span more than MICROBIT_RADIO_UNICAST_HISTORY. Recipients discard duplicate packets, but packets may be delivered out of order.
+  *
+  * The retransmission timeout for each peer is derived from measurements of its round trip time, which are made
+  * available alongside loss statistics through getPeer().
+  *
+  * @note This API does not contain any form of encryption, authentication or authorisation. Its purpose is solely for use as a
+  * teaching aid to demonstrate how simple communications operates, and to provide a sandpit through which learning can take place.
+  * For serious applications, BLE should be considered a substantially more secure alternative.
+  */
+
+/**
+  * Constructor.
+  *
+  * @param r The underlying radio module used to send and receive data.
+  */
+MicroBitRadioUnicast::MicroBitRadioUnicast(MicroBitRadio &r) : radio(r)
+{
+    this->address = (uint16_t) microbit_serial_number();
+    this->rxQueue = NULL;
+    this->lastTransmission = 0;
+
+    // Zero is reserved to mark unused peer entries.
+    if (this->address == 0)
+        this->address = 1;
+
+    memset(peers, 0, sizeof(peers));
+
+    for (int i = 0; i < MICROBIT_RADIO_UNICAST_WINDOW_SIZE; i++)
+        window[i].active = false;
+}
+
+/**
+  * Retrieves the address of this device.
+  */
+uint16_t MicroBitRadioUnicast::getAddress()
+{
+    return address;
+}
+
+/**
+  * Changes the address of this device. By default, this is derived from its serial number.
+  *
+  * @param address The new address, which must not be zero.
+  *
+  * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the address is zero.
+  */
+int MicroBitRadioUnicast::setAddress(uint16_t address)
+{
+    if (address == 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    this->address = address;
+
+    return DEVICE_OK;
+}
+
+/**
+  * Retrieves the next packet received.
+  *
+  * @param source If not NULL, set to the address of the sender of the packet.
+  *
+  * @return the data received, or an empty PacketBuffer if no data is available.
+  */
+PacketBuffer MicroBitRadioUnicast::recv(uint16_t *source)
+{
+    if (rxQueue == NULL)
+        return PacketBuffer::EmptyPacket;
+
+    FrameBuffer *p = rxQueue;
+    rxQueue = rxQueue->next;
+
+    MicroBitRadioUnicastHeader *header = (MicroBitRadioUnicastHeader *) p->payload;
+
+    if (source)
+        *source = header->source;
+
+    PacketBuffer packet(p->payload + sizeof(MicroBitRadioUnicastHeader), p->length - (MICROBIT_RADIO_HEADER_SIZE - 1) - sizeof(MicroBitRadioUnicastHeader), p->rssi);
+
+    delete p;
+    return packet;
+}
+
+/**
+  * Transmits the given buffer to the given peer.
+  *
+  * This call waits until there is room in the window of packets awaiting acknowledgement, and for the packet to be
+  * transmitted once and then acknowledged or for up to MICROBIT_RADIO_UNICAST_ACK_GUARD milliseconds, before
+  * returning. As the radio is half duplex, this keeps the next packet from colliding with the acknowledgement.
+  * Acknowledgement and any retransmission take place in the background, and a
+  * MICROBIT_RADIO_EVT_UNICAST_TX event is raised when the packet is acknowledged or abandoned.
+  *
+  * @param address The address of the recipient.
+  * @param buffer The packet contents to transmit.
+  * @param len The number of bytes to transmit.
+  *
+  * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the buffer or address is invalid,
+  *         or the number of bytes to transmit is greater than MICROBIT_RADIO_UNICAST_MAX_PAYLOAD.
+  */
+int MicroBitRadioUnicast::send(uint16_t address, uint8_t *buffer, int len)
+{
+    if (address == 0 || buffer == NULL || len < 0 || len > MICROBIT_RADIO_UNICAST_MAX_PAYLOAD)
+        return DEVICE_INVALID_PARAMETER;
+
+    MicroBitRadioUnicastWindow *w;
+    MicroBitRadioUnicastPeer *peer;
+
+    // Wait for an acknowledgement (or failure) to make room in the window. We also hold back while the oldest packet
+    // awaiting acknowledgement by this peer is MICROBIT_RADIO_UNICAST_HISTORY sequence numbers behind, so that the peer can
+    // still recognise it as a duplicate.
+    while (true)
+    {
+        bool stalled = false;
+
+        w = NULL;
+        peer = lookup(address, true);
+
+        // Every peer we know has packets awaiting acknowledgement. Wait for one of them to finish.
+        if (peer == NULL)
+        {
+            fiber_wait_for_event(DEVICE_ID_RADIO, MICROBIT_RADIO_EVT_UNICAST_TX);
+            continue;
+        }
+
+        for (int i = 0; i < MICROBIT_RADIO_UNICAST_WINDOW_SIZE; i++)
+        {
+            if (!window[i].active)
+                w = &window[i];
+
+            else if (window[i].header.destination == address && (uint8_t)(peer->txSequence - window[i].header.sequence) >= MICROBIT_RADIO_UNICAST_HISTORY)
+                stalled = true;
+        }
+
+        if (w && !stalled)
+            break;
+
+        fiber_wait_for_event(DEVICE_ID_RADIO, MICROBIT_RADIO_EVT_UNICAST_TX);
+    }
+
+    w->length = len;
+    w->header.destination = address;
+    w->header.source = this->address;
+    w->header.type = MICROBIT_RADIO_UNICAST_TYPE_DATA;
+    w->header.sequence = peer->txSequence++;
+    memcpy(w->data, buffer, len);
+
+    peer->sent++;
+
+    w->active = true;
+    w->retries = 0;
+    w->timeout = peer->rto;
+    w->timestamp = (uint32_t) system_timer_current_time_us();
+
+    int result = transmit(w, true);
+
+    if (result != DEVICE_OK)
+    {
+        w->active = false;
+        return result;
+    }
+
+    // Leave the air free for the acknowledgement. Once the guard time has passed, the acknowledgement is most likely
+    // being delayed by the peer, and the window allows us to carry on sending.
+    uint8_t sequence = w->header.sequence;
+    uint32_t sent = system_timer_current_time();
+
+    while (w->active && w->header.destination == address && w->header.sequence == sequence && system_timer_current_time() - sent < MICROBIT_RADIO_UNICAST_ACK_GUARD)
+        fiber_sleep(1);
+
+    return DEVICE_OK;
+}
+
+/**
+  * Transmits the given buffer to the given peer.
+  *
+  * @param address The address of the recipient.
+  * @param data The packet contents to transmit.
+  *
+  * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the address is invalid,
+  *         or the number of bytes to transmit is greater than MICROBIT_RADIO_UNICAST_MAX_PAYLOAD.
+  */
+int MicroBitRadioUnicast::send(uint16_t address, PacketBuffer data)
+{
+    return send(address, data.getBytes(), data.length());
+}
+
+/**
+  * Retrieves the round trip time and loss statistics for the given peer.
+  *
+  * @param address The address of the peer.
+  *
+  * @return the state held for the peer, or NULL if no packets have been exchanged with it recently.
+  */
+const MicroBitRadioUnicastPeer *MicroBitRadioUnicast::getPeer(uint16_t address)
+{
+    return lookup(address, false);
+}
+
+/**
+  * Finds the state held for the given peer, optionally creating it.
+  * If the peer table is full, the least recently active peer is forgotten. Peers with packets awaiting
+  * acknowledgement are never forgotten, as their sequence numbers and round trip times are still in use.
+  *
+  * @return the state held for the peer, or NULL if it is not known and either create is not set, or every peer is busy.
+  */
+MicroBitRadioUnicastPeer *MicroBitRadioUnicast::lookup(uint16_t address, bool create)
+{
+    MicroBitRadioUnicastPeer *oldest = NULL;
+    uint32_t now = system_timer_current_time();
+
+    for (int i = 0; i < MICROBIT_RADIO_UNICAST_PEERS; i++)
+    {
+        if (peers[i].address == address)
+        {
+            peers[i].lastActivity = now;
+            return &peers[i];
+        }
+
+        bool busy = false;
+
+        for (int j = 0; j < MICROBIT_RADIO_UNICAST_WINDOW_SIZE; j++)
+            if (peers[i].address != 0 && window[j].active && window[j].header.destination == peers[i].address)
+                busy = true;
+
+        if (!busy && (oldest == NULL || (oldest->address != 0 && (peers[i].address == 0 || peers[i].lastActivity < oldest->lastActivity))))
+            oldest = &peers[i];
+    }
+
+    if (!create || address == 0 || oldest == NULL)
+        return NULL;
+
+    memset(oldest, 0, sizeof(MicroBitRadioUnicastPeer));
+
+    // Start from a random sequence number, so that a peer that has restarted is unlikely to see our packets as duplicates.
+    oldest->address = address;
+    oldest->txSequence = microbit_random(256);
+    oldest->rto = MICROBIT_RADIO_UNICAST_INITIAL_RTO * 1000;
+    oldest->lastActivity = now;
+
+    return oldest;
+}
+
+/**
+  * Transmits the packet held in the given entry in the window.
+  *
+  * @param w The packet to transmit.
+  * @param wait If set, wait for the packet to be transmitted. Otherwise, queue it and return immediately.
+  *
+  * @return DEVICE_OK on success, or an error code as per MicroBitRadio::send() or MicroBitRadio::sendAsync().
+  */
+int MicroBitRadioUnicast::transmit(MicroBitRadioUnicastWindow *w, bool wait)
+{
+    FrameBuffer buf;
+
+    buf.length = w->length + sizeof(MicroBitRadioUnicastHeader) + MICROBIT_RADIO_HEADER_SIZE - 1;
+    buf.version = 1;
+    buf.group = 0;
+    buf.protocol = MICROBIT_RADIO_PROTOCOL_UNICAST;
+    memcpy(buf.payload, &w->header, sizeof(MicroBitRadioUnicastHeader));
+    memcpy(buf.payload + sizeof(MicroBitRadioUnicastHeader), w->data, w->length);
+
+    lastTransmission = (uint32_t) system_timer_current_time_us();
+
+    return wait ? radio.send(&buf) : radio.sendAsync(&buf);
+}
+
+/**
+  * Sends an acknowledgement of the given data packet.
+  */
+void MicroBitRadioUnicast::acknowledge(MicroBitRadioUnicastHeader *header)
+{
+    FrameBuffer buf;
+    MicroBitRadioUnicastHeader *ack = (MicroBitRadioUnicastHeader *) buf.payload;
+
+    buf.length = sizeof(MicroBitRadioUnicastHeader) + MICROBIT_RADIO_HEADER_SIZE - 1;
+    buf.version = 1;
+    buf.group = 0;
+    buf.protocol = MICROBIT_RADIO_PROTOCOL_UNICAST;
+
+    ack->destination = header->source;
+    ack->source = address;
+    ack->type = MICROBIT_RADIO_UNICAST_TYPE_ACK;
+    ack->sequence = header->sequence;
+
+    // We may be running in the idle fiber, so must not block. A lost acknowledgement is recovered by retransmission.
+    radio.sendAsync(&buf);
+}
+
+/**
+  * Releases the given entry in the window, and notifies any fiber waiting for space.
+  */
+void MicroBitRadioUnicast::release(MicroBitRadioUnicastWindow *w)
+{
+    w->active = false;
+    Event(DEVICE_ID_RADIO, MICROBIT_RADIO_EVT_UNICAST_TX);
+}
+
+/**
+  * Protocol handler callback. This is called when the radio receives a packet marked as unicast.
+  *
+  * Data packets addressed to this device are acknowledged and queued for user reception, unless they are duplicates.
+  * Acknowledgements release the corresponding packet from the window.
+  */
+void MicroBitRadioUnicast::packetReceived()
+{
+    FrameBuffer *packet = radio.recv();
+    MicroBitRadioUnicastHeader *header = (MicroBitRadioUnicastHeader *) packet->payload;
+    int len = packet->length - (MICROBIT_RADIO_HEADER_SIZE - 1) - (int) sizeof(MicroBitRadioUnicastHeader);
+
+    if (len < 0 || header->destination != address || header->source == 0)
+    {
+        delete packet;
+        return;
+    }
+
+    if (header->type == MICROBIT_RADIO_UNICAST_TYPE_ACK)
+    {
+        uint32_t now = (uint32_t) system_timer_current_time_us();
+
+        for (int i = 0; i < MICROBIT_RADIO_UNICAST_WINDOW_SIZE; i++)
+        {
+            MicroBitRadioUnicastWindow *w = &window[i];
+            if (!w->active || w->header.destination != header->source || w->header.sequence != header->sequence)
+                continue;
+
+            MicroBitRadioUnicastPeer *peer = lookup(header->source, false);
+
+            if (peer)
+            {
+                peer->delivered++;
+
+                // Only measure packets that were sent once, as we can't tell which transmission of any other is being acknowledged.
+                if (w->retries == 0)
+                {
+                    uint32_t rtt = max(now - w->timestamp, (uint32_t) 1);
+
+                    if (peer->srtt == 0)
+                    {
+                        peer->srtt = rtt;
+                        peer->rttvar = rtt / 2;
+                    }
+                    else
+                    {
+                        uint32_t error = peer->srtt > rtt ? peer->srtt - rtt : rtt - peer->srtt;
+                        peer->rttvar = (3 * peer->rttvar + error) / 4;
+                        peer->srtt = (7 * peer->srtt + rtt) / 8;
+                    }
+
+                    peer->rto = min(max(peer->srtt + 4 * peer->rttvar, (uint32_t) MICROBIT_RADIO_UNICAST_MIN_RTO * 1000), (uint32_t) MICROBIT_RADIO_UNICAST_MAX_RTO * 1000);
+                }
+            }
+
+            release(w);
+            break;
+        }
+
+        delete packet;
+        return;
+    }
+
+    if (header->type != MICROBIT_RADIO_UNICAST_TYPE_DATA)
+    {
+        delete packet;
+        return;
+    }
+
+    // If every peer we know has packets awaiting acknowledgement, there is nowhere to record this one.
+    // Don't acknowledge it, so that it will be retransmitted.
+    MicroBitRadioUnicastPeer *peer = lookup(header->source, true);
+
+    if (peer == NULL)
+    {
+        delete packet;
+        return;
+    }
+
+    uint32_t now = system_timer_current_time();
+    int delta = (int8_t)(header->sequence - peer->rxSequence);
+
+    // Forget the history of a peer that has been silent for a while, or that has jumped outside of it, as it has most likely restarted.
+    if (now - peer->rxTimestamp > MICROBIT_RADIO_UNICAST_PEER_TIMEOUT || delta >= MICROBIT_RADIO_UNICAST_HISTORY || delta <= -MICROBIT_RADIO_UNICAST_HISTORY)
+        peer->rxHistory = 0;
+
+    // Acknowledge duplicates again, as our original acknowledgement may have been lost.
+    if (peer->rxHistory && delta <= 0 && (peer->rxHistory & (1UL << -delta)))
+    {
+        peer->duplicates++;
+        acknowledge(header);
+        delete packet;
+        return;
+    }
+
+    // If there is no room for the packet, don't acknowledge it, so that it will be retransmitted.
+    int queueDepth = 0;
+    FrameBuffer *p = rxQueue;
+
+    while (p != NULL)
+    {
+        queueDepth++;
+
+        if (p->next == NULL)
+            break;
+
+        p = p->next;
+    }
+
+    if (queueDepth >= MICROBIT_RADIO_MAXIMUM_RX_BUFFERS)
+    {
+        delete packet;
+        return;
+    }
+
+    if (peer->rxHistory == 0)
+    {
+        peer->rxSequence = header->sequence;
+        peer->rxHistory = 1;
+    }
+    else if (delta > 0)
+    {
+        peer->rxSequence = header->sequence;
+        peer->rxHistory = (peer->rxHistory << delta) | 1;
+    }
+    else
+    {
+        peer->rxHistory |= 1UL << -delta;
+    }
+
+    peer->rxTimestamp = now;
+    peer->received++;
+
+    acknowledge(header);
+
+    // We add to the tail of the queue to preserve causal ordering.
+    packet->next = NULL;
+
+    if (p == NULL)
+        rxQueue = packet;
+    else
+        p->next = packet;
+
+    Event(DEVICE_ID_RADIO, MICROBIT_RADIO_EVT_UNICAST);
+}
+
+/**
+  * Periodic callback from MicroBitRadio, used to retransmit packets whose acknowledgement is overdue.
+  */
+void MicroBitRadioUnicast::idleCallback()
+{
+    uint32_t now = (uint32_t) system_timer_current_time_us();
+
+    for (int i = 0; i < MICROBIT_RADIO_UNICAST_WINDOW_SIZE; i++)
+    {
+        MicroBitRadioUnicastWindow *w = &window[i];
+
+        if (!w->active || now - w->timestamp < w->timeout)
+            continue;
+
+        MicroBitRadioUnicastPeer *peer = lookup(w->header.destination, false);
+
+        if (w->retries >= MICROBIT_RADIO_UNICAST_RETRIES)
+        {
+            if (peer)
+                peer->failed++;
+
+            release(w);
+            continue;
+        }
+
+        // Retransmit one packet at a time, leaving the air free for its acknowledgement. If the transmit queue is full,
+        // try again on the next tick.
+        if ((int32_t)(now - lastTransmission) < MICROBIT_RADIO_UNICAST_ACK_GUARD * 1000 || transmit(w, false) != DEVICE_OK)
+            continue;
+
+        w->retries++;
+        w->timestamp = now;
+        w->timeout = min(w->timeout * 2, (uint32_t) MICROBIT_RADIO_UNICAST_MAX_RTO * 1000);
+
+        if (peer)
+            peer->retransmitted++;
+    }
+}
@@ -25,10 +25,138 @@ DEALINGS IN THE SOFTWARE.
 #include "Mixer2.h"
 #include "StreamNormalizer.h"
 #include "ErrorNo.h"
+#include "codal_target_hal.h"
 #include "CodalDmesg.h"
+#include <math.h>
+
+#if defined(__ARM_FEATURE_DSP)
+#include <arm_acle.h>
+#endif
+
+#if CONFIG_ENABLED(CONFIG_MIXER_INSTRUMENTATION)
+#include "nrf.h"
+#endif
 
 using namespace codal;
 
+#define MIXER_FIXED_UNITY               8192                    // Q13 accumulator value of a full scale input sample on one channel.
+#define MIXER_FIXED_GAIN_SHIFT          14                      // Fractional bits of the per channel gain.
+#define MIXER_FIXED_OUTPUT_SHIFT        14                      // Shift applied to (Q13 * output scale) products.
+
+/**
+ * Saturates a value to the signed 16 bit range. Maps onto a single SSAT instruction where the DSP extensions are available.
+ */
+static inline int32_t mixer_ssat16(int32_t v)
+{
+#if defined(__ARM_FEATURE_DSP)
+    return __ssat(v, 16);
+#else
+    return v > INT16_MAX ? INT16_MAX : v < INT16_MIN ? INT16_MIN : v;
+#endif
+}
+
+/**
+ * Accumulates a normalised 16 bit sample into a Q13 accumulator sample, with saturation.
+ * The sample and accumulator are packed into a pair of halfwords, and multiplied by the channel's packed gain and
+ * unity pair in a single SMLAD where the DSP extensions are available, with identical results elsewhere.
+ *
+ * @param acc The accumulator sample.
+ * @param sample The normalised input sample, in the range INT16_MIN..INT16_MAX.
+ * @param gain The channel gain (low half) packed with Q14 unity (high half), as held in MixerChannel::gainFixed.
+ * @return The updated accumulator sample.
+ */
+static inline int16_t mixer_mac(int16_t acc, int32_t sample, uint32_t gain)
+{
+#if defined(__ARM_FEATURE_DSP)
+    int32_t r = __smlad((uint16_t) sample | ((uint32_t) acc << 16), gain, 1 << (MIXER_FIXED_GAIN_SHIFT - 1));
+#else
+    int32_t r = sample * (int16_t) (gain & 0xFFFF) + acc * (int32_t) (gain >> 16) + (1 << (MIXER_FIXED_GAIN_SHIFT - 1));
+#endif
+    return (int16_t) mixer_ssat16(r >> MIXER_FIXED_GAIN_SHIFT);
+}
+
+#if CONFIG_ENABLED(CONFIG_MIXER_INSTRUMENTATION)
+#define MIXER_CYCLES()                  (DWT->CYCCNT)
+
+/**
+ * Records the duration of a single pull operation.
+ *
+ * @param s The statistics to update.
+ * @param cycles The duration of the pull, in CPU cycles.
+ * @param deadline The playout time of one output buffer, in CPU cycles.
+ */
+static void mixer_record(MixerStatistics &s, uint32_t cycles, uint32_t deadline)
+{
+    uint32_t bucket = deadline ? (uint32_t) (((uint64_t) cycles * MIXER_HISTOGRAM_BUCKETS) / deadline) : 0;
+
+    if (cycles > deadline)
+        s.overruns++;
+
+    if (bucket >= MIXER_HISTOGRAM_BUCKETS)
+        bucket = MIXER_HISTOGRAM_BUCKETS - 1;
+
+    s.pulls++;
+    s.lastCycles = cycles;
+    s.totalCycles += cycles;
+    s.histogram[bucket]++;
+
+    if (cycles > s.maxCycles)
+        s.maxCycles = cycles;
+}
+
+/**
+ * Writes a single set of statistics to DMESG.
+ */
+static void mixer_dump(const char *name, int index, MixerStatistics &s)
+{
+    DMESG("%s %d: pulls %d avg %d max %d cycles, overruns %d underruns %d queue %d", name, index, (int) s.pulls,
+        s.pulls ? (int) (s.totalCycles / s.pulls) : 0, (int) s.maxCycles, (int) s.overruns, (int) s.underruns, (int) s.maxPullRequests);
+
+    for (int i = 0; i < MIXER_HISTOGRAM_BUCKETS; i++)
+        DMESG("    <= %d/%d: %d", i + 1, MIXER_HISTOGRAM_BUCKETS, (int) s.histogram[i]);
+}
+#endif
+
+//
+// Band limited interpolation filter for MIXER_RESAMPLE_POLYPHASE, as Q15 coefficients.
+// Each row is a Blackman windowed sinc (cutoff 0.9 of the input Nyquist frequency) for one fractional
+// sample position, normalised to unity gain. Tap 0 is applied to the oldest input sample.
+//
+static const int16_t mixerPolyphaseCoefficients[MIXER_POLYPHASE_PHASES][MIXER_POLYPHASE_TAPS] = {
+    {   187,  -1042,   2493,  29492,   2493,  -1042,    187,      0},
+    {   160,   -865,   1723,  29446,   3315,  -1226,    215,      0},
+    {   135,   -697,   1006,  29310,   4187,  -1416,    244,     -1},
+    {   112,   -538,    344,  29082,   5105,  -1610,    274,     -1},
+    {    91,   -390,   -263,  28767,   6067,  -1806,    304,     -2},
+    {    72,   -252,   -813,  28364,   7069,  -2003,    335,     -4},
+    {    55,   -126,  -1307,  27876,   8107,  -2197,    365,     -5},
+    {    39,    -12,  -1746,  27312,   9176,  -2388,    394,     -7},
+    {    26,     90,  -2130,  26668,  10272,  -2571,    422,     -9},
+    {    15,    181,  -2461,  25951,  11390,  -2744,    447,    -11},
+    {     5,    260,  -2739,  25166,  12524,  -2905,    470,    -13},
+    {    -2,    327,  -2967,  24318,  13668,  -3051,    490,    -15},
+    {    -9,    383,  -3147,  23414,  14817,  -3178,    505,    -17},
+    {   -13,    429,  -3281,  22455,  15964,  -3283,    515,    -18},
+    {   -17,    464,  -3372,  21454,  17103,  -3363,    519,    -20},
+    {   -19,    490,  -3423,  20410,  18228,  -3415,    517,    -20},
+    {   -20,    508,  -3436,  19333,  19331,  -3436,    508,    -20},
+    {   -20,    517,  -3415,  18228,  20410,  -3423,    490,    -19},
+    {   -20,    519,  -3363,  17103,  21454,  -3372,    464,    -17},
+    {   -18,    515,  -3283,  15964,  22455,  -3281,    429,    -13},
+    {   -17,    505,  -3178,  14817,  23414,  -3147,    383,     -9},
+    {   -15,    490,  -3051,  13668,  24318,  -2967,    327,     -2},
+    {   -13,    470,  -2905,  12524,  25166,  -2739,    260,      5},
+    {   -11,    447,  -2744,  11390,  25951,  -2461,    181,     15},
+    {    -9,    422,  -2571,  10272,  26668,  -2130,     90,     26},
+    {    -7,    394,  -2388,   9176,  27312,  -1746,    -12,     39},
+    {    -5,    365,  -2197,   8107,  27876,  -1307,   -126,     55},
+    {    -4,    335,  -2003,   7069,  28364,   -813,   -252,     72},
+    {    -2,    304,  -1806,   6067,  28767,   -263,   -390,     91},
+    {    -1,    274,  -1610,   5105,  29082,    344,   -538,    112},
+    {    -1,    244,  -1416,   4187,  29310,   1006,   -697,    135},
+    {     0,    215,  -1226,   3315,  29446,   1723,   -865,    160}
+};
+
 
 /**
  * Constructor.
@@ -36,20 +164,45 @@ using namespace codal;
  * @param sampleRate (samples per second) of the mixer output
  * @param sampleRange (quantization levels) the difference between the maximum and minimum sample level on the output channel
  * @param format The format the mixer will output (DATASTREAM_FORMAT_16BIT_UNSIGNED or DATASTREAM_FORMAT_16BIT_SIGNED)
+ * @param engine The mixing engine to use (MIXER_ENGINE_FLOAT or MIXER_ENGINE_FIXED)
  */
-Mixer2::Mixer2(float sampleRate, int sampleRange, int format)
+Mixer2::Mixer2(float sampleRate, int sampleRange, int format, int engine)
 {
     // Set valid defaults.
     this->channels = NULL;
     this->downStream = NULL;
+    this->engine = engine == MIXER_ENGINE_FIXED ? MIXER_ENGINE_FIXED : MIXER_ENGINE_FLOAT;
     this->outputFormat = DATASTREAM_FORMAT_16BIT_UNSIGNED;
     this->bytesPerSampleOut = 2;
+    this->outputRate = CONFIG_MIXER_DEFAULT_SAMPLERATE;
     this->volume = 1.0f;
     this->orMask = 0;
     this->silenceLevel = 0.0f;
+    this->pool = NULL;
+    this->rateHandler = NULL;
+    this->rateHandlerContext = NULL;
+    this->limiterThreshold = 0;
+    this->limiterRatio = 0;
+    this->limiterRelease = CONFIG_MIXER_LIMITER_RELEASE;
+    this->limiterGain = MIXER_LIMITER_UNITY;
+
+    // The fixed point engine needs an accumulator of half the size.
+    if (this->engine == MIXER_ENGINE_FIXED)
+        this->mixFixed = new int16_t[CONFIG_MIXER_BUFFER_SIZE];
+    else
+        this->mix = new float[CONFIG_MIXER_BUFFER_SIZE];
+
+#if CONFIG_ENABLED(CONFIG_MIXER_INSTRUMENTATION)
+    // Enable the cycle counter.
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    memset(&statistics, 0, sizeof(MixerStatistics));
+#endif
 
     // Attempt to configure output format to requested value
     this->setFormat(format);
+    this->defaultRate = sampleRate;
     this->setSampleRate(sampleRate);
     this->setSampleRange(sampleRange);
 }
@@ -63,6 +216,11 @@ Mixer2::~Mixer2()
         n->stream->disconnect();
         delete n;
     }
+
+    if (engine == MIXER_ENGINE_FIXED)
+        delete[] mixFixed;
+    else
+        delete[] mix;
 }
 
 void Mixer2::configureChannel(MixerChannel *c)
@@ -71,30 +229,488 @@ void Mixer2::configureChannel(MixerChannel *c)
     c->format = c->stream->getFormat();
     c->bytesPerSample = DATASTREAM_FORMAT_BYTES_PER_SAMPLE(c->format);
     c->gain = CONFIG_MIXER_INTERNAL_RANGE / (float) c->range;
-    c->skip = c->rate / outputRate;
     c->offset = 0.0f;
 
     if (c->format == DATASTREAM_FORMAT_8BIT_UNSIGNED || c->format == DATASTREAM_FORMAT_16BIT_UNSIGNED)
         c->offset = c->range * -0.5f;       
+
+    // Start interpolation from silence.
+    for (int i = 0; i < MIXER_POLYPHASE_TAPS - 1; i++)
+        c->history[i] = (int32_t) -c->offset;
+
+    // Samples are doubled before the offset is applied, so that the half level offset of unsigned formats is exact.
+    // The result lies within +/- range, and is then shifted to fill (but not exceed) 16 bits.
+    int32_t range = max((int32_t) c->range, (int32_t) 1);
+    int shift = 0;
+
+    while (range > INT16_MAX)
+    {
+        range >>= 1;
+        shift--;
+    }
+
+    while (range <= INT16_MAX / 2)
+    {
+        range <<= 1;
+        shift++;
+    }
+
+    // Fold the channel gain and volume into a single Q14 multiplier that maps the normalised sample onto the Q13 full scale.
+    int32_t gain = (int32_t) ((MIXER_FIXED_UNITY * (float) (1 << MIXER_FIXED_GAIN_SHIFT) * c->volume) / ldexpf(c->range, shift));
+
+    c->offsetFixed = (int32_t) (c->offset * 2.0f);
+    c->shiftFixed = shift;
+    c->gainFixed = (uint16_t) gain | ((uint32_t) (1 << MIXER_FIXED_GAIN_SHIFT) << 16);
+
+    configureKernel(c);
+}
+
+/**
+ * Recompute the sub/super sampling constants of a channel, and select the inner loop best suited to its
+ * input format and sample rate.
+ */
+void Mixer2::configureKernel(MixerChannel *c)
+{
+    c->skip = c->rate / outputRate;
+    c->skipFixed = max((uint32_t) (c->skip * 65536.0f), (uint32_t) 1);
+
+    bool resample = engine == MIXER_ENGINE_FIXED ? c->skipFixed != 65536 : c->skip != 1.0f;
+
+    switch (c->format)
+    {
+        case DATASTREAM_FORMAT_8BIT_UNSIGNED:
+            configureKernel<uint8_t>(c, resample);
+            break;
+
+        case DATASTREAM_FORMAT_8BIT_SIGNED:
+            configureKernel<int8_t>(c, resample);
+            break;
+
+        case DATASTREAM_FORMAT_16BIT_UNSIGNED:
+            configureKernel<uint16_t>(c, resample);
+            break;
+
+        case DATASTREAM_FORMAT_16BIT_SIGNED:
+            configureKernel<int16_t>(c, resample);
+            break;
+
+        default:
+            if (engine == MIXER_ENGINE_FIXED)
+                c->kernelFixed = mixSamplesGenericFixed;
+            else
+                c->kernel = mixSamplesGeneric;
+    }
+}
+
+/**
+ * Select the inner loop for a channel with 8 or 16 bit input samples of type T.
+ * Nearest sample resampling (or none) is used unless an interpolating resample mode is selected.
+ */
+template <typename T>
+void Mixer2::configureKernel(MixerChannel *c, bool resample)
+{
+    int mode = resample ? c->resampleMode : MIXER_RESAMPLE_NEAREST;
+
+    if (engine == MIXER_ENGINE_FIXED)
+    {
+        if (mode == MIXER_RESAMPLE_LINEAR)
+            c->kernelFixed = mixSamplesInterpolatedFixed<T, MIXER_RESAMPLE_LINEAR>;
+        else if (mode == MIXER_RESAMPLE_POLYPHASE)
+            c->kernelFixed = mixSamplesInterpolatedFixed<T, MIXER_RESAMPLE_POLYPHASE>;
+        else
+            c->kernelFixed = resample ? mixSamplesFixed<T, true> : mixSamplesFixed<T, false>;
+    }
+    else
+    {
+        if (mode == MIXER_RESAMPLE_LINEAR)
+            c->kernel = mixSamplesInterpolated<T, MIXER_RESAMPLE_LINEAR>;
+        else if (mode == MIXER_RESAMPLE_POLYPHASE)
+            c->kernel = mixSamplesInterpolated<T, MIXER_RESAMPLE_POLYPHASE>;
+        else
+            c->kernel = resample ? mixSamples<T, true> : mixSamples<T, false>;
+    }
+}
+
+/**
+ * Inner loop for 8 and 16 bit input formats.
+ * At unity sample rate, this reduces to a straight multiply-accumulate over the input buffer.
+ */
+template <typename T, bool resample>
+void Mixer2::mixSamples(MixerChannel *ch, float *out, int len)
+{
+    const T *d = ((const T *) ch->in) + (int) ch->position;
+    const float gain = ch->gain * ch->volume;
+    const float offset = ch->offset * gain;
+
+    if (resample)
+    {
+        const T *base = (const T *) ch->in;
+        float position = ch->position;
+        float skip = ch->skip;
+
+        while(len--)
+        {
+            *out++ += *d * gain + offset;
+
+            position += skip;
+            d = base + (int) position;
+        }
+
+        ch->position = position;
+    }
+    else
+    {
+        ch->position += len;
+
+        while(len--)
+            *out++ += *d++ * gain + offset;
+    }
+}
+
+/**
+ * Inner loop for 8 and 16 bit input formats, for mixers using MIXER_ENGINE_FIXED.
+ * At unity sample rate, this reduces to a shift and a saturating multiply-accumulate per sample.
+ */
+template <typename T, bool resample>
+void Mixer2::mixSamplesFixed(MixerChannel *ch, int16_t *out, int len)
+{
+    const T *d = ((const T *) ch->in) + (ch->positionFixed >> 16);
+    const int32_t offset = ch->offsetFixed;
+    const uint32_t gain = ch->gainFixed;
+    const int32_t scale = 1 << max((int) ch->shiftFixed, 0);
+    const int rshift = max(-(int) ch->shiftFixed, 0);
+
+    if (resample)
+    {
+        const T *base = (const T *) ch->in;
+        uint32_t position = ch->positionFixed;
+        uint32_t skip = ch->skipFixed;
+
+        while(len--)
+        {
+            *out = mixer_mac(*out, ((2 * (int32_t) *d + offset) * scale) >> rshift, gain);
+            out++;
+
+            position += skip;
+            d = base + (position >> 16);
+        }
+
+        ch->positionFixed = position;
+    }
+    else
+    {
+        ch->positionFixed += len << 16;
+
+        while(len--)
+        {
+            *out = mixer_mac(*out, ((2 * (int32_t) *d++ + offset) * scale) >> rshift, gain);
+            out++;
+        }
+    }
+}
+
+/**
+ * Gathers the input samples in the interpolation window of the output sample at input index i, oldest first.
+ * Samples before the start of the buffer are taken from the channel history.
+ */
+template <typename T>
+static inline void mixer_window(const int32_t *history, const T *base, int i, int taps, int32_t *window)
+{
+    if (i >= taps - 1)
+    {
+        const T *d = base + i - (taps - 1);
+        for (int k = 0; k < taps; k++)
+            window[k] = d[k];
+    }
+    else
+    {
+        for (int k = 0; k < taps; k++)
+        {
+            int idx = i - (taps - 1) + k;
+            window[k] = idx >= 0 ? base[idx] : history[MIXER_POLYPHASE_TAPS - 1 + idx];
+        }
+    }
+}
+
+/**
+ * Inner loop for interpolated resampling of 8 and 16 bit input formats.
+ *
+ * Output samples are interpolated from the input samples up to and including the one at the current position,
+ * so no lookahead into the next buffer is needed. Samples before the start of the buffer are taken from the
+ * channel history. This delays the channel by one (linear) or MIXER_POLYPHASE_TAPS/2 (polyphase) input samples.
+ */
+template <typename T, int mode>
+void Mixer2::mixSamplesInterpolated(MixerChannel *ch, float *out, int len)
+{
+    const int taps = mode == MIXER_RESAMPLE_LINEAR ? 2 : MIXER_POLYPHASE_TAPS;
+    const T *base = (const T *) ch->in;
+    int32_t w[MIXER_POLYPHASE_TAPS];
+
+    const float gain = ch->gain * ch->volume;
+    const float offset = ch->offset * gain;
+    float position = ch->position;
+    const float skip = ch->skip;
+
+    while(len--)
+    {
+        int i = (int) position;
+        float fraction = position - i;
+        float v;
+
+        mixer_window(ch->history, base, i, taps, w);
+
+        if (mode == MIXER_RESAMPLE_LINEAR)
+        {
+            v = w[0] + (w[1] - w[0]) * fraction;
+        }
+        else
+        {
+            const int16_t *h = mixerPolyphaseCoefficients[(int) (fraction * MIXER_POLYPHASE_PHASES)];
+            float acc = 0.0f;
+
+            for (int k = 0; k < MIXER_POLYPHASE_TAPS; k++)
+                acc += (float) (h[k] * w[k]);
+
+            v = acc * (1.0f / 32768.0f);
+        }
+
+        *out++ += v * gain + offset;
+        position += skip;
+    }
+
+    ch->position = position;
+}
+
+/**
+ * Inner loop for interpolated resampling of 8 and 16 bit input formats, for mixers using MIXER_ENGINE_FIXED.
+ * The polyphase filter can overshoot full scale, so its normalised output is saturated before it is accumulated.
+ */
+template <typename T, int mode>
+void Mixer2::mixSamplesInterpolatedFixed(MixerChannel *ch, int16_t *out, int len)
+{
+    const int taps = mode == MIXER_RESAMPLE_LINEAR ? 2 : MIXER_POLYPHASE_TAPS;
+    const T *base = (const T *) ch->in;
+    int32_t w[MIXER_POLYPHASE_TAPS];
+
+    const int32_t offset = ch->offsetFixed;
+    const uint32_t gain = ch->gainFixed;
+    const int32_t scale = 1 << max((int) ch->shiftFixed, 0);
+    const int rshift = max(-(int) ch->shiftFixed, 0);
+    uint32_t position = ch->positionFixed;
+    const uint32_t skip = ch->skipFixed;
+
+    while(len--)
+    {
+        int i = position >> 16;
+        uint32_t fraction = position & 0xFFFF;
+        int32_t v;
+
+        mixer_window(ch->history, base, i, taps, w);
+
+        if (mode == MIXER_RESAMPLE_LINEAR)
+        {
+            v = 2 * w[0] + (((w[1] - w[0]) * (int32_t) (fraction >> 2)) >> 13);
+        }
+        else
+        {
+            const int16_t *h = mixerPolyphaseCoefficients[fraction >> 11];
+            int64_t acc = 0;
+
+            for (int k = 0; k < MIXER_POLYPHASE_TAPS; k++)
+                acc += (int32_t) h[k] * w[k];
+
+            v = (int32_t) (acc >> 14);
+        }
+
+        *out = mixer_mac(*out, mixer_ssat16(((v + offset) * scale) >> rshift), gain);
+        out++;
+        position += skip;
+    }
+
+    ch->positionFixed = position;
+}
+
+/**
+ * Record the last samples of a channel's current buffer, before it is replaced.
+ * These provide the interpolation context for the start of the next buffer.
+ */
+void Mixer2::updateHistory(MixerChannel *c)
+{
+    if (c->resampleMode == MIXER_RESAMPLE_NEAREST || c->bytesPerSample == 0)
+        return;
+
+    int samples = c->buffer.length() / c->bytesPerSample;
+
+    // Shift in the samples from the buffer, retaining older history if the buffer was short.
+    for (int k = 0; k < MIXER_POLYPHASE_TAPS - 1; k++)
+    {
+        int idx = samples - (MIXER_POLYPHASE_TAPS - 1) + k;
+        c->history[k] = idx >= 0 ? StreamNormalizer::readSample[c->format](c->in + idx * c->bytesPerSample) : c->history[k + samples];
+    }
+}
+
+/**
+ * Defines the lowest output sample rate at which a channel is acceptably reproduced.
+ * By default, this is the sample rate of the channel's input.
+ *
+ * @param channel The channel to update.
+ * @param sampleRate The required sample rate, in samples per second.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int Mixer2::setRequiredSampleRate(MixerChannel *channel, float sampleRate)
+{
+    if (channel == NULL || sampleRate < 0.0f)
+        return DEVICE_INVALID_PARAMETER;
+
+    channel->requiredRate = sampleRate;
+    notifyRequiredRate(channel);
+
+    return DEVICE_OK;
+}
+
+/**
+ * Determines the lowest output sample rate that acceptably reproduces every channel currently generating audio.
+ * Channels that are muted, paused, or that have no data are ignored.
+ *
+ * @return The required sample rate in samples per second, or zero if no channel is generating audio.
+ */
+float Mixer2::getRequiredSampleRate()
+{
+    float rate = 0.0f;
+
+    // Channel buffers are replaced from within pull(), which may run in interrupt context.
+    target_disable_irq();
+    for (MixerChannel *ch = channels; ch; ch = ch->next)
+    {
+        if (!(ch->status & (MIXER_CHANNEL_STATUS_MUTED | MIXER_CHANNEL_STATUS_PAUSED)) && ch->buffer.length() > 0 && ch->requiredRate > rate)
+            rate = ch->requiredRate;
+    }
+    target_enable_irq();
+
+    return rate;
+}
+
+/**
+ * Registers a handler to be notified as soon as a channel that is added, unmuted, resumed or given a new
+ * required sample rate needs a higher output sample rate than the mixer currently uses. This allows the
+ * output rate to be raised before the channel is first mixed, rather than on the next periodic check.
+ *
+ * @param handler The handler to invoke, or NULL to remove the handler.
+ * @param context Passed to the handler on each invocation.
+ */
+void Mixer2::setRateHandler(MixerRateHandler handler, void *context)
+{
+    this->rateHandler = handler;
+    this->rateHandlerContext = context;
+}
+
+/**
+ * Notifies the rate handler if the given channel, once active, cannot be reproduced at the current output rate.
+ */
+void Mixer2::notifyRequiredRate(MixerChannel *c)
+{
+    if (rateHandler && !(c->status & (MIXER_CHANNEL_STATUS_MUTED | MIXER_CHANNEL_STATUS_PAUSED)) && c->requiredRate > outputRate)
+        rateHandler(rateHandlerContext, c->requiredRate);
+}
+
+/**
+ * Advances a muted channel through its input exactly as the mixing kernels would, without
+ * reading any samples or contributing to the mix.
+ */
+void Mixer2::skipSamples(MixerChannel *ch, int len)
+{
+    if (engine == MIXER_ENGINE_FIXED)
+    {
+        ch->positionFixed += len * ch->skipFixed;
+    }
+    else if (ch->skip == 1.0f)
+    {
+        ch->position += len;
+    }
+    else
+    {
+        // Accumulate one step at a time, so that rounding matches that of the mixing kernels.
+        for (int i = 0; i < len; i++)
+            ch->position += ch->skip;
+    }
+}
+
+/**
+ * Inner loop for any other input format supported by the StreamNormalizer.
+ */
+void Mixer2::mixSamplesGeneric(MixerChannel *ch, float *out, int len)
+{
+    int inputFormat = ch->format;
+    uint8_t *d = ch->in + (int)(ch->position) * ch->bytesPerSample;
+
+    while(len--)
+    {
+        float v = StreamNormalizer::readSample[inputFormat](d);
+        v += ch->offset;
+        v *= ch->gain;    
+        v *= ch->volume;    
+        *out += v;
+
+        ch->position += ch->skip;
+        d = ch->in + (int)(ch->position) * ch->bytesPerSample;
+
+        out++;
+    }
+}
+
+/**
+ * Inner loop for any other input format supported by the StreamNormalizer, for mixers using MIXER_ENGINE_FIXED.
+ */
+void Mixer2::mixSamplesGenericFixed(MixerChannel *ch, int16_t *out, int len)
+{
+    int inputFormat = ch->format;
+    const int32_t scale = 1 << max((int) ch->shiftFixed, 0);
+    const int rshift = max(-(int) ch->shiftFixed, 0);
+    uint8_t *d = ch->in + (ch->positionFixed >> 16) * ch->bytesPerSample;
+
+    while(len--)
+    {
+        int32_t v = StreamNormalizer::readSample[inputFormat](d);
+        v = ((2 * v + ch->offsetFixed) * scale) >> rshift;
+        *out = mixer_mac(*out, mixer_ssat16(v), ch->gainFixed);
+
+        ch->positionFixed += ch->skipFixed;
+        d = ch->in + (ch->positionFixed >> 16) * ch->bytesPerSample;
+
+        out++;
+    }
 }
 
 /**
  * Add a new channel to the mixer.
  * 
  * @oaram stream DataSource to connect to the new input channel
- * @param sampleRate (samples per second) - if set to zero, defaults to the output sample rate of the Mixer
+ * @param sampleRate (samples per second) - if set to zero, defaults to the sample rate the Mixer was constructed with,
+ * regardless of any later change to its output rate
  * @param sampleRange (quantization levels) the difference between the maximum and minimum sample level on the input channel
+ * @param resampleMode The interpolation to use if sampleRate differs from the output sample rate of the mixer:
+ * MIXER_RESAMPLE_NEAREST
+ * MIXER_RESAMPLE_LINEAR
+ * MIXER_RESAMPLE_POLYPHASE
  */
-MixerChannel *Mixer2::addChannel(DataSource &stream, float sampleRate, int sampleRange)
+MixerChannel *Mixer2::addChannel(DataSource &stream, float sampleRate, int sampleRange, int resampleMode)
 {
     MixerChannel *c = new MixerChannel();
     c->stream = &stream;
     c->range = sampleRange;
-    c->rate = sampleRate ? sampleRate : outputRate;
+    // The output rate may since have been lowered to suit the channels then active, which says nothing of this one.
+    c->rate = sampleRate ? sampleRate : defaultRate;
+    c->requiredRate = c->rate;
+    c->resampleMode = resampleMode;
     c->pullRequests = 0;
+    c->status = 0;
     c->in = NULL;
     c->end = NULL;
     c->position = 0;
+    c->positionFixed = 0;
+#if CONFIG_ENABLED(CONFIG_MIXER_INSTRUMENTATION)
+    memset(&c->statistics, 0, sizeof(MixerStatistics));
+#endif
 
     configureChannel(c);
 
@@ -104,21 +720,116 @@ MixerChannel *Mixer2::addChannel(DataSource &stream, float sampleRate, int sampl
     
     // Connect channel to the upstream source.
     stream.connect(*c);
+
+    // Give our owner the chance to raise the output rate before this channel is first mixed.
+    notifyRequiredRate(c);
+
     return c;
 }
 
+/**
+ * Removes a channel from the mixer, disconnecting it from its DataSource.
+ * The channel is deleted, and must not be used after this call. This must not be called from within
+ * the pull() of a DataSource connected to this mixer.
+ *
+ * @param channel The channel to remove.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the channel does not belong to this mixer.
+ */
+int Mixer2::removeChannel(MixerChannel *channel)
+{
+    MixerChannel **p = &channels;
+
+    while (*p && *p != channel)
+        p = &(*p)->next;
+
+    if (channel == NULL || *p == NULL)
+        return DEVICE_INVALID_PARAMETER;
+
+    // Unlink the channel atomically, as pull() may be called from interrupt context.
+    target_disable_irq();
+    *p = channel->next;
+    target_enable_irq();
+
+    channel->stream->disconnect();
+    delete channel;
+
+    return DEVICE_OK;
+}
+
+/**
+ * Mutes or unmutes a channel. A muted channel continues to consume data from its DataSource at the
+ * normal rate, so remains in time with the other channels, but does not contribute to the mix.
+ *
+ * @param channel The channel to update.
+ * @param mute true to mute the channel, false to unmute it.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int Mixer2::setMute(MixerChannel *channel, bool mute)
+{
+    if (channel == NULL)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (mute)
+        channel->status |= MIXER_CHANNEL_STATUS_MUTED;
+    else
+    {
+        channel->status &= ~MIXER_CHANNEL_STATUS_MUTED;
+        notifyRequiredRate(channel);
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Pauses or resumes a channel. A paused channel does not consume data from its DataSource, and resumes
+ * from the same position when unpaused.
+ *
+ * @param channel The channel to update.
+ * @param pause true to pause the channel, false to resume it.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int Mixer2::setPaused(MixerChannel *channel, bool pause)
+{
+    if (channel == NULL)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (pause)
+        channel->status |= MIXER_CHANNEL_STATUS_PAUSED;
+    else
+    {
+        channel->status &= ~MIXER_CHANNEL_STATUS_PAUSED;
+        notifyRequiredRate(channel);
+    }
+
+    return DEVICE_OK;
+}
+
 ManagedBuffer Mixer2::pull() 
 {
     // If we have no channels, just return an empty buffer.
     if (!channels)
     {
+        ManagedBuffer empty = pool ? pool->allocate(CONFIG_MIXER_BUFFER_SIZE) : ManagedBuffer(CONFIG_MIXER_BUFFER_SIZE);
+
+        if (pool)
+            empty.fill(0);
+
         downStream->pullRequest();
-        return ManagedBuffer(CONFIG_MIXER_BUFFER_SIZE);
+        return empty;
     }
 
+#if CONFIG_ENABLED(CONFIG_MIXER_INSTRUMENTATION)
+    uint32_t start = MIXER_CYCLES();
+    uint32_t deadline = (uint32_t) ((CONFIG_MIXER_BUFFER_SIZE / bytesPerSampleOut) * (SystemCoreClock / outputRate));
+#endif
+
+    int samples = CONFIG_MIXER_BUFFER_SIZE/bytesPerSampleOut;
+
     // Clear the accumulator buffer
-    for (int i=0; i<CONFIG_MIXER_BUFFER_SIZE/bytesPerSampleOut; i++)
-        mix[i] = 0.0f;
+    if (engine == MIXER_ENGINE_FIXED)
+        memset(mixFixed, 0, samples * sizeof(int16_t));
+    else
+        memset(mix, 0, samples * sizeof(float));
 
     MixerChannel *next;
     bool silence = true;
@@ -126,6 +837,23 @@ ManagedBuffer Mixer2::pull()
     for (MixerChannel *ch = channels; ch; ch = next) {
         next = ch->next; // save next in case the current channel gets deleted
 
+#if CONFIG_ENABLED(CONFIG_MIXER_INSTRUMENTATION)
+        // A channel whose input ran out part way through the last output buffer either reached the end of its stream,
+        // or was starved, in which case more data has arrived since, and the gap it left is an underrun.
+        if (ch->status & MIXER_CHANNEL_STATUS_STARVED)
+        {
+            if (ch->pullRequests > 0)
+                ch->statistics.underruns++;
+
+            ch->status &= ~MIXER_CHANNEL_STATUS_STARVED;
+        }
+#endif
+
+        // Skip paused channels, and channels that have consumed all their data with nothing more to offer,
+        // without touching their buffers.
+        if ((ch->status & MIXER_CHANNEL_STATUS_PAUSED) || (ch->pullRequests == 0 && ch->in == NULL))
+            continue;
+
         // Attempt to discover the stream format if it is not already defined.
         if (ch->format == DATASTREAM_FORMAT_UNKNOWN)
         {
@@ -136,35 +864,44 @@ ManagedBuffer Mixer2::pull()
                 continue;
         }
 
-        float *out = &mix[0];
-        float *end = &mix[CONFIG_MIXER_BUFFER_SIZE/bytesPerSampleOut];
-        int inputFormat = ch->format;
+        int out = 0;
 
-        while (out < end)
+        while (out < samples)
         {
             // precalculate the maximum number of samples the we can process with the current buffer allocations.
             // choose the minimum between the available samples in the input buffer and the space in the output buffer.
-            int outLen = (int) (end - out);
-            int inLen = ((ch->buffer.length() / ch->bytesPerSample) - ch->position) / ch->skip;
+            int outLen = samples - out;
+            int inLen;
+
+            if (engine == MIXER_ENGINE_FIXED)
+            {
+                uint32_t inSamples = (uint32_t) (ch->buffer.length() / ch->bytesPerSample) << 16;
+                inLen = ch->positionFixed < inSamples ? (int) ((inSamples - ch->positionFixed) / ch->skipFixed) : 0;
+            }
+            else
+            {
+                inLen = ((ch->buffer.length() / ch->bytesPerSample) - ch->position) / ch->skip;
+            }
+
             int len =  min(outLen, inLen);
 
             if (len)
-                silence = false;
+            {
+                if (ch->status & MIXER_CHANNEL_STATUS_MUTED)
+                {
+                    skipSamples(ch, len);
+                }
+                else
+                {
+                    silence = false;
 
-            uint8_t *d = ch->in;
+                    if (engine == MIXER_ENGINE_FIXED)
+                        ch->kernelFixed(ch, &mixFixed[out], len);
+                    else
+                        ch->kernel(ch, &mix[out], len);
+                }
 
-            while(len--)
-            {
-                float v = StreamNormalizer::readSample[inputFormat](d);
-                v += ch->offset;
-                v *= ch->gain;    
-                v *= ch->volume;    
-                *out += v;
- 
-                ch->position += ch->skip;
-                d = ch->in + (int)(ch->position * ch->bytesPerSample);
-
-                out++;
+                out += len;
             }
 
             // Check if we've completed an input buffer. If so, pull down another if available.
@@ -172,12 +909,33 @@ ManagedBuffer Mixer2::pull()
             if (inLen <= outLen)
             {
                 if (ch->pullRequests == 0)
+                {
+#if CONFIG_ENABLED(CONFIG_MIXER_INSTRUMENTATION)
+                    if (len && out < samples)
+                        ch->status |= MIXER_CHANNEL_STATUS_STARVED;
+#endif
+                    // The current buffer is exhausted. Release it and mark the channel as idle until more data arrives.
+                    updateHistory(ch);
+                    ch->buffer = ManagedBuffer();
+                    ch->in = NULL;
+                    ch->end = NULL;
+                    ch->position = 0;
+                    ch->positionFixed = 0;
                     break;
+                }
 
                 ch->pullRequests--;
+                updateHistory(ch);
+#if CONFIG_ENABLED(CONFIG_MIXER_INSTRUMENTATION)
+                uint32_t sourceStart = MIXER_CYCLES();
+                ch->buffer = ch->stream->pull();
+                mixer_record(ch->statistics, MIXER_CYCLES() - sourceStart, deadline);
+#else
                 ch->buffer = ch->stream->pull();
+#endif
                 ch->in = &ch->buffer[0];
                 ch->position = 0;
+                ch->positionFixed = 0;
                 ch->end = ch->in + ch->buffer.length();
 
                 if (ch->buffer.length() == 0)
@@ -186,55 +944,211 @@ ManagedBuffer Mixer2::pull()
         }
     }       
 
-    // If we have silence, set output level to predefined value.
-    if (silence && silenceLevel != 0.0f)
-    {
-        for (int i=0; i<CONFIG_MIXER_BUFFER_SIZE/bytesPerSampleOut; i++)
-            mix[i] = silenceLevel;
-    }
+    // Reduce the gain of any mix that would exceed the limiter threshold.
+    if (limiterThreshold)
+        applyLimiter(samples);
 
     // Scale and pack to our output format
-    ManagedBuffer output = ManagedBuffer(CONFIG_MIXER_BUFFER_SIZE);
+    ManagedBuffer output = pool ? pool->allocate(CONFIG_MIXER_BUFFER_SIZE) : ManagedBuffer(CONFIG_MIXER_BUFFER_SIZE);
     uint8_t *w = &output[0];
-    float *r = mix;
 
     int len = output.length() / bytesPerSampleOut;
-    float scale = volume * outputRange / CONFIG_MIXER_INTERNAL_RANGE;
     int offset = (outputFormat == DATASTREAM_FORMAT_16BIT_UNSIGNED || outputFormat == DATASTREAM_FORMAT_8BIT_UNSIGNED) ? outputRange/2 : 0;
-    float lo = (outputFormat == DATASTREAM_FORMAT_16BIT_UNSIGNED || outputFormat == DATASTREAM_FORMAT_8BIT_UNSIGNED) ? 0 : -outputRange/2;
-    float hi = (outputFormat == DATASTREAM_FORMAT_16BIT_UNSIGNED || outputFormat == DATASTREAM_FORMAT_8BIT_UNSIGNED) ? outputRange : outputRange/2;
 
-    while(len--)
+    if (engine == MIXER_ENGINE_FIXED)
     {
-        float sample = *r * scale;
-        sample += offset;
-        
-        // Clamp output range. Would be nice to use apply some compression here, 
-        // but we don't really want ot use more CPU than we already do.
-        if (sample < lo)
-            sample = lo;
+        int16_t *r = mixFixed;
+
+        // If we have silence, set output level to predefined value.
+        if (silence && silenceLevel != 0.0f)
+        {
+            int16_t level = (int16_t) (silenceLevel * (2.0f * MIXER_FIXED_UNITY / CONFIG_MIXER_INTERNAL_RANGE));
+            for (int i=0; i<samples; i++)
+                mixFixed[i] = level;
+        }
+
+        // Output scale, such that a Q13 full scale sample maps onto outputRange/2 at full master volume.
+        // The product of a 16 bit accumulator sample and a scale of up to 16 bits cannot overflow.
+        int32_t scale = (int32_t) (volume * outputRange * (float) (1 << MIXER_FIXED_OUTPUT_SHIFT) / (2 * MIXER_FIXED_UNITY));
+        int lo = (outputFormat == DATASTREAM_FORMAT_16BIT_UNSIGNED || outputFormat == DATASTREAM_FORMAT_8BIT_UNSIGNED) ? 0 : -outputRange/2;
+        int hi = (outputFormat == DATASTREAM_FORMAT_16BIT_UNSIGNED || outputFormat == DATASTREAM_FORMAT_8BIT_UNSIGNED) ? outputRange : outputRange/2;
+
+        while(len--)
+        {
+            int s = (*r * scale) >> MIXER_FIXED_OUTPUT_SHIFT;
+            s += offset;
+
+            // Clamp output range.
+            if (s < lo)
+                s = lo;
+
+            if (s > hi)
+                s = hi;
+
+            // Apply any requested bit mask
+            s |= orMask;
+
+            // Write out the sample.
+            StreamNormalizer::writeSample[outputFormat](w, s);
+            w += bytesPerSampleOut;
+            r++;
+        }
+    }
+    else
+    {
+        float *r = mix;
+
+        // If we have silence, set output level to predefined value.
+        if (silence && silenceLevel != 0.0f)
+        {
+            for (int i=0; i<samples; i++)
+                mix[i] = silenceLevel;
+        }
+
+        float scale = volume * outputRange / CONFIG_MIXER_INTERNAL_RANGE;
+        float lo = (outputFormat == DATASTREAM_FORMAT_16BIT_UNSIGNED || outputFormat == DATASTREAM_FORMAT_8BIT_UNSIGNED) ? 0 : -outputRange/2;
+        float hi = (outputFormat == DATASTREAM_FORMAT_16BIT_UNSIGNED || outputFormat == DATASTREAM_FORMAT_8BIT_UNSIGNED) ? outputRange : outputRange/2;
+
+        while(len--)
+        {
+            float sample = *r * scale;
+            sample += offset;
+            
+            // Clamp output range. Peaks are handled by the limiter, if enabled.
+            if (sample < lo)
+                sample = lo;
 
-        if (sample > hi)
-            sample = hi;
+            if (sample > hi)
+                sample = hi;
 
-        // Apply any requested bit mask
-        int s = (int)sample;
-        s |= orMask;
+            // Apply any requested bit mask
+            int s = (int)sample;
+            s |= orMask;
 
-        // Write out the sample.
-        StreamNormalizer::writeSample[outputFormat](w, s);
-        w += bytesPerSampleOut;
-        r++;
+            // Write out the sample.
+            StreamNormalizer::writeSample[outputFormat](w, s);
+            w += bytesPerSampleOut;
+            r++;
+        }
     }
 
+#if CONFIG_ENABLED(CONFIG_MIXER_INSTRUMENTATION)
+    mixer_record(statistics, MIXER_CYCLES() - start, deadline);
+#endif
+
     // Return the buffer and we're done.
     downStream->pullRequest();
     return output;
 }
 
+/**
+ * Computes the gain to apply to the current contents of the accumulator, and applies it.
+ * Gain is ramped linearly across the buffer from the value used at the end of the previous buffer.
+ *
+ * @param len The number of samples in the accumulator.
+ */
+void Mixer2::applyLimiter(int len)
+{
+    uint32_t level;
+    uint32_t target = MIXER_LIMITER_UNITY;
+    uint32_t gain = limiterGain;
+
+    // Determine the peak level of the mix, as a Q16 fraction of the full scale output.
+    if (engine == MIXER_ENGINE_FIXED)
+    {
+        int32_t peak = 0;
+        for (int i = 0; i < len; i++)
+        {
+            int32_t s = mixFixed[i] < 0 ? -mixFixed[i] : mixFixed[i];
+            if (s > peak)
+                peak = s;
+        }
+
+        level = (uint32_t) (peak * volume * ((float) MIXER_LIMITER_UNITY / MIXER_FIXED_UNITY));
+    }
+    else
+    {
+        float peak = 0.0f;
+        for (int i = 0; i < len; i++)
+        {
+            float s = fabsf(mix[i]);
+            if (s > peak)
+                peak = s;
+        }
+
+        level = (uint32_t) (peak * volume * (2.0f * MIXER_LIMITER_UNITY / CONFIG_MIXER_INTERNAL_RANGE));
+    }
+
+    // Compute the gain that maps the peak onto the compression curve.
+    if (level > limiterThreshold)
+    {
+        uint32_t ceiling = limiterRatio ? limiterThreshold + (level - limiterThreshold) / limiterRatio : limiterThreshold;
+        target = (uint32_t) (((uint64_t) ceiling << 16) / level);
+    }
+
+    // Reduce gain immediately, but restore it gradually.
+    if (target < gain)
+    {
+        gain = target;
+    }
+    else
+    {
+        uint32_t delta = (uint32_t) (((uint64_t) (target - gain) * limiterReleaseCoefficient) >> 16);
+        gain = delta ? gain + delta : target;
+    }
+
+    // Nothing to do if we're at unity gain throughout the buffer.
+    if (gain == MIXER_LIMITER_UNITY && limiterGain == MIXER_LIMITER_UNITY)
+        return;
+
+    // Ramp from the previous gain to the new one, as Q24 values.
+    int32_t g = (int32_t) (limiterGain * 256);
+    int32_t step = ((int32_t) gain - (int32_t) limiterGain) * 256 / len;
+
+    if (engine == MIXER_ENGINE_FIXED)
+    {
+        for (int i = 0; i < len; i++)
+        {
+            mixFixed[i] = (int16_t) (((int64_t) mixFixed[i] * g) >> 24);
+            g += step;
+        }
+    }
+    else
+    {
+        for (int i = 0; i < len; i++)
+        {
+            mix[i] *= g * (1.0f / 16777216.0f);
+            g += step;
+        }
+    }
+
+    limiterGain = gain;
+}
+
+/**
+ * Recomputes the per buffer release coefficient of the limiter, following a change to its release time,
+ * or to the sample rate or format of the mixer.
+ */
+void Mixer2::configureLimiter()
+{
+    // Recover a fraction 1 - e^(-t/release) of the outstanding gain reduction per buffer, where t is the playout time of one buffer.
+    float period = (CONFIG_MIXER_BUFFER_SIZE / bytesPerSampleOut) * 1000.0f / outputRate;
+
+    if (limiterRelease == 0)
+        limiterReleaseCoefficient = MIXER_LIMITER_UNITY;
+    else
+        limiterReleaseCoefficient = (uint32_t) ((1.0f - expf(-period / limiterRelease)) * MIXER_LIMITER_UNITY);
+}
+
 int MixerChannel::pullRequest()
 {
     pullRequests++;
+
+#if CONFIG_ENABLED(CONFIG_MIXER_INSTRUMENTATION)
+    if ((uint32_t) pullRequests > statistics.maxPullRequests)
+        statistics.maxPullRequests = pullRequests;
+#endif
+
     return DEVICE_OK;
 }
 
@@ -248,6 +1162,15 @@ int Mixer2::getFormat()
 {
     return outputFormat;
 }
+
+/**
+ * Determines the mixing engine in use.
+ * @return MIXER_ENGINE_FLOAT or MIXER_ENGINE_FIXED.
+ */
+int Mixer2::getEngine()
+{
+    return engine;
+}
     
 int Mixer2::setFormat(int format)
 {
@@ -255,6 +1178,7 @@ int Mixer2::setFormat(int format)
     {
         this->outputFormat = format;
         this->bytesPerSampleOut = DATASTREAM_FORMAT_BYTES_PER_SAMPLE(format);
+        configureLimiter();
 
         return DEVICE_OK;
     }
@@ -310,7 +1234,9 @@ int Mixer2::setSampleRate(float sampleRate)
     
     // Recompute the sub/super sampling constants for each channel.    
     for (MixerChannel *c = channels; c; c=c->next)
-        c->skip = c->rate / outputRate;
+        configureKernel(c);
+
+    configureLimiter();
 
     return DEVICE_OK;
 }
@@ -361,4 +1287,100 @@ int Mixer2::setSilenceLevel(float level)
 
     silenceLevel = level - 512.0f;
     return DEVICE_OK;
-}
\ No newline at end of file
+}
+
+/**
+ * Defines a pool from which output buffers are allocated, rather than using the heap.
+ *
+ * @param pool The pool to use, or NULL to allocate output buffers from the heap.
+ * @return DEVICE_OK on success.
+ */
+int Mixer2::setBufferPool(AudioBufferPool *pool)
+{
+    this->pool = pool;
+    return DEVICE_OK;
+}
+
+/**
+ * Determines the pool from which output buffers are allocated.
+ * @return the buffer pool in use, or NULL if output buffers are allocated from the heap.
+ */
+AudioBufferPool *Mixer2::getBufferPool()
+{
+    return pool;
+}
+
+/**
+ * Configures a soft limiter, applied to the mixed output before it is clamped to the output range.
+ * The gain is computed once per output buffer from the peak level of the mix. Gain reduction takes effect
+ * over the course of the buffer in which it is detected, and is released gradually over subsequent buffers.
+ * Any transient faster than this is still clamped to the output range.
+ *
+ * @param threshold The output level above which gain is reduced, in the range 1..1023 (where 1023 represents full scale), or 0 to disable the limiter.
+ * @param ratio The compression ratio applied to levels above the threshold (e.g. 4 for 4:1 compression), or 0 to limit the output to the threshold.
+ * @param release The time taken to restore gain once the output falls below the threshold, in milliseconds.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int Mixer2::setLimiter(int threshold, int ratio, int release)
+{
+    if (threshold < 0 || threshold > 1023 || ratio < 0 || release < 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    this->limiterThreshold = ((uint32_t) threshold * MIXER_LIMITER_UNITY) / 1023;
+    this->limiterRatio = ratio;
+    this->limiterRelease = release;
+    this->limiterGain = MIXER_LIMITER_UNITY;
+    configureLimiter();
+
+    return DEVICE_OK;
+}
+
+/**
+ * Determines the gain currently applied by the limiter.
+ * @return the gain in the range 0..1023, where 1023 indicates that no gain reduction is being applied.
+ */
+int Mixer2::getLimiterGain()
+{
+    return (int) ((limiterGain * 1023) / MIXER_LIMITER_UNITY);
+}
+
+#if CONFIG_ENABLED(CONFIG_MIXER_INSTRUMENTATION)
+/**
+ * Provides the timing statistics gathered for this mixer, or for one of its channels.
+ *
+ * @param channel The channel to report on, or NULL to report on the mixer as a whole.
+ * @return the statistics gathered since the channel was added or statistics were last reset.
+ */
+MixerStatistics *Mixer2::getStatistics(MixerChannel *channel)
+{
+    return channel ? &channel->statistics : &statistics;
+}
+
+/**
+ * Discards the timing statistics gathered for this mixer and all of its channels.
+ */
+void Mixer2::resetStatistics()
+{
+    memset(&statistics, 0, sizeof(MixerStatistics));
+
+    for (MixerChannel *ch = channels; ch; ch = ch->next)
+        memset(&ch->statistics, 0, sizeof(MixerStatistics));
+}
+
+/**
+ * Writes the timing statistics gathered for this mixer, its channels and its buffer pool to DMESG.
+ */
+void Mixer2::dumpStatistics()
+{
+    int index = 0;
+
+    DMESG("MIXER: %d Hz, %d cycles per buffer", (int) outputRate, (int) ((CONFIG_MIXER_BUFFER_SIZE / bytesPerSampleOut) * (SystemCoreClock / outputRate)));
+    mixer_dump("MIXER", 0, statistics);
+
+    for (MixerChannel *ch = channels; ch; ch = ch->next)
+        mixer_dump("CHANNEL", index++, ch->statistics);
+
+    if (pool)
+        DMESG("POOL: hits %d misses %d high water mark %d", (int) pool->getHits(), (int) pool->getMisses(), pool->getHighWaterMark());
+}
+#endif
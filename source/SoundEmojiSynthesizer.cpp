@@ -29,6 +29,7 @@ DEALINGS IN THE SOFTWARE.
 #include "CodalDmesg.h"
 #include "ErrorNo.h"
 #include "MicroBitAudio.h"
+#include "codal_target_hal.h"
 
 using namespace codal;
 
@@ -36,15 +37,38 @@ using namespace codal;
   * Class definition for a Synthesizer.
   * A Synthesizer generates a tone waveform based on a number of overlapping waveforms.
   */
-SoundEmojiSynthesizer::SoundEmojiSynthesizer(uint16_t id, int sampleRate) : CodalComponent(id, 0), buffer(EMOJI_SYNTHESIZER_BUFFER_SIZE), emptyBuffer(0)
+SoundEmojiSynthesizer::SoundEmojiSynthesizer(uint16_t id, int sampleRate, int voiceCount) : CodalComponent(id, 0), buffer(EMOJI_SYNTHESIZER_BUFFER_SIZE), emptyBuffer(0),
+    voices(new SoundEmojiVoice[max(voiceCount, 1)]), lock(voices[0].lock), effectBuffer(voices[0].effectBuffer),
+    samplesToWrite(voices[0].samplesToWrite), samplesWritten(voices[0].samplesWritten), samplesPerStep(voices[0].samplesPerStep)
 {
     this->downStream = NULL;
     this->bufferSize = EMOJI_SYNTHESIZER_BUFFER_SIZE;
-    this->position = 0.0f;
     this->effect = NULL;
+    this->pool = NULL;
+    this->sequence = NULL;
+    this->sequenceLength = 0;
+    this->sampleTime = 0;
 
-    this->samplesToWrite = 0;
-    this->samplesWritten = 0;
+    this->voiceCount = max(voiceCount, 1);
+
+    for (int i = 0; i < this->voiceCount; i++)
+    {
+        voices[i].effect = NULL;
+        voices[i].status = 0;
+        voices[i].samplesToWrite = 0;
+        voices[i].samplesWritten = 0;
+        voices[i].controlEnd = 0;
+        voices[i].phase = 0;
+        voices[i].increment = 0;
+        voices[i].incrementDelta = 0;
+        voices[i].gain = 0;
+        voices[i].gainDelta = 0;
+        voices[i].tone.tonePrint = NULL;
+        voices[i].tone.parameter = NULL;
+        voices[i].waveform = EMOJI_SYNTHESIZER_WAVEFORM_TABLE;
+        voices[i].noise = 0x1234567 + i;
+        voices[i].noiseSample = 0;
+    }
 
     setSampleRate(sampleRate);
     setSampleRange(1023);
@@ -57,6 +81,8 @@ SoundEmojiSynthesizer::SoundEmojiSynthesizer(uint16_t id, int sampleRate) : Coda
  */
 SoundEmojiSynthesizer::~SoundEmojiSynthesizer()
 {
+    delete[] voices;
+    delete[] sequence;
 }
 
 /**
@@ -94,26 +120,30 @@ int SoundEmojiSynthesizer::setBufferSize(int size)
 /**
 * Schedules playout of the given sound effect.
 * @param sound A buffer containing an array of one or more SoundEffects.
+* @param voice The voice on which to play the sound effect.
 * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER
 */
-int SoundEmojiSynthesizer::play(ManagedBuffer sound)
+int SoundEmojiSynthesizer::play(ManagedBuffer sound, int voice)
 {
     // Enable audio pipeline if needed.
     MicroBitAudio::requestActivation();
 
     // Validate inputs
-    if (sound.length() < (int) sizeof(SoundEffect))
+    if (sound.length() < (int) sizeof(SoundEffect) || voice < 0 || voice >= voiceCount)
         return DEVICE_INVALID_PARAMETER;
 
-    // If a playout is already in progress, block until it has been scheduled.
-    lock.wait();
+    SoundEmojiVoice *v = &voices[voice];
 
-    // Store the requested sequence of sound effects.
-    effectBuffer = sound;
+    // If a playout is already in progress, block until it has been scheduled.
+    v->lock.wait();
 
-    // Scheduled this sound effect for playout. 
+    // A scheduled sound effect may still be playing on the voice, as those don't take the lock. Replace it as the
+    // sequencer would, signalling its completion and letting go of its buffer only once the voice no longer refers to it.
     // Generation will start the next time a pull() operation is called from downstream.
-    nextSoundEffect();
+    target_disable_irq();
+    startSoundEffect(v, sound);
+    v->status |= EMOJI_SYNTHESIZER_STATUS_LOCKED;
+    target_enable_irq();
 
     // Perform on demand activiation if this is the first time this compoennt has been used.
     // Simply issue a pull request to start the process.
@@ -126,180 +156,716 @@ int SoundEmojiSynthesizer::play(ManagedBuffer sound)
     return DEVICE_OK;
 }
 
-void SoundEmojiSynthesizer::stop() {
-    if (effect)
-        status |= EMOJI_SYNTHESIZER_STATUS_STOPPING;
+/**
+* Stops play of the current buffer of SoundEffects on all voices and discards them.
+*/
+void SoundEmojiSynthesizer::stop()
+{
+    for (int i = 0; i < voiceCount; i++)
+        stop(i);
+}
+
+/**
+* Stops play of the current buffer of SoundEffects on the given voice and discards it.
+* @param voice The voice to stop.
+* @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER
+*/
+int SoundEmojiSynthesizer::stop(int voice)
+{
+    if (voice < 0 || voice >= voiceCount)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (voices[voice].effect)
+        voices[voice].status |= EMOJI_SYNTHESIZER_STATUS_STOPPING;
+
+    return DEVICE_OK;
+}
+
+/**
+ * Schedules playout of the given sound effect at an exact sample time.
+ * When the sample time is reached, any sound effect playing on the voice is replaced, starting at the
+ * first sample of that time. This allows a sequence of sounds to be queued in advance and played with
+ * sample accurate timing, without waking a fiber for each sound. Sound effects scheduled in the past
+ * start at the beginning of the next buffer generated.
+ *
+ * @param sound A buffer containing an array of one or more SoundEffects.
+ * @param time The sample time at which to start playback. See getSampleTime().
+ * @param voice The voice on which to play the sound effect.
+ * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER, or DEVICE_NO_RESOURCES if
+ * CONFIG_EMOJI_SYNTHESIZER_SEQUENCE_LENGTH sound effects are already scheduled.
+ */
+int SoundEmojiSynthesizer::schedule(ManagedBuffer sound, uint32_t time, int voice)
+{
+    // Enable audio pipeline if needed.
+    MicroBitAudio::requestActivation();
+
+    if (sound.length() < (int) sizeof(SoundEffect) || voice < 0 || voice >= voiceCount)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (sequence == NULL)
+        sequence = new SoundEmojiSequencerEvent[CONFIG_EMOJI_SYNTHESIZER_SEQUENCE_LENGTH];
+
+    // The sequence is consumed from interrupt context, so insert in order of start time with interrupts disabled.
+    // Sound effects with the same start time play in the order they were scheduled.
+    target_disable_irq();
+
+    if (sequenceLength == CONFIG_EMOJI_SYNTHESIZER_SEQUENCE_LENGTH)
+    {
+        target_enable_irq();
+        return DEVICE_NO_RESOURCES;
+    }
+
+    int i = sequenceLength;
+    while (i > 0 && (int32_t) (sequence[i-1].time - time) > 0)
+    {
+        sequence[i] = sequence[i-1];
+        i--;
+    }
+
+    sequence[i].time = time;
+    sequence[i].voice = voice;
+    sequence[i].sound = sound;
+    sequenceLength++;
+
+    target_enable_irq();
+
+    // Perform on demand activation, as per play().
+    if (!(status & EMOJI_SYNTHESIZER_STATUS_ACTIVE))
+    {
+        status |= EMOJI_SYNTHESIZER_STATUS_ACTIVE;
+        downStream->pullRequest();
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Starts playout of the given sound effect on the given voice at once, replacing any sound effect playing or
+ * scheduled on it. Unlike play(), this never blocks, so may be used when the schedule is full.
+ *
+ * @param sound A buffer containing an array of one or more SoundEffects.
+ * @param voice The voice on which to play the sound effect.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER
+ */
+int SoundEmojiSynthesizer::replace(ManagedBuffer sound, int voice)
+{
+    // Enable audio pipeline if needed.
+    MicroBitAudio::requestActivation();
+
+    if (sound.length() < (int) sizeof(SoundEffect) || voice < 0 || voice >= voiceCount)
+        return DEVICE_INVALID_PARAMETER;
+
+    // The sequence and voices are consumed from interrupt context, so update them with interrupts disabled.
+    target_disable_irq();
+
+    // Discard sound effects scheduled on the voice, which would otherwise replace this one when they fall due.
+    int length = 0;
+
+    for (int i = 0; i < sequenceLength; i++)
+        if (sequence[i].voice != voice)
+            sequence[length++] = sequence[i];
+
+    for (int i = length; i < sequenceLength; i++)
+        sequence[i].sound = emptyBuffer;
+
+    sequenceLength = length;
+
+    // If the sound replaced was started by play(), completing it releases the lock play() took.
+    startSoundEffect(&voices[voice], sound);
+
+    target_enable_irq();
+
+    // Perform on demand activation, as per play().
+    if (!(status & EMOJI_SYNTHESIZER_STATUS_ACTIVE))
+    {
+        status |= EMOJI_SYNTHESIZER_STATUS_ACTIVE;
+        downStream->pullRequest();
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Discards all sound effects scheduled for playout that have not yet started.
+ */
+void SoundEmojiSynthesizer::clearSchedule()
+{
+    target_disable_irq();
+
+    for (int i = 0; i < sequenceLength; i++)
+        sequence[i].sound = emptyBuffer;
+
+    sequenceLength = 0;
+
+    target_enable_irq();
 }
 
 /**
- * Schedules the next sound effect as defined in the effectBuffer, if available.
+ * Determines the current sample time of this synthesizer.
+ * The sample time is the number of samples generated so far. It advances only while the synthesizer
+ * is generating output, and wraps around after 2^32 samples.
+ *
+ * @return the sample time of the next sample to be generated.
+ */
+uint32_t SoundEmojiSynthesizer::getSampleTime()
+{
+    return sampleTime;
+}
+
+/**
+ * Determines the sample time a given period after the next sample to be generated.
+ *
+ * @param offset The period, in milliseconds.
+ * @return the sample time at the given offset.
+ */
+uint32_t SoundEmojiSynthesizer::getSampleTime(float offset)
+{
+    return sampleTime + (uint32_t) determineSampleCount(offset);
+}
+
+/**
+ * Determines if the given voice is playing, or has a sound effect scheduled to play.
+ *
+ * @param voice The voice to test.
+ * @return true if the voice is in use, false otherwise.
+ */
+bool SoundEmojiSynthesizer::isVoiceActive(int voice)
+{
+    if (voice < 0 || voice >= voiceCount)
+        return false;
+
+    bool active = voices[voice].effect != NULL || voices[voice].lock.getWaitCount() > 0;
+
+    target_disable_irq();
+
+    for (int i = 0; i < sequenceLength && !active; i++)
+        if (sequence[i].voice == voice)
+            active = true;
+
+    target_enable_irq();
+
+    return active;
+}
+
+/**
+ * Determines the number of voices of this synthesizer.
+ * @return the number of sound effect sequences that can be played simultaneously.
+ */
+int SoundEmojiSynthesizer::getVoiceCount()
+{
+    return voiceCount;
+}
+
+/**
+ * Schedules the next sound effect as defined in the effectBuffer of the given voice, if available.
+ * @param voice The voice to advance.
  * @return true if we've just completed a buffer of effects, false otherwise.
  */
-bool SoundEmojiSynthesizer::nextSoundEffect()
+bool SoundEmojiSynthesizer::nextSoundEffect(SoundEmojiVoice *voice)
 {
-    const bool hadEffect = effect != NULL;
-    if (status & EMOJI_SYNTHESIZER_STATUS_STOPPING)
+    const bool hadEffect = voice->effect != NULL;
+    if (voice->status & EMOJI_SYNTHESIZER_STATUS_STOPPING)
     {
-        effect = NULL;
-        effectBuffer = emptyBuffer;
+        voice->effect = NULL;
+        voice->effectBuffer = emptyBuffer;
     }
 
     // If a sequence of SoundEffects are being played, attempt to move on to the next.
     // If not, select the first in the buffer.
-    if (effect)
-        effect++;
+    if (voice->effect)
+        voice->effect++;
     else
-        effect = (SoundEffect *) &effectBuffer[0];
+        voice->effect = (SoundEffect *) &voice->effectBuffer[0];
     
     // Validate that we have a valid sound effect. If not, record that we have nothing to play.
-    if ((uint8_t *)effect >= &effectBuffer[0] + effectBuffer.length())
+    if ((uint8_t *)voice->effect >= &voice->effectBuffer[0] + voice->effectBuffer.length())
     {
         // if we have an effect with a negative duration, reset the buffer (unless there is an update pending)
-        effect = (SoundEffect *) &effectBuffer[0];
+        voice->effect = (SoundEffect *) &voice->effectBuffer[0];
 
-        if (effect->duration >= 0 || lock.getWaitCount() > 0)
+        if (voice->effectBuffer.length() == 0 || voice->effect->duration >= 0 || voice->lock.getWaitCount() > 0)
         {
-            effect = NULL;
-            effectBuffer = emptyBuffer;
-            samplesWritten = 0;
-            samplesToWrite = 0;
-            position = 0.0f;
+            voice->effect = NULL;
+            voice->effectBuffer = emptyBuffer;
+            voice->samplesWritten = 0;
+            voice->samplesToWrite = 0;
+            voice->phase = 0;
             return hadEffect;
         }
     }
 
     // We have a valid buffer. Set up our synthesizer to the requested parameters.
-    samplesToWrite = determineSampleCount(effect->duration);
-    frequency = effect->frequency;
-    volume = effect->volume;
-    samplesWritten = 0;
+    voice->samplesToWrite = determineSampleCount(voice->effect->duration);
+    voice->frequency = voice->effect->frequency;
+    voice->volume = voice->effect->volume;
+    voice->samplesWritten = 0;
+    voice->controlEnd = 0;
+
+    // If we are starting from silence, fade in over the first control block.
+    if (!hadEffect)
+    {
+        voice->increment = phaseIncrement(voice->frequency);
+        voice->gain = 0;
+    }
 
     // validate and initialise per effect rendering state.
     for (int i=0; i<EMOJI_SYNTHESIZER_TONE_EFFECTS; i++)
     {
-        effect->effects[i].step = 0;
-        effect->effects[i].steps = max(effect->effects[i].steps, 1);
-        samplesPerStep[i] = (float) samplesToWrite / (float) effect->effects[i].steps;
+        voice->effect->effects[i].step = 0;
+        voice->effect->effects[i].steps = max(voice->effect->effects[i].steps, 1);
+        voice->samplesPerStep[i] = (float) voice->samplesToWrite / (float) voice->effect->effects[i].steps;
     }
     return false;
 }
 
 /**
- * Provide the next available ManagedBuffer to our downstream caller, if available.
+ * Schedules the next sound effect as defined in the effectBuffer of voice 0, if available.
+ * @return true if we've just completed a buffer of effects, false otherwise.
  */
-ManagedBuffer SoundEmojiSynthesizer::pull()
+bool SoundEmojiSynthesizer::nextSoundEffect()
 {
-    // Generate a buffer on demand. This is likely to be in interrupt context, so
-    // the receiver driven nature reduces glitching on audio output.
-    bool done = false;
-    uint16_t *sample = NULL;
-    uint16_t *bufferEnd;
+    return nextSoundEffect(&voices[0]);
+}
 
-    while (!done)
+/**
+ * Moves the given voice onto its next sound effect if the current one has completed,
+ * and signals completion of its buffer of effects.
+ *
+ * @param voice The voice to prepare.
+ * @return true if the voice has samples to render, false otherwise.
+ */
+bool SoundEmojiSynthesizer::prepareVoice(SoundEmojiVoice *voice)
+{
+    if (voice->samplesWritten == voice->samplesToWrite || voice->status & EMOJI_SYNTHESIZER_STATUS_STOPPING)
     {
-        if (samplesWritten == samplesToWrite || status & EMOJI_SYNTHESIZER_STATUS_STOPPING)
-        {
-            bool renderComplete = nextSoundEffect();
+        bool renderComplete = nextSoundEffect(voice);
 
-            // If we have just completed active playout of an effect, and there are no more effects scheduled, 
-            // unblock any fibers that may be waiting to play a sound effect.
-            if (samplesToWrite == 0 || status & EMOJI_SYNTHESIZER_STATUS_STOPPING)
+        // If we have just completed active playout of an effect, and there are no more effects scheduled, 
+        // unblock any fibers that may be waiting to play a sound effect.
+        if (voice->samplesToWrite == 0 || voice->status & EMOJI_SYNTHESIZER_STATUS_STOPPING)
+        {
+            if (renderComplete || voice->status & EMOJI_SYNTHESIZER_STATUS_STOPPING)
             {
-                done = true;
-                if (renderComplete || status & EMOJI_SYNTHESIZER_STATUS_STOPPING)
-                {
-                    status &= ~EMOJI_SYNTHESIZER_STATUS_STOPPING;
-                    Event(id, DEVICE_SOUND_EMOJI_SYNTHESIZER_EVT_DONE);
-                    lock.notify();
-                }
+                voice->status &= ~EMOJI_SYNTHESIZER_STATUS_STOPPING;
+                completeVoice(voice);
             }
+
+            return false;
         }
-        
-        // If we have something to do, ensure our buffers are created.
-        // We defer creation to avoid unecessary heap allocation when genertaing silence.
-        if (((samplesWritten < samplesToWrite) || !(status & EMOJI_SYNTHESIZER_STATUS_OUTPUT_SILENCE_AS_EMPTY)) && sample == NULL)
+    }
+
+    return voice->samplesWritten < voice->samplesToWrite;
+}
+
+/**
+ * Signals completion of the playout on the given voice: raises DEVICE_SOUND_EMOJI_SYNTHESIZER_EVT_DONE and
+ * DEVICE_SOUND_EMOJI_SYNTHESIZER_EVT_VOICE_DONE, and releases the voice's lock if a call to play() holds it.
+ *
+ * @param voice The voice that has completed.
+ */
+void SoundEmojiSynthesizer::completeVoice(SoundEmojiVoice *voice)
+{
+    Event(id, DEVICE_SOUND_EMOJI_SYNTHESIZER_EVT_DONE);
+    Event(id, DEVICE_SOUND_EMOJI_SYNTHESIZER_EVT_VOICE_DONE + (voice - voices));
+
+    // Scheduled sound effects do not take the lock, so must not release it either.
+    if (voice->status & EMOJI_SYNTHESIZER_STATUS_LOCKED)
+    {
+        voice->status &= ~EMOJI_SYNTHESIZER_STATUS_LOCKED;
+        voice->lock.notify();
+    }
+}
+
+/**
+ * Samples the TonePrint of the current effect of the given voice into its wavetable, and selects how it is rendered.
+ *
+ * @param voice The voice to update.
+ */
+void SoundEmojiSynthesizer::loadWavetable(SoundEmojiVoice *voice)
+{
+    TonePrint *tone = &voice->effect->tone;
+
+    for (int i = 0; i < EMOJI_SYNTHESIZER_WAVETABLE_SIZE; i++)
+        voice->wavetable[i] = tone->tonePrint ? (int16_t) tone->tonePrint(tone->parameter, i * (EMOJI_SYNTHESIZER_TONE_WIDTH / EMOJI_SYNTHESIZER_WAVETABLE_SIZE)) - 512 : 0;
+
+    voice->wavetable[EMOJI_SYNTHESIZER_WAVETABLE_SIZE] = voice->wavetable[0];
+    voice->tone = *tone;
+    voice->waveform = EMOJI_SYNTHESIZER_WAVEFORM_TABLE;
+
+#if CONFIG_ENABLED(CONFIG_EMOJI_SYNTHESIZER_BAND_LIMITED)
+    if (tone->tonePrint == Synthesizer::SquareWaveTone)
+        voice->waveform = EMOJI_SYNTHESIZER_WAVEFORM_SQUARE;
+
+    if (tone->tonePrint == Synthesizer::SawtoothTone)
+        voice->waveform = EMOJI_SYNTHESIZER_WAVEFORM_SAWTOOTH;
+
+    if (tone->tonePrint == Synthesizer::NoiseTone)
+        voice->waveform = EMOJI_SYNTHESIZER_WAVEFORM_NOISE;
+#endif
+}
+
+#if CONFIG_ENABLED(CONFIG_EMOJI_SYNTHESIZER_BAND_LIMITED)
+/**
+ * Determines the PolyBLEP correction for a unit step at phase zero, for a sample at the given phase.
+ *
+ * @param phase The phase of the sample, where 2^32 represents one full cycle.
+ * @param increment The phase increment per sample.
+ * @return the correction, scaled such that 32768 represents half the height of the step.
+ */
+static inline int32_t polyBlep(uint32_t phase, uint32_t increment)
+{
+    // Just after the step: -(1-x)^2, where x is the distance from the step in samples.
+    if (phase < increment)
+    {
+        int32_t r = 32768 - (int32_t) (((uint64_t) phase << 15) / increment);
+        return -((r * r) >> 15);
+    }
+
+    // Just before the step: (1-x)^2.
+    if (phase > ~increment)
+    {
+        int32_t r = 32768 - (int32_t) (((uint64_t) (0 - phase) << 15) / increment);
+        return (r * r) >> 15;
+    }
+
+    return 0;
+}
+#endif
+
+/**
+ * Determines the phase increment per sample for the given frequency, at the current sample rate.
+ *
+ * @param frequency The frequency, in Hz.
+ * @return the phase increment, where 2^32 represents one full cycle.
+ */
+uint32_t SoundEmojiSynthesizer::phaseIncrement(float frequency)
+{
+    return (uint32_t) (int64_t) (frequency * (4294967296.0f / sampleRate));
+}
+
+/**
+ * Determines the gain to apply to wavetable samples for the given volume, at the current sample range.
+ *
+ * @param volume The volume, in the range 0..1.
+ * @return the gain, in 16.16 fixed point.
+ */
+int32_t SoundEmojiSynthesizer::fixedGain(float volume)
+{
+    return (int32_t) ((sampleRange * volume) * (65536.0f / 1024.0f));
+}
+
+/**
+ * Renders a block of samples of the tone of the given voice, ramping its frequency and volume.
+ *
+ * @param voice The voice to render.
+ * @param out The buffer of signed samples to add the output of the voice into.
+ * @param len The number of samples to render.
+ */
+void SoundEmojiSynthesizer::renderTone(SoundEmojiVoice *voice, int32_t *out, int len)
+{
+    if (voice->tone.tonePrint != voice->effect->tone.tonePrint || voice->tone.parameter != voice->effect->tone.parameter)
+        loadWavetable(voice);
+
+    const int16_t *table = voice->wavetable;
+    uint32_t phase = voice->phase;
+    uint32_t increment = voice->increment;
+    int32_t incrementDelta = voice->incrementDelta;
+    int32_t gain = voice->gain;
+    int32_t gainDelta = voice->gainDelta;
+
+    switch (voice->waveform)
+    {
+#if CONFIG_ENABLED(CONFIG_EMOJI_SYNTHESIZER_BAND_LIMITED)
+        case EMOJI_SYNTHESIZER_WAVEFORM_SQUARE:
         {
-            buffer = ManagedBuffer(bufferSize);
-            sample = (uint16_t *) &buffer[0];
-            bufferEnd = (uint16_t *) (&buffer[0] + buffer.length());
+            // Rising edge at the start of the cycle, falling edge half way through.
+            int32_t high = table[0];
+            int32_t low = table[EMOJI_SYNTHESIZER_WAVETABLE_SIZE / 2];
+            int32_t step = (high - low) / 2;
+
+            while (len--)
+            {
+                int32_t s = phase < 0x80000000 ? high : low;
+                s += (step * (polyBlep(phase, increment) - polyBlep(phase + 0x80000000, increment))) >> 15;
+
+                *out++ += (int32_t) (((int64_t) s * gain) >> 16);
+
+                phase += increment;
+                increment += incrementDelta;
+                gain += gainDelta;
+            }
+            break;
         }
 
-        // Generate some samples with the current effect parameters.
-        while(samplesWritten < samplesToWrite)
+        case EMOJI_SYNTHESIZER_WAVEFORM_SAWTOOTH:
         {
-            float skip = ((EMOJI_SYNTHESIZER_TONE_WIDTH_F * frequency) / sampleRate);
-            float gain = (sampleRange * volume) / 1024.0f;
-            float offset = 512.0f - (512.0f * gain);
+            // A linear ramp across the cycle, with a single edge as it wraps.
+            int32_t start = table[0];
+            int32_t end = 2 * table[EMOJI_SYNTHESIZER_WAVETABLE_SIZE - 1] - table[EMOJI_SYNTHESIZER_WAVETABLE_SIZE - 2];
+            int32_t step = (start - end) / 2;
 
-            int effectStepEnd[EMOJI_SYNTHESIZER_TONE_EFFECTS];
-
-            for (int i = 0; i < EMOJI_SYNTHESIZER_TONE_EFFECTS; i++)
+            while (len--)
             {
-                effectStepEnd[i] = (int) (samplesPerStep[i] * (effect->effects[i].step));
-                if (effect->effects[i].step == effect->effects[i].steps - 1)
-                    effectStepEnd[i] = samplesToWrite;
+                int32_t s = start + (((end - start) * (int32_t) (phase >> 16)) >> 16);
+                s += (step * polyBlep(phase, increment)) >> 15;
+
+                *out++ += (int32_t) (((int64_t) s * gain) >> 16);
+
+                phase += increment;
+                increment += incrementDelta;
+                gain += gainDelta;
             }
-                
-            int stepEndPosition = effectStepEnd[0];
-            for (int i = 1; i < EMOJI_SYNTHESIZER_TONE_EFFECTS; i++)
-                stepEndPosition = min(stepEndPosition, effectStepEnd[i]);
+            break;
+        }
+
+        case EMOJI_SYNTHESIZER_WAVEFORM_NOISE:
+        {
+            // Take a new sample from a xorshift register each time the phase moves onto a new wavetable entry.
+            uint32_t noise = voice->noise;
+            int32_t s = voice->noiseSample;
 
-            // Write samples until the end of the next effect-step
-            while (samplesWritten < stepEndPosition)
+            while (len--)
             {
-                // Stop processing when we've filled the requested buffer
-                if (sample == bufferEnd)
+                uint32_t next = phase + increment;
+
+                *out++ += (int32_t) (((int64_t) s * gain) >> 16);
+
+                if ((next ^ phase) >> (32 - EMOJI_SYNTHESIZER_WAVETABLE_BITS))
                 {
-                    downStream->pullRequest();
-                    return buffer;
+                    noise ^= noise << 13;
+                    noise ^= noise >> 17;
+                    noise ^= noise << 5;
+                    s = (int32_t) (noise >> 22) - 512;
                 }
 
-                // Synthesize a sample
-                float s = effect->tone.tonePrint(effect->tone.parameter, (int) position);
+                phase = next;
+                increment += incrementDelta;
+                gain += gainDelta;
+            }
 
-                // Apply volume scaling and OR mask (if specified).
-                *sample = ((uint16_t) ((s * gain) + offset)) | orMask;
+            voice->noise = noise;
+            voice->noiseSample = s;
+            break;
+        }
+#endif
 
-                // Move on our pointers.
-                sample++;
-                samplesWritten++;
-                position += skip;
+        default:
+            while (len--)
+            {
+                uint32_t index = phase >> (32 - EMOJI_SYNTHESIZER_WAVETABLE_BITS);
+                int32_t fraction = (phase >> (16 - EMOJI_SYNTHESIZER_WAVETABLE_BITS)) & 0xFFFF;
+                int32_t s = table[index] + (((table[index+1] - table[index]) * fraction) >> 16);
 
-                // Keep our toneprint pointer in range
-                while(position > EMOJI_SYNTHESIZER_TONE_WIDTH_F)
-                    position -= EMOJI_SYNTHESIZER_TONE_WIDTH_F;
+                *out++ += (int32_t) (((int64_t) s * gain) >> 16);
+
+                phase += increment;
+                increment += incrementDelta;
+                gain += gainDelta;
             }
+    }
 
-            // Invoke the effect function for any effects that are due.
-            for (int i = 0; i < EMOJI_SYNTHESIZER_TONE_EFFECTS; i++)
-            {
-                if (samplesWritten == effectStepEnd[i])
-                {
-                    if (effect->effects[i].step < effect->effects[i].steps)
-                    {
-                        if (effect->effects[i].effect)
-                            effect->effects[i].effect(this, &effect->effects[i]);
+    voice->phase = phase;
+    voice->increment = increment;
+    voice->gain = gain;
+}
 
-                        effect->effects[i].step++;
-                    }
-                }
-            }
+/**
+ * Invokes the effect functions of the given voice for all effect steps that fall due before the given sample.
+ *
+ * @param voice The voice to update.
+ * @param end The sample at which the current control block ends.
+ */
+void SoundEmojiSynthesizer::evaluateEffects(SoundEmojiVoice *voice, int end)
+{
+    SoundEffect *fx = voice->effect;
+
+    // Effect functions operate on the frequency and volume of the synthesizer, so load those of this voice.
+    effect = fx;
+    frequency = voice->frequency;
+    volume = voice->volume;
+
+    for (int i = 0; i < EMOJI_SYNTHESIZER_TONE_EFFECTS; i++)
+    {
+        ToneEffect *e = &fx->effects[i];
+
+        while (e->step < e->steps)
+        {
+            int stepEnd = (e->step == e->steps - 1) ? voice->samplesToWrite : (int) (voice->samplesPerStep[i] * e->step);
+            if (stepEnd >= end)
+                break;
+
+            if (e->effect)
+                e->effect(this, e);
+
+            e->step++;
         }
     }
 
+    voice->frequency = frequency;
+    voice->volume = volume;
+}
+
+/**
+ * Starts playback of the given buffer of sound effects on the given voice, replacing any playing.
+ * The frequency and volume of a playing sound effect ramp into those of the new one.
+ *
+ * @param voice The voice to use.
+ * @param sound A buffer containing an array of one or more SoundEffects.
+ */
+void SoundEmojiSynthesizer::startSoundEffect(SoundEmojiVoice *voice, ManagedBuffer sound)
+{
+    bool playing = voice->effect != NULL;
+    uint32_t increment = voice->increment;
+    int32_t gain = voice->gain;
+
+    // The sound being replaced will never complete, so signal its completion now, as if it had been stopped.
+    if (playing)
+        completeVoice(voice);
+
+    voice->status &= ~EMOJI_SYNTHESIZER_STATUS_STOPPING;
+    voice->effect = NULL;
+    voice->effectBuffer = sound;
+    nextSoundEffect(voice);
+
+    // Continue from the current output of the voice, rather than fading in from silence.
+    if (playing)
+    {
+        voice->increment = increment;
+        voice->gain = gain;
+    }
+}
+
+/**
+ * Renders the given number of samples of all voices, starting scheduled sound effects at the sample they fall due.
+ *
+ * @param out The buffer of signed samples to add the output of the voices into.
+ * @param len The number of samples to render.
+ */
+void SoundEmojiSynthesizer::render(int32_t *out, int len)
+{
+    uint32_t time = sampleTime;
+    int32_t *end = out + len;
+
+    while (out < end)
+    {
+        int samples = end - out;
+
+        // Start any scheduled sound effects that are due, and render only up to the next one.
+        while (sequenceLength > 0 && (int32_t) (sequence[0].time - time) <= 0)
+        {
+            startSoundEffect(&voices[sequence[0].voice], sequence[0].sound);
+
+            sequenceLength--;
+            for (int i = 0; i < sequenceLength; i++)
+                sequence[i] = sequence[i+1];
+
+            sequence[sequenceLength].sound = emptyBuffer;
+        }
+
+        if (sequenceLength > 0)
+            samples = min(samples, (int) (sequence[0].time - time));
+
+        for (int i = 0; i < voiceCount; i++)
+            renderVoice(&voices[i], out, samples);
+
+        out += samples;
+        time += samples;
+    }
+}
+
+/**
+ * Renders up to the given number of samples of the given voice, evaluating its effects as they fall due.
+ *
+ * @param voice The voice to render.
+ * @param out The buffer of signed samples to add the output of the voice into.
+ * @param len The number of samples to render.
+ */
+void SoundEmojiSynthesizer::renderVoice(SoundEmojiVoice *voice, int32_t *out, int len)
+{
+    int32_t *end = out + len;
+
+    while (out < end && prepareVoice(voice))
+    {
+        // At the start of each control block, apply any effect steps that fall due within it,
+        // and ramp towards the resulting frequency and volume over the block.
+        if (voice->samplesWritten >= voice->controlEnd)
+        {
+            int blockEnd = min((voice->samplesWritten / EMOJI_SYNTHESIZER_CONTROL_PERIOD + 1) * EMOJI_SYNTHESIZER_CONTROL_PERIOD, voice->samplesToWrite);
+            int blockLength = blockEnd - voice->samplesWritten;
+
+            evaluateEffects(voice, blockEnd);
+
+            voice->incrementDelta = ((int32_t) (phaseIncrement(voice->frequency) - voice->increment)) / blockLength;
+            voice->gainDelta = (fixedGain(voice->volume) - voice->gain) / blockLength;
+            voice->controlEnd = blockEnd;
+        }
+
+        int samples = min(voice->controlEnd - voice->samplesWritten, (int) (end - out));
+
+        renderTone(voice, out, samples);
+        out += samples;
+        voice->samplesWritten += samples;
+
+        // Remove any rounding error accumulated over the ramp.
+        if (voice->samplesWritten == voice->controlEnd)
+        {
+            voice->increment = phaseIncrement(voice->frequency);
+            voice->gain = fixedGain(voice->volume);
+        }
+    }
+}
+
+/**
+ * Provide the next available ManagedBuffer to our downstream caller, if available.
+ */
+ManagedBuffer SoundEmojiSynthesizer::pull()
+{
+    // Generate a buffer on demand. This is likely to be in interrupt context, so
+    // the receiver driven nature reduces glitching on audio output.
+    // Scheduled sound effects keep us busy, so that silence before them is timed in samples.
+    bool busy = sequenceLength > 0;
+
+    for (int i = 0; i < voiceCount; i++)
+        if (prepareVoice(&voices[i]))
+            busy = true;
+
     // if we have no data to send, return an empty buffer (if requested)
-    if (sample == NULL)
+    // We defer creation to avoid unecessary heap allocation when genertaing silence.
+    if (!busy && (status & EMOJI_SYNTHESIZER_STATUS_OUTPUT_SILENCE_AS_EMPTY))
     {
         buffer = ManagedBuffer();
+        downStream->pullRequest();
+        return buffer;
     }
-    else
+
+    buffer = pool ? pool->allocate(bufferSize) : ManagedBuffer(bufferSize);
+
+    uint16_t *sample = (uint16_t *) &buffer[0];
+    int len = buffer.length() / 2;
+    int range = (int) sampleRange;
+    int centre = (range + 1) / 2;
+
+    // Voices are accumulated as signed samples centred on zero, one block at a time, with enough headroom
+    // for several loud voices at the full 16 bit sample range.
+    int32_t mix[EMOJI_SYNTHESIZER_MIX_BLOCK];
+
+    for (int i = 0; i < len; i += EMOJI_SYNTHESIZER_MIX_BLOCK)
     {
-        // Pad the output buffer with silence if necessary.
-        uint16_t silence = ((uint16_t) (sampleRange *0.5f)) | orMask;
-        while(sample < bufferEnd)
+        int samples = min(len - i, EMOJI_SYNTHESIZER_MIX_BLOCK);
+
+        memset(mix, 0, samples * sizeof(int32_t));
+
+        if (busy)
+            render(mix, samples);
+
+        sampleTime += samples;
+
+        // Move the mix into our output range, and apply the OR mask (if specified).
+        for (int j = 0; j < samples; j++)
         {
-            *sample = silence;
-            sample++;
+            int s = mix[j] + centre;
+            s = s < 0 ? 0 : s > range ? range : s;
+            sample[i + j] = ((uint16_t) s) | orMask;
         }
     }
 
@@ -392,4 +958,16 @@ void SoundEmojiSynthesizer::allowEmptyBuffers(bool mode)
         this->status &= ~EMOJI_SYNTHESIZER_STATUS_OUTPUT_SILENCE_AS_EMPTY;
 
     
-}
\ No newline at end of file
+}
+
+/**
+ * Defines a pool from which output buffers are allocated, rather than using the heap.
+ *
+ * @param pool The pool to use, or NULL to allocate output buffers from the heap.
+ * @return DEVICE_OK on success.
+ */
+int SoundEmojiSynthesizer::setBufferPool(AudioBufferPool *pool)
+{
+    this->pool = pool;
+    return DEVICE_OK;
+}
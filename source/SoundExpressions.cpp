@@ -30,6 +30,7 @@ DEALINGS IN THE SOFTWARE.
 #include "SoundEmojiSynthesizer.h"
 #include "SoundSynthesizerEffects.h"
 #include "ManagedString.h"
+#include "MicroBitFile.h"
 
 #define CLAMP(lo, v, hi) ((v) = ((v) < (lo) ? (lo) : (v) > (hi) ? (hi) : (v)))
 
@@ -37,7 +38,20 @@ DEALINGS IN THE SOFTWARE.
   * Default Constructor.
   */
 SoundExpressions::SoundExpressions(SoundEmojiSynthesizer &synth): synth(synth)
-{}
+{
+    this->cacheClock = 0;
+    this->voiceClock = 0;
+    this->voiceStarted = new uint32_t[synth.getVoiceCount()];
+
+    for (int i = 0; i < synth.getVoiceCount(); i++)
+        voiceStarted[i] = 0;
+
+    for (int i = 0; i < CONFIG_SOUND_EXPRESSIONS_CACHE_SIZE; i++)
+    {
+        cache[i].hash = 0;
+        cache[i].lastUsed = 0;
+    }
+}
 
 /**
   * Destructor.
@@ -46,40 +60,192 @@ SoundExpressions::SoundExpressions(SoundEmojiSynthesizer &synth): synth(synth)
   */
 SoundExpressions::~SoundExpressions()
 {
+    delete[] voiceStarted;
 }
 
 void SoundExpressions::play(ManagedString sound) {
-    fiber_wake_on_event(synth.id, DEVICE_SOUND_EMOJI_SYNTHESIZER_EVT_DONE);
-    playAsync(sound);
-    schedule();
+    play(compile(sound));
 }
 
 void SoundExpressions::playAsync(ManagedString sound) {
+    playAsync(compile(sound));
+}
+
+void SoundExpressions::play(ManagedBuffer compiled) {
+    if (!isValid(compiled)) {
+        return;
+    }
+    int voice = allocateVoice();
+    fiber_wake_on_event(synth.id, DEVICE_SOUND_EMOJI_SYNTHESIZER_EVT_VOICE_DONE + voice);
+    start(compiled, voice);
+    schedule();
+}
+
+void SoundExpressions::playAsync(ManagedBuffer compiled) {
+    if (!isValid(compiled)) {
+        return;
+    }
+    start(compiled, allocateVoice());
+}
+
+/**
+ * Selects a voice for a new sound: the first idle voice, or failing that the voice that started playing least recently.
+ */
+int SoundExpressions::allocateVoice() {
+    int oldest = 0;
+    for (int i = 0; i < synth.getVoiceCount(); i++) {
+        if (!synth.isVoiceActive(i)) {
+            return i;
+        }
+        if ((int32_t) (voiceStarted[i] - voiceStarted[oldest]) < 0) {
+            oldest = i;
+        }
+    }
+    return oldest;
+}
+
+/**
+ * Expands a compiled sound and starts it on the given voice, replacing any sound already playing there.
+ */
+void SoundExpressions::start(ManagedBuffer compiled, int voice) {
+    // Expand the compiled effects, applying any randomness they specify.
+    const unsigned effectCount = compiled.length() / sizeof(SoundExpressionEffect);
+    const SoundExpressionEffect *expression = (SoundExpressionEffect *) &compiled[0];
+
+    ManagedBuffer b(sizeof(SoundEffect) * effectCount);
+    SoundEffect *fx = (SoundEffect *) &b[0];
+    for (unsigned i = 0; i < effectCount; ++i) {
+        expandSoundExpression(expression++, fx++);
+    }
+
+    voiceStarted[voice] = ++voiceClock;
+
+    // Start at the next sample generated. Should the schedule be full, take over the voice at once instead, as
+    // playAsync() must never block.
+    if (synth.schedule(b, synth.getSampleTime(), voice) != DEVICE_OK) {
+        synth.replace(b, voice);
+    }
+}
+
+ManagedBuffer SoundExpressions::compile(ManagedString sound) {
+    const uint32_t soundHash = hash(sound);
+    SoundExpressionCacheEntry *entry = &cache[0];
+
+    // Reuse a previous compilation of this sound if we have one, otherwise replace the least recently used.
+    cacheClock++;
+    for (int i = 0; i < CONFIG_SOUND_EXPRESSIONS_CACHE_SIZE; i++) {
+        if (cache[i].hash == soundHash && cache[i].compiled.length() > 0 && cache[i].sound == sound) {
+            cache[i].lastUsed = cacheClock;
+            return cache[i].compiled;
+        }
+        if (cache[i].lastUsed < entry->lastUsed) {
+            entry = &cache[i];
+        }
+    }
+
     // Sound is either encoded data or a name of a built-in sound for which we have the data.
-    sound = lookupBuiltIn(sound);
-    const unsigned soundLen = sound.length();
-    const char *soundChars = sound.toCharArray();
+    ManagedString data = lookupBuiltIn(sound);
+    const unsigned soundLen = data.length();
+    const char *soundChars = data.toCharArray();
 
     // 72 characters of sound data comma separated
     const unsigned charsPerEffect = 72;
     const unsigned effectCount = (soundLen + 1) / (charsPerEffect + 1);
     const unsigned expectedLength = effectCount * (charsPerEffect + 1) - 1;
-    if (soundLen != expectedLength) {
-        return;
+    if (effectCount == 0 || soundLen != expectedLength) {
+        return ManagedBuffer();
     }
-    
-    ManagedBuffer b(sizeof(SoundEffect) * effectCount);
-    SoundEffect *fx = (SoundEffect *) &b[0];
+
+    ManagedBuffer compiled(sizeof(SoundExpressionEffect) * effectCount);
+    SoundExpressionEffect *fx = (SoundExpressionEffect *) &compiled[0];
     for (unsigned i = 0; i < effectCount; ++i)  {
         const int start = i * charsPerEffect + i;
         if (start > 0 && soundChars[start - 1] != ',') {
-            return;
+            return ManagedBuffer();
         }
         if (!parseSoundExpression(&soundChars[start], fx++)) {
-            return;
+            return ManagedBuffer();
+        }
+    }
+
+    entry->hash = soundHash;
+    entry->lastUsed = cacheClock;
+    entry->sound = sound;
+    entry->compiled = compiled;
+
+    return compiled;
+}
+
+int SoundExpressions::save(ManagedString sound, ManagedString filename) {
+    ManagedBuffer compiled = compile(sound);
+    if (!isValid(compiled)) {
+        return DEVICE_INVALID_PARAMETER;
+    }
+
+    // Replace any existing file of the same name.
+    {
+        MicroBitFile existing(filename, READ);
+        if (existing.isValid()) {
+            existing.remove();
         }
     }
-    synth.play(b);
+
+    MicroBitFile file(filename, WRITE | CREATE);
+    if (!file.isValid()) {
+        return DEVICE_NO_RESOURCES;
+    }
+
+    SoundExpressionFileHeader header;
+    header.magic = SOUND_EXPRESSIONS_FILE_MAGIC;
+    header.version = SOUND_EXPRESSIONS_FILE_VERSION;
+    header.effectSize = sizeof(SoundExpressionEffect);
+    header.count = compiled.length() / sizeof(SoundExpressionEffect);
+
+    int written = file.write((const char *) &header, sizeof(header));
+    if (written == sizeof(header)) {
+        written = file.write((const char *) &compiled[0], compiled.length());
+    }
+    file.close();
+
+    return written == compiled.length() ? DEVICE_OK : DEVICE_NO_RESOURCES;
+}
+
+ManagedBuffer SoundExpressions::load(ManagedString filename) {
+    MicroBitFile file(filename, READ);
+    if (!file.isValid()) {
+        return ManagedBuffer();
+    }
+
+    // The header gives the length of the file, and rejects files that were not written by save().
+    SoundExpressionFileHeader header;
+    if (file.read((char *) &header, sizeof(header)) != sizeof(header) ||
+        header.magic != SOUND_EXPRESSIONS_FILE_MAGIC ||
+        header.version != SOUND_EXPRESSIONS_FILE_VERSION ||
+        header.effectSize != sizeof(SoundExpressionEffect) ||
+        header.count == 0) {
+        return ManagedBuffer();
+    }
+
+    int length = header.count * sizeof(SoundExpressionEffect);
+    ManagedBuffer compiled(length);
+    if (file.read((char *) &compiled[0], length) != length) {
+        return ManagedBuffer();
+    }
+    return compiled;
+}
+
+bool SoundExpressions::isValid(ManagedBuffer compiled) {
+    return compiled.length() > 0 && compiled.length() % sizeof(SoundExpressionEffect) == 0;
+}
+
+uint32_t SoundExpressions::hash(ManagedString sound) {
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    const char *c = sound.toCharArray();
+    for (int i = 0; i < sound.length(); ++i) {
+        h = (h ^ (uint8_t) c[i]) * 16777619u;
+    }
+    return h;
 }
 
 int SoundExpressions::parseDigits(const char *input, const int digits) {
@@ -101,6 +267,7 @@ int SoundExpressions::parseDigits(const char *input, const int digits) {
 }
 
 void SoundExpressions::stop() {
+    synth.clearSchedule();
     synth.stop();
 }
 
@@ -112,7 +279,7 @@ int SoundExpressions::applyRandom(int value, int rand) {
     return abs(value + delta);
 }
 
-bool SoundExpressions::parseSoundExpression(const char *soundChars, SoundEffect *fx) {
+bool SoundExpressions::parseSoundExpression(const char *soundChars, SoundExpressionEffect *fx) {
     // Encoded as a sequence of zero padded decimal strings.
     // This encoding is worth reconsidering if we can!
     // The ADSR effect (and perhaps others in future) has two parameters which cannot be expressed.
@@ -144,26 +311,67 @@ bool SoundExpressions::parseSoundExpression(const char *soundChars, SoundEffect
     int fxnSteps = parseDigits(&soundChars[40], 4);
 
     // Details that encoded randomness to be applied when frame is used:
-    // Can the randomness cause any parameters to go out of range?
     // [44] 0000-9999 frequency random
-    frequency = applyRandom(frequency, parseDigits(&soundChars[44], 4));
+    int frequencyRandom = parseDigits(&soundChars[44], 4);
     // [48] 0000-9999 end frequency random
-    endFrequency = applyRandom(endFrequency, parseDigits(&soundChars[48], 4));
+    int endFrequencyRandom = parseDigits(&soundChars[48], 4);
     // [52] 0000-9999 volume random
-    effectVolume = applyRandom(effectVolume, parseDigits(&soundChars[52], 4));
+    int volumeRandom = parseDigits(&soundChars[52], 4);
     // [56] 0000-9999 end volume random
-    endVolume = applyRandom(endVolume, parseDigits(&soundChars[56], 4));
+    int endVolumeRandom = parseDigits(&soundChars[56], 4);
     // [60] 0000-9999 duration random
-    duration = applyRandom(duration, parseDigits(&soundChars[60], 4));
+    int durationRandom = parseDigits(&soundChars[60], 4);
     // [64] 0000-9999 fxParamRandom
-    fxParam = applyRandom(fxParam, parseDigits(&soundChars[64], 4));
+    int fxParamRandom = parseDigits(&soundChars[64], 4);
     // [68] 0000-9999 fxnStepsRandom
-    fxnSteps = applyRandom(fxnSteps, parseDigits(&soundChars[68], 4));
+    int fxnStepsRandom = parseDigits(&soundChars[68], 4);
 
     if (frequency == -1 || endFrequency == -1 || effectVolume == -1 || endVolume == -1 || duration == -1 || fxParam == -1 || fxnSteps == -1) {
         return false;
     }
 
+    if (frequencyRandom == -1 || endFrequencyRandom == -1 || volumeRandom == -1 || endVolumeRandom == -1 || durationRandom == -1 || fxParamRandom == -1 || fxnStepsRandom == -1) {
+        return false;
+    }
+
+    fx->wave = wave;
+    fx->shape = shape;
+    fx->fxChoice = fxChoice;
+    fx->reserved = 0;
+    fx->steps = steps;
+    fx->volume = effectVolume;
+    fx->frequency = frequency;
+    fx->duration = duration;
+    fx->endFrequency = endFrequency;
+    fx->endVolume = endVolume;
+    fx->fxParam = fxParam;
+    fx->fxnSteps = fxnSteps;
+    fx->frequencyRandom = frequencyRandom;
+    fx->endFrequencyRandom = endFrequencyRandom;
+    fx->volumeRandom = volumeRandom;
+    fx->endVolumeRandom = endVolumeRandom;
+    fx->durationRandom = durationRandom;
+    fx->fxParamRandom = fxParamRandom;
+    fx->fxnStepsRandom = fxnStepsRandom;
+    return true;
+}
+
+void SoundExpressions::expandSoundExpression(const SoundExpressionEffect *expression, SoundEffect *fx) {
+    int wave = expression->wave == 0xFF ? -1 : expression->wave;
+    int shape = expression->shape == 0xFF ? -1 : expression->shape;
+    int fxChoice = expression->fxChoice == 0xFF ? -1 : expression->fxChoice;
+    int steps = expression->steps;
+
+    // Apply the encoded randomness.
+    // Can the randomness cause any parameters to go out of range?
+    int frequency = applyRandom(expression->frequency, expression->frequencyRandom);
+    int endFrequency = applyRandom(expression->endFrequency, expression->endFrequencyRandom);
+    int effectVolume = applyRandom(expression->volume, expression->volumeRandom);
+    int endVolume = applyRandom(expression->endVolume, expression->endVolumeRandom);
+    int duration = applyRandom(expression->duration, expression->durationRandom);
+    int fxParam = applyRandom(expression->fxParam, expression->fxParamRandom);
+    int fxnSteps = applyRandom(expression->fxnSteps, expression->fxnStepsRandom);
+
     float volumeScaleFactor = 1.0f;
 
     switch(wave) {
@@ -279,7 +487,6 @@ bool SoundExpressions::parseSoundExpression(const char *soundChars, SoundEffect
             fx->effects[2].parameter[0] = (float) fxParam;
             break;
     }
-    return true;
 }
 
 // Names and data for each built-in sound expression.
@@ -28,7 +28,6 @@ DEALINGS IN THE SOFTWARE.
   * Commonly represents an I/O pin on the edge connector.
   */
 #include "SoundOutputPin.h"
-#include "Synthesizer.h"
 #include "CodalDmesg.h"
 #include "MicroBitAudio.h"
 
@@ -41,17 +40,15 @@ using namespace codal;
  * @param id the unique EventModel id of this component.
  * @param mixer the mixer to use
  */
-SoundOutputPin::SoundOutputPin(Mixer2 &mix, int id) : codal::Pin(id, 0, PIN_CAPABILITY_ANALOG), mixer(mix), synth(DEVICE_ID_SOUND_EMOJI_SYNTHESIZER_1), outputBuffer(sizeof(SoundEffect))
+SoundOutputPin::SoundOutputPin(Mixer2 &mix, int id) : codal::Pin(id, 0, PIN_CAPABILITY_ANALOG), mixer(mix), generator(CONFIG_SOUND_OUTPUT_PIN_SAMPLE_RATE)
 {
     this->value = 512;
     this->periodUs = 0;
-    this->fx = NULL;
     this->channel = NULL;
     this->timeOfLastUpdate = 0;
 
-    // Enable lazy periodic callback and optimised silence generation.
+    // Enable lazy periodic callback, used to detach from the mixer during silence.
     CodalComponent::status |= DEVICE_COMPONENT_STATUS_IDLE_TICK;
-    synth.allowEmptyBuffers(true);
 }
 
 
@@ -148,45 +145,37 @@ int SoundOutputPin::getAnalogPeriod()
  */
 void SoundOutputPin::update()
 {
-    float volume = periodUs == 0.0f ? 0.0f : (4.0f * ((float)value)) / 512.0f;
+    // Map our normalised value (0..128) onto the full volume range of the generator.
+    int volume = periodUs == 0 ? 0 : min(1023, value * 8);
 
     // Snapshot the curent time, so we can determine periods of silence.
     this->timeOfLastUpdate = system_timer_current_time();
 
-    // If this is the first time we've been asked to produce a sound, prime a SoundEffect buffer.
-    if (fx == NULL)
+    // Update our parameters
+    generator.setFrequency(periodUs == 0 ? 6068 : 1000000.0f / (float) periodUs);
+    generator.setVolume(volume);
+
+    // If we're not currently attached to the mixer, and have something to play, attach the generator as a new channel.
+    if (volume > 0 && !(CodalComponent::status & SOUND_OUTPUT_PIN_STATUS_ACTIVE))
     {
         // Enable the audio output pipeline, if needed.
         MicroBitAudio::requestActivation();
 
-        // Create a sound effect buffer, and configure a synthesizer for a raw squarewave output into the mixer.
-        fx = (SoundEffect *)&outputBuffer[0];
-        fx->duration = -CONFIG_SOUND_OUTPUT_PIN_PERIOD;
-        fx->tone.tonePrint = Synthesizer::SquareWaveTone;
-        fx->volume = 0.0f;
-        channel = mixer.addChannel(synth);
+        CodalComponent::status |= SOUND_OUTPUT_PIN_STATUS_ACTIVE;
+        generator.setBufferPool(mixer.getBufferPool());
+        channel = mixer.addChannel(generator, CONFIG_SOUND_OUTPUT_PIN_SAMPLE_RATE, SQUARE_WAVE_GENERATOR_RANGE);
     }
-
-    // Update our parameters
-    fx->frequency = periodUs == 0 ? 6068 : 1000000.0f / (float) periodUs;
-    fx->volume = volume;
 }
 
 /**
- * Disable the synthesizer during long periods of silence, for efficiency.
+ * Detach the generator from the mixer during long periods of silence, for efficiency.
  */
 void SoundOutputPin::idleCallback()
 {
-    if ((CodalComponent::status & SOUND_OUTPUT_PIN_STATUS_ACTIVE) && (fx->volume == 0.0f) && (system_timer_current_time() - this->timeOfLastUpdate > CONFIG_SOUND_OUTPUT_PIN_SILENCE_GATE))
+    if ((CodalComponent::status & SOUND_OUTPUT_PIN_STATUS_ACTIVE) && generator.getVolume() == 0 && (system_timer_current_time() - this->timeOfLastUpdate > CONFIG_SOUND_OUTPUT_PIN_SILENCE_GATE))
     {
+        mixer.removeChannel(channel);
+        channel = NULL;
         CodalComponent::status &= ~SOUND_OUTPUT_PIN_STATUS_ACTIVE;
-        synth.stop();
     }
-
-    // If our volume is non-zero and we're not active, then restart to synthesizer.
-    if (!(CodalComponent::status & SOUND_OUTPUT_PIN_STATUS_ACTIVE) && fx && fx->volume > 0.0f)
-    {
-        CodalComponent::status |= SOUND_OUTPUT_PIN_STATUS_ACTIVE;
-        synth.play(outputBuffer);
-    }
-}
\ No newline at end of file
+}
@@ -0,0 +1,211 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "SquareWaveGenerator.h"
+#include "ErrorNo.h"
+
+using namespace codal;
+
+/**
+ * Constructor.
+ * Creates a silent generator.
+ *
+ * @param sampleRate The sample rate at which to generate samples.
+ */
+SquareWaveGenerator::SquareWaveGenerator(int sampleRate)
+{
+    this->downStream = NULL;
+    this->pool = NULL;
+    this->sampleRate = sampleRate > 0 ? sampleRate : 1;
+    this->frequency = 0.0f;
+    this->increment = 0;
+    this->duty = 0x80000000;
+    this->amplitude = 0;
+    this->phase = 0;
+}
+
+/**
+ * Provide the next available ManagedBuffer to our downstream caller.
+ */
+ManagedBuffer SquareWaveGenerator::pull()
+{
+    int16_t a = amplitude;
+    uint32_t inc = increment;
+    uint32_t edge = duty;
+
+    // Don't generate anything while silent.
+    if (a == 0 || downStream == NULL)
+    {
+        if (downStream)
+            downStream->pullRequest();
+
+        return ManagedBuffer();
+    }
+
+    ManagedBuffer b = pool ? pool->allocate(CONFIG_SQUARE_WAVE_GENERATOR_BUFFER_SIZE) : ManagedBuffer(CONFIG_SQUARE_WAVE_GENERATOR_BUFFER_SIZE);
+    int16_t *out = (int16_t *) &b[0];
+    int16_t *end = out + b.length() / sizeof(int16_t);
+
+    while (out < end)
+    {
+        // Determine how many samples remain until the next edge, and write them as a single run.
+        bool high = phase < edge;
+        uint64_t remaining = (high ? (uint64_t) edge : 0x100000000ULL) - phase;
+        uint64_t n = inc ? (remaining + inc - 1) / inc : (uint64_t) (end - out);
+
+        if (n > (uint64_t) (end - out))
+            n = end - out;
+
+        int16_t v = high ? a : -a;
+        for (int16_t *runEnd = out + n; out < runEnd; out++)
+            *out = v;
+
+        phase += (uint32_t) (n * inc);
+    }
+
+    downStream->pullRequest();
+    return b;
+}
+
+/**
+ * Define a downstream component for data stream.
+ *
+ * @sink The component that data will be delivered to, when it is availiable
+ */
+void SquareWaveGenerator::connect(DataSink &sink)
+{
+    this->downStream = &sink;
+    downStream->pullRequest();
+}
+
+/**
+ * Stop delivering data to our downstream component.
+ */
+void SquareWaveGenerator::disconnect()
+{
+    this->downStream = NULL;
+}
+
+/**
+ * Determine the data format of the buffers streamed out of this component.
+ */
+int SquareWaveGenerator::getFormat()
+{
+    return DATASTREAM_FORMAT_16BIT_SIGNED;
+}
+
+/**
+ * Defines the frequency of the waveform.
+ *
+ * @param frequency The frequency, in Hz. Values above half the sample rate are clamped.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int SquareWaveGenerator::setFrequency(float frequency)
+{
+    if (frequency < 0.0f)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (frequency > sampleRate / 2)
+        frequency = sampleRate / 2;
+
+    this->frequency = frequency;
+    this->increment = (uint32_t) ((frequency / sampleRate) * 4294967296.0f);
+
+    return DEVICE_OK;
+}
+
+/**
+ * Defines the duty cycle of the waveform.
+ *
+ * @param duty The proportion of each cycle for which the output is high, in the range 0..1023. 512 generates a square wave.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int SquareWaveGenerator::setDutyCycle(int duty)
+{
+    if (duty < 0 || duty > 1023)
+        return DEVICE_INVALID_PARAMETER;
+
+    this->duty = (uint32_t) duty << 22;
+    return DEVICE_OK;
+}
+
+/**
+ * Defines the amplitude of the waveform.
+ *
+ * @param volume The amplitude, in the range 0..1023, where 1023 spans the full sample range.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int SquareWaveGenerator::setVolume(int volume)
+{
+    if (volume < 0 || volume > 1023)
+        return DEVICE_INVALID_PARAMETER;
+
+    this->amplitude = (int16_t) ((volume * (SQUARE_WAVE_GENERATOR_RANGE / 2)) / 1023);
+    return DEVICE_OK;
+}
+
+/**
+ * Determines the amplitude of the waveform.
+ * @return the amplitude, in the range 0..1023.
+ */
+int SquareWaveGenerator::getVolume()
+{
+    return (amplitude * 1023) / (SQUARE_WAVE_GENERATOR_RANGE / 2);
+}
+
+/**
+ * Change the sample rate at which samples are generated.
+ *
+ * @param sampleRate The new sample rate, in samples per second.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int SquareWaveGenerator::setSampleRate(int sampleRate)
+{
+    if (sampleRate <= 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    this->sampleRate = sampleRate;
+    return setFrequency(frequency);
+}
+
+/**
+ * Determine the sample rate at which samples are generated.
+ * @return the sample rate, in samples per second.
+ */
+int SquareWaveGenerator::getSampleRate()
+{
+    return sampleRate;
+}
+
+/**
+ * Defines a pool from which output buffers are allocated, rather than using the heap.
+ *
+ * @param pool The pool to use, or NULL to allocate output buffers from the heap.
+ * @return DEVICE_OK on success.
+ */
+int SquareWaveGenerator::setBufferPool(AudioBufferPool *pool)
+{
+    this->pool = pool;
+    return DEVICE_OK;
+}
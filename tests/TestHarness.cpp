@@ -0,0 +1,203 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "TestHarness.h"
+#include "DataStream.h"
+
+#include <chrono>
+#include <string>
+#include <stdio.h>
+
+#define TEST_GOLDEN_DIRECTORY   "golden/"
+
+static int checks = 0;
+static int failures = 0;
+
+bool test_check(bool passed, const char *condition, const char *file, int line)
+{
+    checks++;
+
+    if (!passed)
+    {
+        failures++;
+        printf("%s:%d: check failed: %s\n", file, line, condition);
+    }
+
+    return passed;
+}
+
+bool test_check_equal(long long expected, long long actual, const char *expression, const char *file, int line)
+{
+    checks++;
+
+    if (expected != actual)
+    {
+        failures++;
+        printf("%s:%d: check failed: %s is %lld, expected %lld\n", file, line, expression, actual, expected);
+    }
+
+    return expected == actual;
+}
+
+bool test_golden(const char *name, const std::vector<int16_t> &samples, int tolerance)
+{
+    std::string path = std::string(TEST_GOLDEN_DIRECTORY) + name + ".raw";
+    checks++;
+
+    if (getenv("CODAL_UPDATE_GOLDEN"))
+    {
+        FILE *f = fopen(path.c_str(), "wb");
+
+        if (f == NULL || fwrite(samples.data(), sizeof(int16_t), samples.size(), f) != samples.size())
+        {
+            failures++;
+            printf("%s: could not write golden file\n", path.c_str());
+        }
+
+        if (f)
+            fclose(f);
+
+        return true;
+    }
+
+    std::vector<int16_t> expected;
+    FILE *f = fopen(path.c_str(), "rb");
+
+    if (f == NULL)
+    {
+        failures++;
+        printf("%s: missing golden file\n", path.c_str());
+        return false;
+    }
+
+    int16_t sample;
+
+    while (fread(&sample, sizeof(int16_t), 1, f) == 1)
+        expected.push_back(sample);
+
+    fclose(f);
+
+    if (expected.size() != samples.size())
+    {
+        failures++;
+        printf("%s: %d samples generated, expected %d\n", path.c_str(), (int) samples.size(), (int) expected.size());
+        return false;
+    }
+
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        if (abs(samples[i] - expected[i]) > tolerance)
+        {
+            failures++;
+            printf("%s: sample %d is %d, expected %d\n", path.c_str(), (int) i, samples[i], expected[i]);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void test_append_samples(std::vector<int16_t> &samples, codal::ManagedBuffer buffer, int format)
+{
+    int bytesPerSample = DATASTREAM_FORMAT_BYTES_PER_SAMPLE(format);
+
+    for (int i = 0; i + bytesPerSample <= buffer.length(); i += bytesPerSample)
+    {
+        switch (format)
+        {
+            case DATASTREAM_FORMAT_8BIT_UNSIGNED:
+                samples.push_back(buffer[i]);
+                break;
+
+            case DATASTREAM_FORMAT_8BIT_SIGNED:
+                samples.push_back((int8_t) buffer[i]);
+                break;
+
+            case DATASTREAM_FORMAT_16BIT_UNSIGNED:
+                samples.push_back((int16_t) (buffer[i] | buffer[i + 1] << 8));
+                break;
+
+            default:
+                samples.push_back((int16_t) (buffer[i] | buffer[i + 1] << 8));
+                break;
+        }
+    }
+}
+
+void test_put16(std::vector<uint8_t> &v, uint16_t x)
+{
+    v.push_back(x);
+    v.push_back(x >> 8);
+}
+
+void test_put32(std::vector<uint8_t> &v, uint32_t x)
+{
+    test_put16(v, x);
+    test_put16(v, x >> 16);
+}
+
+std::vector<uint8_t> test_wave(int encoding, int channels, int sampleRate, int bitsPerSample, int blockAlign, const std::vector<uint8_t> &data)
+{
+    static const uint8_t list[3] = { 'a', 'b', 'c' };
+    std::vector<uint8_t> f;
+
+    f.insert(f.end(), (const uint8_t *) "RIFF", (const uint8_t *) "RIFF" + 4);
+    test_put32(f, 4 + 24 + 8 + sizeof(list) + 1 + 8 + data.size());
+    f.insert(f.end(), (const uint8_t *) "WAVEfmt ", (const uint8_t *) "WAVEfmt " + 8);
+    test_put32(f, 16);
+    test_put16(f, encoding);
+    test_put16(f, channels);
+    test_put32(f, sampleRate);
+    test_put32(f, sampleRate * blockAlign);
+    test_put16(f, blockAlign);
+    test_put16(f, bitsPerSample);
+
+    f.insert(f.end(), (const uint8_t *) "LIST", (const uint8_t *) "LIST" + 4);
+    test_put32(f, sizeof(list));
+    f.insert(f.end(), list, list + sizeof(list));
+    f.push_back(0);
+
+    f.insert(f.end(), (const uint8_t *) "data", (const uint8_t *) "data" + 4);
+    test_put32(f, data.size());
+    f.insert(f.end(), data.begin(), data.end());
+
+    return f;
+}
+
+double test_clock()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void test_report_throughput(const char *name, uint64_t samples, double seconds)
+{
+    printf("%s: %llu samples in %.3f ms, %.0f samples/sec\n", name, (unsigned long long) samples, seconds * 1000.0, seconds > 0 ? samples / seconds : 0.0);
+}
+
+int test_result()
+{
+    printf("%d checks, %d failed\n", checks, failures);
+
+    return failures ? 1 : 0;
+}
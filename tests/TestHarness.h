@@ -0,0 +1,116 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef TEST_HARNESS_H
+#define TEST_HARNESS_H
+
+#include "HostStubs.h"
+#include "ManagedBuffer.h"
+
+/**
+ * A minimal harness for the host tests.
+ *
+ * Checks record failures and carry on, so that a single run reports everything that is wrong. A test's main()
+ * returns test_result(), which is non-zero if any check failed.
+ *
+ * Golden files hold the expected output of a test as raw 16 bit little endian samples, under tests/golden. They are
+ * rewritten, rather than compared, when the environment variable CODAL_UPDATE_GOLDEN is set.
+ */
+
+#define CHECK(condition)                test_check((condition), #condition, __FILE__, __LINE__)
+#define CHECK_EQUAL(expected, actual)   test_check_equal((long long) (expected), (long long) (actual), #actual, __FILE__, __LINE__)
+
+/**
+ * Records the outcome of a check, reporting it if it failed.
+ *
+ * @return the outcome of the check.
+ */
+bool test_check(bool passed, const char *condition, const char *file, int line);
+
+/**
+ * Records the outcome of a comparison, reporting both values if they differ.
+ *
+ * @return true if the values are equal.
+ */
+bool test_check_equal(long long expected, long long actual, const char *expression, const char *file, int line);
+
+/**
+ * Compares samples with those held in a golden file, allowing each to differ by up to the given tolerance.
+ * Reports the first sample that differs by more, and records a failure.
+ *
+ * @param name The name of the golden file, without its directory or extension.
+ * @param samples The samples to compare.
+ * @param tolerance The largest difference permitted between each sample and its expected value.
+ * @return true if every sample is within tolerance of the golden file.
+ */
+bool test_golden(const char *name, const std::vector<int16_t> &samples, int tolerance);
+
+/**
+ * Appends the samples held in an audio buffer of the given format to a vector, as 16 bit values.
+ */
+void test_append_samples(std::vector<int16_t> &samples, codal::ManagedBuffer buffer, int format);
+
+/**
+ * Appends a 16 or 32 bit value to a vector, in little endian byte order.
+ */
+void test_put16(std::vector<uint8_t> &v, uint16_t x);
+void test_put32(std::vector<uint8_t> &v, uint32_t x);
+
+/**
+ * Builds a WAVE file around the given sample data. An odd sized LIST chunk follows the format chunk, at a fixed offset
+ * of TEST_WAVE_LIST_OFFSET bytes, so that readers must skip it and its padding to find the data.
+ *
+ * @param encoding The encoding of the samples, as held in the format chunk (e.g. 1 for PCM).
+ * @param channels The number of channels.
+ * @param sampleRate The sample rate, in samples per second.
+ * @param bitsPerSample The number of bits in each sample.
+ * @param blockAlign The number of bytes in each block of samples, across all channels.
+ * @param data The sample data.
+ */
+std::vector<uint8_t> test_wave(int encoding, int channels, int sampleRate, int bitsPerSample, int blockAlign, const std::vector<uint8_t> &data);
+
+#define TEST_WAVE_LIST_OFFSET           36
+
+/**
+ * Returns the time since an arbitrary point, in seconds, measured by the host clock.
+ */
+double test_clock();
+
+/**
+ * Reports the rate at which a test processed samples, as measured by the host clock.
+ *
+ * @param name A description of the work measured.
+ * @param samples The number of samples processed.
+ * @param seconds The host time taken, in seconds.
+ */
+void test_report_throughput(const char *name, uint64_t samples, double seconds);
+
+/**
+ * Reports the number of checks made and failed.
+ *
+ * @return 0 if every check passed, or 1 otherwise.
+ */
+int test_result();
+
+#endif
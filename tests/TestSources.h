@@ -0,0 +1,142 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef TEST_SOURCES_H
+#define TEST_SOURCES_H
+
+#include "DataStream.h"
+#include "ErrorNo.h"
+
+#include <math.h>
+
+#define TEST_BUFFER_SAMPLES     256
+#define TEST_SOURCE_BUFFERS     64
+
+/**
+ * A source of sine waves, in any 8, 16 or 24 bit format, with each buffer ready as soon as the last is pulled.
+ * The buffers are generated in advance, so that pulling them costs next to nothing when benchmarking. After
+ * TEST_SOURCE_BUFFERS buffers the source repeats itself.
+ */
+class TestSineSource : public codal::DataSource
+{
+    codal::DataSink         *sink;
+    int                     format;
+    int                     position;
+    codal::ManagedBuffer    buffers[TEST_SOURCE_BUFFERS];
+
+    public:
+
+    /**
+     * Constructor.
+     *
+     * @param format The format of the samples generated (e.g. DATASTREAM_FORMAT_16BIT_UNSIGNED).
+     * @param step The change in phase from one sample to the next, in radians.
+     * @param amplitude The peak deviation of the wave from its midpoint.
+     * @param midpoint The value the wave is centred on.
+     * @param shift A left shift applied to every sample, to represent the same wave at a higher resolution.
+     */
+    TestSineSource(int format, double step, int amplitude, int midpoint, int shift = 0)
+    {
+        int bytesPerSample = DATASTREAM_FORMAT_BYTES_PER_SAMPLE(format);
+
+        this->sink = NULL;
+        this->format = format;
+        this->position = 0;
+
+        for (int n = 0; n < TEST_SOURCE_BUFFERS; n++)
+        {
+            buffers[n] = codal::ManagedBuffer(TEST_BUFFER_SAMPLES * bytesPerSample);
+
+            for (int i = 0; i < TEST_BUFFER_SAMPLES; i++)
+            {
+                uint32_t v = (uint32_t) (midpoint + (int) lround(amplitude * sin((n * TEST_BUFFER_SAMPLES + i) * step))) << shift;
+
+                for (int j = 0; j < bytesPerSample; j++)
+                    buffers[n][i * bytesPerSample + j] = v >> (8 * j);
+            }
+        }
+    }
+
+    virtual void connect(codal::DataSink &sink)
+    {
+        this->sink = &sink;
+        sink.pullRequest();
+    }
+
+    virtual void disconnect()
+    {
+        this->sink = NULL;
+    }
+
+    virtual int getFormat()
+    {
+        return format;
+    }
+
+    virtual codal::ManagedBuffer pull()
+    {
+        codal::ManagedBuffer b = buffers[position++ % TEST_SOURCE_BUFFERS];
+
+        if (sink)
+            sink->pullRequest();
+
+        return b;
+    }
+};
+
+/**
+ * A sink that does nothing when data is ready; the test pulls from its source explicitly.
+ */
+class TestNullSink : public codal::DataSink
+{
+    public:
+
+    virtual int pullRequest()
+    {
+        return DEVICE_OK;
+    }
+};
+
+/**
+ * A sink counting the pull requests it receives; the test pulls from its source explicitly.
+ */
+class TestCountingSink : public codal::DataSink
+{
+    public:
+
+    int requests;
+
+    TestCountingSink()
+    {
+        this->requests = 0;
+    }
+
+    virtual int pullRequest()
+    {
+        requests++;
+        return DEVICE_OK;
+    }
+};
+
+#endif
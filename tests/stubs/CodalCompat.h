@@ -0,0 +1,24 @@
+/*
+ * Host stand-in for codal-core's CodalCompat.h.
+ */
+
+#ifndef CODAL_COMPAT_H
+#define CODAL_COMPAT_H
+
+#include "CodalConfig.h"
+
+#define PI 3.14159265359
+
+template <typename T> inline T min(T a, T b) { return a < b ? a : b; }
+template <typename T> inline T max(T a, T b) { return a > b ? a : b; }
+
+inline int min(int a, float b) { return a < b ? a : (int) b; }
+
+namespace codal
+{
+    int random(int max);
+}
+
+using codal::random;
+
+#endif
@@ -0,0 +1,56 @@
+/*
+ * Host stand-in for codal-core's CodalComponent.h.
+ * Components register themselves as on the target, and HostStubs calls the idleCallback() of those
+ * flagged with DEVICE_COMPONENT_STATUS_IDLE_TICK whenever every fiber is blocked.
+ */
+
+#ifndef CODAL_COMPONENT_H
+#define CODAL_COMPONENT_H
+
+#include "CodalConfig.h"
+#include "CodalFiber.h"
+
+#define DEVICE_COMPONENT_COUNT 60
+
+namespace codal
+{
+    class CodalComponent
+    {
+        protected:
+
+        void addComponent();
+        void removeComponent();
+
+        public:
+
+        static CodalComponent *components[DEVICE_COMPONENT_COUNT];
+
+        uint16_t id;
+        uint16_t status;
+
+        CodalComponent()
+        {
+            this->id = 0;
+            this->status = 0;
+            addComponent();
+        }
+
+        CodalComponent(uint16_t id, uint8_t status)
+        {
+            this->id = id;
+            this->status = status;
+            addComponent();
+        }
+
+        virtual int init() { return DEVICE_OK; }
+        virtual void periodicCallback() {}
+        virtual void idleCallback() {}
+
+        virtual ~CodalComponent()
+        {
+            removeComponent();
+        }
+    };
+}
+
+#endif
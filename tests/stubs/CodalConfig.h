@@ -0,0 +1,41 @@
+/*
+ * Host stand-in for codal-core's CodalConfig.h.
+ * Provides the configuration macros, device identifiers and platform services used by the sources under test.
+ */
+
+#ifndef CODAL_CONFIG_H
+#define CODAL_CONFIG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define CONFIG_ENABLED(X)                   (X == 1)
+#define CONFIG_DISABLED(X)                  (X != 1)
+
+#define CODAL_TIMESTAMP                     uint64_t
+#define PROCESSOR_WORD_TYPE                 uint32_t
+
+// Device identifiers, as per CodalComponent.h.
+#define DEVICE_ID_ANY                       0
+#define DEVICE_ID_RADIO                     9
+#define DEVICE_ID_RADIO_DATA_READY          10
+#define DEVICE_ID_NOTIFY_ONE                1022
+#define DEVICE_ID_NOTIFY                    1023
+
+#define DEVICE_EVT_ANY                      0
+
+// Component status flags, as per CodalComponent.h.
+#define DEVICE_COMPONENT_RUNNING            0x1000
+#define DEVICE_COMPONENT_STATUS_SYSTEM_TICK 0x2000
+#define DEVICE_COMPONENT_STATUS_IDLE_TICK   0x4000
+
+#include "CodalCompat.h"
+#include "ErrorNo.h"
+
+uint32_t system_timer_current_time();
+uint64_t system_timer_current_time_us();
+
+#endif
@@ -0,0 +1,21 @@
+/*
+ * Host stand-in for codal-core's CodalDevice.h.
+ */
+
+#ifndef CODAL_DEVICE_H
+#define CODAL_DEVICE_H
+
+#include "CodalConfig.h"
+
+namespace codal
+{
+    class CodalDevice
+    {
+        public:
+        virtual ~CodalDevice() {}
+        virtual void seedRandom() {}
+        virtual int seedRandom(uint32_t) { return DEVICE_OK; }
+    };
+}
+
+#endif
@@ -0,0 +1,13 @@
+/*
+ * Host stand-in for codal-core's CodalDmesg.h. Debug output is discarded.
+ */
+
+#ifndef CODAL_DMESG_H
+#define CODAL_DMESG_H
+
+#include "CodalConfig.h"
+
+#define DMESG(...)  ((void) 0)
+#define DMESGF(...) ((void) 0)
+
+#endif
@@ -0,0 +1,42 @@
+/*
+ * Host stand-in for codal-core's CodalFiber.h.
+ * HostStubs implements cooperative fibers on ucontext, scheduled against the simulated clock. The test's main
+ * thread of execution is itself a fiber, so any of these may be called from it.
+ */
+
+#ifndef CODAL_FIBER_H
+#define CODAL_FIBER_H
+
+#include "CodalConfig.h"
+#include "Event.h"
+
+namespace codal
+{
+    struct Fiber;
+
+    class FiberLock
+    {
+        bool locked;
+        Fiber *queue;
+
+        public:
+
+        FiberLock();
+        void wait();
+        void notify();
+        void notifyAll();
+        int getWaitCount();
+    };
+
+    Fiber *create_fiber(void (*entry_fn)(void), void (*completion_fn)(void) = NULL);
+    Fiber *create_fiber(void (*entry_fn)(void *), void *param, void (*completion_fn)(void *) = NULL);
+    void release_fiber(void);
+
+    void schedule();
+    void fiber_sleep(unsigned long t);
+    int fiber_wait_for_event(uint16_t id, uint16_t value);
+    int fiber_wake_on_event(uint16_t id, uint16_t value);
+    int fiber_scheduler_running();
+}
+
+#endif
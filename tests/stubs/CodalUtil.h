@@ -0,0 +1,10 @@
+/*
+ * Host stand-in for codal-core's CodalUtil.h.
+ */
+
+#ifndef CODAL_UTIL_H
+#define CODAL_UTIL_H
+
+#include "CodalConfig.h"
+
+#endif
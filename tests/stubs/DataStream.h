@@ -0,0 +1,65 @@
+/*
+ * Host stand-in for codal-core's DataStream.h.
+ */
+
+#ifndef CODAL_DATA_STREAM_H
+#define CODAL_DATA_STREAM_H
+
+#include "CodalConfig.h"
+#include "ManagedBuffer.h"
+#include "CodalComponent.h"
+
+#define DATASTREAM_FORMAT_UNKNOWN           0
+#define DATASTREAM_FORMAT_8BIT_UNSIGNED     1
+#define DATASTREAM_FORMAT_8BIT_SIGNED       2
+#define DATASTREAM_FORMAT_16BIT_UNSIGNED    3
+#define DATASTREAM_FORMAT_16BIT_SIGNED      4
+#define DATASTREAM_FORMAT_24BIT_UNSIGNED    5
+#define DATASTREAM_FORMAT_24BIT_SIGNED      6
+#define DATASTREAM_FORMAT_32BIT_UNSIGNED    7
+#define DATASTREAM_FORMAT_32BIT_SIGNED      8
+
+#define DATASTREAM_FORMAT_BYTES_PER_SAMPLE(x) ((x+1)/2)
+
+namespace codal
+{
+    class DataSink
+    {
+        public:
+        virtual ~DataSink() {}
+        virtual int pullRequest();
+    };
+
+    class DataSource
+    {
+        public:
+        virtual ~DataSource() {}
+        virtual ManagedBuffer pull();
+        virtual void connect(DataSink &sink);
+        virtual void disconnect();
+        virtual int getFormat();
+        virtual int setFormat(int format);
+    };
+
+    /**
+     * Passes buffers straight through from an upstream source to a single downstream sink.
+     */
+    class DataStream : public DataSource, public DataSink
+    {
+        DataSource *upStream;
+        DataSink *downStream;
+        ManagedBuffer buffer;
+
+        public:
+
+        DataStream(DataSource &upstream);
+        virtual ManagedBuffer pull();
+        virtual int pullRequest();
+        virtual void connect(DataSink &sink);
+        virtual void disconnect();
+        virtual int getFormat();
+        virtual int setFormat(int format);
+    };
+}
+
+#endif
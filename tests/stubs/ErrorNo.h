@@ -0,0 +1,27 @@
+/*
+ * Host stand-in for codal-core's ErrorNo.h.
+ */
+
+#ifndef ERROR_NO_H
+#define ERROR_NO_H
+
+enum ErrorCode
+{
+    DEVICE_OK = 0,
+    DEVICE_INVALID_PARAMETER = -1001,
+    DEVICE_NOT_SUPPORTED = -1002,
+    DEVICE_CALIBRATION_IN_PROGRESS = -1003,
+    DEVICE_CALIBRATION_REQUIRED = -1004,
+    DEVICE_NO_RESOURCES = -1005,
+    DEVICE_BUSY = -1006,
+    DEVICE_CANCELLED = -1007,
+    DEVICE_I2C_ERROR = -1010,
+    DEVICE_SERIAL_IN_USE = -1011,
+    DEVICE_NO_DATA = -1012,
+    DEVICE_NOT_IMPLEMENTED = -1013,
+    DEVICE_INVALID_STATE = -1014
+};
+
+#define MICROBIT_NO_DATA DEVICE_NO_DATA
+
+#endif
@@ -0,0 +1,65 @@
+/*
+ * Host stand-in for codal-core's Event.h and EventModel.h.
+ * Events are delivered by HostStubs, which wakes any fiber waiting for them and counts them for the tests.
+ * Listeners are not modelled on the host.
+ */
+
+#ifndef CODAL_EVENT_H
+#define CODAL_EVENT_H
+
+#include "CodalConfig.h"
+
+#define MESSAGE_BUS_LISTENER_REENTRANT          0x0001
+#define MESSAGE_BUS_LISTENER_QUEUE_IF_BUSY      0x0002
+#define MESSAGE_BUS_LISTENER_DROP_IF_BUSY       0x0004
+#define MESSAGE_BUS_LISTENER_IMMEDIATE          0x0010
+
+#define EVENT_LISTENER_DEFAULT_FLAGS            MESSAGE_BUS_LISTENER_QUEUE_IF_BUSY
+
+namespace codal
+{
+    enum EventLaunchMode
+    {
+        CREATE_ONLY,
+        CREATE_AND_FIRE
+    };
+
+    class Event
+    {
+        public:
+
+        uint16_t source;
+        uint16_t value;
+        CODAL_TIMESTAMP timestamp;
+
+        Event(uint16_t source, uint16_t value, EventLaunchMode mode = CREATE_AND_FIRE);
+        Event();
+
+        void fire();
+    };
+
+    class EventModel
+    {
+        public:
+
+        static EventModel *defaultEventBus;
+
+        virtual ~EventModel() {}
+
+        virtual int send(Event evt);
+
+        template <typename T>
+        int listen(uint16_t, uint16_t, T *, void (T::*)(Event), uint16_t = EVENT_LISTENER_DEFAULT_FLAGS)
+        {
+            return DEVICE_NOT_SUPPORTED;
+        }
+
+        template <typename T>
+        int ignore(uint16_t, uint16_t, T *, void (T::*)(Event))
+        {
+            return DEVICE_NOT_SUPPORTED;
+        }
+    };
+}
+
+#endif
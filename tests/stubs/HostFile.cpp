@@ -0,0 +1,238 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * A host implementation of MicroBitFile, over an in-memory file system.
+ */
+
+#include "HostStubs.h"
+#include "MicroBitFile.h"
+#include "ErrorNo.h"
+
+#include <map>
+#include <string>
+
+#define HOST_MAX_OPEN_FILES     8
+
+struct HostOpenFile
+{
+    std::string     name;
+    int             position;
+    bool            open;
+};
+
+static std::map<std::string, std::vector<uint8_t> > files;
+static HostOpenFile openFiles[HOST_MAX_OPEN_FILES];
+
+void host_file_write(const char *name, const void *data, int length)
+{
+    files[name].assign((const uint8_t *) data, (const uint8_t *) data + length);
+}
+
+bool host_file_read(const char *name, std::vector<uint8_t> &data)
+{
+    std::map<std::string, std::vector<uint8_t> >::iterator f = files.find(name);
+
+    if (f == files.end())
+        return false;
+
+    data = f->second;
+    return true;
+}
+
+MicroBitFile::MicroBitFile(ManagedString fileName, int mode)
+{
+    this->fileName = fileName;
+    this->fileHandle = DEVICE_NO_RESOURCES;
+
+    if (files.find(fileName.toCharArray()) == files.end())
+    {
+        if (!(mode & MB_CREAT))
+        {
+            fileHandle = DEVICE_INVALID_PARAMETER;
+            return;
+        }
+
+        files[fileName.toCharArray()];
+    }
+
+    for (int i = 0; i < HOST_MAX_OPEN_FILES; i++)
+    {
+        if (!openFiles[i].open)
+        {
+            openFiles[i].name = fileName.toCharArray();
+            openFiles[i].position = 0;
+            openFiles[i].open = true;
+            fileHandle = i;
+            return;
+        }
+    }
+}
+
+int MicroBitFile::setPosition(int position)
+{
+    if (fileHandle < 0)
+        return DEVICE_NOT_SUPPORTED;
+
+    if (position < 0 || position > (int) files[openFiles[fileHandle].name].size())
+        return DEVICE_INVALID_PARAMETER;
+
+    openFiles[fileHandle].position = position;
+
+    return position;
+}
+
+int MicroBitFile::getPosition()
+{
+    if (fileHandle < 0)
+        return DEVICE_NOT_SUPPORTED;
+
+    return openFiles[fileHandle].position;
+}
+
+int MicroBitFile::write(const char *bytes, int len)
+{
+    if (fileHandle < 0)
+        return DEVICE_NOT_SUPPORTED;
+
+    std::vector<uint8_t> &data = files[openFiles[fileHandle].name];
+    int &position = openFiles[fileHandle].position;
+
+    if (position + len > (int) data.size())
+        data.resize(position + len);
+
+    memcpy(&data[0] + position, bytes, len);
+    position += len;
+
+    return len;
+}
+
+int MicroBitFile::write(ManagedString s)
+{
+    return write(s.toCharArray(), s.length());
+}
+
+int MicroBitFile::read()
+{
+    char c;
+    int ret = read(&c, 1);
+
+    if (ret > 0)
+        return c;
+
+    return ret < 0 ? ret : DEVICE_NO_DATA;
+}
+
+int MicroBitFile::read(char *buffer, int size)
+{
+    if (fileHandle < 0)
+        return DEVICE_NOT_SUPPORTED;
+
+    if (size < 0 || buffer == NULL)
+        return DEVICE_INVALID_PARAMETER;
+
+    std::vector<uint8_t> &data = files[openFiles[fileHandle].name];
+    int &position = openFiles[fileHandle].position;
+    int length = min(size, (int) data.size() - position);
+
+    if (length > 0)
+        memcpy(buffer, &data[0] + position, length);
+
+    position += length;
+
+    return length;
+}
+
+ManagedString MicroBitFile::read(int size)
+{
+    std::vector<char> buffer(size + 1);
+    int ret = read(&buffer[0], size);
+
+    if (ret < 0)
+        return ManagedString();
+
+    return ManagedString(&buffer[0], ret);
+}
+
+int MicroBitFile::remove()
+{
+    if (fileHandle >= 0)
+        close();
+
+    if (files.erase(fileName.toCharArray()) == 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    fileHandle = DEVICE_NOT_SUPPORTED;
+
+    return DEVICE_OK;
+}
+
+int MicroBitFile::append(const char *bytes, int len)
+{
+    if (fileHandle < 0)
+        return DEVICE_NOT_SUPPORTED;
+
+    openFiles[fileHandle].position = files[openFiles[fileHandle].name].size();
+
+    return write(bytes, len);
+}
+
+int MicroBitFile::append(ManagedString s)
+{
+    return append(s.toCharArray(), s.length());
+}
+
+bool MicroBitFile::isValid()
+{
+    return fileHandle >= 0;
+}
+
+int MicroBitFile::getHandle()
+{
+    return fileHandle;
+}
+
+int MicroBitFile::close()
+{
+    if (fileHandle < 0)
+        return DEVICE_NOT_SUPPORTED;
+
+    openFiles[fileHandle].open = false;
+    fileHandle = DEVICE_NO_RESOURCES;
+
+    return DEVICE_OK;
+}
+
+int MicroBitFile::flush()
+{
+    if (fileHandle < 0)
+        return DEVICE_NOT_SUPPORTED;
+
+    return DEVICE_OK;
+}
+
+MicroBitFile::~MicroBitFile()
+{
+    close();
+}
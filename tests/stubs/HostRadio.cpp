@@ -0,0 +1,258 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * A host simulation of the nRF52 RADIO peripheral, sufficient for MicroBitRadio and its protocols.
+ */
+
+#include "HostRadio.h"
+
+using namespace codal;
+
+#define HOST_RADIO_DISABLED     0
+#define HOST_RADIO_RX_IDLE      1
+#define HOST_RADIO_RX           2
+#define HOST_RADIO_TX           3
+
+struct HostRadioNode
+{
+    NRF_RADIO_Type  registers;                      // The peripheral registers of this node.
+    MicroBitRadio   *radio;                         // The radio attached to this node, if any.
+    int             state;                          // The state of the transceiver (HOST_RADIO_*).
+    uint32_t        transmissions;                  // The number of frames transmitted.
+    FrameBuffer     frame;                          // The frame being transmitted.
+};
+
+struct HostRadioLink
+{
+    bool            disconnected;
+    float           loss;
+};
+
+static HostRadioNode radioNodes[HOST_MAX_NODES];
+static HostRadioLink links[HOST_MAX_NODES][HOST_MAX_NODES];
+static bool initialised = false;
+
+NRF_RADIO_Type *NRF_RADIO = &radioNodes[0].registers;
+
+extern "C" void RADIO_IRQHandler(void);
+
+/**
+ * Recovers the buffer addressed by PACKETPTR, which holds only the low 32 bits of its address.
+ * Every frame buffer is a member of the radio, so the high bits are those of the radio itself.
+ */
+static FrameBuffer *packetBuffer(HostRadioNode &n)
+{
+    return (FrameBuffer *) (((uintptr_t) n.radio & ~(uintptr_t) 0xffffffff) | n.registers.PACKETPTR);
+}
+
+/**
+ * Raises the RADIO interrupt on the given node, if the event is enabled.
+ */
+static void raise(int node, uint32_t mask)
+{
+    if (!(radioNodes[node].registers.INTENSET & mask))
+        return;
+
+    int current = host_current_node();
+
+    host_select_node(node);
+    NVIC_SetPendingIRQ(RADIO_IRQn);
+    host_select_node(current);
+}
+
+/**
+ * Completes the reception of a frame on the given node, as the hardware does at the END event.
+ */
+static void receive(int node, const FrameBuffer &frame)
+{
+    HostRadioNode &n = radioNodes[node];
+    int length = min((int) frame.length, MICROBIT_RADIO_MAX_PACKET_SIZE + MICROBIT_RADIO_HEADER_SIZE - 1);
+
+    memcpy(packetBuffer(n), &frame, length + 1);
+    packetBuffer(n)->length = length;
+
+    n.registers.RSSISAMPLE = HOST_RADIO_RSSI;
+    n.registers.CRCSTATUS = 1;
+    n.registers.EVENTS_END = 1;
+    n.state = HOST_RADIO_RX_IDLE;
+
+    raise(node, RADIO_INTENSET_END_Msk);
+}
+
+/**
+ * Completes a transmission: delivers the frame to every node in range, then disables the transmitter.
+ */
+static void transmitted(void *context)
+{
+    int sender = (int) (intptr_t) context;
+    HostRadioNode &s = radioNodes[sender];
+
+    for (int i = 0; i < HOST_MAX_NODES; i++)
+    {
+        HostRadioNode &r = radioNodes[i];
+
+        if (i == sender || r.radio == NULL || r.state != HOST_RADIO_RX || links[sender][i].disconnected)
+            continue;
+
+        if (r.registers.FREQUENCY != s.registers.FREQUENCY || r.registers.BASE0 != s.registers.BASE0 || r.registers.PREFIX0 != s.registers.PREFIX0)
+            continue;
+
+        if (links[sender][i].loss > 0 && rand() < links[sender][i].loss * ((float) RAND_MAX + 1))
+            continue;
+
+        receive(i, s.frame);
+    }
+
+    s.transmissions++;
+    s.registers.EVENTS_END = 1;
+
+    if (s.registers.SHORTS & RADIO_SHORTS_END_DISABLE_Msk)
+    {
+        s.state = HOST_RADIO_DISABLED;
+        s.registers.EVENTS_DISABLED = 1;
+        raise(sender, RADIO_INTENSET_END_Msk | RADIO_INTENSET_DISABLED_Msk);
+    }
+    else
+    {
+        raise(sender, RADIO_INTENSET_END_Msk);
+    }
+}
+
+/**
+ * Performs a task triggered on the current node.
+ */
+static void task(HostPeripheralTask task)
+{
+    int node = host_current_node();
+    HostRadioNode &n = radioNodes[node];
+
+    switch (task)
+    {
+        case HOST_TASK_RADIO_RXEN:
+            n.registers.EVENTS_READY = 1;
+            n.state = (n.registers.SHORTS & RADIO_SHORTS_READY_START_Msk) ? HOST_RADIO_RX : HOST_RADIO_RX_IDLE;
+            break;
+
+        case HOST_TASK_RADIO_TXEN:
+            // The frame is sampled at the start of transmission, which is close enough to TXEN to treat as the same.
+            n.registers.EVENTS_READY = 1;
+            n.state = HOST_RADIO_TX;
+            memcpy(&n.frame, packetBuffer(n), sizeof(FrameBuffer));
+            host_schedule(host_time() + HOST_RADIO_TX_DELAY + (n.frame.length + HOST_RADIO_FRAME_OVERHEAD) * 8, transmitted, (void *) (intptr_t) node);
+            break;
+
+        case HOST_TASK_RADIO_START:
+            if (n.state == HOST_RADIO_RX_IDLE)
+                n.state = HOST_RADIO_RX;
+            break;
+
+        case HOST_TASK_RADIO_STOP:
+            if (n.state == HOST_RADIO_RX)
+                n.state = HOST_RADIO_RX_IDLE;
+            break;
+
+        case HOST_TASK_RADIO_DISABLE:
+            host_cancel(transmitted, (void *) (intptr_t) node);
+            n.state = HOST_RADIO_DISABLED;
+            n.registers.EVENTS_DISABLED = 1;
+            raise(node, RADIO_INTENSET_DISABLED_Msk);
+            break;
+
+        default:
+            break;
+    }
+}
+
+/**
+ * Switches the peripheral registers and radio instance seen by the code under test when the current node changes.
+ */
+static void nodeChanged(int node)
+{
+    NRF_RADIO = &radioNodes[node].registers;
+
+    if (radioNodes[node].radio)
+        MicroBitRadio::instance = radioNodes[node].radio;
+}
+
+/**
+ * Attaches a radio to the simulated peripheral of the current node.
+ */
+void host_radio_attach(MicroBitRadio &radio)
+{
+    // PACKETPTR can only address buffers that share the high half of their address with the radio.
+    if (((uintptr_t) &radio >> 32) != ((uintptr_t) (&radio + 1) >> 32))
+        abort();
+
+    if (!initialised)
+    {
+        host_set_node_listener(nodeChanged);
+        host_set_task_handler(task);
+        host_set_irq_handler(RADIO_IRQn, RADIO_IRQHandler);
+        initialised = true;
+    }
+
+    radioNodes[host_current_node()].radio = &radio;
+    nodeChanged(host_current_node());
+}
+
+/**
+ * Configures the link from one node to another. All nodes are linked, without loss, by default.
+ *
+ * @param from The transmitting node.
+ * @param to The receiving node.
+ * @param connected true if frames transmitted by the first node can reach the second.
+ * @param loss The probability of each frame being lost, from 0 to 1.
+ */
+void host_radio_set_link(int from, int to, bool connected, float loss)
+{
+    links[from][to].disconnected = !connected;
+    links[from][to].loss = loss;
+}
+
+/**
+ * Delivers a frame to the current node as though it had just been received, and takes the RADIO interrupt.
+ * May be called from another thread, to model the interrupt preempting the code under test.
+ *
+ * @return true if the frame was received, or false if the radio was not listening.
+ */
+bool host_radio_receive(const FrameBuffer &frame)
+{
+    int node = host_current_node();
+
+    if (radioNodes[node].state != HOST_RADIO_RX)
+        return false;
+
+    receive(node, frame);
+
+    return true;
+}
+
+/**
+ * Determines the number of frames the given node has transmitted.
+ */
+uint32_t host_radio_get_transmissions(int node)
+{
+    return radioNodes[node].transmissions;
+}
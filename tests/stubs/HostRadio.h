@@ -0,0 +1,78 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef HOST_RADIO_H
+#define HOST_RADIO_H
+
+#include "HostStubs.h"
+#include "MicroBitRadio.h"
+
+/**
+ * Simulates the RADIO peripheral of each node, and the air between them.
+ *
+ * Transmissions take HOST_RADIO_TX_DELAY to start, then occupy the air for the length of the frame and its
+ * overhead at 1Mbit/s. Every node that is listening on the same frequency, address and group, and that has a link
+ * from the transmitter, then receives the frame and takes its RADIO interrupt. Frames are never corrupted by
+ * collisions: concurrent transmissions of the same flood are modelled as interfering constructively, as they do
+ * in practice.
+ */
+
+// The time from TXEN to the start of the frame: the transmitter ramp up, and interrupt latency.
+#define HOST_RADIO_TX_DELAY             MICROBIT_RADIO_FLOOD_RELAY_DELAY
+
+// The bytes sent on air in addition to the frame: preamble, address, length and CRC.
+#define HOST_RADIO_FRAME_OVERHEAD       MICROBIT_RADIO_FLOOD_FRAME_OVERHEAD
+
+// The RSSI reported for every frame received.
+#define HOST_RADIO_RSSI                 60
+
+/**
+ * Attaches a radio to the simulated peripheral of the current node.
+ */
+void host_radio_attach(codal::MicroBitRadio &radio);
+
+/**
+ * Configures the link from one node to another. All nodes are linked, without loss, by default.
+ *
+ * @param from The transmitting node.
+ * @param to The receiving node.
+ * @param connected true if frames transmitted by the first node can reach the second.
+ * @param loss The probability of each frame being lost, from 0 to 1.
+ */
+void host_radio_set_link(int from, int to, bool connected, float loss = 0.0f);
+
+/**
+ * Delivers a frame to the current node as though it had just been received, and takes the RADIO interrupt.
+ * May be called from another thread, to model the interrupt preempting the code under test.
+ *
+ * @return true if the frame was received, or false if the radio was not listening.
+ */
+bool host_radio_receive(const codal::FrameBuffer &frame);
+
+/**
+ * Determines the number of frames the given node has transmitted.
+ */
+uint32_t host_radio_get_transmissions(int node);
+
+#endif
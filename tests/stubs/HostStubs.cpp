@@ -0,0 +1,1050 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * Host implementations of the codal-core, codal-nrf52 and micro:bit services used by the sources under test,
+ * and the simulated runtime described in HostStubs.h.
+ */
+
+#include "HostStubs.h"
+#include "CodalComponent.h"
+#include "CodalFiber.h"
+#include "DataStream.h"
+#include "Event.h"
+#include "ManagedString.h"
+#include "MicroBitAudio.h"
+#include "MicroBitDevice.h"
+#include "StreamNormalizer.h"
+#include "Synthesizer.h"
+#include "codal_target_hal.h"
+
+#include <stdio.h>
+#include <ucontext.h>
+#include <map>
+
+using namespace codal;
+
+#define HOST_FIBER_STACK_SIZE   (256 * 1024)
+
+// The period of the scheduler tick, which wakes the idle loop even when nothing else is due, in microseconds.
+#define HOST_IDLE_TICK          4000
+
+// The simulated time for which nothing may be due before the scheduler reports a deadlock, in microseconds.
+#define HOST_DEADLOCK_TIME      (600 * 1000000ULL)
+
+/*
+ * Nodes and interrupts.
+ */
+
+struct HostNode
+{
+    uint32_t    serial;                             // The serial number of the device.
+    int64_t     clockOffset;                        // The offset of the device's system timer from simulated time.
+    int         irqDisabled;                        // The depth of nested target_disable_irq() calls.
+    int         activeIrq;                          // The interrupt being handled, or -1 in thread mode.
+    bool        enabled[HOST_IRQ_COUNT];            // Interrupts enabled in the NVIC.
+    bool        pending[HOST_IRQ_COUNT];            // Interrupts pending in the NVIC.
+};
+
+static HostNode nodes[HOST_MAX_NODES] = { { 0x12345678, 0, 0, -1, {}, {} } };
+static int nodeCount = 1;
+static int currentNode = 0;
+
+static void (*nodeListener)(int node) = NULL;
+static void (*irqHandlers[HOST_IRQ_COUNT])(void);
+static void (*taskHandler)(HostPeripheralTask task) = NULL;
+
+static uint64_t hostTime = 0;
+
+static NRF_CLOCK_Type clockRegisters;
+static NRF_FICR_Type ficrRegisters = { 4096, 128, { 0x12345678, 0 } };
+static NRF_UICR_Type uicrRegisters;
+static NRF_PWM_Type pwmRegisters[2];
+static DWT_Type dwtRegisters;
+static CoreDebug_Type coreDebugRegisters;
+
+NRF_CLOCK_Type *NRF_CLOCK = &clockRegisters;
+NRF_FICR_Type *NRF_FICR = &ficrRegisters;
+NRF_UICR_Type *NRF_UICR = &uicrRegisters;
+NRF_PWM_Type *NRF_PWM0 = &pwmRegisters[0];
+NRF_PWM_Type *NRF_PWM1 = &pwmRegisters[1];
+DWT_Type *DWT = &dwtRegisters;
+CoreDebug_Type *CoreDebug = &coreDebugRegisters;
+uint32_t SystemCoreClock = 64000000;
+
+/**
+ * Runs the handlers of any enabled, pending interrupts on the current node, unless they are masked
+ * or an interrupt is already being handled.
+ */
+static void serviceInterrupts()
+{
+    HostNode &n = nodes[currentNode];
+    bool serviced = true;
+
+    while (serviced && n.irqDisabled == 0 && n.activeIrq < 0)
+    {
+        serviced = false;
+
+        for (int i = 0; i < HOST_IRQ_COUNT; i++)
+        {
+            if (n.pending[i] && n.enabled[i] && irqHandlers[i])
+            {
+                n.pending[i] = false;
+                n.activeIrq = i;
+                irqHandlers[i]();
+                n.activeIrq = -1;
+                serviced = true;
+                break;
+            }
+        }
+    }
+}
+
+uint64_t host_time()
+{
+    return hostTime;
+}
+
+int host_create_node(uint32_t serial, int64_t clockOffset)
+{
+    if (nodeCount == HOST_MAX_NODES)
+        return DEVICE_NO_RESOURCES;
+
+    HostNode &n = nodes[nodeCount];
+    memset(&n, 0, sizeof(HostNode));
+    n.serial = serial;
+    n.clockOffset = clockOffset;
+    n.activeIrq = -1;
+
+    return nodeCount++;
+}
+
+void host_select_node(int node)
+{
+    if (node == currentNode)
+        return;
+
+    currentNode = node;
+
+    if (nodeListener)
+        nodeListener(node);
+}
+
+int host_current_node()
+{
+    return currentNode;
+}
+
+void host_set_node_listener(void (*listener)(int node))
+{
+    nodeListener = listener;
+}
+
+void host_set_irq_handler(IRQn_Type irq, void (*handler)(void))
+{
+    irqHandlers[irq] = handler;
+}
+
+void host_set_task_handler(void (*handler)(HostPeripheralTask task))
+{
+    taskHandler = handler;
+}
+
+void host_peripheral_task(HostPeripheralTask task)
+{
+    // The high frequency clock starts immediately.
+    if (task == HOST_TASK_HFCLKSTART)
+    {
+        NRF_CLOCK->EVENTS_HFCLKSTARTED = 1;
+        return;
+    }
+
+    if (taskHandler)
+        taskHandler(task);
+}
+
+void NVIC_EnableIRQ(IRQn_Type irq)
+{
+    nodes[currentNode].enabled[irq] = true;
+    serviceInterrupts();
+}
+
+void NVIC_DisableIRQ(IRQn_Type irq)
+{
+    nodes[currentNode].enabled[irq] = false;
+}
+
+void NVIC_SetPendingIRQ(IRQn_Type irq)
+{
+    nodes[currentNode].pending[irq] = true;
+    serviceInterrupts();
+}
+
+void NVIC_ClearPendingIRQ(IRQn_Type irq)
+{
+    nodes[currentNode].pending[irq] = false;
+}
+
+void NVIC_SetPriority(IRQn_Type, uint32_t)
+{
+}
+
+uint32_t __get_IPSR(void)
+{
+    return nodes[currentNode].activeIrq < 0 ? 0 : nodes[currentNode].activeIrq + 16;
+}
+
+void target_disable_irq()
+{
+    nodes[currentNode].irqDisabled++;
+}
+
+void target_enable_irq()
+{
+    HostNode &n = nodes[currentNode];
+
+    if (n.irqDisabled > 0 && --n.irqDisabled == 0)
+        serviceInterrupts();
+}
+
+void target_wait_for_event()
+{
+}
+
+void target_reset()
+{
+    fprintf(stderr, "target_reset() called\n");
+    abort();
+}
+
+uint32_t system_timer_current_time()
+{
+    return (uint32_t) (system_timer_current_time_us() / 1000);
+}
+
+uint64_t system_timer_current_time_us()
+{
+    return hostTime + nodes[currentNode].clockOffset;
+}
+
+namespace codal
+{
+    int random(int max)
+    {
+        return max <= 0 ? 0 : rand() % max;
+    }
+
+    int microbit_random(int max)
+    {
+        return random(max);
+    }
+
+    uint32_t microbit_serial_number()
+    {
+        return nodes[currentNode].serial;
+    }
+
+    bool ble_running()
+    {
+        return false;
+    }
+}
+
+/*
+ * Fibers, timers and events.
+ */
+
+#define HOST_FIBER_RUNNABLE         0
+#define HOST_FIBER_SLEEPING         1
+#define HOST_FIBER_WAITING_EVENT    2
+#define HOST_FIBER_WAITING_LOCK     3
+#define HOST_FIBER_COMPLETE         4
+
+namespace codal
+{
+    struct Fiber
+    {
+        ucontext_t  context;
+        char        *stack;                         // The fiber's stack, or NULL for the main fiber.
+        int         node;                           // The node the fiber runs on.
+        int         state;                          // HOST_FIBER_*
+        uint64_t    wakeTime;                       // The simulated time at which a sleeping fiber becomes runnable.
+        uint16_t    waitSource;                     // The event a waiting fiber is blocked on.
+        uint16_t    waitValue;
+        Fiber       *next;                          // The next fiber queued on the same FiberLock.
+        void        (*entry)(void *);
+        void        *param;
+        void        (*completion)(void *);
+    };
+}
+
+struct HostTimer
+{
+    uint64_t    time;
+    int         node;
+    void        (*callback)(void *);
+    void        *context;
+};
+
+static Fiber mainFiber;
+static Fiber *currentFiber = NULL;
+static std::vector<Fiber *> fibers;
+static std::vector<HostTimer> timers;
+static std::map<uint32_t, uint32_t> eventCounts;
+static int componentNodes[DEVICE_COMPONENT_COUNT];
+static uint64_t idleSince = UINT64_MAX;                 // The time from which nothing has been due, or UINT64_MAX.
+
+static void initScheduler()
+{
+    if (currentFiber)
+        return;
+
+    mainFiber.state = HOST_FIBER_RUNNABLE;
+    currentFiber = &mainFiber;
+    fibers.push_back(&mainFiber);
+}
+
+static void launchFiber()
+{
+    Fiber *f = currentFiber;
+
+    f->entry(f->param);
+
+    if (f->completion)
+        f->completion(f->param);
+
+    release_fiber();
+}
+
+static void launchVoidFiber(void *entry)
+{
+    ((void (*)(void)) entry)();
+}
+
+static bool isRunnable(Fiber *f)
+{
+    if (f->state == HOST_FIBER_SLEEPING && f->wakeTime <= hostTime)
+        f->state = HOST_FIBER_RUNNABLE;
+
+    return f->state == HOST_FIBER_RUNNABLE;
+}
+
+/**
+ * Runs one pass of the idle loop: the idle callbacks of registered components, then any timers that are due.
+ * If no timer was due and nothing is runnable, advances time to the next timer or sleeping fiber.
+ */
+static void idle()
+{
+    int node = currentNode;
+
+    for (int i = 0; i < DEVICE_COMPONENT_COUNT; i++)
+    {
+        CodalComponent *c = CodalComponent::components[i];
+
+        if (c && (c->status & DEVICE_COMPONENT_STATUS_IDLE_TICK))
+        {
+            host_select_node(componentNodes[i]);
+            c->idleCallback();
+        }
+    }
+
+    host_select_node(node);
+
+    bool fired = false;
+
+    for (size_t i = 0; i < timers.size(); )
+    {
+        if (timers[i].time <= hostTime)
+        {
+            HostTimer t = timers[i];
+            timers.erase(timers.begin() + i);
+
+            host_select_node(t.node);
+            t.callback(t.context);
+            host_select_node(node);
+
+            fired = true;
+            i = 0;
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    // As on a device woken by an interrupt, let the idle callbacks see the effects of any timer before time moves on.
+    if (fired)
+        return;
+
+    uint64_t next = UINT64_MAX;
+
+    for (size_t i = 0; i < fibers.size(); i++)
+    {
+        if (isRunnable(fibers[i]))
+            return;
+
+        if (fibers[i]->state == HOST_FIBER_SLEEPING)
+            next = min(next, fibers[i]->wakeTime);
+    }
+
+    for (size_t i = 0; i < timers.size(); i++)
+        next = min(next, timers[i].time);
+
+    // With nothing due, the idle loop still runs on each scheduler tick, as components may poll for timeouts.
+    if (next == UINT64_MAX)
+    {
+        if (idleSince == UINT64_MAX)
+            idleSince = hostTime;
+
+        if (hostTime - idleSince > HOST_DEADLOCK_TIME)
+        {
+            fprintf(stderr, "host scheduler: every fiber is blocked, and no timers are pending\n");
+            abort();
+        }
+
+        next = hostTime + HOST_IDLE_TICK;
+    }
+    else
+    {
+        idleSince = UINT64_MAX;
+    }
+
+    hostTime = next;
+}
+
+void host_schedule(uint64_t time, void (*callback)(void *), void *context)
+{
+    HostTimer t = { time, currentNode, callback, context };
+    timers.push_back(t);
+}
+
+int host_cancel(void (*callback)(void *), void *context)
+{
+    int cancelled = 0;
+
+    for (size_t i = 0; i < timers.size(); )
+    {
+        if (timers[i].callback == callback && timers[i].context == context)
+        {
+            timers.erase(timers.begin() + i);
+            cancelled++;
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    return cancelled;
+}
+
+uint32_t host_event_count(uint16_t source, uint16_t value)
+{
+    std::map<uint32_t, uint32_t>::iterator i = eventCounts.find(((uint32_t) source << 16) | value);
+
+    return i == eventCounts.end() ? 0 : i->second;
+}
+
+void host_reset_events()
+{
+    eventCounts.clear();
+}
+
+namespace codal
+{
+    void schedule()
+    {
+        initScheduler();
+
+        Fiber *previous = currentFiber;
+
+        for (;;)
+        {
+            // Round robin, starting from the fiber after the current one, and ending with the current one.
+            size_t index = 0;
+            while (fibers[index] != previous)
+                index++;
+
+            Fiber *next = NULL;
+
+            for (size_t i = 1; i <= fibers.size() && next == NULL; i++)
+            {
+                Fiber *f = fibers[(index + i) % fibers.size()];
+
+                if (isRunnable(f))
+                    next = f;
+            }
+
+            if (next)
+            {
+                if (next != previous)
+                {
+                    previous->node = currentNode;
+                    currentFiber = next;
+                    host_select_node(next->node);
+                    swapcontext(&previous->context, &next->context);
+                }
+
+                break;
+            }
+
+            idle();
+        }
+
+        // Free the stacks of any fibers that have completed. We are never running on one of them here.
+        for (size_t i = 0; i < fibers.size(); )
+        {
+            Fiber *f = fibers[i];
+
+            if (f->state == HOST_FIBER_COMPLETE && f != currentFiber)
+            {
+                fibers.erase(fibers.begin() + i);
+                free(f->stack);
+                delete f;
+            }
+            else
+            {
+                i++;
+            }
+        }
+    }
+
+    Fiber *create_fiber(void (*entry_fn)(void *), void *param, void (*completion_fn)(void *))
+    {
+        initScheduler();
+
+        Fiber *f = new Fiber();
+        f->stack = (char *) malloc(HOST_FIBER_STACK_SIZE);
+        f->node = currentNode;
+        f->state = HOST_FIBER_RUNNABLE;
+        f->entry = entry_fn;
+        f->param = param;
+        f->completion = completion_fn;
+
+        getcontext(&f->context);
+        f->context.uc_stack.ss_sp = f->stack;
+        f->context.uc_stack.ss_size = HOST_FIBER_STACK_SIZE;
+        f->context.uc_link = NULL;
+        makecontext(&f->context, launchFiber, 0);
+
+        fibers.push_back(f);
+
+        return f;
+    }
+
+    Fiber *create_fiber(void (*entry_fn)(void), void (*completion_fn)(void))
+    {
+        return create_fiber(launchVoidFiber, (void *) entry_fn, (void (*)(void *)) completion_fn);
+    }
+
+    void release_fiber(void)
+    {
+        initScheduler();
+
+        if (currentFiber == &mainFiber)
+        {
+            fprintf(stderr, "host scheduler: release_fiber() called from main()\n");
+            abort();
+        }
+
+        currentFiber->state = HOST_FIBER_COMPLETE;
+        schedule();
+    }
+
+    void fiber_sleep(unsigned long t)
+    {
+        initScheduler();
+
+        currentFiber->state = HOST_FIBER_SLEEPING;
+        currentFiber->wakeTime = hostTime + (uint64_t) t * 1000;
+        schedule();
+    }
+
+    int fiber_wake_on_event(uint16_t id, uint16_t value)
+    {
+        initScheduler();
+
+        currentFiber->state = HOST_FIBER_WAITING_EVENT;
+        currentFiber->waitSource = id;
+        currentFiber->waitValue = value;
+
+        return DEVICE_OK;
+    }
+
+    int fiber_wait_for_event(uint16_t id, uint16_t value)
+    {
+        fiber_wake_on_event(id, value);
+        schedule();
+
+        return DEVICE_OK;
+    }
+
+    int fiber_scheduler_running()
+    {
+        return 1;
+    }
+
+    FiberLock::FiberLock()
+    {
+        this->locked = false;
+        this->queue = NULL;
+    }
+
+    void FiberLock::wait()
+    {
+        initScheduler();
+
+        if (!locked)
+        {
+            locked = true;
+            return;
+        }
+
+        // Ownership of the lock passes directly to the fiber woken by notify().
+        currentFiber->state = HOST_FIBER_WAITING_LOCK;
+        currentFiber->next = NULL;
+
+        Fiber **tail = &queue;
+        while (*tail)
+            tail = &(*tail)->next;
+        *tail = currentFiber;
+
+        schedule();
+    }
+
+    void FiberLock::notify()
+    {
+        Fiber *f = queue;
+
+        if (f)
+        {
+            queue = f->next;
+            f->state = HOST_FIBER_RUNNABLE;
+        }
+        else
+        {
+            locked = false;
+        }
+    }
+
+    void FiberLock::notifyAll()
+    {
+        while (queue)
+        {
+            queue->state = HOST_FIBER_RUNNABLE;
+            queue = queue->next;
+        }
+
+        locked = false;
+    }
+
+    int FiberLock::getWaitCount()
+    {
+        int count = 0;
+
+        for (Fiber *f = queue; f; f = f->next)
+            count++;
+
+        return count;
+    }
+
+    EventModel *EventModel::defaultEventBus = NULL;
+
+    int EventModel::send(Event evt)
+    {
+        evt.fire();
+        return DEVICE_OK;
+    }
+
+    Event::Event(uint16_t source, uint16_t value, EventLaunchMode mode)
+    {
+        this->source = source;
+        this->value = value;
+        this->timestamp = system_timer_current_time_us();
+
+        if (mode == CREATE_AND_FIRE)
+            fire();
+    }
+
+    Event::Event()
+    {
+        this->source = 0;
+        this->value = 0;
+        this->timestamp = system_timer_current_time_us();
+    }
+
+    void Event::fire()
+    {
+        initScheduler();
+
+        eventCounts[((uint32_t) source << 16) | value]++;
+
+        for (size_t i = 0; i < fibers.size(); i++)
+        {
+            Fiber *f = fibers[i];
+
+            if (f->state == HOST_FIBER_WAITING_EVENT && (f->waitSource == source || f->waitSource == DEVICE_ID_ANY) &&
+                (f->waitValue == value || f->waitValue == DEVICE_EVT_ANY))
+                f->state = HOST_FIBER_RUNNABLE;
+        }
+    }
+
+    /*
+     * Components.
+     */
+
+    CodalComponent *CodalComponent::components[DEVICE_COMPONENT_COUNT];
+
+    void CodalComponent::addComponent()
+    {
+        for (int i = 0; i < DEVICE_COMPONENT_COUNT; i++)
+        {
+            if (components[i] == NULL)
+            {
+                components[i] = this;
+                componentNodes[i] = currentNode;
+                return;
+            }
+        }
+    }
+
+    void CodalComponent::removeComponent()
+    {
+        for (int i = 0; i < DEVICE_COMPONENT_COUNT; i++)
+            if (components[i] == this)
+                components[i] = NULL;
+    }
+}
+
+/*
+ * Managed types.
+ */
+
+void RefCounted::init()
+{
+    refCount = 3;
+    tag = 0;
+}
+
+void RefCounted::incr()
+{
+    if (!isReadOnly())
+        refCount += 2;
+}
+
+void RefCounted::decr()
+{
+    if (isReadOnly())
+        return;
+
+    refCount -= 2;
+
+    if (refCount == 1)
+        free(this);
+}
+
+namespace codal
+{
+    static BufferData *emptyData()
+    {
+        static BufferData *empty = NULL;
+
+        if (empty == NULL)
+        {
+            empty = (BufferData *) malloc(sizeof(BufferData));
+            empty->init();
+            empty->refCount = 0xffff;
+            empty->length = 0;
+        }
+
+        return empty;
+    }
+
+    void ManagedBuffer::init(const uint8_t *data, int length)
+    {
+        if (length <= 0)
+        {
+            ptr = emptyData();
+            return;
+        }
+
+        ptr = (BufferData *) malloc(sizeof(BufferData) + length);
+        ptr->init();
+        ptr->length = length;
+
+        if (data)
+            memcpy(ptr->payload, data, length);
+        else
+            memset(ptr->payload, 0, length);
+    }
+
+    ManagedBuffer::ManagedBuffer()
+    {
+        init(NULL, 0);
+    }
+
+    ManagedBuffer::ManagedBuffer(int length)
+    {
+        init(NULL, length);
+    }
+
+    ManagedBuffer::ManagedBuffer(uint8_t *data, int length)
+    {
+        init(data, length);
+    }
+
+    ManagedBuffer::ManagedBuffer(const ManagedBuffer &buffer)
+    {
+        ptr = buffer.ptr;
+        ptr->incr();
+    }
+
+    ManagedBuffer::ManagedBuffer(BufferData *p)
+    {
+        ptr = p;
+        ptr->incr();
+    }
+
+    ManagedBuffer::~ManagedBuffer()
+    {
+        ptr->decr();
+    }
+
+    ManagedBuffer& ManagedBuffer::operator=(const ManagedBuffer &p)
+    {
+        if (ptr != p.ptr)
+        {
+            ptr->decr();
+            ptr = p.ptr;
+            ptr->incr();
+        }
+
+        return *this;
+    }
+
+    int ManagedBuffer::fill(uint8_t value, int offset, int length)
+    {
+        if (offset < 0 || offset > ptr->length)
+            return DEVICE_INVALID_PARAMETER;
+
+        if (length < 0 || offset + length > ptr->length)
+            length = ptr->length - offset;
+
+        memset(ptr->payload + offset, value, length);
+
+        return DEVICE_OK;
+    }
+
+    BufferData *ManagedBuffer::leakData()
+    {
+        BufferData *p = ptr;
+        ptr = emptyData();
+
+        return p;
+    }
+
+    void ManagedString::init(const char *str, int len)
+    {
+        data = (char *) malloc(len + 1);
+        memcpy(data, str, len);
+        data[len] = 0;
+    }
+
+    ManagedString::ManagedString()
+    {
+        init("", 0);
+    }
+
+    ManagedString::ManagedString(const char *str)
+    {
+        init(str ? str : "", str ? strlen(str) : 0);
+    }
+
+    ManagedString::ManagedString(const char *str, const int16_t length)
+    {
+        init(str, length);
+    }
+
+    ManagedString::ManagedString(const ManagedString &s)
+    {
+        init(s.data, strlen(s.data));
+    }
+
+    ManagedString::~ManagedString()
+    {
+        free(data);
+    }
+
+    ManagedString& ManagedString::operator=(const ManagedString &s)
+    {
+        if (this != &s)
+        {
+            free(data);
+            init(s.data, strlen(s.data));
+        }
+
+        return *this;
+    }
+
+    bool ManagedString::operator==(const ManagedString &s) const
+    {
+        return strcmp(data, s.data) == 0;
+    }
+
+    char ManagedString::charAt(int16_t index) const
+    {
+        return index >= 0 && index < length() ? data[index] : 0;
+    }
+
+    int16_t ManagedString::length() const
+    {
+        return strlen(data);
+    }
+
+    /*
+     * Streams.
+     */
+
+    int DataSink::pullRequest()
+    {
+        return DEVICE_NOT_SUPPORTED;
+    }
+
+    ManagedBuffer DataSource::pull()
+    {
+        return ManagedBuffer();
+    }
+
+    void DataSource::connect(DataSink &)
+    {
+    }
+
+    void DataSource::disconnect()
+    {
+    }
+
+    int DataSource::getFormat()
+    {
+        return DATASTREAM_FORMAT_16BIT_UNSIGNED;
+    }
+
+    int DataSource::setFormat(int)
+    {
+        return DEVICE_NOT_SUPPORTED;
+    }
+
+    DataStream::DataStream(DataSource &upstream)
+    {
+        this->upStream = &upstream;
+        this->downStream = NULL;
+        upstream.connect(*this);
+    }
+
+    ManagedBuffer DataStream::pull()
+    {
+        return upStream->pull();
+    }
+
+    int DataStream::pullRequest()
+    {
+        return downStream ? downStream->pullRequest() : DEVICE_OK;
+    }
+
+    void DataStream::connect(DataSink &sink)
+    {
+        downStream = &sink;
+    }
+
+    void DataStream::disconnect()
+    {
+        downStream = NULL;
+    }
+
+    int DataStream::getFormat()
+    {
+        return upStream->getFormat();
+    }
+
+    int DataStream::setFormat(int format)
+    {
+        return upStream->setFormat(format);
+    }
+
+    static int read8(uint8_t *p) { return *(uint8_t *) p; }
+    static int readSigned8(uint8_t *p) { return *(int8_t *) p; }
+    static int read16(uint8_t *p) { return *(uint16_t *) p; }
+    static int readSigned16(uint8_t *p) { return *(int16_t *) p; }
+    static int read24(uint8_t *p) { return p[0] | (p[1] << 8) | (p[2] << 16); }
+    static int readSigned24(uint8_t *p) { return (read24(p) << 8) >> 8; }
+    static int read32(uint8_t *p) { return *(int32_t *) p; }
+
+    static void write8(uint8_t *p, int v) { *p = v; }
+    static void write16(uint8_t *p, int v) { *(uint16_t *) p = v; }
+    static void write24(uint8_t *p, int v) { p[0] = v; p[1] = v >> 8; p[2] = v >> 16; }
+    static void write32(uint8_t *p, int v) { *(int32_t *) p = v; }
+
+    SampleReadFn StreamNormalizer::readSample[9] = { read8, read8, readSigned8, read16, readSigned16, read24, readSigned24, read32, read32 };
+    SampleWriteFn StreamNormalizer::writeSample[9] = { write8, write8, write8, write16, write16, write24, write24, write32, write32 };
+
+    /*
+     * Tone prints, over the same 0..1023 position and sample range as codal-core.
+     */
+
+    uint16_t Synthesizer::SineTone(void *, int position)
+    {
+        return (uint16_t) (511.5f + 511.5f * sinf(2.0f * (float) M_PI * position / 1024.0f));
+    }
+
+    uint16_t Synthesizer::SawtoothTone(void *, int position)
+    {
+        return position;
+    }
+
+    uint16_t Synthesizer::TriangleTone(void *, int position)
+    {
+        return position < 512 ? position * 2 : (1023 - position) * 2;
+    }
+
+    uint16_t Synthesizer::SquareWaveTone(void *, int position)
+    {
+        return position < 512 ? 1023 : 0;
+    }
+
+    uint16_t Synthesizer::NoiseTone(void *, int)
+    {
+        // A deterministic 16 bit Galois LFSR, so that renders are repeatable.
+        static uint16_t lfsr = 0xACE1;
+
+        lfsr = (lfsr >> 1) ^ (-(lfsr & 1) & 0xB400);
+
+        return lfsr & 1023;
+    }
+
+    /**
+     * There is no audio pipeline to activate on the host.
+     */
+    void MicroBitAudio::requestActivation()
+    {
+    }
+}
@@ -0,0 +1,121 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef HOST_STUBS_H
+#define HOST_STUBS_H
+
+#include "CodalConfig.h"
+#include "nrf.h"
+#include <vector>
+
+/**
+ * Controls for the simulated runtime the host tests execute on.
+ *
+ * Time is simulated, and only passes when every fiber is blocked: the scheduler then runs the idle callbacks of
+ * registered components, fires any timers that are due, and otherwise advances the clock to the next sleeping fiber
+ * or timer, or by one scheduler tick if nothing is due. A test's main() runs as a fiber, so it can sleep, wait for
+ * events, and block on FiberLocks.
+ *
+ * Several devices can be simulated at once, as nodes. Each node has its own serial number, clock offset and
+ * interrupt controller. Fibers, timers and components run in the context of the node that created them.
+ */
+
+#define HOST_MAX_NODES          64
+
+/**
+ * Returns the simulated time, in microseconds, common to all nodes.
+ */
+uint64_t host_time();
+
+/**
+ * Creates a node.
+ *
+ * @param serial The serial number reported by microbit_serial_number() on the node.
+ * @param clockOffset The offset of the node's system timer from the simulated time, in microseconds.
+ * @return The index of the node, or DEVICE_NO_RESOURCES. Node 0 always exists.
+ */
+int host_create_node(uint32_t serial, int64_t clockOffset = 0);
+
+/**
+ * Makes the given node current, such that calls into the code under test execute on that node.
+ */
+void host_select_node(int node);
+
+/**
+ * Returns the index of the current node.
+ */
+int host_current_node();
+
+/**
+ * Registers a function to be called whenever the current node changes, such as to switch peripheral registers.
+ */
+void host_set_node_listener(void (*listener)(int node));
+
+/**
+ * Registers the handler of a simulated interrupt, on all nodes.
+ */
+void host_set_irq_handler(IRQn_Type irq, void (*handler)(void));
+
+/**
+ * Registers a function to receive the radio tasks triggered through the peripheral registers.
+ */
+void host_set_task_handler(void (*handler)(HostPeripheralTask task));
+
+/**
+ * Calls the given function at the given simulated time, in the context of the current node.
+ *
+ * @param time The simulated time at which to call the function, in microseconds.
+ */
+void host_schedule(uint64_t time, void (*callback)(void *), void *context);
+
+/**
+ * Cancels all pending calls to the given function with the given context.
+ *
+ * @return The number of calls cancelled.
+ */
+int host_cancel(void (*callback)(void *), void *context);
+
+/**
+ * Determines the number of events raised with the given source and value, on any node, since the last reset.
+ */
+uint32_t host_event_count(uint16_t source, uint16_t value);
+
+/**
+ * Resets the counts of raised events.
+ */
+void host_reset_events();
+
+/**
+ * Replaces the contents of a file in the simulated file system, as seen by MicroBitFile.
+ */
+void host_file_write(const char *name, const void *data, int length);
+
+/**
+ * Reads a file from the simulated file system.
+ *
+ * @return true if the file exists.
+ */
+bool host_file_read(const char *name, std::vector<uint8_t> &data);
+
+#endif
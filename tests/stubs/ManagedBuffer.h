@@ -0,0 +1,52 @@
+/*
+ * Host stand-in for codal-core's ManagedBuffer.h, with the same BufferData layout as the target.
+ */
+
+#ifndef MANAGED_BUFFER_H
+#define MANAGED_BUFFER_H
+
+#include "CodalConfig.h"
+#include "RefCounted.h"
+
+namespace codal
+{
+    struct BufferData : RefCounted
+    {
+        uint16_t length;
+        uint8_t payload[0];
+    };
+
+    class ManagedBuffer
+    {
+        BufferData *ptr;
+
+        void init(const uint8_t *data, int length);
+
+        public:
+
+        ManagedBuffer();
+        ManagedBuffer(int length);
+        ManagedBuffer(uint8_t *data, int length);
+        ManagedBuffer(const ManagedBuffer &buffer);
+        ManagedBuffer(BufferData *p);
+        ~ManagedBuffer();
+
+        ManagedBuffer& operator=(const ManagedBuffer &p);
+
+        // As in codal-core, buffers are equal if their contents are.
+        bool operator==(const ManagedBuffer &p) const { return ptr == p.ptr || (ptr->length == p.ptr->length && memcmp(ptr->payload, p.ptr->payload, ptr->length) == 0); }
+        bool operator!=(const ManagedBuffer &p) const { return !(*this == p); }
+
+        uint8_t &operator[](int i) { return ptr->payload[i]; }
+        uint8_t operator[](int i) const { return ptr->payload[i]; }
+
+        uint8_t *getBytes() { return ptr->payload; }
+        int length() const { return ptr->length; }
+
+        int fill(uint8_t value, int offset = 0, int length = -1);
+
+        BufferData *leakData();
+    };
+}
+
+#endif
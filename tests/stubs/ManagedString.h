@@ -0,0 +1,38 @@
+/*
+ * Host stand-in for codal-core's ManagedString.h.
+ */
+
+#ifndef MANAGED_STRING_H
+#define MANAGED_STRING_H
+
+#include "CodalConfig.h"
+#include "ManagedBuffer.h"
+
+namespace codal
+{
+    class ManagedString
+    {
+        char *data;
+
+        void init(const char *str, int len);
+
+        public:
+
+        ManagedString();
+        ManagedString(const char *str);
+        ManagedString(const char *str, const int16_t length);
+        ManagedString(const ManagedString &s);
+        ~ManagedString();
+
+        ManagedString& operator=(const ManagedString &s);
+
+        bool operator==(const ManagedString &s) const;
+        bool operator!=(const ManagedString &s) const { return !(*this == s); }
+
+        char charAt(int16_t index) const;
+        int16_t length() const;
+        const char *toCharArray() const { return data; }
+    };
+}
+
+#endif
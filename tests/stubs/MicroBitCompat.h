@@ -0,0 +1,19 @@
+/*
+ * Host stand-in for inc/compat/MicroBitCompat.h, which would otherwise pull in every codal-core driver.
+ * Placed ahead of inc/compat on the include path.
+ */
+
+#ifndef MICROBIT_COMPAT_H
+#define MICROBIT_COMPAT_H
+
+#include "CodalConfig.h"
+#include "ErrorNo.h"
+#include "ManagedString.h"
+#include "codal-core/inc/types/Event.h"
+#include "CodalComponent.h"
+
+#define MICROBIT_ID_VIRTUAL_SPEAKER_PIN 39
+
+using namespace codal;
+
+#endif
@@ -0,0 +1,29 @@
+/*
+ * Host stand-in for codal-nrf52's NRF52ADC.h. Declarations only; the ADC is not simulated.
+ */
+
+#ifndef NRF52_ADC_H
+#define NRF52_ADC_H
+
+#include "DataStream.h"
+#include "Pin.h"
+
+namespace codal
+{
+    class NRF52ADCChannel : public DataSource
+    {
+        public:
+        DataStream output;
+        int setGain(int gain, int bias);
+    };
+
+    class NRF52ADC
+    {
+        public:
+        NRF52ADCChannel *getChannel(Pin &pin, bool activate = true);
+        int setSamplePeriod(int samplePeriod);
+        int getSamplePeriod();
+    };
+}
+
+#endif
@@ -0,0 +1,31 @@
+/*
+ * Host stand-in for codal-nrf52's NRF52PWM.h. Declarations only; the PWM is not simulated.
+ */
+
+#ifndef NRF52PWM_H
+#define NRF52PWM_H
+
+#include "DataStream.h"
+#include "NRF52Pin.h"
+#include "nrf.h"
+
+#define PWM_DECODER_LOAD_Common 0
+
+namespace codal
+{
+    class NRF52PWM : public CodalComponent, public DataSink
+    {
+        public:
+        NRF52PWM(NRF_PWM_Type *module, DataSource &source, int sampleRate = 44100, uint16_t id = 0);
+        int setDecoderMode(uint32_t mode);
+        int getSampleRange();
+        int setSampleRate(int frequency);
+        int getSampleRate();
+        int connectPin(Pin &pin, int channel);
+        int disconnectPin(Pin &pin);
+        int setStreamingMode(bool streaming);
+        virtual int pullRequest();
+    };
+}
+
+#endif
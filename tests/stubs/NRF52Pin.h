@@ -0,0 +1,20 @@
+/*
+ * Host stand-in for codal-nrf52's NRF52Pin.h.
+ */
+
+#ifndef NRF52_PIN_H
+#define NRF52_PIN_H
+
+#include "Pin.h"
+
+namespace codal
+{
+    class NRF52Pin : public Pin
+    {
+        public:
+        NRF52Pin(int id, int name, int capability) : Pin(id, name, capability) {}
+        void setHighDrive(bool) {}
+    };
+}
+
+#endif
@@ -0,0 +1,47 @@
+/*
+ * Host stand-in for codal-core's Pin.h.
+ */
+
+#ifndef CODAL_PIN_H
+#define CODAL_PIN_H
+
+#include "CodalConfig.h"
+#include "CodalComponent.h"
+
+#define PIN_CAPABILITY_DIGITAL      0x01
+#define PIN_CAPABILITY_ANALOG       0x02
+#define PIN_CAPABILITY_AD           (PIN_CAPABILITY_DIGITAL | PIN_CAPABILITY_ANALOG)
+
+namespace codal
+{
+    class Pin
+    {
+        public:
+
+        uint16_t status;
+        uint16_t id;
+        int name;
+        int capability;
+
+        Pin(int id, int name, int capability)
+        {
+            this->status = 0;
+            this->id = id;
+            this->name = name;
+            this->capability = capability;
+        }
+
+        virtual ~Pin() {}
+
+        virtual int setDigitalValue(int) { return DEVICE_NOT_IMPLEMENTED; }
+        virtual int getDigitalValue() { return DEVICE_NOT_IMPLEMENTED; }
+        virtual int setAnalogValue(int) { return DEVICE_NOT_IMPLEMENTED; }
+        virtual int getAnalogValue() { return DEVICE_NOT_IMPLEMENTED; }
+        virtual int setAnalogPeriod(int) { return DEVICE_NOT_IMPLEMENTED; }
+        virtual int setAnalogPeriodUs(uint32_t) { return DEVICE_NOT_IMPLEMENTED; }
+        virtual uint32_t getAnalogPeriodUs() { return DEVICE_NOT_IMPLEMENTED; }
+        virtual int getAnalogPeriod() { return DEVICE_NOT_IMPLEMENTED; }
+    };
+}
+
+#endif
@@ -0,0 +1,25 @@
+/*
+ * Host stand-in for codal-core's RefCounted.h, with the same layout as the target.
+ */
+
+#ifndef REF_COUNTED_H
+#define REF_COUNTED_H
+
+#include "CodalConfig.h"
+
+/**
+ * Base of reference counted payloads. The count is held as (references * 2 + 1), and 0xffff marks
+ * a read-only object in flash that is never counted or freed.
+ */
+struct RefCounted
+{
+    uint16_t refCount;
+    uint16_t tag;
+
+    void incr();
+    void decr();
+    void init();
+    bool isReadOnly() { return refCount == 0xffff; }
+};
+
+#endif
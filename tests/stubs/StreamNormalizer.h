@@ -0,0 +1,23 @@
+/*
+ * Host stand-in for codal-core's StreamNormalizer.h. Only the sample access tables are provided.
+ */
+
+#ifndef STREAM_NORMALIZER_H
+#define STREAM_NORMALIZER_H
+
+#include "DataStream.h"
+
+namespace codal
+{
+    typedef int (*SampleReadFn)(uint8_t *);
+    typedef void (*SampleWriteFn)(uint8_t *, int);
+
+    class StreamNormalizer : public DataSink, public DataSource
+    {
+        public:
+        static SampleReadFn readSample[9];
+        static SampleWriteFn writeSample[9];
+    };
+}
+
+#endif
@@ -0,0 +1,23 @@
+/*
+ * Host stand-in for codal-core's Synthesizer.h. Only the tone print functions are provided.
+ */
+
+#ifndef SYNTHESIZER_H
+#define SYNTHESIZER_H
+
+#include "DataStream.h"
+
+namespace codal
+{
+    class Synthesizer
+    {
+        public:
+        static uint16_t SineTone(void *arg, int position);
+        static uint16_t SawtoothTone(void *arg, int position);
+        static uint16_t TriangleTone(void *arg, int position);
+        static uint16_t SquareWaveTone(void *arg, int position);
+        static uint16_t NoiseTone(void *arg, int position);
+    };
+}
+
+#endif
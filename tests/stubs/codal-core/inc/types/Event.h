@@ -0,0 +1,6 @@
+/*
+ * Host stand-in for codal-core/inc/types/Event.h, as included by path from this repository.
+ */
+
+#include "../../../Event.h"
+#include "../../../CodalComponent.h"
@@ -0,0 +1,16 @@
+/*
+ * Host stand-in for codal's target HAL.
+ * Interrupts are modelled by HostStubs: a disabled section defers any simulated interrupt until it is re-enabled.
+ */
+
+#ifndef CODAL_TARGET_HAL_H
+#define CODAL_TARGET_HAL_H
+
+#include "CodalConfig.h"
+
+void target_disable_irq();
+void target_enable_irq();
+void target_wait_for_event();
+void target_reset();
+
+#endif
@@ -0,0 +1,161 @@
+/*
+ * Host stand-in for the nRF52833 device header.
+ *
+ * Peripheral registers are plain memory, except for tasks: writing to a task register calls into the simulated
+ * peripheral through host_peripheral_task(). Peripherals raise interrupts through the simulated NVIC in HostStubs.
+ * PACKETPTR registers hold only the low 32 bits of an address, as on the target; see HostRadio.
+ */
+
+#ifndef HOST_NRF_H
+#define HOST_NRF_H
+
+#include <stdint.h>
+
+enum HostPeripheralTask
+{
+    HOST_TASK_HFCLKSTART,
+    HOST_TASK_RADIO_TXEN,
+    HOST_TASK_RADIO_RXEN,
+    HOST_TASK_RADIO_START,
+    HOST_TASK_RADIO_STOP,
+    HOST_TASK_RADIO_DISABLE
+};
+
+void host_peripheral_task(HostPeripheralTask task);
+
+/**
+ * A task register. Writing a non zero value triggers the task. Reads return 0.
+ */
+template <HostPeripheralTask task>
+struct HostTaskRegister
+{
+    void operator=(uint32_t value) volatile
+    {
+        if (value)
+            host_peripheral_task(task);
+    }
+
+    operator uint32_t() const volatile
+    {
+        return 0;
+    }
+};
+
+typedef struct
+{
+    volatile HostTaskRegister<HOST_TASK_RADIO_TXEN>     TASKS_TXEN;
+    volatile HostTaskRegister<HOST_TASK_RADIO_RXEN>     TASKS_RXEN;
+    volatile HostTaskRegister<HOST_TASK_RADIO_START>    TASKS_START;
+    volatile HostTaskRegister<HOST_TASK_RADIO_STOP>     TASKS_STOP;
+    volatile HostTaskRegister<HOST_TASK_RADIO_DISABLE>  TASKS_DISABLE;
+    volatile uint32_t EVENTS_READY;
+    volatile uint32_t EVENTS_ADDRESS;
+    volatile uint32_t EVENTS_END;
+    volatile uint32_t EVENTS_DISABLED;
+    volatile uint32_t SHORTS;
+    volatile uint32_t INTENSET;
+    volatile uint32_t INTENCLR;
+    volatile uint32_t CRCSTATUS;
+    volatile uint32_t RSSISAMPLE;
+    volatile uint32_t STATE;
+    volatile uint32_t PACKETPTR;
+    volatile uint32_t FREQUENCY;
+    volatile uint32_t TXPOWER;
+    volatile uint32_t MODE;
+    volatile uint32_t PCNF0;
+    volatile uint32_t PCNF1;
+    volatile uint32_t BASE0;
+    volatile uint32_t PREFIX0;
+    volatile uint32_t TXADDRESS;
+    volatile uint32_t RXADDRESSES;
+    volatile uint32_t CRCCNF;
+    volatile uint32_t CRCPOLY;
+    volatile uint32_t CRCINIT;
+    volatile uint32_t DATAWHITEIV;
+} NRF_RADIO_Type;
+
+typedef struct
+{
+    volatile HostTaskRegister<HOST_TASK_HFCLKSTART>     TASKS_HFCLKSTART;
+    volatile uint32_t EVENTS_HFCLKSTARTED;
+} NRF_CLOCK_Type;
+
+typedef struct
+{
+    volatile uint32_t CODEPAGESIZE;
+    volatile uint32_t CODESIZE;
+    volatile uint32_t DEVICEID[2];
+} NRF_FICR_Type;
+
+typedef struct
+{
+    volatile uint32_t NRFFW[15];
+} NRF_UICR_Type;
+
+typedef struct
+{
+    volatile uint32_t ENABLE;
+} NRF_PWM_Type;
+
+typedef struct
+{
+    volatile uint32_t CTRL;
+    volatile uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct
+{
+    volatile uint32_t DEMCR;
+} CoreDebug_Type;
+
+// The radio registers of the node currently executing. See HostRadio.
+extern NRF_RADIO_Type *NRF_RADIO;
+extern NRF_CLOCK_Type *NRF_CLOCK;
+extern NRF_FICR_Type *NRF_FICR;
+extern NRF_UICR_Type *NRF_UICR;
+extern NRF_PWM_Type *NRF_PWM0;
+extern NRF_PWM_Type *NRF_PWM1;
+extern DWT_Type *DWT;
+extern CoreDebug_Type *CoreDebug;
+extern uint32_t SystemCoreClock;
+
+#define CoreDebug_DEMCR_TRCENA_Msk              (1UL << 24)
+#define DWT_CTRL_CYCCNTENA_Msk                  (1UL << 0)
+
+#define RADIO_MODE_MODE_Nrf_1Mbit               0
+#define RADIO_CRCCNF_LEN_Two                    2
+#define RADIO_SHORTS_READY_START_Msk            (1UL << 0)
+#define RADIO_SHORTS_END_DISABLE_Msk            (1UL << 1)
+#define RADIO_SHORTS_DISABLED_TXEN_Msk          (1UL << 2)
+#define RADIO_SHORTS_DISABLED_RXEN_Msk          (1UL << 3)
+#define RADIO_SHORTS_ADDRESS_RSSISTART_Msk      (1UL << 4)
+#define RADIO_INTENSET_READY_Msk                (1UL << 0)
+#define RADIO_INTENSET_ADDRESS_Msk              (1UL << 1)
+#define RADIO_INTENSET_END_Msk                  (1UL << 3)
+#define RADIO_INTENSET_DISABLED_Msk             (1UL << 4)
+
+typedef enum
+{
+    RADIO_IRQn = 1,
+    SAADC_IRQn = 7,
+    PWM0_IRQn = 28,
+    PWM1_IRQn = 33,
+    HOST_IRQ_COUNT = 48
+} IRQn_Type;
+
+void NVIC_EnableIRQ(IRQn_Type irq);
+void NVIC_DisableIRQ(IRQn_Type irq);
+void NVIC_SetPendingIRQ(IRQn_Type irq);
+void NVIC_ClearPendingIRQ(IRQn_Type irq);
+void NVIC_SetPriority(IRQn_Type irq, uint32_t priority);
+
+/**
+ * Returns the number of the interrupt being handled, or 0 in thread mode.
+ */
+uint32_t __get_IPSR(void);
+
+static inline void __DMB(void) { __sync_synchronize(); }
+static inline void __DSB(void) {}
+static inline void __ISB(void) {}
+
+#endif
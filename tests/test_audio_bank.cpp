@@ -0,0 +1,244 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * Builds MicroBitAudioBank images from WAVE files with the tool in tools/, and plays them back, checking that every
+ * buffer delivered downstream refers to the image in place.
+ */
+
+#include "TestHarness.h"
+#include "TestSources.h"
+#include "tools/AudioBankBuilder.h"
+#include "MicroBitAudioBank.h"
+
+#include <math.h>
+#include <stdio.h>
+
+using namespace codal;
+
+/**
+ * Builds a PCM WAVE file holding the given samples.
+ */
+static std::vector<uint8_t> wave(int channels, int sampleRate, int bitsPerSample, const std::vector<uint8_t> &samples)
+{
+    return test_wave(1, channels, sampleRate, bitsPerSample, channels * bitsPerSample / 8, samples);
+}
+
+static std::vector<uint8_t> tone(int count)
+{
+    std::vector<uint8_t> samples;
+
+    for (int i = 0; i < count; i++)
+    {
+        test_put16(samples, lround(20000 * sin(i * 0.1)));
+    }
+
+    return samples;
+}
+
+/**
+ * Copies an image into word aligned memory, as it would be in flash.
+ */
+static std::vector<uint32_t> flash(const std::vector<uint8_t> &image)
+{
+    std::vector<uint32_t> words((image.size() + 3) / 4);
+    memcpy(&words[0], &image[0], image.size());
+
+    return words;
+}
+
+static void testWave()
+{
+    AudioBankSound sound;
+
+    CHECK(audio_bank_read_wave(wave(1, 11025, 16, tone(1000)), sound));
+    CHECK_EQUAL(11025, sound.sampleRate);
+    CHECK_EQUAL(DATASTREAM_FORMAT_16BIT_SIGNED, sound.format);
+    CHECK(sound.samples == tone(1000));
+
+    CHECK(audio_bank_read_wave(wave(1, 8000, 8, std::vector<uint8_t>(300, 0x80)), sound));
+    CHECK_EQUAL(DATASTREAM_FORMAT_8BIT_UNSIGNED, sound.format);
+    CHECK_EQUAL(300, (int) sound.samples.size());
+
+    // Stereo, 24 bit and malformed files are rejected.
+    CHECK(!audio_bank_read_wave(wave(2, 11025, 16, tone(1000)), sound));
+    CHECK(!audio_bank_read_wave(wave(1, 11025, 24, tone(999)), sound));
+
+    std::vector<uint8_t> truncated = wave(1, 11025, 16, tone(10));
+    truncated.resize(30);
+    CHECK(!audio_bank_read_wave(truncated, sound));
+}
+
+static void testLayout()
+{
+    std::vector<AudioBankSound> sounds(2);
+    std::vector<uint8_t> image;
+
+    sounds[0].name = "beep";
+    audio_bank_read_wave(wave(1, 11025, 16, tone(1000)), sounds[0]);
+    sounds[1].name = "twelve_chars";
+    audio_bank_read_wave(wave(1, 8000, 8, std::vector<uint8_t>(301, 0x40)), sounds[1]);
+
+    CHECK(audio_bank_build(sounds, image, 512));
+    CHECK_EQUAL(0, (int) image.size() % 4);
+
+    std::vector<uint32_t> words = flash(image);
+    MicroBitAudioBank bank(&words[0]);
+    const uint8_t *start = (const uint8_t *) &words[0];
+
+    CHECK(bank.isValid());
+    CHECK_EQUAL(2, bank.getCount());
+    CHECK_EQUAL(0, bank.find("beep"));
+    CHECK_EQUAL(1, bank.find("twelve_chars"));
+    CHECK_EQUAL(DEVICE_INVALID_PARAMETER, bank.find("boop"));
+
+    const MicroBitAudioBankEntry *entry = bank.getEntry(0);
+    CHECK_EQUAL(11025, (int) entry->sampleRate);
+    CHECK_EQUAL(DATASTREAM_FORMAT_16BIT_SIGNED, entry->format);
+    CHECK_EQUAL(4, entry->blockCount);
+    CHECK_EQUAL(1, bank.getEntry(1)->blockCount);
+
+    // Each block is a read-only BufferData, at the documented offsets.
+    const uint8_t *block = bank.getFirstBlock(0);
+    CHECK_EQUAL(0, (int) ((block - start) % 4));
+    CHECK_EQUAL(0xff, block[0]);
+    CHECK_EQUAL(0xff, block[1]);
+    CHECK_EQUAL(0, block[2] | block[3] << 8);
+    CHECK_EQUAL(512, block[4] | block[5] << 8);
+    CHECK(memcmp(block + 6, &sounds[0].samples[0], 512) == 0);
+
+    for (int i = 0; i < 3; i++)
+        block = MicroBitAudioBank::getNextBlock(block);
+
+    CHECK_EQUAL(2000 - 3 * 512, block[4] | block[5] << 8);
+    CHECK(MicroBitAudioBank::getNextBlock(block) == bank.getFirstBlock(1));
+    CHECK(MicroBitAudioBank::getNextBlock(bank.getFirstBlock(1)) == start + image.size());
+
+    // Names must fit the entry, and blocks must hold whole samples.
+    sounds[1].name = "thirteen_chr";
+    sounds[1].name += "s";
+    CHECK(!audio_bank_build(sounds, image, 512));
+    sounds[1].name = "ok";
+    CHECK(!audio_bank_build(sounds, image, 511));
+    CHECK(!audio_bank_build(sounds, image, 0x10000));
+
+    // The C++ source defines the image as words.
+    CHECK(audio_bank_build(sounds, image, 512));
+    std::string source = audio_bank_source(image, "sounds");
+    CHECK(source.find("const uint32_t sounds[] = {") != std::string::npos);
+    CHECK(source.find("0x4b4e4241") != std::string::npos);
+}
+
+static void testPlayback()
+{
+    std::vector<AudioBankSound> sounds(1);
+    std::vector<uint8_t> image;
+
+    sounds[0].name = "beep";
+    audio_bank_read_wave(wave(1, 11025, 16, tone(1000)), sounds[0]);
+    CHECK(audio_bank_build(sounds, image, 256));
+
+    std::vector<uint32_t> words = flash(image);
+    const uint8_t *start = (const uint8_t *) &words[0];
+    MicroBitAudioBank bank(start);
+    MicroBitAudioBankSource source(bank, bank.find("beep"));
+    TestCountingSink sink;
+    std::vector<uint8_t> played;
+
+    CHECK(source.isValid());
+    CHECK_EQUAL(11025, source.getSampleRate());
+    CHECK_EQUAL(DATASTREAM_FORMAT_16BIT_SIGNED, source.getFormat());
+
+    host_reset_events();
+    source.connect(sink);
+    CHECK_EQUAL(1, sink.requests);
+
+    for (int i = 0; i < 8; i++)
+    {
+        ManagedBuffer b = source.pull();
+
+        if (b.length() == 0)
+            break;
+
+        // The buffer refers to the image in place.
+        CHECK(b.getBytes() >= start + MICROBIT_AUDIO_BANK_BLOCK_SAMPLES_OFFSET && b.getBytes() < start + image.size());
+        played.insert(played.end(), b.getBytes(), b.getBytes() + b.length());
+    }
+
+    CHECK(played == sounds[0].samples);
+    CHECK_EQUAL(8, sink.requests);
+    CHECK_EQUAL(1, (int) host_event_count(DEVICE_ID_MICROBIT_AUDIO_BANK, MICROBIT_AUDIO_BANK_EVT_DONE));
+    CHECK_EQUAL(0, source.pull().length());
+
+    // Releasing the buffers leaves the image untouched.
+    CHECK(memcmp(start, &image[0], image.size()) == 0);
+
+    CHECK_EQUAL(DEVICE_OK, source.rewind());
+    CHECK_EQUAL(256, source.pull().length());
+
+    MicroBitAudioBankSource missing(bank, 1);
+    CHECK(!missing.isValid());
+    CHECK_EQUAL(DEVICE_INVALID_PARAMETER, missing.rewind());
+}
+
+static void testInvalid()
+{
+    std::vector<AudioBankSound> sounds(1);
+    std::vector<uint8_t> image;
+
+    sounds[0].name = "beep";
+    audio_bank_read_wave(wave(1, 11025, 16, tone(1000)), sounds[0]);
+    audio_bank_build(sounds, image, 512);
+
+    // A block that is not read-only would be freed by the last ManagedBuffer referring to it.
+    std::vector<uint32_t> words = flash(image);
+    MicroBitAudioBank bank(&words[0]);
+    uint8_t *block = (uint8_t *) bank.getFirstBlock(0);
+
+    block[0] = 2;
+    CHECK(!MicroBitAudioBank(&words[0]).isValid());
+
+    words = flash(image);
+    words[0] ^= 1;
+    CHECK(!MicroBitAudioBank(&words[0]).isValid());
+
+    // Truncated banks are rejected.
+    image[8] -= 4;
+    words = flash(image);
+    CHECK(!MicroBitAudioBank(&words[0]).isValid());
+
+    // Banks must be word aligned.
+    words = flash(image);
+    CHECK(!MicroBitAudioBank((uint8_t *) &words[0] + 2).isValid());
+}
+
+int main()
+{
+    testWave();
+    testLayout();
+    testPlayback();
+    testInvalid();
+
+    return test_result();
+}
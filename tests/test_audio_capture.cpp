@@ -0,0 +1,344 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * Replays WAVE data through the microphone capture pipeline: a source delivering buffers at the rate of the SAADC,
+ * an AudioStreamSplitter shared by two consumers, and a MicroBitAudioCapture analysing one of them.
+ *
+ * By default the test generates a file of tones, noise and silence, and checks the features and events extracted
+ * from each segment. Given the path of a 16 bit mono WAVE file, it replays that instead, and reports the features
+ * of each buffer.
+ */
+
+#include "TestHarness.h"
+#include "MicroBitAudioCapture.h"
+#include "AudioStreamSplitter.h"
+
+#include <math.h>
+#include <stdio.h>
+
+using namespace codal;
+
+#define CAPTURE_TEST_SAMPLE_RATE    11000
+#define CAPTURE_TEST_BUFFER         256
+#define CAPTURE_TEST_SEGMENT        (CAPTURE_TEST_SAMPLE_RATE / 2)
+
+/**
+ * Delivers the samples of a 16 bit mono WAVE file one buffer at a time, at the rate they were recorded, as the
+ * SAADC does by DMA.
+ */
+class ReplaySource : public DataSource
+{
+    public:
+
+    DataSink                *sink;
+    std::vector<int16_t>    samples;
+    int                     sampleRate;
+    size_t                  position;
+    ManagedBuffer           buffer;
+    int                     buffers;
+
+    ReplaySource()
+    {
+        this->sink = NULL;
+        this->sampleRate = 0;
+        this->position = 0;
+        this->buffers = 0;
+    }
+
+    bool load(const std::vector<uint8_t> &f)
+    {
+        size_t p = 12;
+
+        if (f.size() < 12 || memcmp(&f[0], "RIFF", 4) != 0 || memcmp(&f[8], "WAVE", 4) != 0)
+            return false;
+
+        while (p + 8 <= f.size())
+        {
+            uint32_t size = f[p + 4] | f[p + 5] << 8 | f[p + 6] << 16 | (uint32_t) f[p + 7] << 24;
+
+            if (memcmp(&f[p], "fmt ", 4) == 0)
+            {
+                // Only 16 bit mono PCM is supported.
+                if (f[p + 8] != 1 || f[p + 10] != 1 || f[p + 22] != 16)
+                    return false;
+
+                sampleRate = f[p + 12] | f[p + 13] << 8 | f[p + 14] << 16 | f[p + 15] << 24;
+            }
+            else if (memcmp(&f[p], "data", 4) == 0)
+            {
+                for (size_t i = p + 8; i + 1 < f.size() && i + 1 < p + 8 + size; i += 2)
+                    samples.push_back((int16_t) (f[i] | f[i + 1] << 8));
+
+                return sampleRate > 0;
+            }
+
+            p += 8 + size + (size & 1);
+        }
+
+        return false;
+    }
+
+    virtual void connect(DataSink &sink)
+    {
+        this->sink = &sink;
+    }
+
+    virtual void disconnect()
+    {
+        this->sink = NULL;
+    }
+
+    virtual int getFormat()
+    {
+        return DATASTREAM_FORMAT_16BIT_SIGNED;
+    }
+
+    virtual ManagedBuffer pull()
+    {
+        return buffer;
+    }
+
+    void start()
+    {
+        host_schedule(host_time() + period(), deliver, this);
+    }
+
+    uint64_t period()
+    {
+        return CAPTURE_TEST_BUFFER * 1000000ULL / sampleRate;
+    }
+
+    static void deliver(void *context)
+    {
+        ReplaySource *s = (ReplaySource *) context;
+
+        if (s->position + CAPTURE_TEST_BUFFER > s->samples.size())
+            return;
+
+        s->buffer = ManagedBuffer((uint8_t *) &s->samples[s->position], CAPTURE_TEST_BUFFER * sizeof(int16_t));
+        s->position += CAPTURE_TEST_BUFFER;
+        s->buffers++;
+
+        if (s->sink)
+            s->sink->pullRequest();
+
+        host_schedule(host_time() + s->period(), deliver, s);
+    }
+};
+
+/**
+ * A consumer of captured audio, pulling each buffer as soon as it is ready.
+ */
+class RecordingSink : public DataSink
+{
+    public:
+
+    DataSource              &source;
+    std::vector<int16_t>    samples;
+
+    RecordingSink(DataSource &source) : source(source)
+    {
+        source.connect(*this);
+    }
+
+    virtual int pullRequest()
+    {
+        test_append_samples(samples, source.pull(), DATASTREAM_FORMAT_16BIT_SIGNED);
+        return DEVICE_OK;
+    }
+};
+
+struct Segment
+{
+    const char  *name;
+    float       frequency;          // The frequency of the tone, or 0 for noise.
+    int         amplitude;
+    int         band;               // The octave band the tone falls in, or -1.
+};
+
+static const Segment segments[] = {
+    { "silence", 0, 0, -1 },
+    { "1kHz tone", 1000, 1000, 2 },
+    { "quiet 1kHz tone", 1000, 50, 2 },
+    { "200Hz tone", 200, 800, 0 },
+    { "3kHz tone", 3000, 800, 4 },
+    { "noise", 0, 1000, -1 },
+    { "silence", 0, 0, -1 },
+};
+
+#define CAPTURE_TEST_SEGMENTS       (int) (sizeof(segments) / sizeof(segments[0]))
+
+static void count(const char *name, uint32_t loud, uint32_t quiet, uint32_t zcrHigh, uint32_t zcrLow, uint32_t band4)
+{
+    test_check_equal(loud, host_event_count(DEVICE_ID_MICROBIT_AUDIO_CAPTURE, MICROBIT_AUDIO_CAPTURE_EVT_LOUD), name, __FILE__, __LINE__);
+    test_check_equal(quiet, host_event_count(DEVICE_ID_MICROBIT_AUDIO_CAPTURE, MICROBIT_AUDIO_CAPTURE_EVT_QUIET), name, __FILE__, __LINE__);
+    test_check_equal(zcrHigh, host_event_count(DEVICE_ID_MICROBIT_AUDIO_CAPTURE, MICROBIT_AUDIO_CAPTURE_EVT_ZCR_HIGH), name, __FILE__, __LINE__);
+    test_check_equal(zcrLow, host_event_count(DEVICE_ID_MICROBIT_AUDIO_CAPTURE, MICROBIT_AUDIO_CAPTURE_EVT_ZCR_LOW), name, __FILE__, __LINE__);
+    test_check_equal(band4, host_event_count(DEVICE_ID_MICROBIT_AUDIO_CAPTURE, MICROBIT_AUDIO_CAPTURE_EVT_BAND + 4), name, __FILE__, __LINE__);
+}
+
+static void testSegments()
+{
+    std::vector<int16_t> samples;
+
+    srand(1);
+
+    for (int s = 0; s < CAPTURE_TEST_SEGMENTS; s++)
+    {
+        for (int i = 0; i < CAPTURE_TEST_SEGMENT; i++)
+        {
+            if (segments[s].frequency)
+                samples.push_back(lround(segments[s].amplitude * sin(2 * M_PI * segments[s].frequency * i / CAPTURE_TEST_SAMPLE_RATE)));
+            else if (segments[s].amplitude)
+                samples.push_back(rand() % (2 * segments[s].amplitude + 1) - segments[s].amplitude);
+            else
+                samples.push_back(0);
+        }
+    }
+
+    std::vector<uint8_t> data;
+
+    for (size_t i = 0; i < samples.size(); i++)
+        test_put16(data, samples[i]);
+
+    std::vector<uint8_t> f = test_wave(1, 1, CAPTURE_TEST_SAMPLE_RATE, 16, 2, data);
+    ReplaySource source;
+
+    CHECK(source.load(f));
+    CHECK_EQUAL(CAPTURE_TEST_SAMPLE_RATE, source.sampleRate);
+
+    AudioStreamSplitter splitter(source);
+    MicroBitAudioCapture capture(*splitter.createChannel(), source.sampleRate);
+    RecordingSink captured(capture);
+    RecordingSink shared(*splitter.createChannel());
+
+    CHECK_EQUAL(DEVICE_INVALID_PARAMETER, capture.setLevelThresholds(500, 100));
+    CHECK_EQUAL(DEVICE_INVALID_PARAMETER, capture.setZeroCrossingThreshold(-1));
+    CHECK_EQUAL(DEVICE_INVALID_PARAMETER, capture.setBandThreshold(MICROBIT_AUDIO_CAPTURE_BANDS, 100));
+    CHECK_EQUAL(DEVICE_INVALID_PARAMETER, capture.getBandLevel(MICROBIT_AUDIO_CAPTURE_BANDS));
+
+    CHECK_EQUAL(DEVICE_OK, capture.setLevelThresholds(100, 500));
+    CHECK_EQUAL(DEVICE_OK, capture.setZeroCrossingThreshold(4000));
+    CHECK_EQUAL(DEVICE_OK, capture.setBandThreshold(4, 300));
+
+    host_reset_events();
+    source.start();
+
+    for (int s = 0; s < CAPTURE_TEST_SEGMENTS; s++)
+    {
+        // Sample the features near the end of each segment, once the analysis has settled.
+        fiber_sleep((s + 1) * 500 - 20 - (int) (host_time() / 1000));
+
+        const Segment &seg = segments[s];
+        int expectedLevel = seg.frequency ? (int) (seg.amplitude / sqrt(2.0)) : (int) (seg.amplitude / sqrt(3.0));
+
+        printf("%s: level %d zcr %d bands", seg.name, capture.getLevel(), capture.getZeroCrossingRate());
+
+        for (int b = 0; b < MICROBIT_AUDIO_CAPTURE_BANDS; b++)
+            printf(" %d", capture.getBandLevel(b));
+
+        printf("\n");
+
+        CHECK(abs(capture.getLevel() - expectedLevel) <= expectedLevel / 10 + 1);
+
+        if (seg.frequency)
+        {
+            CHECK(abs(capture.getZeroCrossingRate() - 2 * seg.frequency) <= 2 * seg.frequency / 10);
+
+            // The tone dominates its own octave band.
+            for (int b = 0; b < MICROBIT_AUDIO_CAPTURE_BANDS; b++)
+                if (b != seg.band)
+                    CHECK(capture.getBandLevel(b) < capture.getBandLevel(seg.band));
+        }
+
+        // Events are raised only on transitions.
+        if (s == 2)
+            count(seg.name, 1, 1, 0, 0, 0);
+        if (s == 3)
+            count(seg.name, 2, 1, 0, 0, 0);
+        if (s == 4)
+            count(seg.name, 2, 1, 1, 0, 1);
+    }
+
+    // Let the source run out.
+    fiber_sleep(100);
+
+    count("end", 2, 2, 1, 1, 1);
+
+    // Both consumers of the splitter received the whole recording, unaltered.
+    size_t replayed = source.position;
+
+    CHECK(replayed > samples.size() - CAPTURE_TEST_BUFFER);
+    CHECK(captured.samples == std::vector<int16_t>(samples.begin(), samples.begin() + replayed));
+    CHECK(shared.samples == captured.samples);
+    CHECK_EQUAL(0, capture.getOverrunCount());
+}
+
+static void replay(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    std::vector<uint8_t> f;
+    int c;
+
+    if (!test_check(file != NULL, path, __FILE__, __LINE__))
+        return;
+
+    while ((c = fgetc(file)) != EOF)
+        f.push_back(c);
+
+    fclose(file);
+
+    ReplaySource source;
+
+    if (!test_check(source.load(f), "16 bit mono WAVE file", __FILE__, __LINE__))
+        return;
+
+    AudioStreamSplitter splitter(source);
+    MicroBitAudioCapture capture(*splitter.createChannel(), source.sampleRate);
+
+    source.start();
+
+    for (int n = 0; source.position + CAPTURE_TEST_BUFFER <= source.samples.size(); n++)
+    {
+        fiber_sleep(source.period() / 1000 + 1);
+
+        printf("%.3fs: level %d zcr %d bands", (double) source.position / source.sampleRate, capture.getLevel(), capture.getZeroCrossingRate());
+
+        for (int b = 0; b < MICROBIT_AUDIO_CAPTURE_BANDS; b++)
+            printf(" %d", capture.getBandLevel(b));
+
+        printf("\n");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+        replay(argv[1]);
+    else
+        testSegments();
+
+    return test_result();
+}
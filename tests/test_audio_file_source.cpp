@@ -0,0 +1,329 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * Tests MicroBitAudioFileSource against WAVE files held in the simulated file system.
+ *
+ * Files are generated by the test in 8 and 16 bit PCM, and in IMA ADPCM using a reference encoder, then streamed
+ * and compared with the samples they were generated from.
+ */
+
+#include "TestHarness.h"
+#include "TestSources.h"
+#include "MicroBitAudioFileSource.h"
+
+#include <math.h>
+#include <stdio.h>
+
+using namespace codal;
+
+#define FILE_TEST_SAMPLE_RATE       11025
+#define FILE_TEST_ADPCM_BLOCK       256
+#define FILE_TEST_ADPCM_SAMPLES     (1 + (FILE_TEST_ADPCM_BLOCK - 4) * 2)
+
+static const int16_t imaStepTable[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+    130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060,
+    1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484,
+    7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int8_t imaIndexTable[16] = { -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8 };
+
+/**
+ * Builds a WAVE file around the given sample data, at FILE_TEST_SAMPLE_RATE.
+ */
+static std::vector<uint8_t> wave(int encoding, int channels, int bitsPerSample, int blockAlign, const std::vector<uint8_t> &data)
+{
+    return test_wave(encoding, channels, FILE_TEST_SAMPLE_RATE, bitsPerSample, blockAlign, data);
+}
+
+static int imaStep(int nibble, int &predictor, int &index)
+{
+    int step = imaStepTable[index];
+    int diff = step >> 3;
+
+    if (nibble & 1)
+        diff += step >> 2;
+    if (nibble & 2)
+        diff += step >> 1;
+    if (nibble & 4)
+        diff += step;
+
+    predictor += (nibble & 8) ? -diff : diff;
+    predictor = predictor < -32768 ? -32768 : predictor > 32767 ? 32767 : predictor;
+
+    index += imaIndexTable[nibble];
+    index = index < 0 ? 0 : index > 88 ? 88 : index;
+
+    return predictor;
+}
+
+/**
+ * Encodes samples as IMA ADPCM blocks, and returns the samples a decoder should reconstruct from them.
+ */
+static std::vector<int16_t> imaEncode(const std::vector<int16_t> &samples, std::vector<uint8_t> &data)
+{
+    std::vector<int16_t> decoded;
+    int index = 0;
+
+    for (size_t start = 0; start < samples.size(); start += FILE_TEST_ADPCM_SAMPLES)
+    {
+        size_t end = min(start + FILE_TEST_ADPCM_SAMPLES, samples.size());
+        int predictor = samples[start];
+
+        test_put16(data, predictor);
+        data.push_back(index);
+        data.push_back(0);
+        decoded.push_back(predictor);
+
+        for (size_t i = start + 1; i < end; i += 2)
+        {
+            uint8_t byte = 0;
+
+            for (int n = 0; n < 2; n++)
+            {
+                int diff = (i + n < end ? samples[i + n] : predictor) - predictor;
+                int step = imaStepTable[index];
+                int nibble = 0;
+
+                if (diff < 0)
+                {
+                    nibble = 8;
+                    diff = -diff;
+                }
+
+                for (int bit = 4; bit; bit >>= 1, step >>= 1)
+                {
+                    if (diff >= step)
+                    {
+                        nibble |= bit;
+                        diff -= step;
+                    }
+                }
+
+                decoded.push_back(imaStep(nibble, predictor, index));
+                byte |= nibble << (4 * n);
+            }
+
+            data.push_back(byte);
+        }
+    }
+
+    return decoded;
+}
+
+/**
+ * Streams a file to the end, pulling one block at a time, and letting the scheduler read ahead between pulls.
+ */
+static std::vector<int16_t> stream(MicroBitAudioFileSource &source)
+{
+    std::vector<int16_t> output;
+    TestNullSink sink;
+
+    source.connect(sink);
+
+    for (int i = 0; i < 10000; i++)
+    {
+        ManagedBuffer b = source.pull();
+
+        if (b.length() == 0 && host_event_count(DEVICE_ID_MICROBIT_AUDIO_FILE, MICROBIT_AUDIO_FILE_EVT_DONE))
+            break;
+
+        test_append_samples(output, b, source.getFormat());
+        fiber_sleep(1);
+    }
+
+    source.disconnect();
+
+    return output;
+}
+
+static std::vector<int16_t> sine(int count, int amplitude)
+{
+    std::vector<int16_t> samples;
+
+    for (int i = 0; i < count; i++)
+        samples.push_back(lround(amplitude * sin(i * 0.05)));
+
+    return samples;
+}
+
+static void testPcm16()
+{
+    std::vector<int16_t> samples = sine(3001, 20000);
+    std::vector<uint8_t> data;
+
+    for (size_t i = 0; i < samples.size(); i++)
+        test_put16(data, samples[i]);
+
+    std::vector<uint8_t> f = wave(MICROBIT_AUDIO_FILE_ENCODING_PCM, 1, 16, 2, data);
+    host_file_write("pcm16.wav", &f[0], f.size());
+    host_reset_events();
+
+    MicroBitAudioFileSource source("pcm16.wav");
+
+    CHECK(source.isValid());
+    CHECK_EQUAL(FILE_TEST_SAMPLE_RATE, source.getSampleRate());
+    CHECK_EQUAL(DATASTREAM_FORMAT_16BIT_SIGNED, source.getFormat());
+
+    CHECK(stream(source) == samples);
+    CHECK_EQUAL(1, host_event_count(DEVICE_ID_MICROBIT_AUDIO_FILE, MICROBIT_AUDIO_FILE_EVT_DONE));
+    CHECK_EQUAL(0, source.getUnderrunCount());
+
+    // Rewinding plays the file again from the start.
+    host_reset_events();
+    CHECK_EQUAL(DEVICE_OK, source.rewind());
+    CHECK(stream(source) == samples);
+    CHECK_EQUAL(1, host_event_count(DEVICE_ID_MICROBIT_AUDIO_FILE, MICROBIT_AUDIO_FILE_EVT_DONE));
+}
+
+static void testPcm8()
+{
+    std::vector<int16_t> samples;
+    std::vector<uint8_t> data;
+
+    for (int i = 0; i < 2000; i++)
+    {
+        data.push_back(128 + lround(100 * sin(i * 0.05)));
+        samples.push_back(data.back());
+    }
+
+    std::vector<uint8_t> f = wave(MICROBIT_AUDIO_FILE_ENCODING_PCM, 1, 8, 1, data);
+    host_file_write("pcm8.wav", &f[0], f.size());
+    host_reset_events();
+
+    MicroBitAudioFileSource source("pcm8.wav");
+
+    CHECK(source.isValid());
+    CHECK_EQUAL(DATASTREAM_FORMAT_8BIT_UNSIGNED, source.getFormat());
+    CHECK(stream(source) == samples);
+}
+
+static void testAdpcm()
+{
+    // Three whole blocks, and a partial one.
+    std::vector<int16_t> samples = sine(3 * FILE_TEST_ADPCM_SAMPLES + 201, 20000);
+    std::vector<uint8_t> data;
+    std::vector<int16_t> decoded = imaEncode(samples, data);
+
+    std::vector<uint8_t> f = wave(MICROBIT_AUDIO_FILE_ENCODING_IMA_ADPCM, 1, 4, FILE_TEST_ADPCM_BLOCK, data);
+    host_file_write("adpcm.wav", &f[0], f.size());
+    host_reset_events();
+
+    MicroBitAudioFileSource source("adpcm.wav");
+
+    CHECK(source.isValid());
+    CHECK_EQUAL(DATASTREAM_FORMAT_16BIT_SIGNED, source.getFormat());
+
+    std::vector<int16_t> output = stream(source);
+
+    CHECK(output == decoded);
+
+    // The encoding should also track the original closely.
+    double error = 0;
+
+    for (size_t i = 0; i < samples.size() && i < output.size(); i++)
+        error += fabs(samples[i] - output[i]);
+
+    CHECK(error / samples.size() < 200);
+}
+
+static void testReadAhead()
+{
+    std::vector<uint8_t> data(CONFIG_AUDIO_FILE_BLOCK_SIZE * (CONFIG_AUDIO_FILE_READ_AHEAD + 2));
+    std::vector<uint8_t> f = wave(MICROBIT_AUDIO_FILE_ENCODING_PCM, 1, 16, 2, data);
+    host_file_write("silence.wav", &f[0], f.size());
+
+    MicroBitAudioFileSource source("silence.wav");
+    TestNullSink sink;
+
+    // Only the read ahead blocks are loaded on connection, rather than the whole file.
+    source.connect(sink);
+
+    for (int i = 0; i < CONFIG_AUDIO_FILE_READ_AHEAD; i++)
+        CHECK_EQUAL(CONFIG_AUDIO_FILE_BLOCK_SIZE, source.pull().length());
+
+    CHECK_EQUAL(0, source.pull().length());
+    CHECK_EQUAL(0, source.getUnderrunCount());
+
+    // Playback consumed everything read ahead before the idle fiber could refill it.
+    source.idleCallback();
+    CHECK_EQUAL(1, source.getUnderrunCount());
+
+    CHECK_EQUAL(CONFIG_AUDIO_FILE_BLOCK_SIZE, source.pull().length());
+    CHECK_EQUAL(CONFIG_AUDIO_FILE_BLOCK_SIZE, source.pull().length());
+    CHECK_EQUAL(0, source.pull().length());
+}
+
+static void testInvalid()
+{
+    std::vector<uint8_t> data(100);
+    std::vector<uint8_t> stereo = wave(MICROBIT_AUDIO_FILE_ENCODING_PCM, 2, 16, 4, data);
+    std::vector<uint8_t> float32 = wave(3, 1, 32, 4, data);
+    const char *text = "This is not a WAVE file";
+
+    host_file_write("stereo.wav", &stereo[0], stereo.size());
+    host_file_write("float.wav", &float32[0], float32.size());
+    host_file_write("text.wav", text, strlen(text));
+
+    CHECK(!MicroBitAudioFileSource("stereo.wav").isValid());
+    CHECK(!MicroBitAudioFileSource("float.wav").isValid());
+    CHECK(!MicroBitAudioFileSource("text.wav").isValid());
+    CHECK(!MicroBitAudioFileSource("missing.wav").isValid());
+
+    // Chunk sizes that would wrap the position of the next chunk, back onto the same chunk or before the start of the file.
+    static const uint32_t corrupt[] = { 0xFFFFFFF7, 0xFFFFFFF8, 0xFFFFFFF0, 0x7FFFFFFF };
+    std::vector<uint8_t> mono = wave(MICROBIT_AUDIO_FILE_ENCODING_PCM, 1, 16, 2, data);
+
+    for (uint32_t size : corrupt)
+    {
+        std::vector<uint8_t> f = mono;
+
+        for (int i = 0; i < 4; i++)
+            f[TEST_WAVE_LIST_OFFSET + 4 + i] = size >> (8 * i);
+
+        host_file_write("corrupt.wav", &f[0], f.size());
+        CHECK(!MicroBitAudioFileSource("corrupt.wav").isValid());
+    }
+
+    // A file that is not valid never starts streaming.
+    MicroBitAudioFileSource source("text.wav");
+    TestNullSink sink;
+
+    source.connect(sink);
+    CHECK_EQUAL(0, source.pull().length());
+    CHECK_EQUAL(DEVICE_INVALID_PARAMETER, source.rewind());
+}
+
+int main()
+{
+    testPcm16();
+    testPcm8();
+    testAdpcm();
+    testReadAhead();
+    testInvalid();
+
+    return test_result();
+}
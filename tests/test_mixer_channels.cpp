@@ -0,0 +1,291 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * Tests removing, muting and pausing Mixer2 channels, the skipping of idle channels, and the input rate assumed for
+ * channels added without one.
+ *
+ * Also measures the cost of a pull against the number of idle channels attached to the mixer, which should be
+ * close to constant.
+ */
+
+#include "TestHarness.h"
+#include "TestSources.h"
+#include "Mixer2.h"
+
+#include <stdio.h>
+
+using namespace codal;
+
+#define CHANNEL_TEST_PULLS      2000
+
+/**
+ * A source of a rising ramp, which offers data only when told to, and counts the buffers pulled from it.
+ */
+class RampSource : public DataSource
+{
+    public:
+
+    DataSink    *sink;
+    int         next;
+    int         pulls;
+    bool        continuous;
+    bool        connected;
+
+    RampSource(bool continuous)
+    {
+        this->sink = NULL;
+        this->next = 0;
+        this->pulls = 0;
+        this->continuous = continuous;
+        this->connected = false;
+    }
+
+    virtual void connect(DataSink &sink)
+    {
+        this->sink = &sink;
+        this->connected = true;
+
+        if (continuous)
+            sink.pullRequest();
+    }
+
+    virtual void disconnect()
+    {
+        this->connected = false;
+    }
+
+    virtual int getFormat()
+    {
+        return DATASTREAM_FORMAT_16BIT_UNSIGNED;
+    }
+
+    virtual ManagedBuffer pull()
+    {
+        ManagedBuffer b(TEST_BUFFER_SAMPLES * 2);
+
+        for (int i = 0; i < TEST_BUFFER_SAMPLES; i++)
+            ((uint16_t *) &b[0])[i] = 256 + (next++ % 512);
+
+        pulls++;
+
+        if (continuous)
+            sink->pullRequest();
+
+        return b;
+    }
+
+    void offer()
+    {
+        sink->pullRequest();
+    }
+};
+
+static std::vector<int16_t> pull(Mixer2 &mixer)
+{
+    std::vector<int16_t> output;
+    test_append_samples(output, mixer.pull(), mixer.getFormat());
+
+    return output;
+}
+
+static void testRemove()
+{
+    RampSource a(true), b(true);
+    TestNullSink sink;
+    Mixer2 mixer(44100, 1024, DATASTREAM_FORMAT_16BIT_UNSIGNED, MIXER_ENGINE_FLOAT);
+
+    mixer.connect(sink);
+    MixerChannel *ca = mixer.addChannel(a, 44100, 1024);
+    MixerChannel *cb = mixer.addChannel(b, 44100, 1024);
+
+    pull(mixer);
+    CHECK(a.pulls > 0);
+    CHECK(b.pulls > 0);
+
+    CHECK_EQUAL(DEVICE_OK, mixer.removeChannel(cb));
+    CHECK(!b.connected);
+    CHECK(a.connected);
+
+    // The removed channel is no longer pulled, and no longer contributes to the mix.
+    int pulls = b.pulls;
+    std::vector<int16_t> output = pull(mixer);
+
+    CHECK_EQUAL(pulls, b.pulls);
+    CHECK(abs(output[1] - output[0] - 1) <= 1);
+
+    CHECK_EQUAL(DEVICE_INVALID_PARAMETER, mixer.removeChannel(cb));
+    CHECK_EQUAL(DEVICE_INVALID_PARAMETER, mixer.removeChannel(NULL));
+    CHECK_EQUAL(DEVICE_OK, mixer.removeChannel(ca));
+
+    // With no channels, the mixer outputs silence.
+    output = pull(mixer);
+    CHECK_EQUAL(CONFIG_MIXER_BUFFER_SIZE / 2, output.size());
+}
+
+static void testMuteAndPause()
+{
+    RampSource a(true), b(true);
+    TestNullSink sink;
+    Mixer2 mixer(44100, 1024, DATASTREAM_FORMAT_16BIT_UNSIGNED, MIXER_ENGINE_FLOAT);
+
+    mixer.connect(sink);
+    mixer.addChannel(a, 44100, 1024);
+    MixerChannel *cb = mixer.addChannel(b, 44100, 1024);
+
+    CHECK_EQUAL(DEVICE_INVALID_PARAMETER, mixer.setMute(NULL, true));
+    CHECK_EQUAL(DEVICE_INVALID_PARAMETER, mixer.setPaused(NULL, true));
+
+    // A muted channel keeps consuming its source in time with the others, but does not contribute to the mix.
+    CHECK_EQUAL(DEVICE_OK, mixer.setMute(cb, true));
+
+    std::vector<int16_t> output = pull(mixer);
+
+    CHECK_EQUAL(a.pulls, b.pulls);
+    CHECK(abs(output[1] - output[0] - 1) <= 1);
+
+    mixer.setMute(cb, false);
+    output = pull(mixer);
+    CHECK(abs(output[1] - output[0] - 2) <= 1);
+
+    // A paused channel is not pulled at all, and resumes where it left off.
+    CHECK_EQUAL(DEVICE_OK, mixer.setPaused(cb, true));
+
+    int pulls = b.pulls;
+    int next = b.next;
+
+    for (int i = 0; i < 4; i++)
+    {
+        output = pull(mixer);
+        CHECK(abs(output[1] - output[0] - 1) <= 1);
+    }
+
+    CHECK_EQUAL(pulls, b.pulls);
+    CHECK_EQUAL(next, b.next);
+
+    mixer.setPaused(cb, false);
+    pull(mixer);
+    CHECK(b.pulls > pulls);
+    CHECK(a.pulls > b.pulls);
+}
+
+static void testIdleChannels()
+{
+    RampSource a(true), idle(false);
+    TestNullSink sink;
+    Mixer2 mixer(44100, 1024, DATASTREAM_FORMAT_16BIT_UNSIGNED, MIXER_ENGINE_FLOAT);
+
+    mixer.connect(sink);
+    mixer.addChannel(a, 44100, 1024);
+    mixer.addChannel(idle, 44100, 1024);
+
+    // A channel with nothing to offer is never pulled.
+    for (int i = 0; i < 10; i++)
+        pull(mixer);
+
+    CHECK_EQUAL(0, idle.pulls);
+
+    // Once it offers a buffer, it is pulled exactly once, then goes idle again.
+    idle.offer();
+
+    for (int i = 0; i < 10; i++)
+        pull(mixer);
+
+    CHECK_EQUAL(1, idle.pulls);
+}
+
+static void onRateRequired(void *context, float sampleRate)
+{
+    *(float *) context = sampleRate;
+}
+
+static void testDefaultRate()
+{
+    RampSource a(true);
+    TestNullSink sink;
+    Mixer2 mixer(44100, 1024, DATASTREAM_FORMAT_16BIT_UNSIGNED);
+    float requested = 0.0f;
+
+    mixer.connect(sink);
+    mixer.setRateHandler(onRateRequired, &requested);
+
+    // As rate negotiation does when the pipeline is idle.
+    mixer.setSampleRate(16000);
+
+    // A channel added without a rate is taken to be at the rate the mixer was constructed with, not the one it has
+    // been lowered to, so it asks for the output rate to be raised again.
+    mixer.addChannel(a);
+    CHECK_EQUAL(44100, requested);
+
+    pull(mixer);
+    CHECK_EQUAL(44100, mixer.getRequiredSampleRate());
+}
+
+static void benchmark()
+{
+    for (int count = 0; count <= 128; count = count ? count * 4 : 2)
+    {
+        RampSource a(true);
+        std::vector<RampSource *> idle;
+        TestNullSink sink;
+        Mixer2 *mixer = new Mixer2(44100, 1024, DATASTREAM_FORMAT_16BIT_UNSIGNED);
+
+        mixer->connect(sink);
+        mixer->addChannel(a, 44100, 1024);
+
+        for (int i = 0; i < count; i++)
+        {
+            idle.push_back(new RampSource(false));
+            mixer->addChannel(*idle.back(), 44100, 1024);
+        }
+
+        double start = test_clock();
+
+        for (int i = 0; i < CHANNEL_TEST_PULLS; i++)
+            mixer->pull();
+
+        double t = (test_clock() - start) / CHANNEL_TEST_PULLS;
+
+        printf("%d idle channel%s: %.2f us/pull\n", count, count == 1 ? "" : "s", t * 1e6);
+
+        delete mixer;
+
+        for (int i = 0; i < count; i++)
+        {
+            CHECK_EQUAL(0, idle[i]->pulls);
+            delete idle[i];
+        }
+    }
+}
+
+int main()
+{
+    testRemove();
+    testMuteAndPause();
+    testIdleChannels();
+    testDefaultRate();
+    benchmark();
+
+    return test_result();
+}
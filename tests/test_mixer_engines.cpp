@@ -0,0 +1,122 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * Compares the fixed point mixing engine of Mixer2 with the floating point engine.
+ *
+ * Feeds the same synthetic channels through a mixer using each engine, and reports the largest difference between
+ * their outputs and the time each takes per sample. Cycle counts on the target are available through
+ * CONFIG_MIXER_INSTRUMENTATION; on the host, the time per sample is the nearest equivalent.
+ */
+
+#include "TestHarness.h"
+#include "TestSources.h"
+#include "Mixer2.h"
+
+#include <stdio.h>
+
+using namespace codal;
+
+#define ENGINE_TEST_PULLS       200
+
+struct EngineResult
+{
+    std::vector<int16_t>    output;
+    double                  seconds;
+};
+
+/**
+ * Mixes the given number of sine waves of the given format through a mixer using the given engine.
+ */
+static EngineResult mix(int engine, int format, int range, int midpoint, int channels, float rate)
+{
+    EngineResult result;
+    TestSineSource *sources[8];
+    TestNullSink sink;
+    Mixer2 *mixer = new Mixer2(44100, 1024, DATASTREAM_FORMAT_16BIT_UNSIGNED, engine);
+
+    mixer->connect(sink);
+
+    for (int c = 0; c < channels; c++)
+    {
+        sources[c] = new TestSineSource(format, 0.01 * (c + 1), (range / 2 - 8) / channels, midpoint);
+        mixer->addChannel(*sources[c], rate, range);
+    }
+
+    double start = test_clock();
+
+    for (int i = 0; i < ENGINE_TEST_PULLS; i++)
+        test_append_samples(result.output, mixer->pull(), mixer->getFormat());
+
+    result.seconds = test_clock() - start;
+
+    delete mixer;
+
+    for (int c = 0; c < channels; c++)
+        delete sources[c];
+
+    return result;
+}
+
+static void compareEngines(const char *name, int format, int range, int midpoint, float rate)
+{
+    for (int channels = 1; channels <= 8; channels *= 2)
+    {
+        EngineResult f = mix(MIXER_ENGINE_FLOAT, format, range, midpoint, channels, rate);
+        EngineResult x = mix(MIXER_ENGINE_FIXED, format, range, midpoint, channels, rate);
+        int delta = 0;
+        int differences = 0;
+
+        CHECK_EQUAL(f.output.size(), x.output.size());
+
+        for (size_t i = 0; i < f.output.size() && i < x.output.size(); i++)
+        {
+            int d = abs(f.output[i] - x.output[i]);
+
+            if (d)
+                differences++;
+
+            delta = max(delta, d);
+        }
+
+        printf("%s, %d channel%s: float %.1f ns/sample, fixed %.1f ns/sample, max delta %d, %d of %d samples differ\n",
+            name, channels, channels > 1 ? "s" : "", f.seconds * 1e9 / f.output.size(), x.seconds * 1e9 / x.output.size(),
+            delta, differences, (int) f.output.size());
+
+        // The engines round differently, by at most one output level.
+        CHECK(delta <= 1);
+    }
+}
+
+int main()
+{
+    compareEngines("u8", DATASTREAM_FORMAT_8BIT_UNSIGNED, 256, 128, 0);
+    compareEngines("s8", DATASTREAM_FORMAT_8BIT_SIGNED, 256, 0, 0);
+    compareEngines("u10", DATASTREAM_FORMAT_16BIT_UNSIGNED, 1024, 512, 0);
+    compareEngines("u16", DATASTREAM_FORMAT_16BIT_UNSIGNED, 65536, 32768, 0);
+    compareEngines("s16", DATASTREAM_FORMAT_16BIT_SIGNED, 65536, 0, 0);
+    compareEngines("u10 resampled", DATASTREAM_FORMAT_16BIT_UNSIGNED, 1024, 512, 22050);
+
+    return test_result();
+}
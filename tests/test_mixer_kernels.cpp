@@ -0,0 +1,98 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * Compares the format specialised mixing kernels of Mixer2 with the generic kernel.
+ *
+ * The generic kernel is selected for formats without a specialised kernel, such as 24 bit samples. Each 16 bit
+ * signed sine wave is therefore also presented as a 24 bit wave, shifted left by 8 bits with its range scaled to
+ * match, which normalises to exactly the same values. Both are mixed through 1, 2, 4 and 8 channels, at unity rate
+ * and resampled, and the outputs compared and timed.
+ */
+
+#include "TestHarness.h"
+#include "TestSources.h"
+#include "Mixer2.h"
+
+#include <stdio.h>
+
+using namespace codal;
+
+#define KERNEL_TEST_PULLS       200
+
+static std::vector<int16_t> mix(int engine, int format, int shift, int channels, float rate, double &seconds)
+{
+    std::vector<int16_t> output;
+    TestSineSource *sources[8];
+    TestNullSink sink;
+    Mixer2 *mixer = new Mixer2(44100, 1024, DATASTREAM_FORMAT_16BIT_UNSIGNED, engine);
+
+    mixer->connect(sink);
+
+    for (int c = 0; c < channels; c++)
+    {
+        sources[c] = new TestSineSource(format, 0.01 * (c + 1), 32000 / channels, 0, shift);
+        mixer->addChannel(*sources[c], rate, 65536 << shift);
+    }
+
+    double start = test_clock();
+
+    for (int i = 0; i < KERNEL_TEST_PULLS; i++)
+        test_append_samples(output, mixer->pull(), mixer->getFormat());
+
+    seconds = test_clock() - start;
+
+    delete mixer;
+
+    for (int c = 0; c < channels; c++)
+        delete sources[c];
+
+    return output;
+}
+
+static void compareKernels(const char *name, int engine, float rate)
+{
+    for (int channels = 1; channels <= 8; channels *= 2)
+    {
+        double specialisedTime, genericTime;
+        std::vector<int16_t> specialised = mix(engine, DATASTREAM_FORMAT_16BIT_SIGNED, 0, channels, rate, specialisedTime);
+        std::vector<int16_t> generic = mix(engine, DATASTREAM_FORMAT_24BIT_SIGNED, 8, channels, rate, genericTime);
+
+        printf("%s, %d channel%s: specialised %.1f ns/sample, generic %.1f ns/sample, speedup %.2fx\n",
+            name, channels, channels > 1 ? "s" : "", specialisedTime * 1e9 / specialised.size(),
+            genericTime * 1e9 / generic.size(), genericTime / specialisedTime);
+
+        CHECK(specialised == generic);
+    }
+}
+
+int main()
+{
+    compareKernels("float", MIXER_ENGINE_FLOAT, 0);
+    compareKernels("float resampled", MIXER_ENGINE_FLOAT, 22050);
+    compareKernels("fixed", MIXER_ENGINE_FIXED, 0);
+    compareKernels("fixed resampled", MIXER_ENGINE_FIXED, 22050);
+
+    return test_result();
+}
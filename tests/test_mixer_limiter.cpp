@@ -0,0 +1,210 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * Tests the soft limiter of Mixer2, and measures its cost per sample.
+ *
+ * Four channels, each at half of full scale, are mixed at twice full scale. Without the limiter the mix is clipped;
+ * with it, the output settles below the threshold, or on the compression curve when a ratio is given, and the gain
+ * is released once the mix falls quiet.
+ */
+
+#include "TestHarness.h"
+#include "TestSources.h"
+#include "Mixer2.h"
+
+#include <stdio.h>
+
+using namespace codal;
+
+#define LIMITER_TEST_CHANNELS       4
+#define LIMITER_TEST_PULLS          200
+
+struct LimiterTest
+{
+    TestSineSource  *sources[LIMITER_TEST_CHANNELS];
+    MixerChannel    *channels[LIMITER_TEST_CHANNELS];
+    TestNullSink    sink;
+    Mixer2          *mixer;
+
+    LimiterTest(int engine)
+    {
+        mixer = new Mixer2(44100, 1024, DATASTREAM_FORMAT_16BIT_UNSIGNED, engine);
+        mixer->connect(sink);
+
+        for (int c = 0; c < LIMITER_TEST_CHANNELS; c++)
+        {
+            // Identical waves, which sum to a steady twice full scale.
+            sources[c] = new TestSineSource(DATASTREAM_FORMAT_16BIT_UNSIGNED, 0.02, 256, 512);
+            channels[c] = mixer->addChannel(*sources[c], 0, 1024);
+        }
+    }
+
+    ~LimiterTest()
+    {
+        delete mixer;
+
+        for (int c = 0; c < LIMITER_TEST_CHANNELS; c++)
+            delete sources[c];
+    }
+
+    /**
+     * Pulls the given number of buffers, and returns the peak deviation of the last from the midpoint of the output.
+     */
+    int peak(int pulls, int *clipped = NULL)
+    {
+        int p = 0;
+
+        if (clipped)
+            *clipped = 0;
+
+        for (int i = 0; i < pulls; i++)
+        {
+            std::vector<int16_t> output;
+            test_append_samples(output, mixer->pull(), mixer->getFormat());
+
+            p = 0;
+
+            for (size_t j = 0; j < output.size(); j++)
+            {
+                p = max(p, abs(output[j] - 512));
+
+                if (clipped && (output[j] <= 0 || output[j] >= 1023))
+                    (*clipped)++;
+            }
+        }
+
+        return p;
+    }
+};
+
+static void testParameters()
+{
+    LimiterTest t(MIXER_ENGINE_DEFAULT);
+
+    CHECK_EQUAL(DEVICE_INVALID_PARAMETER, t.mixer->setLimiter(-1));
+    CHECK_EQUAL(DEVICE_INVALID_PARAMETER, t.mixer->setLimiter(1024));
+    CHECK_EQUAL(DEVICE_INVALID_PARAMETER, t.mixer->setLimiter(800, -1));
+    CHECK_EQUAL(DEVICE_INVALID_PARAMETER, t.mixer->setLimiter(800, 4, -1));
+    CHECK_EQUAL(DEVICE_OK, t.mixer->setLimiter(800, 4, 100));
+    CHECK_EQUAL(1023, t.mixer->getLimiterGain());
+}
+
+static void testLimiting(int engine)
+{
+    int clipped;
+
+    // Without the limiter, the mix is clipped.
+    {
+        LimiterTest t(engine);
+
+        CHECK(t.peak(LIMITER_TEST_PULLS, &clipped) >= 511);
+        CHECK(clipped > 0);
+        CHECK_EQUAL(1023, t.mixer->getLimiterGain());
+    }
+
+    // Limiting to a threshold holds the mix there.
+    {
+        LimiterTest t(engine);
+
+        t.mixer->setLimiter(800);
+        t.peak(1);
+
+        int p = t.peak(LIMITER_TEST_PULLS, &clipped);
+
+        CHECK(p <= 800 / 2 + 2);
+        CHECK(p >= 800 / 2 - 40);
+        CHECK_EQUAL(0, clipped);
+        CHECK(t.mixer->getLimiterGain() < 1023);
+    }
+
+    // Compression places the peak on the curve above the threshold, with the mix at twice full scale.
+    {
+        LimiterTest t(engine);
+
+        t.mixer->setLimiter(400, 4);
+        t.peak(1);
+
+        int p = t.peak(LIMITER_TEST_PULLS, &clipped);
+
+        CHECK(p <= (400 + (2 * 1023 - 400) / 4) / 2 + 2);
+        CHECK(p >= (400 + (2 * 1023 - 400) / 4) / 2 - 40);
+        CHECK_EQUAL(0, clipped);
+    }
+
+    // Once the mix falls quiet, gain is restored gradually.
+    {
+        LimiterTest t(engine);
+
+        t.mixer->setLimiter(800, 0, 50);
+        t.peak(LIMITER_TEST_PULLS);
+
+        int gain = t.mixer->getLimiterGain();
+
+        for (int c = 1; c < LIMITER_TEST_CHANNELS; c++)
+            t.mixer->setMute(t.channels[c], true);
+
+        t.peak(1);
+        CHECK(t.mixer->getLimiterGain() > gain);
+        CHECK(t.mixer->getLimiterGain() < 1023);
+
+        // 50ms is under 9 buffers, so 100 buffers release the gain fully.
+        t.peak(100);
+        CHECK_EQUAL(1023, t.mixer->getLimiterGain());
+    }
+}
+
+static void benchmark(int engine, const char *name)
+{
+    double times[2];
+
+    for (int limiter = 0; limiter < 2; limiter++)
+    {
+        LimiterTest t(engine);
+
+        if (limiter)
+            t.mixer->setLimiter(800, 4);
+
+        double start = test_clock();
+
+        for (int i = 0; i < LIMITER_TEST_PULLS * 10; i++)
+            t.mixer->pull();
+
+        times[limiter] = (test_clock() - start) * 1e9 / (LIMITER_TEST_PULLS * 10 * (CONFIG_MIXER_BUFFER_SIZE / 2));
+    }
+
+    printf("%s: %.2f ns/sample without limiter, %.2f ns/sample with, %.2f ns/sample for the limiter\n", name, times[0], times[1], times[1] - times[0]);
+}
+
+int main()
+{
+    testParameters();
+    testLimiting(MIXER_ENGINE_FLOAT);
+    testLimiting(MIXER_ENGINE_FIXED);
+
+    benchmark(MIXER_ENGINE_FLOAT, "float");
+    benchmark(MIXER_ENGINE_FIXED, "fixed");
+
+    return test_result();
+}
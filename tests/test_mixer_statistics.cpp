@@ -0,0 +1,193 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * Tests the statistics Mixer2 gathers when built with CONFIG_MIXER_INSTRUMENTATION: pull counts, the depth of each
+ * channel's queue, overruns, and underruns, which a stream reaching its end does not count as.
+ *
+ * The cycle counter does not run on the host, so a source simulates a slow pull by advancing it.
+ */
+
+#include "TestHarness.h"
+#include "TestSources.h"
+#include "Mixer2.h"
+#include "nrf.h"
+
+using namespace codal;
+
+#define STATISTICS_TEST_RATE        44100
+#define STATISTICS_TEST_SAMPLES     100
+
+/**
+ * A source of short buffers, which offers data only when told to, and takes the given number of cycles to pull.
+ */
+class BurstSource : public DataSource
+{
+    public:
+
+    DataSink    *sink;
+    uint32_t    cycles;
+
+    BurstSource()
+    {
+        this->sink = NULL;
+        this->cycles = 0;
+    }
+
+    virtual void connect(DataSink &sink)
+    {
+        this->sink = &sink;
+    }
+
+    virtual void disconnect()
+    {
+        this->sink = NULL;
+    }
+
+    virtual int getFormat()
+    {
+        return DATASTREAM_FORMAT_16BIT_SIGNED;
+    }
+
+    virtual ManagedBuffer pull()
+    {
+        ManagedBuffer b(STATISTICS_TEST_SAMPLES * 2);
+
+        for (int i = 0; i < STATISTICS_TEST_SAMPLES; i++)
+            ((int16_t *) &b[0])[i] = 1000;
+
+        DWT->CYCCNT += cycles;
+
+        return b;
+    }
+
+    void offer(int count = 1)
+    {
+        for (int i = 0; i < count; i++)
+            sink->pullRequest();
+    }
+};
+
+/**
+ * The playout time of one output buffer of the mixer, in cycles.
+ */
+static uint32_t deadline()
+{
+    return (uint32_t) ((CONFIG_MIXER_BUFFER_SIZE / 2) * (SystemCoreClock / (float) STATISTICS_TEST_RATE));
+}
+
+static void testPulls()
+{
+    BurstSource source;
+    TestNullSink sink;
+    Mixer2 mixer(STATISTICS_TEST_RATE);
+
+    mixer.connect(sink);
+    MixerChannel *channel = mixer.addChannel(source, STATISTICS_TEST_RATE);
+
+    // Each output buffer takes more than two of the source's buffers.
+    source.offer(3);
+    CHECK_EQUAL(3u, mixer.getStatistics(channel)->maxPullRequests);
+
+    mixer.pull();
+    mixer.pull();
+
+    CHECK_EQUAL(2u, mixer.getStatistics()->pulls);
+    CHECK_EQUAL(3u, mixer.getStatistics(channel)->pulls);
+    CHECK_EQUAL(0u, mixer.getStatistics()->overruns);
+    CHECK_EQUAL(0u, mixer.getStatistics(channel)->overruns);
+
+    mixer.resetStatistics();
+    CHECK_EQUAL(0u, mixer.getStatistics()->pulls);
+    CHECK_EQUAL(0u, mixer.getStatistics(channel)->pulls);
+    CHECK_EQUAL(0u, mixer.getStatistics(channel)->maxPullRequests);
+}
+
+static void testOverruns()
+{
+    BurstSource source;
+    TestNullSink sink;
+    Mixer2 mixer(STATISTICS_TEST_RATE);
+
+    mixer.connect(sink);
+    MixerChannel *channel = mixer.addChannel(source, STATISTICS_TEST_RATE);
+
+    // A pull that takes longer than the playout time of an output buffer is an overrun, of both the channel and the mixer.
+    source.cycles = deadline() / 4;
+    source.offer(3);
+    mixer.pull();
+
+    CHECK_EQUAL(0u, mixer.getStatistics(channel)->overruns);
+    CHECK_EQUAL(0u, mixer.getStatistics()->overruns);
+    CHECK(mixer.getStatistics(channel)->maxCycles >= deadline() / 4);
+
+    source.cycles = deadline() + 1;
+    source.offer(3);
+    mixer.pull();
+
+    CHECK_EQUAL(3u, mixer.getStatistics(channel)->overruns);
+    CHECK_EQUAL(1u, mixer.getStatistics()->overruns);
+    CHECK_EQUAL(3u, mixer.getStatistics(channel)->histogram[MIXER_HISTOGRAM_BUCKETS - 1]);
+}
+
+static void testUnderruns()
+{
+    BurstSource source;
+    TestNullSink sink;
+    Mixer2 mixer(STATISTICS_TEST_RATE);
+
+    mixer.connect(sink);
+    MixerChannel *channel = mixer.addChannel(source, STATISTICS_TEST_RATE);
+
+    // A stream that ends part way through an output buffer has not underrun, however long it stays silent.
+    source.offer();
+    mixer.pull();
+    mixer.pull();
+    mixer.pull();
+
+    CHECK_EQUAL(0u, mixer.getStatistics(channel)->underruns);
+
+    // Data that arrives after the channel ran out, in time for the next output buffer, left a gap in the stream.
+    source.offer();
+    mixer.pull();
+    source.offer();
+    mixer.pull();
+
+    CHECK_EQUAL(1u, mixer.getStatistics(channel)->underruns);
+
+    // Once the stream ends again, the count holds.
+    mixer.pull();
+    mixer.pull();
+
+    CHECK_EQUAL(1u, mixer.getStatistics(channel)->underruns);
+}
+
+int main()
+{
+    testPulls();
+    testOverruns();
+    testUnderruns();
+
+    return test_result();
+}
@@ -0,0 +1,469 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * Tests MicroBitRadioFlood as a discrete event simulation of up to FLOOD_TEST_NODES devices, over fully connected,
+ * grid and line topologies. Measures coverage and latency against the number of nodes, and checks that floods take
+ * the shortest path, are delivered once, stop after MICROBIT_RADIO_FLOOD_MAX_RELAYS, and synchronise the network time
+ * of devices whose clocks are offset from each other, even when a flood is started behind other queued packets.
+ */
+
+#include "TestHarness.h"
+#include "HostRadio.h"
+#include "MicroBitRadio.h"
+#include "MicroBitDevice.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace codal;
+
+#define FLOOD_TEST_NODES        49
+#define FLOOD_TEST_PAYLOAD      8
+
+static MicroBitRadio *radios[FLOOD_TEST_NODES];
+static uint32_t serials[FLOOD_TEST_NODES];
+static uint32_t floodCount = 0;
+
+// The nodes in use, and their arrangement. Nodes at or beyond nodeCount are out of range of every other node.
+static int nodeCount;
+static int gridWidth;
+
+/**
+ * The time taken by each hop of a flood carrying FLOOD_TEST_PAYLOAD bytes, in microseconds.
+ */
+static uint32_t slot()
+{
+    return MICROBIT_RADIO_FLOOD_RELAY_DELAY + (FLOOD_TEST_PAYLOAD + sizeof(MicroBitRadioFloodHeader) + MICROBIT_RADIO_HEADER_SIZE - 1 + MICROBIT_RADIO_FLOOD_FRAME_OVERHEAD) * 8;
+}
+
+static bool mesh(int a, int b)
+{
+    return a != b;
+}
+
+static bool line(int a, int b)
+{
+    return abs(a - b) == 1;
+}
+
+static bool grid(int a, int b)
+{
+    return abs(a % gridWidth - b % gridWidth) + abs(a / gridWidth - b / gridWidth) == 1;
+}
+
+/**
+ * The number of hops between two nodes of the grid.
+ */
+static int gridDistance(int a, int b)
+{
+    return abs(a % gridWidth - b % gridWidth) + abs(a / gridWidth - b / gridWidth);
+}
+
+/**
+ * Links the first count nodes as given by the topology, each link losing the given proportion of frames.
+ */
+static void connect(int count, bool (*linked)(int, int), float loss = 0.0f)
+{
+    nodeCount = count;
+
+    for (int a = 0; a < FLOOD_TEST_NODES; a++)
+        for (int b = 0; b < FLOOD_TEST_NODES; b++)
+            host_radio_set_link(a, b, a < count && b < count && linked(a, b), loss);
+}
+
+static uint32_t transmissions()
+{
+    uint32_t total = 0;
+
+    for (int n = 0; n < FLOOD_TEST_NODES; n++)
+        total += host_radio_get_transmissions(n);
+
+    return total;
+}
+
+/**
+ * Starts a flood from the given node, waits for it to cross the network, and collects it from every node.
+ *
+ * @param hops Set to the number of hops the flood took to reach each node, or zero if it did not.
+ * @return the number of nodes, other than the initiator, that received the flood.
+ */
+static int flood(int initiator, int hops[FLOOD_TEST_NODES])
+{
+    uint8_t data[FLOOD_TEST_PAYLOAD];
+    uint32_t tag = ++floodCount;
+
+    for (int i = 0; i < FLOOD_TEST_PAYLOAD; i++)
+        data[i] = (uint8_t) (tag >> (8 * (i % 4))) ^ i;
+
+    host_select_node(initiator);
+    CHECK_EQUAL(DEVICE_OK, radios[initiator]->flood.send(data, sizeof(data)));
+
+    // MICROBIT_RADIO_FLOOD_MAX_RELAYS slots are well under 10ms.
+    fiber_sleep(10);
+
+    int reached = 0;
+
+    for (int n = 0; n < FLOOD_TEST_NODES; n++)
+    {
+        PacketBuffer p;
+        uint16_t source;
+        uint8_t h;
+
+        hops[n] = 0;
+        host_select_node(n);
+
+        while (!((p = radios[n]->flood.recv(&source, &h)) == PacketBuffer::EmptyPacket))
+        {
+            CHECK_EQUAL(0, hops[n]);
+            CHECK_EQUAL((uint16_t) serials[initiator], source);
+            CHECK(p.length() == FLOOD_TEST_PAYLOAD && memcmp(p.getBytes(), data, FLOOD_TEST_PAYLOAD) == 0);
+            hops[n] = h;
+        }
+
+        reached += hops[n] > 0;
+    }
+
+    CHECK_EQUAL(0, hops[initiator]);
+
+    for (int n = nodeCount; n < FLOOD_TEST_NODES; n++)
+        CHECK_EQUAL(0, hops[n]);
+
+    return reached;
+}
+
+/**
+ * Floods the network repeatedly from the given node, checking each node is reached in the expected number of hops,
+ * and reports the coverage and latency.
+ *
+ * @param distance If not NULL, the number of hops expected between two nodes.
+ */
+static void measure(const char *name, int initiator, int (*distance)(int, int))
+{
+    const int floods = 10;
+    int hops[FLOOD_TEST_NODES];
+    int reached = 0;
+    int maxHops = 0;
+    uint64_t totalHops = 0;
+    uint32_t before = transmissions();
+
+    for (int f = 0; f < floods; f++)
+    {
+        reached += flood(initiator, hops);
+
+        for (int n = 0; n < nodeCount; n++)
+        {
+            if (n != initiator && distance)
+                CHECK_EQUAL(distance(initiator, n), hops[n]);
+
+            totalHops += hops[n];
+            maxHops = max(maxHops, hops[n]);
+        }
+    }
+
+    // Without loss, every node relays each flood exactly once.
+    double perFlood = (double) (transmissions() - before) / floods;
+    CHECK_EQUAL(nodeCount, perFlood);
+
+    printf("%-6s %2d nodes: coverage %5.1f%%, latency mean %6.0f us, max %5u us, %4.1f transmissions per flood\n",
+        name, nodeCount, 100.0 * reached / (floods * (nodeCount - 1)), reached ? (double) totalHops * slot() / reached : 0.0,
+        maxHops * slot(), perFlood);
+
+    CHECK_EQUAL(floods * (nodeCount - 1), reached);
+}
+
+static int meshDistance(int a, int b)
+{
+    return a != b;
+}
+
+static int lineDistance(int a, int b)
+{
+    return abs(a - b);
+}
+
+static void testCoverageVersusNodeCount()
+{
+    const int sizes[] = { 2, 4, 9, 16, 25, 36, 49 };
+
+    for (unsigned i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        connect(sizes[i], mesh);
+        measure("mesh", 0, meshDistance);
+    }
+
+    // Square grids, flooded from the centre: the flood spreads one hop per slot, so latency grows with the diameter.
+    for (unsigned i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        gridWidth = (int) sqrt((double) sizes[i]);
+        connect(sizes[i], grid);
+        measure("grid", (gridWidth / 2) * gridWidth + gridWidth / 2, gridDistance);
+    }
+}
+
+static void testRelayLimit()
+{
+    int hops[FLOOD_TEST_NODES];
+
+    // A flood is relayed MICROBIT_RADIO_FLOOD_MAX_RELAYS times, so travels one hop further than that.
+    connect(MICROBIT_RADIO_FLOOD_MAX_RELAYS + 4, line);
+    uint32_t before = transmissions();
+
+    CHECK_EQUAL(MICROBIT_RADIO_FLOOD_MAX_RELAYS + 1, flood(0, hops));
+
+    for (int n = 1; n < nodeCount; n++)
+        CHECK_EQUAL(n <= MICROBIT_RADIO_FLOOD_MAX_RELAYS + 1 ? lineDistance(0, n) : 0, hops[n]);
+
+    CHECK_EQUAL(MICROBIT_RADIO_FLOOD_MAX_RELAYS + 1, transmissions() - before);
+
+    printf("line   %2d nodes: reached %d hops in %u us\n", nodeCount, MICROBIT_RADIO_FLOOD_MAX_RELAYS + 1, (MICROBIT_RADIO_FLOOD_MAX_RELAYS + 1) * slot());
+}
+
+static void testLossyLinks()
+{
+    const int floods = 20;
+    const float losses[] = { 0.1f, 0.3f, 0.5f };
+    int hops[FLOOD_TEST_NODES];
+
+    srand(25);
+
+    for (unsigned i = 0; i < sizeof(losses) / sizeof(losses[0]); i++)
+    {
+        for (int topology = 0; topology < 2; topology++)
+        {
+            int reached = 0;
+            int initiator = 0;
+
+            if (topology == 0)
+            {
+                connect(16, mesh, losses[i]);
+            }
+            else
+            {
+                gridWidth = 5;
+                connect(25, grid, losses[i]);
+                initiator = 12;
+            }
+
+            for (int f = 0; f < floods; f++)
+            {
+                reached += flood(initiator, hops);
+
+                // Loss can only lengthen the path a flood takes.
+                for (int n = 0; n < nodeCount; n++)
+                    if (hops[n] && topology == 1)
+                        CHECK(hops[n] >= gridDistance(initiator, n));
+            }
+
+            double coverage = (double) reached / (floods * (nodeCount - 1));
+
+            printf("%-6s %2d nodes, %2.0f%% loss: coverage %5.1f%%\n", topology ? "grid" : "mesh", nodeCount, losses[i] * 100, coverage * 100);
+
+            // In the mesh, a node is only missed if it loses the initiator's frame and every relay of it. In the grid,
+            // a node hears at most four neighbours, each relaying only once, so coverage falls away with loss.
+            if (topology == 0)
+                CHECK(coverage > 0.99);
+            else
+                CHECK(coverage > 1.0 - 1.5 * losses[i]);
+        }
+    }
+}
+
+/**
+ * Determines the largest difference between the network time of any node in use and that of the given node.
+ */
+static int32_t synchronisationError(int reference)
+{
+    host_select_node(reference);
+    uint32_t expected = radios[reference]->flood.getNetworkTime();
+    int32_t error = 0;
+
+    for (int n = 0; n < nodeCount; n++)
+    {
+        host_select_node(n);
+        CHECK(radios[n]->flood.isSynchronised());
+        error = max(error, (int32_t) abs((int32_t) (radios[n]->flood.getNetworkTime() - expected)));
+    }
+
+    return error;
+}
+
+static void testTimeSynchronisation()
+{
+    int hops[FLOOD_TEST_NODES];
+
+    // None of the floods so far were started by a time reference.
+    for (int n = 0; n < FLOOD_TEST_NODES; n++)
+    {
+        host_select_node(n);
+        CHECK(!radios[n]->flood.isSynchronised());
+    }
+
+    gridWidth = 7;
+    connect(49, grid);
+
+    int reference = 3 * gridWidth + 3;
+    host_select_node(reference);
+    radios[reference]->flood.setTimeReference(true);
+    CHECK(radios[reference]->flood.isSynchronised());
+
+    // The nodes' clocks are up to ten seconds apart, so the network time starts well away from the local time.
+    uint32_t referenceTime = radios[reference]->flood.getNetworkTime();
+    host_select_node(0);
+    CHECK(abs((int32_t) (radios[0]->flood.getNetworkTime() - referenceTime)) > 1000);
+
+    CHECK_EQUAL(48, flood(reference, hops));
+    int32_t error = synchronisationError(reference);
+    CHECK(error <= 1);
+
+    // The simulated clocks don't drift, so the network time holds until the next flood.
+    fiber_sleep(1000);
+    CHECK(synchronisationError(reference) <= 1);
+
+    // Floods started by other nodes don't disturb the network time.
+    flood(0, hops);
+    CHECK(synchronisationError(reference) <= 1);
+
+    // Across the relay limit of a line, the error does not accumulate hop by hop.
+    connect(MICROBIT_RADIO_FLOOD_MAX_RELAYS + 2, line);
+    host_select_node(reference);
+    radios[reference]->flood.setTimeReference(false);
+    host_select_node(0);
+    radios[0]->flood.setTimeReference(true);
+
+    for (int n = 1; n < nodeCount; n++)
+    {
+        host_select_node(n);
+        radios[n]->flood.setTimeReference(false);
+        CHECK(!radios[n]->flood.isSynchronised());
+    }
+
+    CHECK_EQUAL(nodeCount - 1, flood(0, hops));
+    int32_t lineError = synchronisationError(0);
+    CHECK(lineError <= 1);
+
+    printf("time synchronisation: grid error %d us, %d hop line error %d us\n", error, nodeCount - 1, lineError);
+
+    host_select_node(0);
+    radios[0]->flood.setTimeReference(false);
+}
+
+/**
+ * A flood started while other packets are queued for transmission waits for them, so that it still leaves at the time
+ * it was stamped with, and synchronises the network time as accurately.
+ */
+static void testQueuedBehindOtherPackets()
+{
+    FrameBuffer frame;
+
+    connect(2, mesh);
+    host_select_node(0);
+    radios[0]->flood.setTimeReference(true);
+
+    memset(&frame, 0, sizeof(frame));
+    frame.length = MICROBIT_RADIO_MAX_PACKET_SIZE + MICROBIT_RADIO_HEADER_SIZE - 1;
+    frame.version = 1;
+    frame.protocol = MICROBIT_RADIO_PROTOCOL_DATAGRAM;
+
+    for (int i = 0; i < 2; i++)
+        CHECK_EQUAL(DEVICE_OK, radios[0]->sendAsync(&frame));
+
+    uint8_t data[FLOOD_TEST_PAYLOAD] = { 0 };
+    CHECK_EQUAL(DEVICE_OK, radios[0]->flood.send(data, sizeof(data)));
+    CHECK_EQUAL(0, radios[0]->getTxQueueLength());
+
+    fiber_sleep(10);
+    CHECK(synchronisationError(0) <= 1);
+
+    host_select_node(1);
+    CHECK(!(radios[1]->flood.recv() == PacketBuffer::EmptyPacket));
+
+    host_select_node(0);
+    radios[0]->flood.setTimeReference(false);
+}
+
+/**
+ * At most MICROBIT_RADIO_MAXIMUM_RX_BUFFERS floods are held for the application, and those beyond are discarded.
+ */
+static void testReceiveQueueLimit()
+{
+    uint8_t data[FLOOD_TEST_PAYLOAD];
+
+    connect(2, mesh);
+    host_select_node(0);
+
+    for (int i = 0; i < MICROBIT_RADIO_MAXIMUM_RX_BUFFERS + 2; i++)
+    {
+        data[0] = i;
+        CHECK_EQUAL(DEVICE_OK, radios[0]->flood.send(data, sizeof(data)));
+    }
+
+    fiber_sleep(10);
+    host_select_node(1);
+
+    for (int i = 0; i < MICROBIT_RADIO_MAXIMUM_RX_BUFFERS; i++)
+    {
+        PacketBuffer p = radios[1]->flood.recv();
+        CHECK(p.length() == FLOOD_TEST_PAYLOAD && p[0] == i);
+    }
+
+    CHECK(radios[1]->flood.recv() == PacketBuffer::EmptyPacket);
+}
+
+static void testInvalid()
+{
+    uint8_t data[MICROBIT_RADIO_FLOOD_MAX_PAYLOAD + 1] = { 0 };
+
+    host_select_node(0);
+    CHECK_EQUAL(DEVICE_INVALID_PARAMETER, radios[0]->flood.send(NULL, 1));
+    CHECK_EQUAL(DEVICE_INVALID_PARAMETER, radios[0]->flood.send(data, -1));
+    CHECK_EQUAL(DEVICE_INVALID_PARAMETER, radios[0]->flood.send(data, MICROBIT_RADIO_FLOOD_MAX_PAYLOAD + 1));
+    CHECK_EQUAL(DEVICE_INVALID_PARAMETER, radios[0]->flood.send(PacketBuffer(MICROBIT_RADIO_FLOOD_MAX_PAYLOAD + 1)));
+}
+
+int main()
+{
+    srand(1);
+
+    for (int n = 0; n < FLOOD_TEST_NODES; n++)
+    {
+        // Give every clock but node 0's an offset of up to ten seconds either way.
+        serials[n] = n == 0 ? microbit_serial_number() : 0x52000 + n;
+        host_select_node(n == 0 ? 0 : host_create_node(serials[n], (int64_t) (rand() % 20000001) - 10000000));
+        radios[n] = new MicroBitRadio();
+        host_radio_attach(*radios[n]);
+        CHECK_EQUAL(DEVICE_OK, radios[n]->enable());
+    }
+
+    testCoverageVersusNodeCount();
+    testRelayLimit();
+    testLossyLinks();
+    testTimeSynchronisation();
+    testQueuedBehindOtherPackets();
+    testReceiveQueueLimit();
+    testInvalid();
+
+    return test_result();
+}
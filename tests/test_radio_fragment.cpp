@@ -0,0 +1,253 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * Tests MicroBitRadioFragment in loopback between two simulated nodes, and against fragments injected directly into
+ * the receiver to exercise reordering, duplicates, concurrent reassembly and timeouts.
+ */
+
+#include "TestHarness.h"
+#include "HostRadio.h"
+#include "MicroBitRadio.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace codal;
+
+static MicroBitRadio *radios[2];
+
+static ManagedBuffer message(int length, int seed)
+{
+    ManagedBuffer b(length);
+
+    for (int i = 0; i < length; i++)
+        b[i] = seed + i * 7;
+
+    return b;
+}
+
+/**
+ * Builds a fragment of the given message, as a sender with the given source would.
+ */
+static FrameBuffer fragment(uint16_t source, uint8_t sequence, ManagedBuffer data, int index)
+{
+    FrameBuffer f;
+    MicroBitRadioFragmentHeader *header = (MicroBitRadioFragmentHeader *) f.payload;
+    int count = max(1, (data.length() + MICROBIT_RADIO_FRAGMENT_DATA_SIZE - 1) / MICROBIT_RADIO_FRAGMENT_DATA_SIZE);
+    int offset = index * MICROBIT_RADIO_FRAGMENT_DATA_SIZE;
+    int length = min(data.length() - offset, MICROBIT_RADIO_FRAGMENT_DATA_SIZE);
+
+    memset(&f, 0, sizeof(f));
+    f.version = 1;
+    f.protocol = MICROBIT_RADIO_PROTOCOL_FRAGMENT;
+    f.length = MICROBIT_RADIO_HEADER_SIZE - 1 + sizeof(MicroBitRadioFragmentHeader) + length;
+
+    header->source = source;
+    header->message = sequence;
+    header->index = index;
+    header->count = count;
+    header->length = data.length();
+    memcpy(f.payload + sizeof(MicroBitRadioFragmentHeader), data.getBytes() + offset, length);
+
+    return f;
+}
+
+/**
+ * Delivers a fragment to node 1, and lets it be processed.
+ */
+static void inject(const FrameBuffer &f)
+{
+    host_select_node(1);
+    CHECK(host_radio_receive(f));
+    fiber_sleep(1);
+}
+
+static void testLoopback()
+{
+    const int lengths[] = { 0, 1, 24, 25, 100, 1000, MICROBIT_RADIO_FRAGMENT_MAX_LENGTH };
+
+    host_reset_events();
+
+    for (int i = 0; i < (int) (sizeof(lengths) / sizeof(lengths[0])); i++)
+    {
+        ManagedBuffer m = message(lengths[i], i);
+        uint64_t start = host_time();
+
+        host_select_node(0);
+        CHECK_EQUAL(DEVICE_OK, radios[0]->fragment.send(m));
+        fiber_sleep(1);
+
+        host_select_node(1);
+        ManagedBuffer r = radios[1]->fragment.recv();
+
+        CHECK(r.length() == m.length() && r == m);
+        CHECK_EQUAL(0, radios[1]->fragment.recv().length());
+
+        printf("%d bytes: %d fragments in %.1f ms\n", lengths[i], max(1, (lengths[i] + MICROBIT_RADIO_FRAGMENT_DATA_SIZE - 1) / MICROBIT_RADIO_FRAGMENT_DATA_SIZE), (host_time() - start) / 1000.0);
+    }
+
+    CHECK_EQUAL(7u, host_event_count(DEVICE_ID_RADIO, MICROBIT_RADIO_EVT_FRAGMENT));
+    CHECK_EQUAL(0u, radios[1]->fragment.getDroppedCount());
+
+    host_select_node(0);
+    uint8_t data[1];
+    CHECK_EQUAL(DEVICE_INVALID_PARAMETER, radios[0]->fragment.send(message(MICROBIT_RADIO_FRAGMENT_MAX_LENGTH + 1, 0)));
+    CHECK_EQUAL(DEVICE_INVALID_PARAMETER, radios[0]->fragment.send(NULL, 1));
+    CHECK_EQUAL(DEVICE_INVALID_PARAMETER, radios[0]->fragment.send(data, -1));
+}
+
+static void testLossyLink()
+{
+    int delivered = 0;
+    uint32_t dropped = radios[1]->fragment.getDroppedCount();
+
+    srand(1);
+    host_radio_set_link(0, 1, true, 0.05f);
+
+    for (int i = 0; i < 20; i++)
+    {
+        ManagedBuffer m = message(200, i);
+
+        host_select_node(0);
+        CHECK_EQUAL(DEVICE_OK, radios[0]->fragment.send(m));
+        fiber_sleep(1);
+
+        // Only complete, intact messages are delivered.
+        host_select_node(1);
+        ManagedBuffer r = radios[1]->fragment.recv();
+
+        if (r.length())
+        {
+            CHECK(r == m);
+            delivered++;
+        }
+    }
+
+    host_radio_set_link(0, 1, true);
+
+    // Each message lost a fragment with probability 1 - 0.95^9, about 37%. Incomplete messages are abandoned as
+    // later ones displace them, or once they time out.
+    fiber_sleep(MICROBIT_RADIO_FRAGMENT_TIMEOUT + 10);
+    host_select_node(0);
+    radios[0]->fragment.send(message(1, 0));
+    fiber_sleep(1);
+    host_select_node(1);
+    CHECK_EQUAL(1, radios[1]->fragment.recv().length());
+
+    printf("lossy link: %d of 20 messages delivered, %u abandoned\n", delivered, radios[1]->fragment.getDroppedCount() - dropped);
+
+    CHECK(delivered > 5 && delivered < 20);
+    CHECK_EQUAL(20u - delivered, radios[1]->fragment.getDroppedCount() - dropped);
+}
+
+static void testReassembly()
+{
+    MicroBitRadioFragment &rx = radios[1]->fragment;
+    ManagedBuffer a = message(100, 1), b = message(60, 2), c = message(30, 3);
+    uint32_t dropped = rx.getDroppedCount();
+
+    // Fragments out of order, each received twice, are reassembled into one message.
+    for (int i = 4; i >= 0; i--)
+    {
+        inject(fragment(0x1111, 7, a, i));
+        inject(fragment(0x1111, 7, a, i));
+    }
+
+    CHECK(rx.recv() == a);
+    CHECK_EQUAL(0, rx.recv().length());
+
+    // A retransmission of a completed message is suppressed, until the timeout has passed.
+    for (int i = 0; i < 5; i++)
+        inject(fragment(0x1111, 7, a, i));
+
+    CHECK_EQUAL(0, rx.recv().length());
+
+    fiber_sleep(MICROBIT_RADIO_FRAGMENT_TIMEOUT + 10);
+
+    for (int i = 0; i < 5; i++)
+        inject(fragment(0x1111, 7, a, i));
+
+    CHECK(rx.recv() == a);
+
+    // Messages from different senders are reassembled concurrently.
+    for (int i = 0; i < 5; i++)
+    {
+        inject(fragment(0x1111, 8, a, i));
+
+        if (i < 3)
+            inject(fragment(0x2222, 8, b, i));
+    }
+
+    CHECK(rx.recv() == b);
+    CHECK(rx.recv() == a);
+    CHECK_EQUAL(dropped, rx.getDroppedCount());
+
+    // Reassembly memory is bounded: a third concurrent message displaces the one that has waited longest.
+    inject(fragment(0x1111, 9, a, 0));
+    inject(fragment(0x2222, 9, b, 0));
+    inject(fragment(0x3333, 9, c, 0));
+    CHECK_EQUAL(dropped + 1, rx.getDroppedCount());
+
+    inject(fragment(0x3333, 9, c, 1));
+    CHECK(rx.recv() == c);
+
+    for (int i = 1; i < 5; i++)
+        inject(fragment(0x1111, 9, a, i));
+
+    CHECK_EQUAL(0, rx.recv().length());
+
+    // A message that stalls is abandoned once the timeout has passed.
+    fiber_sleep(MICROBIT_RADIO_FRAGMENT_TIMEOUT + 10);
+    inject(fragment(0x2222, 9, b, 1));
+    inject(fragment(0x2222, 9, b, 2));
+    CHECK_EQUAL(0, rx.recv().length());
+    CHECK(rx.getDroppedCount() >= dropped + 3);
+
+    // Malformed fragments are ignored.
+    FrameBuffer f = fragment(0x4444, 1, c, 0);
+    f.length--;
+    inject(f);
+    f = fragment(0x4444, 1, c, 1);
+    ((MicroBitRadioFragmentHeader *) f.payload)->count = 3;
+    inject(f);
+    CHECK_EQUAL(0, rx.recv().length());
+}
+
+int main()
+{
+    for (int n = 0; n < 2; n++)
+    {
+        host_select_node(n == 0 ? 0 : host_create_node(0x2000 + n));
+        radios[n] = new MicroBitRadio();
+        host_radio_attach(*radios[n]);
+        CHECK_EQUAL(DEVICE_OK, radios[n]->enable());
+    }
+
+    testLoopback();
+    testLossyLink();
+    testReassembly();
+
+    return test_result();
+}
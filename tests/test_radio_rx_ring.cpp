@@ -0,0 +1,212 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * Tests the receive ring of MicroBitRadio: packets taken by the RADIO interrupt while the consumer drains the ring,
+ * in deterministic interleavings and with the interrupt running concurrently on another thread. Every packet carries
+ * a sequence number and a pattern derived from it, so reordering, duplication and corruption are all detected.
+ */
+
+#include "TestHarness.h"
+#include "HostRadio.h"
+#include "MicroBitRadio.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+
+using namespace codal;
+
+#define RING_TEST_PAYLOAD       MICROBIT_RADIO_MAX_PACKET_SIZE
+#define RING_TEST_PACKETS       200000
+
+/**
+ * Delivers the packet with the given sequence number, as the RADIO interrupt does.
+ */
+static bool produce(uint32_t sequence)
+{
+    FrameBuffer frame;
+
+    memset(&frame, 0, sizeof(frame));
+    frame.length = MICROBIT_RADIO_HEADER_SIZE - 1 + RING_TEST_PAYLOAD;
+    frame.version = 1;
+    frame.protocol = MICROBIT_RADIO_PROTOCOL_DATAGRAM;
+    memcpy(frame.payload, &sequence, sizeof(sequence));
+
+    for (int i = sizeof(sequence); i < RING_TEST_PAYLOAD; i++)
+        frame.payload[i] = sequence * 7 + i;
+
+    return host_radio_receive(frame);
+}
+
+/**
+ * Checks a packet taken from the ring, and returns its sequence number.
+ */
+static uint32_t consume(FrameBuffer *p, bool &intact)
+{
+    uint32_t sequence;
+
+    memcpy(&sequence, p->payload, sizeof(sequence));
+    intact = p->length == MICROBIT_RADIO_HEADER_SIZE - 1 + RING_TEST_PAYLOAD && p->rssi == -HOST_RADIO_RSSI;
+
+    for (int i = sizeof(sequence); i < RING_TEST_PAYLOAD; i++)
+        if (p->payload[i] != (uint8_t) (sequence * 7 + i))
+            intact = false;
+
+    delete p;
+    return sequence;
+}
+
+/**
+ * Runs random bursts of interrupts and reads against a model of the ring, which holds at most
+ * MICROBIT_RADIO_RX_RING_SIZE packets and drops new packets while full.
+ */
+static void testInterleavings(MicroBitRadio &radio)
+{
+    uint32_t produced = 0, expected = 0, dropped = radio.getDroppedCount();
+    int depth = 0;
+    bool ok = true;
+
+    srand(1);
+
+    for (int round = 0; round < 20000 && ok; round++)
+    {
+        int writes = rand() % (MICROBIT_RADIO_RX_RING_SIZE + 3);
+        int reads = rand() % (MICROBIT_RADIO_RX_RING_SIZE + 3);
+
+        for (int i = 0; i < writes; i++)
+        {
+            ok &= produce(produced++);
+
+            // Packets arriving while the ring is full are dropped, so the consumer never sees them.
+            if (depth == MICROBIT_RADIO_RX_RING_SIZE)
+                dropped++;
+            else
+                depth++;
+        }
+
+        ok &= radio.dataReady() == depth;
+
+        for (int i = 0; i < reads; i++)
+        {
+            FrameBuffer *p = radio.recv();
+
+            if (depth == 0)
+            {
+                ok &= p == NULL;
+                continue;
+            }
+
+            bool intact;
+            uint32_t sequence = consume(p, intact);
+
+            // Skip over the packets dropped since the last one read.
+            ok &= intact && sequence >= expected && sequence < produced;
+            expected = sequence + 1;
+            depth--;
+        }
+
+        ok &= radio.getDroppedCount() == dropped;
+    }
+
+    CHECK(ok);
+    CHECK(radio.getDroppedCount() > 0);
+
+    while (FrameBuffer *p = radio.recv())
+        delete p;
+}
+
+/**
+ * Takes interrupts on another thread, as fast as it can, while this thread drains the ring.
+ */
+static void testConcurrent(MicroBitRadio &radio)
+{
+    volatile bool done = false;
+    uint32_t rejected = 0;
+    uint32_t received = 0, corrupt = 0, outOfOrder = 0, next = 0;
+    uint32_t dropped = radio.getDroppedCount();
+
+    std::thread producer([&]() {
+        for (uint32_t i = 0; i < RING_TEST_PACKETS; i++)
+        {
+            if (!produce(i))
+                rejected++;
+
+            // Let the consumer catch up once the ring fills, but only after some packets have been dropped.
+            if (i % 16 == 0 && radio.dataReady() == MICROBIT_RADIO_RX_RING_SIZE)
+                std::this_thread::yield();
+        }
+
+        done = true;
+    });
+
+    while (true)
+    {
+        bool finished = done;
+        FrameBuffer *p = radio.recv();
+
+        if (p == NULL)
+        {
+            if (finished)
+                break;
+
+            std::this_thread::yield();
+            continue;
+        }
+
+        bool intact;
+        uint32_t sequence = consume(p, intact);
+
+        if (!intact)
+            corrupt++;
+
+        if (sequence < next)
+            outOfOrder++;
+
+        next = sequence + 1;
+        received++;
+    }
+
+    producer.join();
+
+    printf("concurrent: %u packets received, %u dropped\n", received, radio.getDroppedCount() - dropped);
+
+    CHECK_EQUAL(0u, rejected);
+    CHECK_EQUAL(0u, corrupt);
+    CHECK_EQUAL(0u, outOfOrder);
+    CHECK_EQUAL((uint32_t) RING_TEST_PACKETS, received + radio.getDroppedCount() - dropped);
+}
+
+int main()
+{
+    MicroBitRadio radio;
+
+    host_radio_attach(radio);
+    CHECK_EQUAL(DEVICE_OK, radio.enable());
+
+    testInterleavings(radio);
+    testConcurrent(radio);
+
+    return test_result();
+}
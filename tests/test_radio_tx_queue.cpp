@@ -0,0 +1,156 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * Tests the transmit queue of MicroBitRadio across disable(): packets sent before the radio is disabled are reported
+ * as sent, queued packets are discarded and reported as cancelled, and nothing queued is left to go out stale once
+ * the radio is enabled again.
+ */
+
+#include "TestHarness.h"
+#include "HostRadio.h"
+#include "MicroBitRadio.h"
+
+#include <stdio.h>
+
+using namespace codal;
+
+#define TX_TEST_PAYLOAD         10
+
+static MicroBitRadio *radio;
+static FrameBuffer frame;
+static int sendResult;
+static bool sending;
+
+/**
+ * The time from a packet being queued on an idle radio to the end of its transmission, in microseconds.
+ */
+static uint32_t transmissionTime()
+{
+    return HOST_RADIO_TX_DELAY + (frame.length + HOST_RADIO_FRAME_OVERHEAD) * 8;
+}
+
+static void sender(void *)
+{
+    sendResult = radio->send(&frame);
+    sending = false;
+}
+
+static void startSending()
+{
+    sending = true;
+    sendResult = DEVICE_OK + 1;
+    create_fiber(sender, NULL);
+}
+
+static void maskRadioInterrupt(void *)
+{
+    NVIC_DisableIRQ(RADIO_IRQn);
+}
+
+static void disableRadio(void *)
+{
+    CHECK_EQUAL(DEVICE_OK, radio->disable());
+}
+
+static void testSentBeforeDisable()
+{
+    uint32_t before = host_radio_get_transmissions(0);
+
+    // The packet finishes while the RADIO interrupt is held off, and the radio is disabled before it is handled.
+    uint64_t start = host_time();
+    host_schedule(start + transmissionTime() - 1, maskRadioInterrupt, NULL);
+    host_schedule(start + transmissionTime() + 1, disableRadio, NULL);
+    startSending();
+
+    fiber_sleep(10);
+
+    CHECK(!sending);
+    CHECK_EQUAL(before + 1, host_radio_get_transmissions(0));
+    CHECK_EQUAL(DEVICE_OK, sendResult);
+    CHECK_EQUAL(0, radio->getTxQueueLength());
+
+    CHECK_EQUAL(DEVICE_OK, radio->enable());
+}
+
+static void testCancelledByDisable()
+{
+    uint32_t before = host_radio_get_transmissions(0);
+
+    // Disabled mid transmission: the packet is not sent, and its sender hears so.
+    host_schedule(host_time() + transmissionTime() / 2, disableRadio, NULL);
+    startSending();
+
+    fiber_sleep(10);
+
+    CHECK(!sending);
+    CHECK_EQUAL(before, host_radio_get_transmissions(0));
+    CHECK_EQUAL(DEVICE_CANCELLED, sendResult);
+
+    CHECK_EQUAL(DEVICE_OK, radio->enable());
+}
+
+static void testNothingLeftQueued()
+{
+    uint32_t before = host_radio_get_transmissions(0);
+
+    for (int i = 0; i < MICROBIT_RADIO_TX_QUEUE_SIZE; i++)
+        CHECK_EQUAL(DEVICE_OK, radio->sendAsync(&frame));
+
+    CHECK_EQUAL(DEVICE_NO_RESOURCES, radio->sendAsync(&frame));
+    CHECK_EQUAL(DEVICE_OK, radio->disable());
+    CHECK_EQUAL(0, radio->getTxQueueLength());
+
+    // Producers in interrupt context can't queue packets once the radio is disabled, as it can't be enabled from there.
+    CHECK_EQUAL(DEVICE_INVALID_STATE, radio->sendAsync(&frame));
+    CHECK_EQUAL(0, radio->getTxQueueLength());
+
+    fiber_sleep(10);
+    CHECK_EQUAL(DEVICE_OK, radio->enable());
+    fiber_sleep(10);
+
+    CHECK_EQUAL(before, host_radio_get_transmissions(0));
+
+    // The radio carries on as normal afterwards.
+    CHECK_EQUAL(DEVICE_OK, radio->send(&frame));
+    CHECK_EQUAL(before + 1, host_radio_get_transmissions(0));
+}
+
+int main()
+{
+    memset(&frame, 0, sizeof(frame));
+    frame.length = MICROBIT_RADIO_HEADER_SIZE - 1 + TX_TEST_PAYLOAD;
+    frame.version = 1;
+    frame.protocol = MICROBIT_RADIO_PROTOCOL_DATAGRAM;
+
+    radio = new MicroBitRadio();
+    host_radio_attach(*radio);
+    CHECK_EQUAL(DEVICE_OK, radio->enable());
+
+    testSentBeforeDisable();
+    testCancelledByDisable();
+    testNothingLeftQueued();
+
+    return test_result();
+}
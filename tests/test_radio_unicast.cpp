@@ -0,0 +1,348 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * Tests MicroBitRadioUnicast between simulated nodes, over perfect, lossy and broken links: every packet sent is
+ * delivered exactly once or reported as failed, and the round trip time and loss statistics reflect the link. Also checks
+ * the receive queue limit, and that peers with packets awaiting acknowledgement are never forgotten.
+ */
+
+#include "TestHarness.h"
+#include "HostRadio.h"
+#include "MicroBitRadio.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+using namespace codal;
+
+#define UNICAST_TEST_NODES      3
+
+static MicroBitRadio *radios[UNICAST_TEST_NODES];
+
+static uint16_t address(int node)
+{
+    return radios[node]->unicast.getAddress();
+}
+
+/**
+ * Sends packets numbered from first, from node 0 to node 1.
+ */
+static void sendPackets(int first, int count)
+{
+    host_select_node(0);
+
+    for (int i = first; i < first + count; i++)
+    {
+        uint8_t data[MICROBIT_RADIO_UNICAST_MAX_PAYLOAD];
+
+        for (int j = 0; j < MICROBIT_RADIO_UNICAST_MAX_PAYLOAD; j++)
+            data[j] = i + j;
+
+        data[0] = i;
+        data[1] = i >> 8;
+
+        CHECK_EQUAL(DEVICE_OK, radios[0]->unicast.send(address(1), data, sizeof(data)));
+    }
+}
+
+static std::vector<int> received;
+
+/**
+ * Receives packets on node 1 as they arrive, as an application would, checking their contents and sender.
+ */
+static void receiver(void *)
+{
+    uint16_t source;
+
+    while (true)
+    {
+        PacketBuffer p = radios[1]->unicast.recv(&source);
+
+        if (p == PacketBuffer::EmptyPacket)
+        {
+            fiber_wait_for_event(DEVICE_ID_RADIO, MICROBIT_RADIO_EVT_UNICAST);
+            continue;
+        }
+
+        int i = p[0] | p[1] << 8;
+        bool intact = p.length() == MICROBIT_RADIO_UNICAST_MAX_PAYLOAD && source == address(0);
+
+        for (int j = 2; j < p.length(); j++)
+            intact = intact && p[j] == (uint8_t) (i + j);
+
+        CHECK(intact);
+        received.push_back(i);
+    }
+}
+
+static void testPerfectLink()
+{
+    uint64_t start = host_time();
+
+    host_reset_events();
+    sendPackets(0, 50);
+    fiber_sleep(100);
+
+    const MicroBitRadioUnicastPeer *peer = radios[0]->unicast.getPeer(address(1));
+
+    // Without loss, packets arrive in order, once each, and only at their destination.
+    CHECK_EQUAL(50, (int) received.size());
+    for (size_t i = 0; i < received.size(); i++)
+        CHECK_EQUAL((int) i, received[i]);
+
+    CHECK(radios[2]->unicast.recv() == PacketBuffer::EmptyPacket);
+    CHECK(radios[2]->unicast.getPeer(address(0)) == NULL);
+
+    CHECK(peer != NULL);
+    CHECK_EQUAL(50u, peer->sent);
+    CHECK_EQUAL(50u, peer->delivered);
+    CHECK_EQUAL(0u, peer->retransmitted);
+    CHECK_EQUAL(0u, peer->failed);
+    CHECK_EQUAL(50u, host_event_count(DEVICE_ID_RADIO, MICROBIT_RADIO_EVT_UNICAST_TX));
+
+    // A data packet and its acknowledgement each take well under a millisecond on air.
+    CHECK(peer->srtt > 500 && peer->srtt < 5000);
+
+    host_select_node(1);
+    CHECK_EQUAL(50u, radios[1]->unicast.getPeer(address(0))->received);
+    CHECK_EQUAL(0u, radios[1]->unicast.getPeer(address(0))->duplicates);
+
+    printf("perfect link: srtt %u us, rto %u us, 50 packets in %.1f ms\n", peer->srtt, peer->rto, (host_time() - start) / 1000.0);
+}
+
+static void testLossyLink()
+{
+    const int count = 200;
+
+    srand(1);
+    host_radio_set_link(0, 1, true, 0.2f);
+    host_radio_set_link(1, 0, true, 0.2f);
+    host_reset_events();
+
+    host_select_node(0);
+    MicroBitRadioUnicastPeer before = *radios[0]->unicast.getPeer(address(1));
+    host_select_node(1);
+    uint32_t duplicatesBefore = radios[1]->unicast.getPeer(address(0))->duplicates;
+
+    received.clear();
+    sendPackets(1000, count);
+
+    // Wait for every packet to be acknowledged or abandoned.
+    for (int i = 0; i < 100 && host_event_count(DEVICE_ID_RADIO, MICROBIT_RADIO_EVT_UNICAST_TX) < (uint32_t) count; i++)
+        fiber_sleep(100);
+
+    std::vector<int> seen(count, 0);
+
+    for (size_t i = 0; i < received.size(); i++)
+    {
+        CHECK(received[i] >= 1000 && received[i] < 1000 + count);
+        seen[received[i] - 1000]++;
+    }
+
+    // No packet is delivered twice, even though lost acknowledgements cause retransmissions.
+    int missing = 0;
+    for (int i = 0; i < count; i++)
+    {
+        CHECK(seen[i] <= 1);
+        missing += seen[i] == 0;
+    }
+
+    host_select_node(0);
+    const MicroBitRadioUnicastPeer *peer = radios[0]->unicast.getPeer(address(1));
+    uint32_t delivered = peer->delivered - before.delivered;
+    uint32_t failed = peer->failed - before.failed;
+    uint32_t retransmitted = peer->retransmitted - before.retransmitted;
+
+    host_select_node(1);
+    uint32_t duplicates = radios[1]->unicast.getPeer(address(0))->duplicates - duplicatesBefore;
+
+    printf("lossy link: %u delivered, %u failed, %u retransmissions, %u duplicates suppressed, %d missing, srtt %u us, rto %u us\n",
+        delivered, failed, retransmitted, duplicates, missing, peer->srtt, peer->rto);
+
+    CHECK_EQUAL((uint32_t) count, host_event_count(DEVICE_ID_RADIO, MICROBIT_RADIO_EVT_UNICAST_TX));
+    CHECK_EQUAL((uint32_t) count, delivered + failed);
+    CHECK_EQUAL((uint32_t) count, peer->sent - before.sent);
+
+    // Every acknowledged packet was received, and a packet can only be missing if it was abandoned.
+    CHECK((int) received.size() >= (int) delivered);
+    CHECK(missing <= (int) failed);
+
+    // Each packet and its acknowledgement survive with probability 0.64, so about 0.56 retransmissions are needed
+    // per packet, and about a fifth of them carry a packet that was already received. A packet is only abandoned if all
+    // MICROBIT_RADIO_UNICAST_RETRIES + 1 attempts fail, which happens to about one in 450.
+    CHECK(retransmitted > count / 4 && retransmitted < count);
+    CHECK(failed <= count / 50);
+    CHECK(duplicates > 0 && duplicates < retransmitted);
+
+    host_radio_set_link(0, 1, true);
+    host_radio_set_link(1, 0, true);
+}
+
+static void testBrokenLink()
+{
+    host_radio_set_link(0, 1, false);
+    host_reset_events();
+
+    host_select_node(0);
+    uint32_t failed = radios[0]->unicast.getPeer(address(1))->failed;
+    uint32_t retransmitted = radios[0]->unicast.getPeer(address(1))->retransmitted;
+    uint64_t start = host_time();
+
+    received.clear();
+    sendPackets(5000, 1);
+
+    while (host_event_count(DEVICE_ID_RADIO, MICROBIT_RADIO_EVT_UNICAST_TX) == 0)
+        fiber_sleep(10);
+
+    host_select_node(0);
+    const MicroBitRadioUnicastPeer *peer = radios[0]->unicast.getPeer(address(1));
+
+    // The packet is retransmitted with exponential backoff, then abandoned.
+    CHECK_EQUAL(failed + 1, peer->failed);
+    CHECK_EQUAL(retransmitted + MICROBIT_RADIO_UNICAST_RETRIES, peer->retransmitted);
+    CHECK(received.empty());
+
+    printf("broken link: abandoned after %.1f ms\n", (host_time() - start) / 1000.0);
+
+    host_radio_set_link(0, 1, true);
+}
+
+/**
+ * At most MICROBIT_RADIO_MAXIMUM_RX_BUFFERS packets are held for the application. Those beyond are not acknowledged,
+ * so the sender retries them, and eventually reports them as failed.
+ */
+static void testReceiveQueueLimit()
+{
+    host_reset_events();
+
+    // Node 2 has no fiber receiving its packets.
+    host_select_node(0);
+
+    for (int i = 0; i < MICROBIT_RADIO_MAXIMUM_RX_BUFFERS + 2; i++)
+    {
+        uint8_t data[1] = { (uint8_t) i };
+        CHECK_EQUAL(DEVICE_OK, radios[0]->unicast.send(address(2), data, sizeof(data)));
+    }
+
+    while (host_event_count(DEVICE_ID_RADIO, MICROBIT_RADIO_EVT_UNICAST_TX) < MICROBIT_RADIO_MAXIMUM_RX_BUFFERS + 2)
+        fiber_sleep(10);
+
+    host_select_node(0);
+    CHECK_EQUAL((uint32_t) MICROBIT_RADIO_MAXIMUM_RX_BUFFERS, radios[0]->unicast.getPeer(address(2))->delivered);
+    CHECK_EQUAL(2u, radios[0]->unicast.getPeer(address(2))->failed);
+
+    host_select_node(2);
+
+    for (int i = 0; i < MICROBIT_RADIO_MAXIMUM_RX_BUFFERS; i++)
+    {
+        PacketBuffer p = radios[2]->unicast.recv();
+        CHECK(p.length() == 1 && p[0] == i);
+    }
+
+    CHECK(radios[2]->unicast.recv() == PacketBuffer::EmptyPacket);
+}
+
+/**
+ * A peer with packets awaiting acknowledgement is never forgotten to make room for another. While every peer is busy,
+ * packets from unknown peers are not acknowledged.
+ */
+static void testBusyPeersKept()
+{
+    uint8_t data[1] = { 0xA5 };
+    uint16_t absent = 0x7000;
+
+    // Fill the window and the peer table with packets to devices that are out of range.
+    host_reset_events();
+    host_select_node(0);
+
+    for (int i = 0; i < MICROBIT_RADIO_UNICAST_PEERS; i++)
+        CHECK_EQUAL(DEVICE_OK, radios[0]->unicast.send(absent + i, data, sizeof(data)));
+
+    host_select_node(1);
+    uint32_t failed = radios[1]->unicast.getPeer(address(0))->failed;
+    CHECK_EQUAL(DEVICE_OK, radios[1]->unicast.send(address(0), data, sizeof(data)));
+
+    while (host_event_count(DEVICE_ID_RADIO, MICROBIT_RADIO_EVT_UNICAST_TX) < MICROBIT_RADIO_UNICAST_PEERS + 1)
+        fiber_sleep(10);
+
+    // Each of those packets was retried in full, and abandoned, and its peer's statistics record this.
+    host_select_node(0);
+
+    for (int i = 0; i < MICROBIT_RADIO_UNICAST_PEERS; i++)
+    {
+        const MicroBitRadioUnicastPeer *peer = radios[0]->unicast.getPeer(absent + i);
+
+        CHECK(peer != NULL);
+        CHECK(peer != NULL && peer->sent == 1 && peer->failed == 1 && peer->retransmitted == MICROBIT_RADIO_UNICAST_RETRIES);
+    }
+
+    CHECK(radios[0]->unicast.recv() == PacketBuffer::EmptyPacket);
+
+    host_select_node(1);
+    CHECK_EQUAL(failed + 1, radios[1]->unicast.getPeer(address(0))->failed);
+
+    // Once the packets have been abandoned, their peers may be forgotten.
+    CHECK_EQUAL(DEVICE_OK, radios[1]->unicast.send(address(0), data, sizeof(data)));
+    fiber_sleep(100);
+
+    host_select_node(0);
+    PacketBuffer p = radios[0]->unicast.recv();
+    CHECK(p.length() == 1 && p[0] == 0xA5);
+}
+
+static void testInvalid()
+{
+    uint8_t data[MICROBIT_RADIO_UNICAST_MAX_PAYLOAD + 1];
+
+    host_select_node(0);
+    CHECK_EQUAL(DEVICE_INVALID_PARAMETER, radios[0]->unicast.send(0, data, 1));
+    CHECK_EQUAL(DEVICE_INVALID_PARAMETER, radios[0]->unicast.send(address(1), NULL, 1));
+    CHECK_EQUAL(DEVICE_INVALID_PARAMETER, radios[0]->unicast.send(address(1), data, sizeof(data)));
+    CHECK_EQUAL(DEVICE_INVALID_PARAMETER, radios[0]->unicast.setAddress(0));
+}
+
+int main()
+{
+    for (int n = 0; n < UNICAST_TEST_NODES; n++)
+    {
+        host_select_node(n == 0 ? 0 : host_create_node(0x51000 + n));
+        radios[n] = new MicroBitRadio();
+        host_radio_attach(*radios[n]);
+        CHECK_EQUAL(DEVICE_OK, radios[n]->enable());
+    }
+
+    host_select_node(1);
+    create_fiber(receiver, NULL);
+
+    testPerfectLink();
+    testLossyLink();
+    testBrokenLink();
+    testReceiveQueueLimit();
+    testBusyPeersKept();
+    testInvalid();
+
+    return test_result();
+}
@@ -0,0 +1,170 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * Tests the cache of compiled sound expressions, and saving compiled expressions to files.
+ *
+ * Also measures the cost of compiling a sound expression, against that of reusing a cached compilation, both alone
+ * and as part of starting playback.
+ */
+
+#include "TestHarness.h"
+#include "TestSources.h"
+#include "SoundExpressions.h"
+#include "MicroBitFile.h"
+
+#include <stdio.h>
+
+using namespace codal;
+
+#define EXPRESSION_TEST_ITERATIONS  2000
+
+// More distinct sounds than the cache holds, so that using them in turn always misses.
+static const char *sounds[] = { "giggle", "happy", "hello", "sad", "slide" };
+#define EXPRESSION_TEST_SOUNDS      (int) (sizeof(sounds) / sizeof(sounds[0]))
+
+static void testCache(SoundExpressions &expressions)
+{
+    ManagedBuffer happy = expressions.compile("happy");
+
+    CHECK(happy.length() > 0);
+    CHECK_EQUAL(0, happy.length() % sizeof(SoundExpressionEffect));
+
+    // A cached compilation is returned as the same buffer.
+    CHECK(expressions.compile("happy").getBytes() == happy.getBytes());
+
+    // Invalid expressions compile to nothing, and are not cached.
+    CHECK_EQUAL(0, expressions.compile("not a sound").length());
+    CHECK_EQUAL(0, expressions.compile("not a sound").length());
+
+    // Keep happy in use while filling the rest of the cache, so that it survives.
+    for (int i = 0; i < EXPRESSION_TEST_SOUNDS; i++)
+    {
+        expressions.compile(sounds[i]);
+        CHECK(expressions.compile("happy").getBytes() == happy.getBytes());
+    }
+
+    // Now push it out with sounds used more recently.
+    for (int i = 0; i < CONFIG_SOUND_EXPRESSIONS_CACHE_SIZE; i++)
+    {
+        char sound[80];
+
+        snprintf(sound, sizeof(sound), "0102309880190084400440088810230016010033002400000000000000000000000000%02d", i);
+        CHECK(expressions.compile(sound).length() > 0);
+    }
+
+    ManagedBuffer recompiled = expressions.compile("happy");
+
+    CHECK(recompiled.getBytes() != happy.getBytes());
+    CHECK(recompiled == happy);
+}
+
+static void testSaveAndLoad(SoundExpressions &expressions)
+{
+    std::vector<uint8_t> file;
+
+    CHECK_EQUAL(DEVICE_OK, expressions.save("giggle", "giggle.snd"));
+    CHECK(expressions.load("giggle.snd") == expressions.compile("giggle"));
+
+    // Saving again replaces the file, rather than appending to it.
+    CHECK_EQUAL(DEVICE_OK, expressions.save("happy", "giggle.snd"));
+    CHECK(expressions.load("giggle.snd") == expressions.compile("happy"));
+
+    CHECK(host_file_read("giggle.snd", file));
+    CHECK_EQUAL(sizeof(SoundExpressionFileHeader) + expressions.compile("happy").length(), file.size());
+
+    SoundExpressionFileHeader *header = (SoundExpressionFileHeader *) &file[0];
+
+    CHECK_EQUAL(SOUND_EXPRESSIONS_FILE_MAGIC, header->magic);
+    CHECK_EQUAL(SOUND_EXPRESSIONS_FILE_VERSION, header->version);
+    CHECK_EQUAL(sizeof(SoundExpressionEffect), header->effectSize);
+    CHECK_EQUAL(expressions.compile("happy").length() / sizeof(SoundExpressionEffect), header->count);
+
+    // Files from other versions, truncated files and missing files are all rejected.
+    header->version++;
+    host_file_write("version.snd", &file[0], file.size());
+    CHECK_EQUAL(0, expressions.load("version.snd").length());
+
+    header->version--;
+    host_file_write("truncated.snd", &file[0], file.size() - 1);
+    CHECK_EQUAL(0, expressions.load("truncated.snd").length());
+
+    CHECK_EQUAL(0, expressions.load("missing.snd").length());
+    CHECK_EQUAL(DEVICE_INVALID_PARAMETER, expressions.save("not a sound", "invalid.snd"));
+}
+
+static void benchmark(SoundEmojiSynthesizer &synth, SoundExpressions &expressions)
+{
+    double start = test_clock();
+
+    for (int i = 0; i < EXPRESSION_TEST_ITERATIONS; i++)
+        expressions.compile(sounds[i % EXPRESSION_TEST_SOUNDS]);
+
+    double parse = (test_clock() - start) / EXPRESSION_TEST_ITERATIONS;
+
+    start = test_clock();
+
+    for (int i = 0; i < EXPRESSION_TEST_ITERATIONS; i++)
+        expressions.compile(sounds[0]);
+
+    double cached = (test_clock() - start) / EXPRESSION_TEST_ITERATIONS;
+
+    start = test_clock();
+
+    for (int i = 0; i < EXPRESSION_TEST_ITERATIONS; i++)
+    {
+        expressions.playAsync(sounds[i % EXPRESSION_TEST_SOUNDS]);
+        synth.clearSchedule();
+    }
+
+    double playParse = (test_clock() - start) / EXPRESSION_TEST_ITERATIONS;
+
+    start = test_clock();
+
+    for (int i = 0; i < EXPRESSION_TEST_ITERATIONS; i++)
+    {
+        expressions.playAsync(sounds[0]);
+        synth.clearSchedule();
+    }
+
+    double playCached = (test_clock() - start) / EXPRESSION_TEST_ITERATIONS;
+
+    printf("compile: %.2f us parsed, %.2f us cached\n", parse * 1e6, cached * 1e6);
+    printf("playAsync: %.2f us parsed, %.2f us cached\n", playParse * 1e6, playCached * 1e6);
+}
+
+int main()
+{
+    SoundEmojiSynthesizer synth(DEVICE_ID_SOUND_EMOJI_SYNTHESIZER_0, 44100, 2);
+    SoundExpressions expressions(synth);
+    TestNullSink sink;
+
+    synth.connect(sink);
+
+    testCache(expressions);
+    testSaveAndLoad(expressions);
+    benchmark(synth, expressions);
+
+    return test_result();
+}
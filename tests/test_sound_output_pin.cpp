@@ -0,0 +1,274 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * Tests the SquareWaveGenerator against a per-sample reference, and the attachment of a SoundOutputPin to the mixer,
+ * including its detachment after CONFIG_SOUND_OUTPUT_PIN_SILENCE_GATE milliseconds of silence.
+ *
+ * Also measures the cost of generating a square wave with the SquareWaveGenerator, and with the SoundEmojiSynthesizer
+ * playing an endless square wave SoundEffect, as SoundOutputPin used to.
+ */
+
+#include "TestHarness.h"
+#include "TestSources.h"
+#include "SquareWaveGenerator.h"
+#include "SoundOutputPin.h"
+#include "SoundEmojiSynthesizer.h"
+#include "Synthesizer.h"
+
+#include <stdio.h>
+
+using namespace codal;
+
+#define PIN_TEST_SAMPLE_RATE    22050
+#define PIN_TEST_PULLS          4000
+
+/**
+ * Generates the expected output of a SquareWaveGenerator one sample at a time, from the same phase accumulator.
+ */
+static std::vector<int16_t> reference(float frequency, int duty, int volume, int samples)
+{
+    std::vector<int16_t> output;
+    uint32_t increment = (uint32_t) ((frequency / PIN_TEST_SAMPLE_RATE) * 4294967296.0f);
+    uint32_t edge = (uint32_t) duty << 22;
+    int16_t amplitude = (volume * (SQUARE_WAVE_GENERATOR_RANGE / 2)) / 1023;
+    uint32_t phase = 0;
+
+    for (int i = 0; i < samples; i++)
+    {
+        output.push_back(phase < edge ? amplitude : -amplitude);
+        phase += increment;
+    }
+
+    return output;
+}
+
+static void testGenerator()
+{
+    SquareWaveGenerator generator(PIN_TEST_SAMPLE_RATE);
+    TestCountingSink sink;
+    std::vector<int16_t> output;
+
+    generator.connect(sink);
+    CHECK_EQUAL(1, sink.requests);
+
+    CHECK_EQUAL(DEVICE_INVALID_PARAMETER, generator.setFrequency(-1.0f));
+    CHECK_EQUAL(DEVICE_INVALID_PARAMETER, generator.setDutyCycle(1024));
+    CHECK_EQUAL(DEVICE_INVALID_PARAMETER, generator.setVolume(-1));
+    CHECK_EQUAL(DEVICE_INVALID_PARAMETER, generator.setSampleRate(0));
+
+    // Nothing is generated while silent, but the stream keeps flowing.
+    CHECK_EQUAL(0, generator.pull().length());
+    CHECK_EQUAL(2, sink.requests);
+
+    CHECK_EQUAL(DEVICE_OK, generator.setFrequency(1000.0f));
+    CHECK_EQUAL(DEVICE_OK, generator.setDutyCycle(256));
+    CHECK_EQUAL(DEVICE_OK, generator.setVolume(1023));
+    CHECK_EQUAL(1023, generator.getVolume());
+
+    // The phase is continuous across buffers, and every sample matches the reference.
+    for (int i = 0; i < 86; i++)
+        test_append_samples(output, generator.pull(), generator.getFormat());
+
+    CHECK_EQUAL(CONFIG_SQUARE_WAVE_GENERATOR_BUFFER_SIZE / 2 * 86, (int) output.size());
+    CHECK(output == reference(1000.0f, 256, 1023, output.size()));
+
+    int high = 0, cycles = 0;
+
+    for (size_t i = 0; i < output.size(); i++)
+    {
+        if (output[i] > 0)
+            high++;
+
+        if (i > 0 && output[i] > 0 && output[i-1] < 0)
+            cycles++;
+    }
+
+    // About one second of a 1kHz wave, high a quarter of the time, spanning the full range.
+    CHECK(abs(cycles - 1000 * (int) output.size() / PIN_TEST_SAMPLE_RATE) <= 1);
+    CHECK(abs(high * 4 - (int) output.size()) <= (int) output.size() / 100);
+    CHECK_EQUAL(SQUARE_WAVE_GENERATOR_RANGE / 2, output[0]);
+    CHECK_EQUAL(2 + 86, sink.requests);
+
+    // Frequencies above the Nyquist limit are clamped, so a square wave alternates every sample.
+    CHECK_EQUAL(DEVICE_OK, generator.setFrequency(PIN_TEST_SAMPLE_RATE));
+    CHECK_EQUAL(DEVICE_OK, generator.setDutyCycle(512));
+    output.clear();
+    test_append_samples(output, generator.pull(), generator.getFormat());
+
+    int alternations = 0;
+    for (size_t i = 1; i < output.size(); i++)
+        if (output[i] == -output[i-1])
+            alternations++;
+
+    CHECK_EQUAL((int) output.size() - 1, alternations);
+
+    generator.disconnect();
+    CHECK_EQUAL(0, generator.pull().length());
+}
+
+static bool isAttached(SoundOutputPin &pin)
+{
+    return pin.CodalComponent::status & SOUND_OUTPUT_PIN_STATUS_ACTIVE;
+}
+
+/**
+ * Determines the peak to peak range of a buffer of mixer output.
+ */
+static int range(Mixer2 &mixer)
+{
+    std::vector<int16_t> output;
+    test_append_samples(output, mixer.pull(), mixer.getFormat());
+
+    int lo = 0xffff, hi = 0;
+
+    for (size_t i = 0; i < output.size(); i++)
+    {
+        lo = min(lo, (int) (uint16_t) output[i]);
+        hi = max(hi, (int) (uint16_t) output[i]);
+    }
+
+    return hi - lo;
+}
+
+/**
+ * Lets simulated time pass, with the scheduler idling every millisecond as it would on the device.
+ */
+static void idle(int ms)
+{
+    for (int i = 0; i < ms; i++)
+        fiber_sleep(1);
+}
+
+static void testPin()
+{
+    Mixer2 mixer(44100, 1024, DATASTREAM_FORMAT_16BIT_UNSIGNED, MIXER_ENGINE_FLOAT);
+    TestNullSink sink;
+    SoundOutputPin pin(mixer);
+
+    mixer.connect(sink);
+
+    // Nothing is attached until there's something to play.
+    CHECK_EQUAL(DEVICE_INVALID_PARAMETER, pin.setAnalogValue(1025));
+    CHECK_EQUAL(DEVICE_OK, pin.setAnalogValue(512));
+    CHECK(!isAttached(pin));
+    CHECK_EQUAL(0, range(mixer));
+
+    CHECK_EQUAL(DEVICE_OK, pin.setAnalogPeriodUs(1000));
+    CHECK(isAttached(pin));
+    CHECK_EQUAL(1000, (int) pin.getAnalogPeriodUs());
+    CHECK_EQUAL(128, pin.getAnalogValue());
+
+    for (int i = 0; i < 4; i++)
+        mixer.pull();
+
+    CHECK(range(mixer) > 512);
+
+    // Silence follows once the buffer already queued has played out, but the generator stays attached until the
+    // silence gate has passed.
+    CHECK_EQUAL(DEVICE_OK, pin.setAnalogValue(0));
+
+    for (int i = 0; i < 4; i++)
+        mixer.pull();
+
+    CHECK_EQUAL(0, range(mixer));
+
+    idle(CONFIG_SOUND_OUTPUT_PIN_SILENCE_GATE / 2);
+    CHECK(isAttached(pin));
+
+    // Any update restarts the gate.
+    CHECK_EQUAL(DEVICE_OK, pin.setAnalogPeriod(2));
+    idle(CONFIG_SOUND_OUTPUT_PIN_SILENCE_GATE / 2 + 10);
+    CHECK(isAttached(pin));
+
+    idle(CONFIG_SOUND_OUTPUT_PIN_SILENCE_GATE);
+    CHECK(!isAttached(pin));
+    CHECK_EQUAL(0, range(mixer));
+
+    // Playing again reattaches the generator.
+    CHECK_EQUAL(DEVICE_OK, pin.setAnalogValue(100));
+    CHECK(isAttached(pin));
+
+    for (int i = 0; i < 4; i++)
+        mixer.pull();
+
+    CHECK(range(mixer) > 512);
+
+    pin.setAnalogValue(0);
+    idle(CONFIG_SOUND_OUTPUT_PIN_SILENCE_GATE * 2);
+    CHECK(!isAttached(pin));
+}
+
+static void benchmark()
+{
+    SquareWaveGenerator generator(PIN_TEST_SAMPLE_RATE);
+    TestNullSink sink;
+    int samples = 0, generated;
+
+    generator.connect(sink);
+    generator.setFrequency(1000.0f);
+    generator.setVolume(1023);
+
+    double start = test_clock();
+
+    for (int i = 0; i < PIN_TEST_PULLS; i++)
+        samples += generator.pull().length() / 2;
+
+    double generatorTime = test_clock() - start;
+    test_report_throughput("square wave generator", samples, generatorTime);
+    generated = samples;
+
+    // The synthesizer, configured for a raw square wave as SoundOutputPin used to.
+    SoundEmojiSynthesizer synth(DEVICE_ID_SOUND_EMOJI_SYNTHESIZER_0, PIN_TEST_SAMPLE_RATE);
+    ManagedBuffer sound(sizeof(SoundEffect));
+    SoundEffect *fx = (SoundEffect *) &sound[0];
+
+    fx->duration = -CONFIG_SOUND_OUTPUT_PIN_PERIOD;
+    fx->tone.tonePrint = Synthesizer::SquareWaveTone;
+    fx->frequency = 1000.0f;
+    fx->volume = 1.0f;
+
+    synth.connect(sink);
+    synth.play(sound);
+    samples = 0;
+    start = test_clock();
+
+    for (int i = 0; i < PIN_TEST_PULLS; i++)
+        samples += synth.pull().length() / 2;
+
+    double synthTime = test_clock() - start;
+    test_report_throughput("sound emoji synthesizer", samples, synthTime);
+
+    CHECK(samples > 0);
+    printf("speedup: %.1fx\n", (synthTime / samples) / (generatorTime / generated));
+}
+
+int main()
+{
+    testGenerator();
+    testPin();
+    benchmark();
+
+    return test_result();
+}
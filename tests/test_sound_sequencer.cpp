@@ -0,0 +1,175 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * Tests the interaction of the SoundEmojiSynthesizer sequencer with play(), and of SoundExpressions with a full
+ * schedule: sounds replaced on a voice signal their completion, and nothing plays on from a buffer already released.
+ */
+
+#include "TestHarness.h"
+#include "TestSources.h"
+#include "SoundEmojiSynthesizer.h"
+#include "SoundExpressions.h"
+#include "Synthesizer.h"
+
+using namespace codal;
+
+#define SEQUENCER_TEST_RATE     44100
+
+/**
+ * Creates a buffer of square wave sound effects, each of the given duration.
+ */
+static ManagedBuffer tone(int effects, float duration, float frequency)
+{
+    ManagedBuffer sound(sizeof(SoundEffect) * effects);
+
+    for (int i = 0; i < effects; i++)
+    {
+        SoundEffect *fx = (SoundEffect *) &sound[0] + i;
+
+        fx->duration = duration;
+        fx->tone.tonePrint = Synthesizer::SquareWaveTone;
+        fx->frequency = frequency;
+        fx->volume = 1.0f;
+    }
+
+    return sound;
+}
+
+static uint32_t voiceDone(int voice)
+{
+    return host_event_count(DEVICE_ID_SOUND_EMOJI_SYNTHESIZER_0, DEVICE_SOUND_EMOJI_SYNTHESIZER_EVT_VOICE_DONE + voice);
+}
+
+/**
+ * Pulls from the synthesizer until it falls silent.
+ *
+ * @return the number of buffers pulled before it did, or -1 if it did not within the given number of buffers.
+ */
+static int pullUntilSilent(SoundEmojiSynthesizer &synth, int limit)
+{
+    for (int i = 0; i < limit; i++)
+        if (synth.pull().length() == 0)
+            return i;
+
+    return -1;
+}
+
+static void testPlayReplacesScheduledSound()
+{
+    SoundEmojiSynthesizer synth(DEVICE_ID_SOUND_EMOJI_SYNTHESIZER_0, SEQUENCER_TEST_RATE, 2);
+    TestNullSink sink;
+
+    synth.connect(sink);
+    synth.allowEmptyBuffers(true);
+    host_reset_events();
+
+    // Start a long scheduled sound, holding no reference to its buffer but the synthesizer's.
+    CHECK_EQUAL(DEVICE_OK, synth.schedule(tone(1, 1000.0f, 440.0f), synth.getSampleTime(), 0));
+    CHECK(synth.pull().length() > 0);
+    CHECK(synth.isVoiceActive(0));
+
+    // play() takes over the voice at once, completing the scheduled sound rather than stepping on through its buffer.
+    CHECK_EQUAL(DEVICE_OK, synth.play(tone(2, 10.0f, 880.0f), 0));
+    CHECK_EQUAL(1u, voiceDone(0));
+
+    // Only the 20ms of the new sound remain, rather than the rest of the second-long one.
+    int pulls = pullUntilSilent(synth, 200);
+    CHECK(pulls >= 1 && pulls <= 4);
+    CHECK_EQUAL(2u, voiceDone(0));
+    CHECK(!synth.isVoiceActive(0));
+
+    // The lock taken by play() was released on completion, so another play() doesn't block.
+    CHECK_EQUAL(DEVICE_OK, synth.play(tone(1, 10.0f, 880.0f), 0));
+    CHECK(pullUntilSilent(synth, 200) > 0);
+    CHECK_EQUAL(3u, voiceDone(0));
+
+    // A voice that is idle starts afresh as before, and other voices are left alone.
+    CHECK_EQUAL(DEVICE_OK, synth.schedule(tone(1, 1000.0f, 440.0f), synth.getSampleTime(), 1));
+    CHECK_EQUAL(DEVICE_OK, synth.play(tone(1, 10.0f, 880.0f), 0));
+    CHECK(synth.pull().length() > 0);
+    CHECK_EQUAL(3u, voiceDone(0));
+    CHECK_EQUAL(0u, voiceDone(1));
+
+    synth.stop();
+    CHECK(pullUntilSilent(synth, 4) >= 0);
+    CHECK_EQUAL(1u, voiceDone(1));
+}
+
+static void testPlayAsyncWithFullSchedule()
+{
+    SoundEmojiSynthesizer synth(DEVICE_ID_SOUND_EMOJI_SYNTHESIZER_0, SEQUENCER_TEST_RATE, 2);
+    SoundExpressions expressions(synth);
+    TestNullSink sink;
+
+    synth.connect(sink);
+    synth.allowEmptyBuffers(true);
+    host_reset_events();
+
+    // Keep both voices busy: voice 0 with a sound started by play(), which holds its lock until the sound completes.
+    CHECK_EQUAL(DEVICE_OK, synth.play(tone(1, 1000.0f, 440.0f), 0));
+    CHECK_EQUAL(DEVICE_OK, synth.schedule(tone(1, 1000.0f, 440.0f), synth.getSampleTime(), 1));
+    CHECK(synth.pull().length() > 0);
+
+    // Fill the schedule with sounds far in the future, one of them on voice 0.
+    uint32_t later = synth.getSampleTime(10000.0f);
+    CHECK_EQUAL(DEVICE_OK, synth.schedule(tone(1, 10.0f, 440.0f), later, 0));
+
+    for (int i = 1; i < CONFIG_EMOJI_SYNTHESIZER_SEQUENCE_LENGTH; i++)
+        CHECK_EQUAL(DEVICE_OK, synth.schedule(tone(1, 10.0f, 440.0f), later, 1));
+
+    CHECK_EQUAL(DEVICE_NO_RESOURCES, synth.schedule(tone(1, 10.0f, 440.0f), later, 1));
+
+    // This would block forever waiting for voice 0's lock if it fell back on play(). Instead it takes over the voice
+    // at once, completing the sound playing there and discarding the one scheduled.
+    expressions.playAsync("giggle");
+    CHECK_EQUAL(1u, voiceDone(0));
+    CHECK_EQUAL(0u, voiceDone(1));
+
+    CHECK_EQUAL(DEVICE_OK, synth.schedule(tone(1, 10.0f, 440.0f), later, 1));
+    CHECK_EQUAL(DEVICE_NO_RESOURCES, synth.schedule(tone(1, 10.0f, 440.0f), later, 1));
+
+    // The expression plays to completion.
+    for (int i = 0; i < 2000 && voiceDone(0) < 2; i++)
+        synth.pull();
+
+    CHECK_EQUAL(2u, voiceDone(0));
+
+    // The lock play() took was released, so playing on voice 0 doesn't block either.
+    CHECK_EQUAL(DEVICE_OK, synth.play(tone(1, 10.0f, 880.0f), 0));
+
+    CHECK_EQUAL(DEVICE_INVALID_PARAMETER, synth.replace(ManagedBuffer(), 0));
+    CHECK_EQUAL(DEVICE_INVALID_PARAMETER, synth.replace(tone(1, 10.0f, 440.0f), 2));
+
+    synth.clearSchedule();
+    synth.stop();
+}
+
+int main()
+{
+    testPlayReplacesScheduledSound();
+    testPlayAsyncWithFullSchedule();
+
+    return test_result();
+}
@@ -0,0 +1,193 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * Builds MicroBitAudioBank images from WAVE files, on the host.
+ */
+
+#include "AudioBankBuilder.h"
+#include "MicroBitAudioBank.h"
+
+#include <stdio.h>
+#include <string.h>
+
+using namespace codal;
+
+static uint32_t get16(const std::vector<uint8_t> &v, size_t p)
+{
+    return v[p] | v[p + 1] << 8;
+}
+
+static uint32_t get32(const std::vector<uint8_t> &v, size_t p)
+{
+    return get16(v, p) | get16(v, p + 2) << 16;
+}
+
+static void put16(std::vector<uint8_t> &v, size_t p, uint32_t x)
+{
+    v[p] = x;
+    v[p + 1] = x >> 8;
+}
+
+static void put32(std::vector<uint8_t> &v, size_t p, uint32_t x)
+{
+    put16(v, p, x);
+    put16(v, p + 2, x >> 16);
+}
+
+/**
+ * Reads a sound from the contents of a mono WAVE file, holding 8 bit or 16 bit PCM samples.
+ *
+ * @param wave The contents of the file.
+ * @param sound The sound to fill in. Its name is left unchanged.
+ * @return true on success, or false if the file is malformed or its format is not supported.
+ */
+bool audio_bank_read_wave(const std::vector<uint8_t> &wave, AudioBankSound &sound)
+{
+    size_t p = 12;
+    int bitsPerSample = 0;
+
+    if (wave.size() < 12 || memcmp(&wave[0], "RIFF", 4) != 0 || memcmp(&wave[8], "WAVE", 4) != 0)
+        return false;
+
+    while (p + 8 <= wave.size())
+    {
+        uint32_t size = get32(wave, p + 4);
+
+        if (memcmp(&wave[p], "fmt ", 4) == 0)
+        {
+            if (size < 16 || p + 8 + size > wave.size())
+                return false;
+
+            // Only mono PCM is supported.
+            if (get16(wave, p + 8) != 1 || get16(wave, p + 10) != 1)
+                return false;
+
+            sound.sampleRate = get32(wave, p + 12);
+            bitsPerSample = get16(wave, p + 22);
+
+            if (bitsPerSample == 8)
+                sound.format = DATASTREAM_FORMAT_8BIT_UNSIGNED;
+            else if (bitsPerSample == 16)
+                sound.format = DATASTREAM_FORMAT_16BIT_SIGNED;
+            else
+                return false;
+        }
+        else if (memcmp(&wave[p], "data", 4) == 0)
+        {
+            if (bitsPerSample == 0 || sound.sampleRate <= 0)
+                return false;
+
+            // Tolerate a truncated final chunk, as many tools write one, but only whole samples are kept.
+            size_t end = p + 8 + size < wave.size() ? p + 8 + size : wave.size();
+            end -= (end - p - 8) % (bitsPerSample / 8);
+
+            sound.samples.assign(wave.begin() + p + 8, wave.begin() + end);
+            return true;
+        }
+
+        p += 8 + size + (size & 1);
+    }
+
+    return false;
+}
+
+/**
+ * Builds the image of a MicroBitAudioBank holding the given sounds.
+ *
+ * @param sounds The sounds to place in the bank, in order.
+ * @param image The image to fill in. Its length is a multiple of four bytes.
+ * @param blockSize The largest number of bytes of samples held in each block.
+ * @return true on success, or false if a name is too long, a sound is too long, or the block size is not valid.
+ */
+bool audio_bank_build(const std::vector<AudioBankSound> &sounds, std::vector<uint8_t> &image, int blockSize)
+{
+    // Blocks hold whole samples, and their length must fit in BufferData.
+    if (blockSize < 2 || blockSize > 0xfffe || (blockSize & 1) || sounds.size() > 0xffff)
+        return false;
+
+    image.assign(sizeof(MicroBitAudioBankHeader) + sounds.size() * sizeof(MicroBitAudioBankEntry), 0);
+    image.resize((image.size() + 3) & ~3, 0);
+
+    for (size_t i = 0; i < sounds.size(); i++)
+    {
+        const AudioBankSound &sound = sounds[i];
+        size_t entry = sizeof(MicroBitAudioBankHeader) + i * sizeof(MicroBitAudioBankEntry);
+        size_t blocks = (sound.samples.size() + blockSize - 1) / blockSize;
+
+        if (sound.name.length() > MICROBIT_AUDIO_BANK_NAME_LENGTH || blocks > 0xffff)
+            return false;
+
+        memcpy(&image[entry + offsetof(MicroBitAudioBankEntry, name)], sound.name.data(), sound.name.length());
+        put32(image, entry + offsetof(MicroBitAudioBankEntry, offset), image.size());
+        put32(image, entry + offsetof(MicroBitAudioBankEntry, sampleRate), sound.sampleRate);
+        put16(image, entry + offsetof(MicroBitAudioBankEntry, format), sound.format);
+        put16(image, entry + offsetof(MicroBitAudioBankEntry, blockCount), blocks);
+
+        for (size_t offset = 0; offset < sound.samples.size(); offset += blockSize)
+        {
+            size_t block = image.size();
+            size_t length = sound.samples.size() - offset < (size_t) blockSize ? sound.samples.size() - offset : blockSize;
+
+            image.resize((block + MICROBIT_AUDIO_BANK_BLOCK_SAMPLES_OFFSET + length + 3) & ~3, 0);
+
+            put16(image, block + MICROBIT_AUDIO_BANK_BLOCK_REFCOUNT_OFFSET, MICROBIT_AUDIO_BANK_BLOCK_REFCOUNT);
+            put16(image, block + MICROBIT_AUDIO_BANK_BLOCK_TAG_OFFSET, 0);
+            put16(image, block + MICROBIT_AUDIO_BANK_BLOCK_LENGTH_OFFSET, length);
+            memcpy(&image[block + MICROBIT_AUDIO_BANK_BLOCK_SAMPLES_OFFSET], &sound.samples[offset], length);
+        }
+    }
+
+    put32(image, offsetof(MicroBitAudioBankHeader, magic), MICROBIT_AUDIO_BANK_MAGIC);
+    put16(image, offsetof(MicroBitAudioBankHeader, version), MICROBIT_AUDIO_BANK_VERSION);
+    put16(image, offsetof(MicroBitAudioBankHeader, count), sounds.size());
+    put32(image, offsetof(MicroBitAudioBankHeader, length), image.size());
+
+    return true;
+}
+
+/**
+ * Writes an image as C++ source, defining a word aligned array that can be linked into flash and passed to
+ * MicroBitAudioBank.
+ *
+ * @param image The image of the bank.
+ * @param name The name of the array.
+ */
+std::string audio_bank_source(const std::vector<uint8_t> &image, const std::string &name)
+{
+    std::string s = "// Generated by audio_bank_builder. Do not edit.\n\n#include <stdint.h>\n\n";
+    char word[20];
+
+    s += "extern const uint32_t " + name + "[];\nconst uint32_t " + name + "[] = {";
+
+    for (size_t i = 0; i < image.size(); i += 4)
+    {
+        snprintf(word, sizeof(word), "%s0x%08x,", i % 32 ? " " : "\n    ", get32(image, i));
+        s += word;
+    }
+
+    s += "\n};\n";
+
+    return s;
+}
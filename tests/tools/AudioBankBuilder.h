@@ -0,0 +1,74 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef AUDIO_BANK_BUILDER_H
+#define AUDIO_BANK_BUILDER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// The largest number of bytes of samples held in each block of a bank.
+#define AUDIO_BANK_BUILDER_BLOCK_SIZE       512
+
+/**
+ * A sound to be placed in a MicroBitAudioBank.
+ */
+struct AudioBankSound
+{
+    std::string             name;                   // The name of the sound, at most MICROBIT_AUDIO_BANK_NAME_LENGTH characters.
+    int                     sampleRate;             // The sample rate of the sound, in samples per second.
+    int                     format;                 // The DATASTREAM_FORMAT of the samples.
+    std::vector<uint8_t>    samples;                // The samples, in the byte order of the target.
+};
+
+/**
+ * Reads a sound from the contents of a mono WAVE file, holding 8 bit or 16 bit PCM samples.
+ *
+ * @param wave The contents of the file.
+ * @param sound The sound to fill in. Its name is left unchanged.
+ * @return true on success, or false if the file is malformed or its format is not supported.
+ */
+bool audio_bank_read_wave(const std::vector<uint8_t> &wave, AudioBankSound &sound);
+
+/**
+ * Builds the image of a MicroBitAudioBank holding the given sounds.
+ *
+ * @param sounds The sounds to place in the bank, in order.
+ * @param image The image to fill in. Its length is a multiple of four bytes.
+ * @param blockSize The largest number of bytes of samples held in each block.
+ * @return true on success, or false if a name is too long, a sound is too long, or the block size is not valid.
+ */
+bool audio_bank_build(const std::vector<AudioBankSound> &sounds, std::vector<uint8_t> &image, int blockSize = AUDIO_BANK_BUILDER_BLOCK_SIZE);
+
+/**
+ * Writes an image as C++ source, defining a word aligned array that can be linked into flash and passed to
+ * MicroBitAudioBank.
+ *
+ * @param image The image of the bank.
+ * @param name The name of the array.
+ */
+std::string audio_bank_source(const std::vector<uint8_t> &image, const std::string &name);
+
+#endif
@@ -0,0 +1,135 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2020 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * Builds a MicroBitAudioBank from WAVE files.
+ *
+ * Usage: audio_bank_builder <output> <file.wav>...
+ *
+ * Each sound is named after its file, without the directory or extension. If the output ends in .c or .cpp, the
+ * bank is written as a const array named after the output file, to be linked into the program. Otherwise the raw
+ * image is written, to be programmed into a reserved region of flash.
+ */
+
+#include "AudioBankBuilder.h"
+
+#include <ctype.h>
+#include <stdio.h>
+
+static bool readFile(const std::string &path, std::vector<uint8_t> &data)
+{
+    FILE *f = fopen(path.c_str(), "rb");
+    int c;
+
+    if (f == NULL)
+        return false;
+
+    while ((c = fgetc(f)) != EOF)
+        data.push_back(c);
+
+    fclose(f);
+    return true;
+}
+
+static std::string baseName(const std::string &path)
+{
+    size_t start = path.find_last_of("/\\");
+    start = start == std::string::npos ? 0 : start + 1;
+
+    return path.substr(start, path.find_last_of('.') > start ? path.find_last_of('.') - start : std::string::npos);
+}
+
+static std::string identifier(const std::string &name)
+{
+    std::string s = name;
+
+    for (size_t i = 0; i < s.length(); i++)
+        if (!isalnum((unsigned char) s[i]))
+            s[i] = '_';
+
+    return s.empty() || isdigit((unsigned char) s[0]) ? "_" + s : s;
+}
+
+static bool endsWith(const std::string &s, const std::string &suffix)
+{
+    return s.length() >= suffix.length() && s.compare(s.length() - suffix.length(), suffix.length(), suffix) == 0;
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<AudioBankSound> sounds;
+    std::vector<uint8_t> image;
+
+    if (argc < 3)
+    {
+        fprintf(stderr, "usage: %s <output> <file.wav>...\n", argv[0]);
+        return 1;
+    }
+
+    for (int i = 2; i < argc; i++)
+    {
+        std::vector<uint8_t> wave;
+        AudioBankSound sound;
+
+        sound.name = baseName(argv[i]);
+
+        if (!readFile(argv[i], wave) || !audio_bank_read_wave(wave, sound))
+        {
+            fprintf(stderr, "%s: not a mono 8 or 16 bit PCM WAVE file\n", argv[i]);
+            return 1;
+        }
+
+        sounds.push_back(sound);
+    }
+
+    if (!audio_bank_build(sounds, image))
+    {
+        fprintf(stderr, "cannot build bank: names are limited to 12 characters, and sounds to 65535 blocks\n");
+        return 1;
+    }
+
+    std::string output = argv[1];
+    FILE *f = fopen(output.c_str(), "wb");
+
+    if (f == NULL)
+    {
+        fprintf(stderr, "%s: cannot write\n", argv[1]);
+        return 1;
+    }
+
+    if (endsWith(output, ".c") || endsWith(output, ".cpp"))
+    {
+        std::string source = audio_bank_source(image, identifier(baseName(output)));
+        fwrite(source.data(), 1, source.length(), f);
+    }
+    else
+    {
+        fwrite(&image[0], 1, image.size(), f);
+    }
+
+    fclose(f);
+    printf("%s: %d sounds, %d bytes\n", argv[1], (int) sounds.size(), (int) image.size());
+
+    return 0;
+}